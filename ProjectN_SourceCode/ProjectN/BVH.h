@@ -0,0 +1,528 @@
+#pragma once
+#ifndef BVH_H
+#define BVH_H
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "Mesh.h"
+#include "Frustum.h"
+
+#include <vector>
+#include <algorithm>
+#include <random>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+
+// Bounding volume hierarchies for ray queries. MeshBVH holds the triangles of one mesh or model in model
+// space, SceneBVH places shapes in the world and keeps a tree over their world boxes; when objects move it
+// is refitted instead of rebuilt. Both trees are binned-SAH builds, and rays are tested against node boxes
+// with a slab test on all three axes at once.
+
+struct RayHit {
+	float t = INFINITY;	// along the unnormalised direction the ray was cast with
+	int object = -1, triangle = -1;
+	glm::vec3 point = glm::vec3(0.0f);	// world space
+	glm::vec3 localPoint = glm::vec3(0.0f);	// in the hit object's model space
+};
+
+namespace bvh {
+
+	// traversals keep their pending nodes on a fixed stack, which holds at most one node per level plus
+	// one; Build stops splitting at MAX_DEPTH so a deep, degenerate tree can't run past it
+	const int STACK = 64, MAX_DEPTH = STACK - 2;
+
+	struct Node {
+		float min[4], max[4];	// 4th lane -inf/+inf, so the slab test ignores it
+		int first;	// first child (the other is first + 1) or first primitive of a leaf
+		int count;	// primitives in a leaf, 0 for inner nodes
+	};
+
+	struct RayData {
+		float origin[4], invDir[4];
+		RayData(const glm::vec3& o, const glm::vec3& d) {
+			origin[0] = o.x, origin[1] = o.y, origin[2] = o.z, origin[3] = 0.0f;
+			invDir[0] = 1.0f / d.x, invDir[1] = 1.0f / d.y, invDir[2] = 1.0f / d.z, invDir[3] = 1.0f;
+		}
+	};
+
+	inline void SetBox(Node& node, const glm::vec3& lo, const glm::vec3& hi) {
+		node.min[0] = lo.x, node.min[1] = lo.y, node.min[2] = lo.z, node.min[3] = -INFINITY;
+		node.max[0] = hi.x, node.max[1] = hi.y, node.max[2] = hi.z, node.max[3] = INFINITY;
+	}
+
+	// entry distance of the ray into the node's box, false if it misses it or enters beyond tMax
+	inline bool RayBox(const RayData& ray, const Node& node, float tMax, float& tNear) {
+#ifdef FRUSTUM_SSE
+		__m128 o = _mm_loadu_ps(ray.origin), inv = _mm_loadu_ps(ray.invDir);
+		__m128 t1 = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(node.min), o), inv);
+		__m128 t2 = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(node.max), o), inv);
+		__m128 lo = _mm_min_ps(t1, t2), hi = _mm_max_ps(t1, t2);
+		lo = _mm_max_ps(lo, _mm_shuffle_ps(lo, lo, _MM_SHUFFLE(2, 3, 0, 1)));
+		lo = _mm_max_ps(lo, _mm_shuffle_ps(lo, lo, _MM_SHUFFLE(1, 0, 3, 2)));
+		hi = _mm_min_ps(hi, _mm_shuffle_ps(hi, hi, _MM_SHUFFLE(2, 3, 0, 1)));
+		hi = _mm_min_ps(hi, _mm_shuffle_ps(hi, hi, _MM_SHUFFLE(1, 0, 3, 2)));
+		float enter = _mm_cvtss_f32(lo), exit = _mm_cvtss_f32(hi);
+#else
+		float enter = -INFINITY, exit = INFINITY;
+		for (int a = 0; a < 3; a++) {
+			float t1 = (node.min[a] - ray.origin[a]) * ray.invDir[a], t2 = (node.max[a] - ray.origin[a]) * ray.invDir[a];
+			enter = std::max(enter, std::min(t1, t2)), exit = std::min(exit, std::max(t1, t2));
+		}
+#endif
+		tNear = enter;
+		return exit >= std::max(enter, 0.0f) && enter <= tMax;
+	}
+
+	// binned SAH build over primitive boxes; order is permuted so every leaf covers a contiguous range
+	inline void Build(std::vector<Node>& nodes, std::vector<int>& order, const std::vector<glm::vec3>& boxMin, const std::vector<glm::vec3>& boxMax, int maxLeaf) {
+		const int BINS = 16;
+		int n = (int)boxMin.size();
+		order.resize(n);
+		for (int i = 0; i < n; i++)order[i] = i;
+		nodes.clear();
+		nodes.reserve(std::max(1, 2 * n));
+		nodes.push_back(Node());
+		// a box that was never set (+inf/-inf) has no centroid; it goes to the origin rather than into the bins as NaN
+		std::vector<glm::vec3> centroid(n);
+		for (int i = 0; i < n; i++) {
+			centroid[i] = (boxMin[i] + boxMax[i]) * 0.5f;
+			if (!std::isfinite(centroid[i].x) || !std::isfinite(centroid[i].y) || !std::isfinite(centroid[i].z))centroid[i] = glm::vec3(0.0f);
+		}
+		// clamped before the conversion, which is undefined for values out of int's range
+		auto bin = [](float c, float lo, float extent) {
+			float f = (c - lo) / extent * BINS;
+			return f >= BINS - 1 ? BINS - 1 : f > 0.0f ? (int)f : 0;
+		};
+		auto area = [](const glm::vec3& lo, const glm::vec3& hi) {
+			glm::vec3 e = glm::max(hi - lo, glm::vec3(0.0f));
+			return e.x * e.y + e.y * e.z + e.z * e.x;
+		};
+
+		struct Task { int node, first, count, depth; };
+		std::vector<Task> stack(1, Task{ 0, 0, n, 0 });
+		while (!stack.empty()) {
+			Task task = stack.back();
+			stack.pop_back();
+			glm::vec3 lo(INFINITY), hi(-INFINITY), clo(INFINITY), chi(-INFINITY);
+			for (int i = task.first; i < task.first + task.count; i++) {
+				int p = order[i];
+				lo = glm::min(lo, boxMin[p]), hi = glm::max(hi, boxMax[p]);
+				clo = glm::min(clo, centroid[p]), chi = glm::max(chi, centroid[p]);
+			}
+			SetBox(nodes[task.node], lo, hi);
+			nodes[task.node].first = task.first;
+			nodes[task.node].count = task.count;
+			if (task.count <= 2 || task.depth >= MAX_DEPTH)continue;
+
+			// best split plane over all three axes
+			float bestCost = area(lo, hi) * task.count;
+			int bestAxis = -1, bestBin = 0;
+			for (int axis = 0; axis < 3; axis++) {
+				float extent = chi[axis] - clo[axis];
+				if (extent <= 0.0f)continue;
+				int binCount[BINS] = {};
+				glm::vec3 binLo[BINS], binHi[BINS];
+				for (int b = 0; b < BINS; b++)binLo[b] = glm::vec3(INFINITY), binHi[b] = glm::vec3(-INFINITY);
+				for (int i = task.first; i < task.first + task.count; i++) {
+					int p = order[i];
+					int b = bin(centroid[p][axis], clo[axis], extent);
+					binCount[b]++;
+					binLo[b] = glm::min(binLo[b], boxMin[p]), binHi[b] = glm::max(binHi[b], boxMax[p]);
+				}
+				float rightArea[BINS];
+				int rightCount[BINS];
+				glm::vec3 rlo(INFINITY), rhi(-INFINITY);
+				int rc = 0;
+				for (int b = BINS - 1; b > 0; b--) {
+					rc += binCount[b];
+					rlo = glm::min(rlo, binLo[b]), rhi = glm::max(rhi, binHi[b]);
+					rightCount[b] = rc, rightArea[b] = area(rlo, rhi);
+				}
+				glm::vec3 llo(INFINITY), lhi(-INFINITY);
+				int lc = 0;
+				for (int b = 0; b < BINS - 1; b++) {
+					lc += binCount[b];
+					llo = glm::min(llo, binLo[b]), lhi = glm::max(lhi, binHi[b]);
+					if (!lc || !rightCount[b + 1])continue;
+					float cost = lc * area(llo, lhi) + rightCount[b + 1] * rightArea[b + 1];
+					if (cost < bestCost)bestCost = cost, bestAxis = axis, bestBin = b;
+				}
+			}
+			if (bestAxis < 0 && task.count <= maxLeaf)continue;
+
+			int mid;
+			if (bestAxis < 0) {
+				// nothing beats a leaf but it's too big: split in the middle of the longest axis
+				glm::vec3 e = chi - clo;
+				int axis = e.x > e.y ? (e.x > e.z ? 0 : 2) : (e.y > e.z ? 1 : 2);
+				mid = task.first + task.count / 2;
+				std::nth_element(order.begin() + task.first, order.begin() + mid, order.begin() + task.first + task.count,
+					[&](int a, int b) { return centroid[a][axis] < centroid[b][axis]; });
+			}
+			else {
+				float extent = chi[bestAxis] - clo[bestAxis];
+				int* split = std::partition(order.data() + task.first, order.data() + task.first + task.count, [&](int p) {
+					return bin(centroid[p][bestAxis], clo[bestAxis], extent) <= bestBin;
+				});
+				mid = (int)(split - order.data());
+			}
+			int left = (int)nodes.size();
+			nodes.push_back(Node());
+			nodes.push_back(Node());
+			nodes[task.node].first = left;
+			nodes[task.node].count = 0;
+			stack.push_back(Task{ left, task.first, mid - task.first, task.depth + 1 });
+			stack.push_back(Task{ left + 1, mid, task.first + task.count - mid, task.depth + 1 });
+		}
+	}
+}
+
+class MeshBVH {
+public:
+	Bounds bounds;
+
+	void Build(const Mesh& mesh) {
+		std::vector<const Mesh*> meshes(1, &mesh);
+		Build(meshes);
+	}
+	void Build(const std::vector<Mesh>& meshes) {
+		std::vector<const Mesh*> list;
+		for (const Mesh& mesh : meshes)list.push_back(&mesh);
+		Build(list);
+	}
+	void Build(const std::vector<const Mesh*>& meshes) {
+		v0.clear(), e1.clear(), e2.clear();
+		std::vector<glm::vec3> boxMin, boxMax;
+		bounds = Bounds();
+		for (const Mesh* mesh : meshes)
+			for (size_t t = 0; t + 2 < mesh->indices.size(); t += 3) {
+				glm::vec3 a = mesh->vertices[mesh->indices[t]].Position;
+				glm::vec3 b = mesh->vertices[mesh->indices[t + 1]].Position;
+				glm::vec3 c = mesh->vertices[mesh->indices[t + 2]].Position;
+				v0.push_back(a), e1.push_back(b - a), e2.push_back(c - a);
+				boxMin.push_back(glm::min(a, glm::min(b, c))), boxMax.push_back(glm::max(a, glm::max(b, c)));
+				bounds.Add(a), bounds.Add(b), bounds.Add(c);
+			}
+		bounds.Finish();
+		bvh::Build(nodes, order, boxMin, boxMax, 4);
+	}
+
+	int TriangleCount() const { return (int)v0.size(); }
+	glm::vec3 FaceNormal(int triangle) const { return glm::normalize(glm::cross(e1[triangle], e2[triangle])); }
+	glm::vec3 Centroid(int triangle) const { return v0[triangle] + (e1[triangle] + e2[triangle]) / 3.0f; }
+
+	// nearest point of the surface to p within maxDistance; updates maxDistance, closest and triangle
+	bool ClosestPoint(const glm::vec3& p, float& maxDistance, glm::vec3& closest, int& triangle) const {
+		if (nodes.empty() || v0.empty())return false;
+		float best = maxDistance * maxDistance;
+		bool found = false;
+		int stack[bvh::STACK], top = 0;
+		if (BoxDistance2(nodes[0], p) > best)return false;
+		stack[top++] = 0;
+		while (top) {
+			const bvh::Node& node = nodes[stack[--top]];
+			if (node.count) {
+				for (int i = node.first; i < node.first + node.count; i++) {
+					glm::vec3 q = ClosestOnTriangle(order[i], p);
+					float d = glm::dot(q - p, q - p);
+					if (d < best)best = d, closest = q, triangle = order[i], found = true;
+				}
+				continue;
+			}
+			float dl = BoxDistance2(nodes[node.first], p), dr = BoxDistance2(nodes[node.first + 1], p);
+			// nearer child on top of the stack
+			if (dl > dr) {
+				if (dl <= best)stack[top++] = node.first;
+				if (dr <= best)stack[top++] = node.first + 1;
+			}
+			else {
+				if (dr <= best)stack[top++] = node.first + 1;
+				if (dl <= best)stack[top++] = node.first;
+			}
+		}
+		if (found)maxDistance = std::sqrt(best);
+		return found;
+	}
+
+	// the same query over every triangle, for comparison
+	bool ClosestPointLinear(const glm::vec3& p, float& maxDistance, glm::vec3& closest, int& triangle) const {
+		float best = maxDistance * maxDistance;
+		bool found = false;
+		for (int i = 0; i < (int)v0.size(); i++) {
+			glm::vec3 q = ClosestOnTriangle(i, p);
+			float d = glm::dot(q - p, q - p);
+			if (d < best)best = d, closest = q, triangle = i, found = true;
+		}
+		if (found)maxDistance = std::sqrt(best);
+		return found;
+	}
+
+	// closest triangle hit nearer than t; updates t and triangle
+	bool Intersect(const glm::vec3& origin, const glm::vec3& direction, float& t, int& triangle) const {
+		if (nodes.empty() || v0.empty())return false;
+		bvh::RayData ray(origin, direction);
+		bool hit = false;
+		int stack[bvh::STACK], top = 0;
+		float tNear;
+		if (!bvh::RayBox(ray, nodes[0], t, tNear))return false;
+		stack[top++] = 0;
+		while (top) {
+			const bvh::Node& node = nodes[stack[--top]];
+			if (node.count) {
+				for (int i = node.first; i < node.first + node.count; i++)
+					if (IntersectTriangle(order[i], origin, direction, t))triangle = order[i], hit = true;
+				continue;
+			}
+			float tl, tr;
+			bool l = bvh::RayBox(ray, nodes[node.first], t, tl), r = bvh::RayBox(ray, nodes[node.first + 1], t, tr);
+			// nearer child on top of the stack
+			if (l && r) {
+				if (tl < tr)stack[top++] = node.first + 1, stack[top++] = node.first;
+				else stack[top++] = node.first, stack[top++] = node.first + 1;
+			}
+			else if (l)stack[top++] = node.first;
+			else if (r)stack[top++] = node.first + 1;
+		}
+		return hit;
+	}
+
+private:
+	std::vector<glm::vec3> v0, e1, e2;	// triangles as a corner and two edges
+	std::vector<bvh::Node> nodes;
+	std::vector<int> order;
+
+	static float BoxDistance2(const bvh::Node& node, const glm::vec3& p) {
+		float d = 0.0f;
+		for (int a = 0; a < 3; a++) {
+			float v = std::max(std::max(node.min[a] - p[a], p[a] - node.max[a]), 0.0f);
+			d += v * v;
+		}
+		return d;
+	}
+
+	// Ericson, Real-Time Collision Detection 5.1.5: region tests on the barycentric coordinates
+	glm::vec3 ClosestOnTriangle(int i, const glm::vec3& p) const {
+		const glm::vec3& a = v0[i];
+		glm::vec3 ab = e1[i], ac = e2[i], ap = p - a;
+		float d1 = glm::dot(ab, ap), d2 = glm::dot(ac, ap);
+		if (d1 <= 0.0f && d2 <= 0.0f)return a;
+		glm::vec3 bp = ap - ab;
+		float d3 = glm::dot(ab, bp), d4 = glm::dot(ac, bp);
+		if (d3 >= 0.0f && d4 <= d3)return a + ab;
+		float vc = d1 * d4 - d3 * d2;
+		if (vc <= 0.0f && d1 >= 0.0f && d3 <= 0.0f)return a + ab * (d1 / (d1 - d3));
+		glm::vec3 cp = ap - ac;
+		float d5 = glm::dot(ab, cp), d6 = glm::dot(ac, cp);
+		if (d6 >= 0.0f && d5 <= d6)return a + ac;
+		float vb = d5 * d2 - d1 * d6;
+		if (vb <= 0.0f && d2 >= 0.0f && d6 <= 0.0f)return a + ac * (d2 / (d2 - d6));
+		float va = d3 * d6 - d5 * d4;
+		if (va <= 0.0f && (d4 - d3) >= 0.0f && (d5 - d6) >= 0.0f)
+			return a + ab + (ac - ab) * ((d4 - d3) / ((d4 - d3) + (d5 - d6)));
+		float denom = 1.0f / (va + vb + vc);
+		return a + ab * (vb * denom) + ac * (vc * denom);
+	}
+
+	// Moller-Trumbore
+	bool IntersectTriangle(int i, const glm::vec3& origin, const glm::vec3& direction, float& t) const {
+		glm::vec3 p = glm::cross(direction, e2[i]);
+		float det = glm::dot(e1[i], p);
+		if (std::fabs(det) < 1e-12f)return false;
+		float inv = 1.0f / det;
+		glm::vec3 s = origin - v0[i];
+		float u = glm::dot(s, p) * inv;
+		if (u < 0.0f || u > 1.0f)return false;
+		glm::vec3 q = glm::cross(s, e1[i]);
+		float v = glm::dot(direction, q) * inv;
+		if (v < 0.0f || u + v > 1.0f)return false;
+		float d = glm::dot(e2[i], q) * inv;
+		if (d <= 0.0f || d >= t)return false;
+		t = d;
+		return true;
+	}
+};
+
+class SceneBVH {
+public:
+	// adds an object of the given shape, returns its id. layers is a bit mask the queries can filter on
+	int Add(const MeshBVH* shape, const glm::mat4& model = glm::mat4(1.0f), bool active = true, unsigned int layers = 1) {
+		objects.push_back(Object());
+		objects.back().shape = shape;
+		objects.back().layers = layers;
+		SetTransform((int)objects.size() - 1, model, active);
+		return (int)objects.size() - 1;
+	}
+
+	// inactive objects are never hit, but keep a world box so Build can place them; call Refit (or Build) afterwards
+	void SetTransform(int id, const glm::mat4& model, bool active) {
+		Object& o = objects[id];
+		o.active = active;
+		if (o.model != model || o.boxMin.x > o.boxMax.x) {
+			o.model = model;
+			o.inverse = glm::inverse(model);
+			const Bounds& b = o.shape->bounds;
+			o.boxMin = glm::vec3(INFINITY), o.boxMax = glm::vec3(-INFINITY);
+			for (int c = 0; c < 8; c++) {
+				glm::vec3 corner((c & 1) ? b.max.x : b.min.x, (c & 2) ? b.max.y : b.min.y, (c & 4) ? b.max.z : b.min.z);
+				glm::vec3 w = glm::vec3(model * glm::vec4(corner, 1.0f));
+				o.boxMin = glm::min(o.boxMin, w), o.boxMax = glm::max(o.boxMax, w);
+			}
+		}
+	}
+
+	void Build() {
+		std::vector<glm::vec3> boxMin, boxMax;
+		for (const Object& o : objects)boxMin.push_back(o.boxMin), boxMax.push_back(o.boxMax);
+		bvh::Build(nodes, order, boxMin, boxMax, 2);
+		Refit();
+	}
+
+	// recomputes the node boxes bottom-up for the current transforms, the tree keeps its shape.
+	// Children always come after their parent, so a reverse sweep sees them first
+	void Refit() {
+		for (int i = (int)nodes.size() - 1; i >= 0; i--) {
+			bvh::Node& node = nodes[i];
+			glm::vec3 lo(INFINITY), hi(-INFINITY);
+			if (node.count) {
+				for (int k = node.first; k < node.first + node.count; k++) {
+					const Object& o = objects[order[k]];
+					if (!o.active)continue;
+					lo = glm::min(lo, o.boxMin), hi = glm::max(hi, o.boxMax);
+				}
+			}
+			else {
+				const bvh::Node& l = nodes[node.first];
+				const bvh::Node& r = nodes[node.first + 1];
+				lo = glm::vec3(std::min(l.min[0], r.min[0]), std::min(l.min[1], r.min[1]), std::min(l.min[2], r.min[2]));
+				hi = glm::vec3(std::max(l.max[0], r.max[0]), std::max(l.max[1], r.max[1]), std::max(l.max[2], r.max[2]));
+			}
+			bvh::SetBox(node, lo, hi);
+		}
+	}
+
+	// closest hit along origin + t * direction with t < hit.t, among the objects sharing a bit with layers
+	bool Intersect(const glm::vec3& origin, const glm::vec3& direction, RayHit& hit, unsigned int layers = ~0u) const {
+		if (nodes.empty())return false;
+		bvh::RayData ray(origin, direction);
+		int stack[bvh::STACK], top = 0;
+		float tNear;
+		bool found = false;
+		if (!bvh::RayBox(ray, nodes[0], hit.t, tNear))return false;
+		stack[top++] = 0;
+		while (top) {
+			const bvh::Node& node = nodes[stack[--top]];
+			if (node.count) {
+				for (int k = node.first; k < node.first + node.count; k++)
+					found |= IntersectObject(order[k], origin, direction, hit, layers);
+				continue;
+			}
+			float tl, tr;
+			bool l = bvh::RayBox(ray, nodes[node.first], hit.t, tl), r = bvh::RayBox(ray, nodes[node.first + 1], hit.t, tr);
+			if (l && r) {
+				if (tl < tr)stack[top++] = node.first + 1, stack[top++] = node.first;
+				else stack[top++] = node.first, stack[top++] = node.first + 1;
+			}
+			else if (l)stack[top++] = node.first;
+			else if (r)stack[top++] = node.first + 1;
+		}
+		if (found)hit.point = origin + direction * hit.t;
+		return found;
+	}
+
+	// the same query without the tree, for comparison
+	bool IntersectLinear(const glm::vec3& origin, const glm::vec3& direction, RayHit& hit, unsigned int layers = ~0u) const {
+		bool found = false;
+		for (int i = 0; i < (int)objects.size(); i++)found |= IntersectObject(i, origin, direction, hit, layers);
+		if (found)hit.point = origin + direction * hit.t;
+		return found;
+	}
+
+	// ids of the active objects whose world box overlaps [lo, hi], in increasing order
+	void Overlap(const glm::vec3& lo, const glm::vec3& hi, std::vector<int>& ids, unsigned int layers = ~0u) const {
+		ids.clear();
+		if (nodes.empty())return;
+		int stack[bvh::STACK], top = 0;
+		stack[top++] = 0;
+		while (top) {
+			const bvh::Node& node = nodes[stack[--top]];
+			if (node.min[0] > hi.x || node.min[1] > hi.y || node.min[2] > hi.z || node.max[0] < lo.x || node.max[1] < lo.y || node.max[2] < lo.z)continue;
+			if (!node.count) {
+				stack[top++] = node.first, stack[top++] = node.first + 1;
+				continue;
+			}
+			for (int k = node.first; k < node.first + node.count; k++) {
+				const Object& o = objects[order[k]];
+				if (o.active && (o.layers & layers) && o.boxMin.x <= hi.x && o.boxMin.y <= hi.y && o.boxMin.z <= hi.z && lo.x <= o.boxMax.x && lo.y <= o.boxMax.y && lo.z <= o.boxMax.z)
+					ids.push_back(order[k]);
+			}
+		}
+		std::sort(ids.begin(), ids.end());
+	}
+
+	int Count() const { return (int)objects.size(); }
+
+private:
+	struct Object {
+		const MeshBVH* shape = nullptr;
+		glm::mat4 model = glm::mat4(0.0f), inverse = glm::mat4(1.0f);
+		glm::vec3 boxMin = glm::vec3(INFINITY), boxMax = glm::vec3(-INFINITY);
+		unsigned int layers = 1;
+		bool active = false;
+	};
+	std::vector<Object> objects;
+	std::vector<bvh::Node> nodes;
+	std::vector<int> order;
+
+	bool IntersectObject(int id, const glm::vec3& origin, const glm::vec3& direction, RayHit& hit, unsigned int layers) const {
+		const Object& o = objects[id];
+		if (!o.active || !(o.layers & layers))return false;
+		// the ray in model space, the direction unnormalised so t means the same in both spaces
+		glm::vec3 localOrigin = glm::vec3(o.inverse * glm::vec4(origin, 1.0f));
+		glm::vec3 localDirection = glm::vec3(o.inverse * glm::vec4(direction, 0.0f));
+		int triangle = -1;
+		if (!o.shape->Intersect(localOrigin, localDirection, hit.t, triangle))return false;
+		hit.object = id, hit.triangle = triangle;
+		hit.localPoint = localOrigin + localDirection * hit.t;
+		return true;
+	}
+};
+
+// rays per second through SceneBVH against a linear scan over every object, for scenes of growing size
+// built from the given shapes. The two must agree on every hit
+inline void RunPickBenchmark(const std::vector<const MeshBVH*>& shapes) {
+	printf("\n-------------------------------- ray picking --------------------------------\n");
+	printf("%8s %10s %14s %14s %8s %10s\n", "objects", "rays", "BVH rays/s", "linear rays/s", "speedup", "mismatch");
+	std::mt19937 rng(7);
+	std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+	for (int count : { 35, 500, 5000 }) {
+		SceneBVH scene;
+		float extent = std::cbrt((float)count) * 0.3f;
+		for (int i = 0; i < count; i++) {
+			glm::vec3 p(unit(rng) * extent, unit(rng) * extent, unit(rng) * extent);
+			scene.Add(shapes[i % shapes.size()], glm::rotate(glm::translate(glm::mat4(1.0f), p), unit(rng) * 3.14159f, glm::vec3(0.0f, 1.0f, 0.0f)) * glm::scale(glm::mat4(1.0f), glm::vec3(2.0f)));
+		}
+		scene.Build();
+		int rays = count >= 5000 ? 2000 : 20000;
+		std::vector<glm::vec3> origins(rays), targets(rays);
+		for (int i = 0; i < rays; i++) {
+			origins[i] = glm::normalize(glm::vec3(unit(rng), unit(rng), unit(rng))) * extent * 3.0f;
+			targets[i] = glm::vec3(unit(rng), unit(rng), unit(rng)) * extent;
+		}
+		std::vector<RayHit> fast(rays), slow(rays);
+		auto start = std::chrono::high_resolution_clock::now();
+		for (int i = 0; i < rays; i++)scene.Intersect(origins[i], targets[i] - origins[i], fast[i]);
+		auto middle = std::chrono::high_resolution_clock::now();
+		for (int i = 0; i < rays; i++)scene.IntersectLinear(origins[i], targets[i] - origins[i], slow[i]);
+		auto end = std::chrono::high_resolution_clock::now();
+		int mismatch = 0;
+		for (int i = 0; i < rays; i++)mismatch += fast[i].object != slow[i].object || fast[i].triangle != slow[i].triangle;
+		double bvhSeconds = std::chrono::duration<double>(middle - start).count();
+		double linearSeconds = std::chrono::duration<double>(end - middle).count();
+		printf("%8d %10d %14.0f %14.0f %7.1fx %10d\n", count, rays, rays / bvhSeconds, rays / linearSeconds, linearSeconds / bvhSeconds, mismatch);
+	}
+	printf("-----------------------------------------------------------------------------\n\n");
+}
+
+#endif // !BVH_H
@@ -3,6 +3,10 @@
 #define BALL_H
 
 #include "Mesh.h"
+#include "ShaderManager.h"
+#include "OcclusionCuller.h"
+#include "FrameArena.h"
+#include "SceneSnapshot.h"
 
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
@@ -10,6 +14,9 @@
 
 #include "Randomizer.h"
 
+#include <string>
+#include <functional>
+
 const float pi = 3.1415926535897932384626433832795;
 enum dType { Default, Wall0, Wall1, Wall2, Wall3, Ground, Tumblers};
 class Ball
@@ -28,14 +35,24 @@ public:
 
 	dType displayType;
 
+	// position, living and displayType as of the last Publish; drawing only uses these, so the simulation may run meanwhile
+	struct Pose {
+		glm::vec3 position = glm::vec3(0.0f);
+		bool living = false;
+		dType type = Default;
+	} pose;
+
 	Ball() { living = false; }
+	// the mesh is only rebuilt for a new radius, a reset keeps its buffers and textures
 	void initParam(float x, float y, float z, float r){
-		radius = r;
 		living = false;
 		position = glm::vec3(x, y, z);
 		V = glm::vec3(0.0f);
 		displayType = Default;
-		GenerateMesh();
+		if (mesh.vertices.empty() || r != radius) {
+			radius = r;
+			GenerateMesh();
+		}
 	}
 
 	Ball(float x, float y, float z, float r) :radius(r) {
@@ -69,7 +86,14 @@ public:
 
 	void GenerateMesh()
 	{
-		mesh.clear();
+		BuildMesh();
+		mesh.setup();
+	}
+
+	// fills mesh.vertices/indices only, safe to call off the GL thread
+	void BuildMesh()
+	{
+		mesh.vertices.clear(), mesh.indices.clear();
 		int cnt = 0;
 		for (float phi = -pi / 2; phi < pi / 2; phi += 0.1)
 			for (float alpha = 0.0; alpha < 2 * pi; alpha += 0.1) {
@@ -96,19 +120,30 @@ public:
 			mesh.indices.push_back(mesh.vertices.size() - 1),
 			mesh.indices.push_back(mesh.vertices.size() - i),
 			mesh.indices.push_back(mesh.vertices.size() - i - 1);
-		mesh.setup();
+	}
+
+	void Publish() {
+		pose.position = position, pose.living = living, pose.type = displayType;
+	}
+	void WorldSphere(glm::vec3& center, float& r) const {
+		center = pose.position + mesh.bounds.center;
+		r = mesh.bounds.radius;
+	}
+	bool InView(Frustum* frustum) const {
+		if (!frustum)return true;
+		glm::vec3 center;
+		float r;
+		WorldSphere(center, r);
+		return frustum->Sphere(center, r);
 	}
 
 	void Draw(Shader& shader)
 	{
-		if (!living)return;
-		if (glm::length(V)) {
-			//printf("Drawing pos(%lf,%lf,%lf) V(%lf,%lf,%lf)\n", position.x, position.y, position.z, V.x, V.y, V.z);
-		}
+		if (!pose.living)return;
 		glm::mat4 modelMatrix = glm::mat4(1.0f);
-		modelMatrix = glm::translate(modelMatrix, position);
+		modelMatrix = glm::translate(modelMatrix, pose.position);
 		shader.setMat4("model", modelMatrix);
-		shader.setInt("type", displayType);
+		shader.setInt("type", pose.type);
 		mesh.Draw(shader);
 	}
 };
@@ -123,18 +158,35 @@ public:
 
 	Texture woodTexture;
 
+	SphereBatch cullBatch;
+	unsigned char inView[30];
+
 	BallSystem() {
 	}
 
-	void InitBalls() {
-		CreateTexture();
-		Randomizer rdm;
-		for (int i = 0; i < N; i++) {
-			balls[i].initParam(0.0f, 0.0f, 0.0f, 0.03f);
-			balls[i].V = glm::vec3(rdm.random(-maxSpeed, maxSpeed), rdm.random(-maxSpeed, maxSpeed), rdm.random(-maxSpeed, maxSpeed));
-		//	balls[i].G = glm::vec3(0.0f);
-			balls[i].mesh.textures.push_back(woodTexture);
-		}
+	// all balls share one sphere, built once on a worker and uploaded per ball once wood is ready
+	void InitBalls(JobSystem& jobs, const Texture& wood, JobHandle woodReady) {
+		JobHandle build = jobs.Submit("balls", "mesh", [this] {
+			Randomizer rdm;
+			for (int i = 0; i < N; i++) {
+				balls[i].radius = 0.03f;
+				balls[i].living = false;
+				balls[i].position = glm::vec3(0.0f);
+				balls[i].displayType = Default;
+				balls[i].V = glm::vec3(rdm.random(-maxSpeed, maxSpeed), rdm.random(-maxSpeed, maxSpeed), rdm.random(-maxSpeed, maxSpeed));
+			}
+			balls[0].BuildMesh();
+			for (int i = 1; i < N; i++)
+				balls[i].mesh.vertices = balls[0].mesh.vertices, balls[i].mesh.indices = balls[0].mesh.indices;
+		});
+		// the balls get their texture here, once
+		jobs.SubmitMain("balls", "upload", [this, &wood] {
+			woodTexture = wood;
+			for (int i = 0; i < N; i++) {
+				balls[i].mesh.textures.push_back(woodTexture);
+				balls[i].mesh.setup();
+			}
+		}, { build, woodReady });
 	}
 
 	void Activate() {
@@ -144,7 +196,6 @@ public:
 			for (int i = 0; i < N; i++) {
 				balls[i].initParam(0.0f, 0.0f, 0.0f, 0.03f);
 				balls[i].V = glm::vec3(rdm.random(-maxSpeed, maxSpeed), rdm.random(-maxSpeed, maxSpeed), rdm.random(-maxSpeed, maxSpeed));
-				balls[i].mesh.textures.push_back(woodTexture);
 			}
 
 			balls[0].V = glm::vec3(0.0f), balls[0].G = glm::vec3(0.0f);
@@ -159,46 +210,86 @@ public:
 		for (int i = 0; i < N; i++)balls[i].KineticMove(deltaTime);
 	}
 
+	void Publish() {
+		for (int i = 0; i < N; i++)balls[i].Publish();
+	}
+	// textures bound per ball draw, summed over the balls; stays at one each
+	int TextureCount() const {
+		int textures = 0;
+		for (int i = 0; i < N; i++)textures += (int)balls[i].mesh.textures.size();
+		return textures;
+	}
+
+	// as published
+	int Living() const {
+		int living = 0;
+		for (int i = 0; i < N; i++)living += balls[i].pose.living;
+		return living;
+	}
+
 	void Draw(Shader& shader) {
 		shader.use();
 		for (int i = 0; i < N; i++)balls[i].Draw(shader);
 	}
+	// one ball.fs permutation per colour type (BALL_TYPE), balls are drawn grouped by it.
+	// prepare sets the frame's uniforms on each program before its balls are drawn.
+	// With a frustum, the living balls are culled against it in one batch first, then against the occluders
+	void Draw(ShaderVariants& variants, const char* defines, const std::function<void(Shader&)>& prepare, Frustum* frustum = nullptr, OcclusionCuller* occlusion = nullptr) {
+		for (int i = 0; i < N; i++)inView[i] = balls[i].pose.living;
+		if (frustum) {
+			cullBatch.Clear();
+			for (int i = 0; i < N; i++) {
+				if (!balls[i].pose.living)continue;
+				glm::vec3 center;
+				float r;
+				balls[i].WorldSphere(center, r);
+				cullBatch.Add(i, center, r);
+			}
+			frustum->Cull(cullBatch);
+			for (int k = 0; k < cullBatch.Count(); k++)inView[cullBatch.ids[k]] = cullBatch.visible[k];
+		}
+		if (occlusion)
+			for (int i = 0; i < N; i++)
+				if (inView[i])inView[i] = occlusion->Visible(&balls[i], balls[i].mesh.bounds, glm::translate(glm::mat4(1.0f), balls[i].pose.position));
+		for (int type = Default; type <= Tumblers; type++) {
+			Shader* shader = nullptr;
+			for (int i = 0; i < N; i++) {
+				if (!inView[i] || balls[i].pose.type != type)continue;
+				if (!shader) {
+					shader = &variants.Get(FrameArena::Frame().Format("%s;BALL_TYPE %d", defines, type));
+					prepare(*shader);
+					shader->use();
+				}
+				balls[i].Draw(*shader);
+			}
+		}
+	}
 	void renderShadow(Shader& shader) {
 		for (int i = 0; i < N; i++)balls[i].Draw(shader);
 	}
 
-	void CreateTexture() {
-		unsigned int textureID;
-		glGenTextures(1, &textureID);
-		int width, height, nrComponents;
-		unsigned char* data = stbi_load("texture\\wood.jpg", &width, &height, &nrComponents, 0);
-		if (data)
-		{
-
-			glBindTexture(GL_TEXTURE_2D, textureID);
-			glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, data);
-			glGenerateMipmap(GL_TEXTURE_2D);
-
-			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-
-			stbi_image_free(data);
-		}
-		else
-		{
-			std::cout << "Texture failed to load at path: ";
-			stbi_image_free(data);
-		}
-		woodTexture.id = textureID;
-		woodTexture.type = "texture_diffuse";
-		woodTexture.path = "texture\\wooden.jpg";
-	};
+	// the balls in flight; the meshes stay as they are, every ball has the same
+	void Save(SceneSnapshot& snapshot) const {
+		snapshot.AddField("BPOS", balls, N, &Ball::position);
+		snapshot.AddField("BV  ", balls, N, &Ball::V);
+		snapshot.AddField("BG  ", balls, N, &Ball::G);
+		snapshot.AddField("BLIV", balls, N, &Ball::living);
+		snapshot.AddField("BTYP", balls, N, &Ball::displayType);
+		*snapshot.Add<int>("BACT", 1) = isActivated;
+	}
+	bool Restore(const SceneSnapshot& snapshot) {
+		const int* activated = snapshot.Get<int>("BACT", 1);
+		if (!activated)return false;
+		isActivated = *activated != 0;
+		return snapshot.GetField("BPOS", balls, N, &Ball::position)
+			&& snapshot.GetField("BV  ", balls, N, &Ball::V)
+			&& snapshot.GetField("BG  ", balls, N, &Ball::G)
+			&& snapshot.GetField("BLIV", balls, N, &Ball::living)
+			&& snapshot.GetField("BTYP", balls, N, &Ball::displayType);
+	}
 
 	void Debug(glm::vec3 raySource, glm::vec3 rayDirection) {
 		balls[0].initParam(raySource.x, raySource.y, raySource.z, 0.03f);
-		balls[0].mesh.textures.push_back(woodTexture);
 		balls[0].V = rayDirection;
 		balls[0].G = glm::vec3(0);
 		balls[0].living = true;
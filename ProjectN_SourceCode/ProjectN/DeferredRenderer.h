@@ -0,0 +1,324 @@
+#pragma once
+#ifndef DEFERREDRENDERER_H
+#define DEFERREDRENDERER_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include "Shader.h"
+#include "LightClusters.h"
+#include "StreamBuffer.h"
+#include "FrameArena.h"
+#include "FrameStats.h"
+
+#include <vector>
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+
+// Deferred lighting for the point lights. The lit shaders' DEFERRED permutation keeps shading with the room
+// light (and its shadow) into the colour target while also writing world position, normal and albedo to
+// the G-buffer. Every point light is then a sphere as big as its reach, all drawn in one instanced call with
+// additive blending, so a light only costs the pixels it covers and the light list can grow to hundreds.
+// Emissive and blended things (the light ball, the fireball, particles) are drawn forward afterwards.
+// With clustered set, LightClustered replaces the volumes by one full-screen pass over per-cluster light lists.
+class DeferredRenderer {
+public:
+	std::vector<PointLight> lights;
+	float cutoff = 5.0f / 256.0f;	// light below this is left out of a light's sphere
+	float maxRadius = 3.5f;	// the room's diagonal
+	bool clustered = false;	// light through LightClustered rather than Light
+	StreamBuffer* stream = nullptr;	// if set, the light volumes' instances are written into it
+	unsigned int screen = 0;	// the framebuffer Present copies to, 0 for the window's
+
+	// counters
+	int frames = 0;
+	long long lightsDrawn = 0;
+	double gpuMilliseconds = 0.0;
+	int gpuSamples = 0;
+
+	// false if the G-buffer isn't supported, the forward path has to be kept then
+	bool Init(int w, int h) {
+		width = w, height = h;
+		glGenFramebuffers(1, &fbo);
+		glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+		const GLenum formats[TARGETS] = { GL_RGBA8, GL_RGBA16F, GL_RGBA16F, GL_RGBA8 };
+		glGenTextures(TARGETS, targets);
+		for (int i = 0; i < TARGETS; i++) {
+			glBindTexture(GL_TEXTURE_2D, targets[i]);
+			glTexImage2D(GL_TEXTURE_2D, 0, formats[i], w, h, 0, GL_RGBA, GL_FLOAT, NULL);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+			glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0 + i, GL_TEXTURE_2D, targets[i], 0);
+		}
+		glGenRenderbuffers(1, &depth);
+		glBindRenderbuffer(GL_RENDERBUFFER, depth);
+		glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, w, h);
+		glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, depth);
+		ready = glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+		glBindFramebuffer(GL_FRAMEBUFFER, 0);
+		if (!ready) {
+			printf("deferred shading: G-buffer incomplete, staying forward\n");
+			return false;
+		}
+		CreateVolume();
+		glGenQueries(1, &query);
+		// the full-screen triangle is made up in the vertex shader, it only needs some VAO bound
+		glGenVertexArrays(1, &screenVAO);
+		glGenBuffers(1, &lightBuffer);
+		glGenTextures(1, &lightTexture);
+		glGenBuffers(1, &clusterBuffer);
+		glGenTextures(1, &clusterTexture);
+		return true;
+	}
+
+	bool Ready() const { return ready; }
+
+	// the radius is worked out from the attenuation unless given
+	void AddLight(PointLight light) {
+		if (light.radius <= 0.0f) {
+			// solve quadratic * d^2 + linear * d + constant = brightest channel / cutoff
+			float brightest = std::max(light.color.x, std::max(light.color.y, light.color.z));
+			float c = light.constant - brightest / cutoff;
+			float d = light.quadratic > 0.0f ? (-light.linear + std::sqrt(light.linear * light.linear - 4.0f * light.quadratic * c)) / (2.0f * light.quadratic)
+				: (light.linear > 0.0f ? -c / light.linear : maxRadius);
+			light.radius = std::min(std::max(d, 0.0f), maxRadius);
+		}
+		lights.push_back(light);
+	}
+
+	// binds the G-buffer for the opaque draws
+	void BeginGeometry() {
+		glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+		const GLenum buffers[TARGETS] = { GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1, GL_COLOR_ATTACHMENT2, GL_COLOR_ATTACHMENT3 };
+		glDrawBuffers(TARGETS, buffers);
+		const float background[4] = { 0.05f, 0.05f, 0.05f, 1.0f }, zero[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+		glClearBufferfv(GL_COLOR, 0, background);
+		for (int i = 1; i < TARGETS; i++)glClearBufferfv(GL_COLOR, i, zero);
+		glClear(GL_DEPTH_BUFFER_BIT);
+	}
+
+	// adds every light's share to the colour target; afterwards only that target is drawn to, for the forward draws
+	void Light(Shader& shader, const glm::mat4& view, const glm::mat4& projection, const glm::vec3& viewPos) {
+		glDrawBuffer(GL_COLOR_ATTACHMENT0);
+		frames++;
+		ReadTimer();
+		if (lights.empty())return;
+
+		instances.clear();
+		Pack(instances);
+		size_t bytes = instances.size() * sizeof(float), offset = 0;
+		unsigned char* out = stream ? stream->Allocate(bytes, offset) : nullptr;
+		if (out) {
+			memcpy(out, instances.data(), bytes);
+			stream->Commit();
+			glBindBuffer(GL_ARRAY_BUFFER, stream->buffer);
+		}
+		else {
+			offset = 0;
+			glBindBuffer(GL_ARRAY_BUFFER, instanceVBO);
+			glBufferData(GL_ARRAY_BUFFER, bytes, instances.data(), GL_STREAM_DRAW);
+		}
+		glBindVertexArray(volumeVAO);
+		for (int i = 0; i < 3; i++)
+			glVertexAttribPointer(3 + i, 4, GL_FLOAT, GL_FALSE, 12 * sizeof(float), (void*)(offset + i * 4 * sizeof(float)));
+		glBindVertexArray(0);
+
+		BindTargets(shader, view, projection, viewPos);
+
+		// back faces without depth test: the camera may be inside a sphere, and each pixel is lit once per light
+		GLboolean culling = glIsEnabled(GL_CULL_FACE);
+		glEnable(GL_CULL_FACE);
+		glCullFace(GL_FRONT);
+		glDisable(GL_DEPTH_TEST);
+		glDepthMask(GL_FALSE);
+		glEnable(GL_BLEND);
+		glBlendFunc(GL_ONE, GL_ONE);
+		glBeginQuery(GL_TIME_ELAPSED, query);
+		glBindVertexArray(volumeVAO);
+		glDrawElementsInstanced(GL_TRIANGLES, volumeIndexCount, GL_UNSIGNED_INT, 0, (GLsizei)lights.size());
+		FrameStats::Get().Draw(volumeIndexCount / 3, (long long)lights.size());
+		glBindVertexArray(0);
+		glEndQuery(GL_TIME_ELAPSED);
+		timerPending = true;
+		glDisable(GL_BLEND);
+		glDepthMask(GL_TRUE);
+		glEnable(GL_DEPTH_TEST);
+		glCullFace(GL_BACK);
+		if (!culling)glDisable(GL_CULL_FACE);
+		glActiveTexture(GL_TEXTURE0);
+		lightsDrawn += lights.size();
+	}
+
+	// Clustered instead of one volume per light: a single full-screen pass where every pixel only loops over the
+	// lights LightClusters binned into its cluster. The lights and the cluster lists are uploaded to texture
+	// buffers once per frame; the assignment itself is done on the CPU beforehand, off the render thread
+	void LightClustered(Shader& shader, const LightClusters& clusters, const glm::mat4& view, const glm::mat4& projection, const glm::vec3& viewPos) {
+		glDrawBuffer(GL_COLOR_ATTACHMENT0);
+		frames++;
+		ReadTimer();
+		if (lights.empty())return;
+		UploadClusters(clusters);
+
+		BindTargets(shader, view, projection, viewPos);
+		glActiveTexture(GL_TEXTURE14);
+		glBindTexture(GL_TEXTURE_BUFFER, lightTexture);
+		glActiveTexture(GL_TEXTURE15);
+		glBindTexture(GL_TEXTURE_BUFFER, clusterTexture);
+		shader.setInt("lightData", 14);
+		shader.setInt("clusterData", 15);
+		shader.setVec3("clusterGrid", glm::vec3((float)LightClusters::X, (float)LightClusters::Y, (float)LightClusters::Z));
+		shader.setFloat("clusterNear", clusters.Near());
+		shader.setFloat("clusterFar", clusters.Far());
+
+		glDisable(GL_DEPTH_TEST);
+		glDepthMask(GL_FALSE);
+		glEnable(GL_BLEND);
+		glBlendFunc(GL_ONE, GL_ONE);
+		glBeginQuery(GL_TIME_ELAPSED, query);
+		glBindVertexArray(screenVAO);
+		glDrawArrays(GL_TRIANGLES, 0, 3);
+		FrameStats::Get().Draw(1);
+		glBindVertexArray(0);
+		glEndQuery(GL_TIME_ELAPSED);
+		timerPending = true;
+		glDisable(GL_BLEND);
+		glDepthMask(GL_TRUE);
+		glEnable(GL_DEPTH_TEST);
+		glActiveTexture(GL_TEXTURE0);
+		lightsDrawn += lights.size();
+	}
+
+	// copies the finished frame to the screen
+	void Present() {
+		glBindFramebuffer(GL_READ_FRAMEBUFFER, fbo);
+		glReadBuffer(GL_COLOR_ATTACHMENT0);
+		glBindFramebuffer(GL_DRAW_FRAMEBUFFER, screen);
+		glBlitFramebuffer(0, 0, width, height, 0, 0, width, height, GL_COLOR_BUFFER_BIT, GL_NEAREST);
+		glBindFramebuffer(GL_FRAMEBUFFER, screen);
+	}
+
+	void PrintStats() {
+		if (!frames)return;
+		printf("deferred shading: %d frames, %.1f lights on average, light pass %.3f ms on the GPU\n",
+			frames, (double)lightsDrawn / frames, gpuSamples ? gpuMilliseconds / gpuSamples : 0.0);
+	}
+
+private:
+	static const int TARGETS = 4;	// lit colour, position, normal + specular, albedo
+	unsigned int fbo = 0, targets[TARGETS] = {}, depth = 0;
+	unsigned int volumeVAO = 0, volumeVBO = 0, volumeEBO = 0, instanceVBO = 0;
+	int volumeIndexCount = 0;
+	unsigned int query = 0;
+	unsigned int screenVAO = 0, lightBuffer = 0, lightTexture = 0, clusterBuffer = 0, clusterTexture = 0;
+	bool timerPending = false, ready = false;
+	int width = 0, height = 0;
+	std::vector<float> instances;	// kept, so packing doesn't allocate once it has grown
+
+	// 12 floats per light: position and radius, colour and shadow flag, attenuation and ambient share
+	void Pack(std::vector<float>& data) const {
+		data.reserve(lights.size() * 12);
+		for (const PointLight& l : lights) {
+			float light[12] = { l.position.x, l.position.y, l.position.z, l.radius, l.color.x, l.color.y, l.color.z, l.shadowed ? 1.0f : 0.0f,
+				l.constant, l.linear, l.quadratic, l.ambient };
+			data.insert(data.end(), light, light + 12);
+		}
+	}
+
+	// the lights as three RGBA32F texels each; one R32UI buffer holding every cluster's offset and count, then the light indices
+	void UploadClusters(const LightClusters& clusters) {
+		instances.clear();
+		Pack(instances);
+		glBindBuffer(GL_TEXTURE_BUFFER, lightBuffer);
+		glBufferData(GL_TEXTURE_BUFFER, instances.size() * sizeof(float), instances.data(), GL_STREAM_DRAW);
+		// only needed until it is handed to GL, so it comes from the frame arena
+		size_t count = 2 * LightClusters::COUNT + clusters.indices.size();
+		unsigned int* lists = FrameArena::Frame().New<unsigned int>(count);
+		for (int c = 0; c < LightClusters::COUNT; c++)
+			lists[2 * c] = 2 * LightClusters::COUNT + clusters.offsets[c], lists[2 * c + 1] = clusters.counts[c];
+		std::copy(clusters.indices.begin(), clusters.indices.end(), lists + 2 * LightClusters::COUNT);
+		glBindBuffer(GL_TEXTURE_BUFFER, clusterBuffer);
+		glBufferData(GL_TEXTURE_BUFFER, count * sizeof(unsigned int), lists, GL_STREAM_DRAW);
+		glBindBuffer(GL_TEXTURE_BUFFER, 0);
+		glBindTexture(GL_TEXTURE_BUFFER, lightTexture);
+		glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, lightBuffer);
+		glBindTexture(GL_TEXTURE_BUFFER, clusterTexture);
+		glTexBuffer(GL_TEXTURE_BUFFER, GL_R32UI, clusterBuffer);
+		glBindTexture(GL_TEXTURE_BUFFER, 0);
+	}
+
+	// G-buffer on units 11-13 and the uniforms both light passes share, the fireball's shadow is already on 10
+	void BindTargets(Shader& shader, const glm::mat4& view, const glm::mat4& projection, const glm::vec3& viewPos) {
+		shader.use();
+		shader.setMat4("view", view);
+		shader.setMat4("projection", projection);
+		shader.setVec3("viewPos", viewPos);
+		shader.setVec2("screenSize", glm::vec2((float)width, (float)height));
+		for (int i = 1; i < TARGETS; i++) {
+			glActiveTexture(GL_TEXTURE10 + i);
+			glBindTexture(GL_TEXTURE_2D, targets[i]);
+		}
+		shader.setInt("gPosition", 11);
+		shader.setInt("gNormal", 12);
+		shader.setInt("gAlbedo", 13);
+		shader.setInt("fireShadowMap", 10);
+	}
+
+	// last frame's light pass time, if the GPU is done with it; never waits
+	void ReadTimer() {
+		if (!timerPending)return;
+		GLint available = 0;
+		glGetQueryObjectiv(query, GL_QUERY_RESULT_AVAILABLE, &available);
+		if (!available)return;
+		GLuint64 ns = 0;
+		glGetQueryObjectui64v(query, GL_QUERY_RESULT, &ns);
+		gpuMilliseconds += ns / 1e6;
+		gpuSamples++;
+		timerPending = false;
+	}
+
+	// unit sphere, pushed out so its flat faces still enclose the round one
+	void CreateVolume() {
+		const int SEGMENTS = 16, RINGS = 8;
+		const float grow = 1.0f / std::cos(3.14159265f / RINGS);
+		std::vector<float> vertices;
+		std::vector<unsigned int> indices;
+		for (int r = 0; r <= RINGS; r++)
+			for (int s = 0; s <= SEGMENTS; s++) {
+				float theta = 3.14159265f * r / RINGS, phi = 2.0f * 3.14159265f * s / SEGMENTS;
+				vertices.push_back(grow * std::sin(theta) * std::cos(phi));
+				vertices.push_back(grow * std::cos(theta));
+				vertices.push_back(grow * std::sin(theta) * std::sin(phi));
+			}
+		for (int r = 0; r < RINGS; r++)
+			for (int s = 0; s < SEGMENTS; s++) {
+				unsigned int a = r * (SEGMENTS + 1) + s, b = a + SEGMENTS + 1;
+				// counter-clockwise seen from outside
+				indices.push_back(a), indices.push_back(a + 1), indices.push_back(b);
+				indices.push_back(a + 1), indices.push_back(b + 1), indices.push_back(b);
+			}
+		volumeIndexCount = (int)indices.size();
+
+		glGenVertexArrays(1, &volumeVAO);
+		glGenBuffers(1, &volumeVBO);
+		glGenBuffers(1, &volumeEBO);
+		glGenBuffers(1, &instanceVBO);
+		glBindVertexArray(volumeVAO);
+		glBindBuffer(GL_ARRAY_BUFFER, volumeVBO);
+		glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(float), vertices.data(), GL_STATIC_DRAW);
+		glEnableVertexAttribArray(0);
+		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void*)0);
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, volumeEBO);
+		glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), indices.data(), GL_STATIC_DRAW);
+		// per light: position and radius, colour and shadow flag, attenuation and ambient share; the buffer
+		// and offset they are read from are set by every Light
+		for (int i = 0; i < 3; i++) {
+			glEnableVertexAttribArray(3 + i);
+			glVertexAttribDivisor(3 + i, 1);
+		}
+		glBindVertexArray(0);
+	}
+};
+
+#endif // !DEFERREDRENDERER_H
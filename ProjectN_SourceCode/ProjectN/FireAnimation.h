@@ -7,6 +7,8 @@
 #include <glm/gtc/type_ptr.hpp>
 #include "Mesh.h"
 #include "Particle.h"
+#include "FrameArena.h"
+#include "SceneSnapshot.h"
 
 class FireBall {
 public:
@@ -43,14 +45,16 @@ public:
 			living = false, fireParticles.Deactivate();
 	}
 
-	void Draw(Shader& ballShader, Shader& particleShader) {
+	void Draw(Shader& ballShader, Shader& particleShader, Frustum* frustum = nullptr) {
 		if (!living)return;
-		ballShader.use();
-		glm::mat4 modelMatrix = glm::mat4(1.0f);
-		modelMatrix = glm::translate(modelMatrix, position);
-		ballShader.setMat4("model", modelMatrix);
-		mesh.Draw(ballShader);
-		fireParticles.Draw(particleShader);
+		if (!frustum || frustum->Sphere(position + mesh.bounds.center, mesh.bounds.radius)) {
+			ballShader.use();
+			glm::mat4 modelMatrix = glm::mat4(1.0f);
+			modelMatrix = glm::translate(modelMatrix, position);
+			ballShader.setMat4("model", modelMatrix);
+			mesh.Draw(ballShader);
+		}
+		fireParticles.Draw(particleShader, frustum);
 	}
 	void renderShadow(Shader& shader) {
 		if (!living)return;
@@ -95,13 +99,22 @@ public:
 
 class StaticParticleManager {
 public:
-	std::vector<std::shared_ptr<ParticleSystem>> ps;
+	// a sparkle's short burst of light, for the deferred and clustered light passes
+	struct Flash {
+		glm::vec3 position;
+		float age;
+	};
+	float flashTime = 0.25f;	// seconds a flash lasts
+
+	std::vector<ParticleSystem*> ps;	// from the pool below, handed back once burnt out
+	std::vector<Flash> flashes;
+	std::vector<Flash> shownFlashes;	// as of the last Publish, for the render pass
 	StaticParticleManager(){
 		ps.clear();
 	}
 
 	void addConicalParticles(glm::vec3 pos, float espeed, glm::vec3 col1, glm::vec3 col2, float pspeed, glm::vec3 norm) {
-		std::shared_ptr<ParticleSystem> newPs = std::make_shared<ParticleSystem>();
+		ParticleSystem* newPs = systems.Acquire();
 		ps.push_back(newPs);
 		newPs->oriented = true, newPs->orientation = norm;
 		newPs->Activate(pos,espeed,false,glm::vec3(0.0f),col1,col2,0.01f,2.0f,pspeed);
@@ -110,21 +123,135 @@ public:
 	void Update(float deltaTime) {
 		for (int i = 0; i < ps.size(); i++) {
 			ps[i]->Update(deltaTime);
-			if (ps[i]->enabled && ps[i]->particles.size() == 0)ps.erase(ps.begin() + i), i--;
+			if (ps[i]->enabled && ps[i]->particles.size() == 0)systems.Release(ps[i]), ps.erase(ps.begin() + i), i--;
 		}
+		for (Flash& flash : flashes)flash.age += deltaTime;
+		flashes.erase(std::remove_if(flashes.begin(), flashes.end(), [this](const Flash& flash) { return flash.age > flashTime; }), flashes.end());
 	}
-	void Draw(Shader& shader) {
-		for (const auto& pss : ps) {
-			pss->Draw(shader);
-		}
+	// copies what the render pass reads, so the next Update can run while it draws
+	void Publish() {
+		shown.clear();
+		for (const ParticleSystem* pss : ps)
+			pss->Publish(shown);
+		shownFlashes = flashes;
 	}
+	// draws the published particles
+	void Draw(Shader& shader, Frustum* frustum = nullptr, StreamBuffer* stream = nullptr) {
+		batch.Draw(shader, shown, frustum, stream);
+	}
+	int Particles() const { return (int)shown.size(); }
 
 	void SE_Ash(glm::vec3 pos, glm::vec3 norm) {
 		addConicalParticles(pos, 30.0f, glm::vec3(0.16171875f), glm::vec3(0.0f), 0.2f, norm);
 	}
 	void SE_Sparkle(glm::vec3 pos, glm::vec3 norm) {
 		addConicalParticles(pos, 200.0f, glm::vec3(249.0f / 256, 212.0f / 256, 35.0f / 256), glm::vec3(248.0f / 256, 54.0f / 256, 0.0f), 0.8f, norm);
+		flashes.push_back(Flash{ pos + norm * 0.05f, 0.0f });
 	}
+
+	// every running particle system with its particles, and the flashes; particles are in one run of
+	// blocks, system after system, SPCT says how many are whose
+	void Save(SceneSnapshot& snapshot) const {
+		const ParticleSystem* const* running = ps.data();
+		size_t n = ps.size();
+		snapshot.AddField("SPOS", running, n, &ParticleSystem::centerPos);
+		snapshot.AddField("SEMI", running, n, &ParticleSystem::emitSpeed);
+		snapshot.AddField("SCON", running, n, &ParticleSystem::consist);
+		snapshot.AddField("SV  ", running, n, &ParticleSystem::systemV);
+		snapshot.AddField("SCO0", running, n, &ParticleSystem::sColor);
+		snapshot.AddField("SCO1", running, n, &ParticleSystem::eColor);
+		snapshot.AddField("SSIZ", running, n, &ParticleSystem::particleSize);
+		snapshot.AddField("SLIF", running, n, &ParticleSystem::particleLife);
+		snapshot.AddField("SSPD", running, n, &ParticleSystem::particleSpeed);
+		snapshot.AddField("SG  ", running, n, &ParticleSystem::particleG);
+		snapshot.AddField("SENA", running, n, &ParticleSystem::enabled);
+		snapshot.AddField("SORI", running, n, &ParticleSystem::oriented);
+		snapshot.AddField("SDIR", running, n, &ParticleSystem::orientation);
+		int* counts = snapshot.Add<int>("SPCT", n);
+		for (size_t i = 0; i < n; i++)counts[i] = (int)ps[i]->particles.size();
+
+		std::vector<Particle> all;
+		for (const ParticleSystem* system : ps)
+			all.insert(all.end(), system->particles.begin(), system->particles.end());
+		const Particle* p = all.data();
+		snapshot.AddField("PPOS", p, all.size(), &Particle::position);
+		snapshot.AddField("PROT", p, all.size(), &Particle::rotation);
+		snapshot.AddField("PCO0", p, all.size(), &Particle::startColor);
+		snapshot.AddField("PCO1", p, all.size(), &Particle::endColor);
+		snapshot.AddField("PSIZ", p, all.size(), &Particle::size);
+		snapshot.AddField("PATT", p, all.size(), &Particle::sizeAttenuation);
+		snapshot.AddField("PLIF", p, all.size(), &Particle::lifeTime);
+		snapshot.AddField("PAGE", p, all.size(), &Particle::livedTime);
+		snapshot.AddField("PV  ", p, all.size(), &Particle::V);
+		snapshot.AddField("PRV ", p, all.size(), &Particle::rotateV);
+		snapshot.AddField("PG  ", p, all.size(), &Particle::G);
+		snapshot.AddField("PFK ", p, all.size(), &Particle::f_k);
+
+		snapshot.AddField("FPOS", flashes.data(), flashes.size(), &Flash::position);
+		snapshot.AddField("FAGE", flashes.data(), flashes.size(), &Flash::age);
+	}
+	// the running systems are replaced by the snapshot's
+	bool Restore(const SceneSnapshot& snapshot) {
+		size_t n = snapshot.Count("SPCT");
+		const int* counts = snapshot.Get<int>("SPCT", n);
+		if (!counts)return false;
+		size_t total = 0;
+		for (size_t i = 0; i < n; i++)total += counts[i];
+		std::vector<Particle> all(total, Particle(glm::vec3(0.0f), glm::vec3(0.0f), glm::vec3(0.0f), glm::vec3(0.0f), glm::vec3(0.0f), 1.0f, 1.0f));
+		Particle* p = all.data();
+		bool particles = snapshot.GetField("PPOS", p, total, &Particle::position)
+			&& snapshot.GetField("PROT", p, total, &Particle::rotation)
+			&& snapshot.GetField("PCO0", p, total, &Particle::startColor)
+			&& snapshot.GetField("PCO1", p, total, &Particle::endColor)
+			&& snapshot.GetField("PSIZ", p, total, &Particle::size)
+			&& snapshot.GetField("PATT", p, total, &Particle::sizeAttenuation)
+			&& snapshot.GetField("PLIF", p, total, &Particle::lifeTime)
+			&& snapshot.GetField("PAGE", p, total, &Particle::livedTime)
+			&& snapshot.GetField("PV  ", p, total, &Particle::V)
+			&& snapshot.GetField("PRV ", p, total, &Particle::rotateV)
+			&& snapshot.GetField("PG  ", p, total, &Particle::G)
+			&& snapshot.GetField("PFK ", p, total, &Particle::f_k);
+		size_t flashCount = snapshot.Count("FPOS");
+		std::vector<Flash> restoredFlashes(flashCount);
+		if (!particles || !snapshot.GetField("FPOS", restoredFlashes.data(), flashCount, &Flash::position)
+			|| !snapshot.GetField("FAGE", restoredFlashes.data(), flashCount, &Flash::age))
+			return false;
+
+		for (ParticleSystem* system : ps)system->Deactivate(), systems.Release(system);
+		ps.clear();
+		for (size_t i = 0; i < n; i++)ps.push_back(systems.Acquire());
+		ParticleSystem** running = ps.data();
+		bool restored = snapshot.GetField("SPOS", running, n, &ParticleSystem::centerPos)
+			&& snapshot.GetField("SEMI", running, n, &ParticleSystem::emitSpeed)
+			&& snapshot.GetField("SCON", running, n, &ParticleSystem::consist)
+			&& snapshot.GetField("SV  ", running, n, &ParticleSystem::systemV)
+			&& snapshot.GetField("SCO0", running, n, &ParticleSystem::sColor)
+			&& snapshot.GetField("SCO1", running, n, &ParticleSystem::eColor)
+			&& snapshot.GetField("SSIZ", running, n, &ParticleSystem::particleSize)
+			&& snapshot.GetField("SLIF", running, n, &ParticleSystem::particleLife)
+			&& snapshot.GetField("SSPD", running, n, &ParticleSystem::particleSpeed)
+			&& snapshot.GetField("SG  ", running, n, &ParticleSystem::particleG)
+			&& snapshot.GetField("SENA", running, n, &ParticleSystem::enabled)
+			&& snapshot.GetField("SORI", running, n, &ParticleSystem::oriented)
+			&& snapshot.GetField("SDIR", running, n, &ParticleSystem::orientation);
+		size_t next = 0;
+		for (size_t i = 0; i < n; i++) {
+			ps[i]->particles.assign(all.begin() + next, all.begin() + next + counts[i]);
+			next += counts[i];
+		}
+		flashes = restoredFlashes;
+		return restored;
+	}
+
+	void PrintStats() {
+		if (!systems.acquired)return;
+		printf("particle systems: %lld started, at most %d at once, %d pooled\n", systems.acquired, systems.peak, systems.Capacity());
+	}
+
+private:
+	ObjectPool<ParticleSystem> systems;
+	std::vector<ParticleInstance> shown;
+	ParticleBatch batch;
 };
 
 #endif // !FIREANIMATION_H
\ No newline at end of file
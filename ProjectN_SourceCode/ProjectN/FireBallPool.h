@@ -0,0 +1,273 @@
+#pragma once
+#ifndef FIREBALLPOOL_H
+#define FIREBALLPOOL_H
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "Mesh.h"
+#include "Particle.h"
+#include "FireAnimation.h"
+#include "Frustum.h"
+#include "SceneSnapshot.h"
+
+#include <vector>
+#include <random>
+#include <algorithm>
+#include <cstdio>
+
+// one particle of a pooled fireball's trail
+struct TrailParticle {
+	glm::vec3 position, V, G;
+	glm::vec3 rotation, rotateV;
+	float size, age;
+};
+
+// Any number of fireballs in flight at once. Every slot, its trail and the meshes are allocated in Init;
+// a launch takes a free slot (or the oldest fireball if none is left) and an impact or leaving the room
+// hands it back, so steady rapid fire neither allocates nor rebuilds a mesh. The slots are FireBalls so
+// the collision code works on them as is, their own mesh and particle system stay unused.
+// The render pass only reads what Publish copied out, so the next Update can run meanwhile.
+// The newest fireball leads: it is the one lighting and shadowing the forward shaders.
+class FireBallPool {
+public:
+	std::vector<FireBall> balls;
+
+	// trail look, as the single fireball's particle system had it
+	glm::vec3 trailStart = glm::vec3(249.0f / 256, 212.0f / 256, 35.0f / 256), trailEnd = glm::vec3(1.0f, 78.0f / 256, 80.0f / 256);
+	float trailSize = 0.013f, trailLife = 0.8f, trailSpread = 0.18f;
+	float speed = 1.0f;
+
+	// counters
+	long long launches = 0, recycled = 0, stolen = 0;
+	int peak = 0;
+
+	// capacity fireballs with up to trailCapacity trail particles each, spread over the trail's life
+	void Init(int capacity, int trailCapacity = 64) {
+		balls = std::vector<FireBall>(capacity);
+		trailSlots = trailCapacity;
+		trails.assign((size_t)capacity * trailCapacity, TrailParticle());
+		trailHead.assign(capacity, 0);
+		trailCount.assign(capacity, 0);
+		emitCarry.assign(capacity, 0.0f);
+		freeSlots.clear();
+		for (int i = capacity - 1; i >= 0; i--)freeSlots.push_back(i);
+		live.clear();
+		live.reserve(capacity);
+		shownBalls.clear();
+		shownBalls.reserve(capacity);
+		shownTrails.clear();
+		shownTrails.reserve(trails.size());
+		// built once, every fireball is drawn with it
+		FireBall shape;
+		shape.GenerateMesh();
+		ballMesh = std::move(shape.mesh);
+	}
+
+	void Launch(glm::vec3 pos, glm::vec3 Dir) {
+		if (balls.empty())return;
+		int slot;
+		if (!freeSlots.empty())slot = freeSlots.back(), freeSlots.pop_back();
+		else {
+			// full: the oldest fireball is taken over
+			slot = live.front();
+			live.erase(live.begin());
+			stolen++;
+		}
+		FireBall& ball = balls[slot];
+		ball.position = pos;
+		ball.V = glm::length(Dir) ? Dir / glm::length(Dir) * speed : glm::vec3(0.0f, 0.0f, -speed);
+		ball.living = true;
+		trailHead[slot] = trailCount[slot] = 0;
+		emitCarry[slot] = 0.0f;
+		live.push_back(slot);
+		launches++;
+		peak = std::max(peak, (int)live.size());
+	}
+
+	// flight and trails of every living fireball; the ones that died since the last call go back to the pool
+	void Update(float deltaTime) {
+		Recycle();
+		for (int slot : live) {
+			FireBall& ball = balls[slot];
+			ball.position += ball.V * deltaTime;
+			if (abs(ball.position.x) >= ball.destroyLimit || abs(ball.position.y) >= ball.destroyLimit || abs(ball.position.z) >= ball.destroyLimit)
+				ball.living = false;
+			UpdateTrail(slot, deltaTime);
+		}
+		Recycle();
+	}
+
+	// copies what the render pass draws: the living fireballs, their trails and the lead
+	void Publish() {
+		shownBalls.clear();
+		shownTrails.clear();
+		for (int slot : live) {
+			if (!balls[slot].living)continue;
+			shownBalls.push_back(balls[slot].position);
+			const TrailParticle* ring = trails.data() + (size_t)slot * trailSlots;
+			for (int k = 0; k < trailCount[slot]; k++) {
+				const TrailParticle& p = ring[(trailHead[slot] + k) % trailSlots];
+				float t = std::min(p.age / trailLife, 1.0f);
+				shownTrails.push_back(ParticleInstance{ p.position, p.rotation, trailStart * (1.0f - t) + trailEnd * t, p.size });
+			}
+		}
+		lead.living = !shownBalls.empty();
+		if (lead.living)lead.position = shownBalls.back();
+		UpdateBounds();
+	}
+
+	// slots of the living fireballs, oldest first; one hit since the last Update is still listed, not living
+	const std::vector<int>& Living() const { return live; }
+
+	// as published: the fireballs' positions, newest last, and the newest
+	const std::vector<glm::vec3>& Shown() const { return shownBalls; }
+	int Count() const { return (int)shownBalls.size(); }
+	int Particles() const { return (int)shownTrails.size(); }
+	FireBall& Lead() { return lead; }
+
+	// all living fireballs as one shadow caster: placed at their centre, bounds around it
+	glm::mat4 GroupTransform() const { return glm::translate(glm::mat4(1.0f), groupCenter); }
+	const Bounds& GroupBounds() const { return groupBounds; }
+
+	// with a stream buffer, particleShader has to be the INSTANCED particle shader
+	void Draw(Shader& ballShader, Shader& particleShader, Frustum* frustum = nullptr, StreamBuffer* stream = nullptr) {
+		if (shownBalls.empty())return;
+		ballShader.use();
+		for (const glm::vec3& position : shownBalls) {
+			if (frustum && !frustum->Sphere(position + ballMesh.bounds.center, ballMesh.bounds.radius))continue;
+			ballShader.setMat4("model", glm::translate(glm::mat4(1.0f), position));
+			ballMesh.Draw(ballShader);
+		}
+		// every trail culled in one batch
+		trailBatch.Draw(particleShader, shownTrails, frustum, stream);
+	}
+
+	void renderShadow(Shader& shader) {
+		for (const glm::vec3& position : shownBalls) {
+			shader.setMat4("model", glm::translate(glm::mat4(1.0f), position));
+			ballMesh.Draw(shader);
+		}
+	}
+
+	// every slot with its trail, and which slots are free or flying; restores into a pool of the same size
+	void Save(SceneSnapshot& snapshot) const {
+		snapshot.AddField("FBPO", balls.data(), balls.size(), &FireBall::position);
+		snapshot.AddField("FBV ", balls.data(), balls.size(), &FireBall::V);
+		snapshot.AddField("FBLI", balls.data(), balls.size(), &FireBall::living);
+		snapshot.AddField("FTPO", trails.data(), trails.size(), &TrailParticle::position);
+		snapshot.AddField("FTV ", trails.data(), trails.size(), &TrailParticle::V);
+		snapshot.AddField("FTG ", trails.data(), trails.size(), &TrailParticle::G);
+		snapshot.AddField("FTRO", trails.data(), trails.size(), &TrailParticle::rotation);
+		snapshot.AddField("FTRV", trails.data(), trails.size(), &TrailParticle::rotateV);
+		snapshot.AddField("FTSZ", trails.data(), trails.size(), &TrailParticle::size);
+		snapshot.AddField("FTAG", trails.data(), trails.size(), &TrailParticle::age);
+		snapshot.AddArray("FTHD", trailHead);
+		snapshot.AddArray("FTCT", trailCount);
+		snapshot.AddArray("FCAR", emitCarry);
+		snapshot.AddArray("FFRE", freeSlots);
+		snapshot.AddArray("FLIV", live);
+	}
+	bool Restore(const SceneSnapshot& snapshot) {
+		if (snapshot.Count("FBPO") != balls.size() || snapshot.Count("FTPO") != trails.size()) {
+			printf("snapshot: %d fireball slots with %d trail particles each, the pool has %d with %d\n", (int)snapshot.Count("FBPO"),
+				snapshot.Count("FBPO") ? (int)(snapshot.Count("FTPO") / snapshot.Count("FBPO")) : 0, (int)balls.size(), trailSlots);
+			return false;
+		}
+		return snapshot.GetField("FBPO", balls.data(), balls.size(), &FireBall::position)
+			&& snapshot.GetField("FBV ", balls.data(), balls.size(), &FireBall::V)
+			&& snapshot.GetField("FBLI", balls.data(), balls.size(), &FireBall::living)
+			&& snapshot.GetField("FTPO", trails.data(), trails.size(), &TrailParticle::position)
+			&& snapshot.GetField("FTV ", trails.data(), trails.size(), &TrailParticle::V)
+			&& snapshot.GetField("FTG ", trails.data(), trails.size(), &TrailParticle::G)
+			&& snapshot.GetField("FTRO", trails.data(), trails.size(), &TrailParticle::rotation)
+			&& snapshot.GetField("FTRV", trails.data(), trails.size(), &TrailParticle::rotateV)
+			&& snapshot.GetField("FTSZ", trails.data(), trails.size(), &TrailParticle::size)
+			&& snapshot.GetField("FTAG", trails.data(), trails.size(), &TrailParticle::age)
+			&& snapshot.GetArray("FTHD", trailHead)
+			&& snapshot.GetArray("FTCT", trailCount)
+			&& snapshot.GetArray("FCAR", emitCarry)
+			&& snapshot.GetArray("FFRE", freeSlots)
+			&& snapshot.GetArray("FLIV", live);
+	}
+
+	void PrintStats() {
+		if (!launches)return;
+		printf("fireballs: %lld launched, at most %d at once, %lld recycled, %lld taken over with the pool full (%d slots)\n",
+			launches, peak, recycled, stolen, (int)balls.size());
+	}
+
+private:
+	std::vector<TrailParticle> trails;	// trailSlots per fireball, each a ring oldest first
+	std::vector<int> trailHead, trailCount;
+	std::vector<float> emitCarry;	// part of a trail particle left over from the last frame
+	int trailSlots = 0;
+	std::vector<int> freeSlots, live;
+	std::vector<glm::vec3> shownBalls;
+	std::vector<ParticleInstance> shownTrails;
+	FireBall lead;
+	Mesh ballMesh;
+	ParticleBatch trailBatch;
+	Bounds groupBounds;
+	glm::vec3 groupCenter = glm::vec3(0.0f);
+	std::mt19937 rng{ 7 };
+	std::uniform_real_distribution<float> unit{ -1.0f, 1.0f };
+
+	void Recycle() {
+		size_t kept = 0;
+		for (int slot : live) {
+			if (balls[slot].living)live[kept++] = slot;
+			else freeSlots.push_back(slot), recycled++;
+		}
+		live.resize(kept);
+	}
+
+	// ages the ring and emits at an even rate, so it is full just as its oldest particle burns out
+	void UpdateTrail(int slot, float deltaTime) {
+		const FireBall& ball = balls[slot];
+		TrailParticle* ring = trails.data() + (size_t)slot * trailSlots;
+		for (int k = 0; k < trailCount[slot]; k++) {
+			TrailParticle& p = ring[(trailHead[slot] + k) % trailSlots];
+			p.position += p.V * deltaTime;
+			// kept inside the room like the other particles
+			p.position.x = std::min(std::max(p.position.x, -1.0f), 1.0f);
+			p.position.y = std::min(std::max(p.position.y, -1.0f), 1.0f);
+			p.position.z = std::max(p.position.z, -1.0f);
+			p.rotation += p.rotateV * deltaTime;
+			p.V += (p.G - glm::length(p.V) * p.V * 0.1f) * deltaTime;
+			p.size -= trailSize / trailLife * deltaTime;
+			p.age += deltaTime;
+		}
+		while (trailCount[slot] && ring[trailHead[slot]].size <= 0.0f)
+			trailHead[slot] = (trailHead[slot] + 1) % trailSlots, trailCount[slot]--;
+
+		emitCarry[slot] += deltaTime * trailSlots / trailLife;
+		glm::vec3 back = glm::length(ball.V) ? -ball.V / glm::length(ball.V) : glm::vec3(0.0f);
+		while (emitCarry[slot] >= 1.0f) {
+			emitCarry[slot] -= 1.0f;
+			// the oldest particle makes room if the ring is full
+			if (trailCount[slot] == trailSlots)trailHead[slot] = (trailHead[slot] + 1) % trailSlots, trailCount[slot]--;
+			TrailParticle& p = ring[(trailHead[slot] + trailCount[slot]) % trailSlots];
+			p.position = ball.position;
+			p.V = glm::vec3(unit(rng), unit(rng), unit(rng)) * trailSpread + ball.V;
+			p.G = back;
+			p.rotation = p.rotateV = glm::vec3(unit(rng), unit(rng), unit(rng)) * 10.0f;
+			p.size = trailSize, p.age = 0.0f;
+			trailCount[slot]++;
+		}
+	}
+
+	void UpdateBounds() {
+		Bounds world;
+		for (const glm::vec3& position : shownBalls)world.Add(position);
+		groupCenter = world.empty ? glm::vec3(0.0f) : (world.min + world.max) * 0.5f;
+		groupBounds = Bounds();
+		if (world.empty)return;
+		glm::vec3 reach(ballMesh.bounds.radius);
+		groupBounds.Add(world.min - groupCenter - reach);
+		groupBounds.Add(world.max - groupCenter + reach);
+		groupBounds.Finish();
+	}
+};
+
+#endif // !FIREBALLPOOL_H
@@ -0,0 +1,28 @@
+#include "FrameArena.h"
+
+// the replacements have to be defined in exactly one translation unit, so they live here and not in the header
+
+void* operator new(std::size_t size) {
+	HeapCounter::Count();
+	if (void* p = std::malloc(size ? size : 1))return p;
+	throw std::bad_alloc();
+}
+void* operator new[](std::size_t size) {
+	HeapCounter::Count();
+	if (void* p = std::malloc(size ? size : 1))return p;
+	throw std::bad_alloc();
+}
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept {
+	HeapCounter::Count();
+	return std::malloc(size ? size : 1);
+}
+void* operator new[](std::size_t size, const std::nothrow_t&) noexcept {
+	HeapCounter::Count();
+	return std::malloc(size ? size : 1);
+}
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete[](void* p) noexcept { std::free(p); }
+void operator delete(void* p, std::size_t) noexcept { std::free(p); }
+void operator delete[](void* p, std::size_t) noexcept { std::free(p); }
+void operator delete(void* p, const std::nothrow_t&) noexcept { std::free(p); }
+void operator delete[](void* p, const std::nothrow_t&) noexcept { std::free(p); }
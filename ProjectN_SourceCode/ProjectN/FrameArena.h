@@ -0,0 +1,168 @@
+#pragma once
+#ifndef FRAMEARENA_H
+#define FRAMEARENA_H
+
+#include <vector>
+#include <memory>
+#include <algorithm>
+#include <atomic>
+#include <new>
+#include <cstdlib>
+#include <cstdio>
+#include <cstdarg>
+#include <cstddef>
+
+// Every heap allocation the program makes passes through here and is counted, in total and per thread,
+// so a frame can be checked for allocating: take Thread() before and after. The global operator new and
+// delete that count them are replaced in FrameArena.cpp, once for the whole program.
+struct HeapCounter {
+	static std::atomic<long long>& Total() {
+		static std::atomic<long long> total{ 0 };
+		return total;
+	}
+	static long long& Thread() {
+		static thread_local long long count = 0;
+		return count;
+	}
+	static void Count() {
+		Total().fetch_add(1, std::memory_order_relaxed);
+		Thread()++;
+	}
+};
+
+// One thread's heap allocations per frame (or step), counted once the warm-up frames are over
+struct FrameAllocations {
+	int warmup = 60;
+	int frames = 0, counted = 0, allocating = 0;
+	long long allocations = 0, worst = 0;
+
+	void Begin() { start = HeapCounter::Thread(); }
+	// the frame's allocations since Begin
+	long long End() {
+		long long n = HeapCounter::Thread() - start;
+		if (frames++ < warmup)return n;
+		counted++;
+		allocations += n;
+		if (n)allocating++;
+		worst = std::max(worst, n);
+		return n;
+	}
+	bool Clean() const { return allocating == 0; }
+
+	void PrintStats(const char* name) const {
+		if (!counted)return;
+		printf("%s: %lld heap allocations in %d frames after %d warm-up frames, %d frames allocated, at most %lld in one\n",
+			name, allocations, counted, warmup, allocating, worst);
+	}
+
+private:
+	long long start = 0;
+};
+
+// Linear allocator for what only lives until the end of the frame: bumps a pointer, and Reset drops
+// everything at once. A frame that needs more than the block adds one; the next Reset replaces them by
+// a single block as big as all of them, so after the first frames it never touches the heap again.
+// Only trivially destructible data belongs here, nothing is destroyed.
+class FrameArena {
+public:
+	// counters
+	size_t peakBytes = 0;
+	int growths = 0;
+
+	explicit FrameArena(size_t bytes = 64 << 10) { blocks.emplace_back(new unsigned char[bytes]), sizes.push_back(bytes); }
+
+	// the main thread's arena, reset by the render loop at the start of every frame
+	static FrameArena& Frame() {
+		static FrameArena arena(256 << 10);
+		return arena;
+	}
+
+	void* Allocate(size_t bytes, size_t align = alignof(std::max_align_t)) {
+		size_t start = (used + align - 1) / align * align;
+		if (start + bytes > sizes.back()) {
+			size_t size = std::max(sizes.back() * 2, bytes + align);
+			blocks.emplace_back(new unsigned char[size]), sizes.push_back(size);
+			growths++;
+			start = 0;
+		}
+		used = start + bytes;
+		total += bytes;
+		return blocks.back().get() + start;
+	}
+	template <class T>
+	T* New(size_t count) { return static_cast<T*>(Allocate(count * sizeof(T), alignof(T))); }
+
+	// printf into the arena, e.g. a shader permutation's defines
+	const char* Format(const char* format, ...) {
+		va_list args;
+		va_start(args, format);
+		va_list again;
+		va_copy(again, args);
+		int length = vsnprintf(nullptr, 0, format, args);
+		va_end(args);
+		char* text = New<char>(length + 1);
+		vsnprintf(text, length + 1, format, again);
+		va_end(again);
+		return text;
+	}
+
+	void Reset() {
+		peakBytes = std::max(peakBytes, total);
+		if (blocks.size() > 1) {
+			size_t size = 0;
+			for (size_t s : sizes)size += s;
+			blocks.clear(), sizes.clear();
+			blocks.emplace_back(new unsigned char[size]), sizes.push_back(size);
+		}
+		used = total = 0;
+	}
+
+	// bytes handed out since the last Reset
+	size_t Used() const { return total; }
+
+	void PrintStats(const char* name) const {
+		printf("%s arena: %.1f KB block, peak %.1f KB in a frame, grown %d times\n", name, sizes.back() / 1024.0, std::max(peakBytes, total) / 1024.0, growths);
+	}
+
+private:
+	std::vector<std::unique_ptr<unsigned char[]>> blocks;
+	std::vector<size_t> sizes;
+	size_t used = 0, total = 0;
+};
+
+// Objects of one type, recycled rather than freed: Acquire hands out a released one if there is one, so
+// whatever the object keeps (its vectors' capacity, its random engine) is kept too and the caller
+// re-initialises it. Storage comes in chunks and is never moved, so the pointers stay valid.
+template <class T, int CHUNK = 32>
+class ObjectPool {
+public:
+	// counters
+	int live = 0, peak = 0;
+	long long acquired = 0;
+
+	T* Acquire() {
+		if (freeList.empty()) {
+			chunks.emplace_back(new T[CHUNK]);
+			for (int i = CHUNK - 1; i >= 0; i--)freeList.push_back(&chunks.back()[i]);
+			// room for every object to come back without the free list growing
+			freeList.reserve(chunks.size() * CHUNK);
+		}
+		T* object = freeList.back();
+		freeList.pop_back();
+		live++, acquired++;
+		peak = std::max(peak, live);
+		return object;
+	}
+	void Release(T* object) {
+		freeList.push_back(object);
+		live--;
+	}
+
+	int Capacity() const { return (int)chunks.size() * CHUNK; }
+
+private:
+	std::vector<std::unique_ptr<T[]>> chunks;
+	std::vector<T*> freeList;
+};
+
+#endif // !FRAMEARENA_H
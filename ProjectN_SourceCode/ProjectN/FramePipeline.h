@@ -0,0 +1,129 @@
+#pragma once
+#ifndef FRAMEPIPELINE_H
+#define FRAMEPIPELINE_H
+
+#include "JobSystem.h"
+
+#include <vector>
+#include <functional>
+#include <type_traits>
+#include <new>
+#include <cstddef>
+#include <chrono>
+#include <cstdio>
+
+// Two-stage frame pipeline: while the main thread renders frame N from what the simulation published, a
+// worker already simulates frame N+1. The objects keep their drawn state apart from their simulated state
+// (Publish copies one to the other), and the main thread only publishes between steps, when no step is in
+// flight. Input that changes the simulation (launching, capturing, dragging) is deferred to that point
+// too. Off, the same steps run in sequence on the main thread, so both can be timed the same way.
+// A frame doesn't allocate: deferred commands are stored in place and the step's job captures only the pipeline.
+class FramePipeline {
+public:
+	bool enabled = false;
+
+	FramePipeline() {
+		commands.reserve(64);
+		applying.reserve(64);
+	}
+
+	// runs fn at the next Step, before the simulation goes on. fn is kept by value in a fixed-size command,
+	// so it may only capture a few plain values
+	template <typename F>
+	void Defer(F fn) {
+		static_assert(sizeof(F) <= sizeof(Command::storage), "deferred command captures too much");
+		static_assert(std::is_trivially_copyable<F>::value && std::is_trivially_destructible<F>::value, "deferred command must capture plain values");
+		commands.emplace_back();
+		Command& command = commands.back();
+		new (command.storage) F(fn);
+		command.call = [](void* f) { (*static_cast<F*>(f))(); };
+	}
+
+	// once per frame, before rendering: waits for the step in flight, applies the deferred input, publishes
+	// and starts the next step (or, off, simulates and then publishes)
+	void Step(JobSystem& jobs, float deltaTime, const std::function<void(float)>& simulate, const std::function<void()>& publish) {
+		auto now = std::chrono::steady_clock::now();
+		Stats& s = stats[mode];
+		if (started) {
+			s.frames++;
+			s.wallMs += Ms(frameStart, now);
+		}
+		started = true;
+		frameStart = now;
+
+		if (inFlight) {
+			jobs.Wait(inFlight);
+			inFlight.reset();
+			// the wait belongs to the frame that ran alongside the step
+			s.waitMs += Ms(now, std::chrono::steady_clock::now());
+			s.simMs += lastSimMs;
+		}
+		mode = enabled ? 1 : 0;
+		applying.swap(commands);
+		for (auto& command : applying)command.call(command.storage);
+		applying.clear();
+
+		if (enabled) {
+			publish();
+			// kept here so the job captures one pointer and fits std::function's inline storage; simulate
+			// outlives the step, which is always waited for (at the latest in Finish)
+			step = &simulate, stepDelta = deltaTime;
+			inFlight = jobs.Submit("frame", "simulate", [this] {
+				auto start = std::chrono::steady_clock::now();
+				(*step)(stepDelta);
+				lastSimMs = Ms(start, std::chrono::steady_clock::now());
+			});
+		}
+		else {
+			auto start = std::chrono::steady_clock::now();
+			simulate(deltaTime);
+			stats[0].simMs += Ms(start, std::chrono::steady_clock::now());
+			publish();
+		}
+	}
+
+	// time the main thread spent blocked outside the pipeline, e.g. on the buffer swap
+	void Idle(double ms) { stats[mode].idleMs += ms; }
+
+	// no step may be left running when the objects go away
+	void Finish(JobSystem& jobs) {
+		if (inFlight)jobs.Wait(inFlight), inFlight.reset();
+	}
+
+	// busy threads: the main thread minus its waits, plus the worker's steps when pipelined
+	void PrintStats() {
+		for (int m = 0; m < 2; m++) {
+			const Stats& s = stats[m];
+			if (!s.frames)continue;
+			double busy = s.wallMs - s.waitMs - s.idleMs + (m ? s.simMs : 0.0);
+			printf("frame pipeline %s: %d frames, %.2f ms per frame, simulation %.2f ms, main thread waited %.2f ms for it and %.2f ms on the swap, %.2f threads busy\n",
+				m ? "on" : "off", s.frames, s.wallMs / s.frames, s.simMs / s.frames, s.waitMs / s.frames, s.idleMs / s.frames,
+				s.wallMs > 0.0 ? busy / s.wallMs : 0.0);
+		}
+	}
+
+private:
+	struct Stats {
+		int frames = 0;
+		double wallMs = 0.0, simMs = 0.0, waitMs = 0.0, idleMs = 0.0;
+	};
+	Stats stats[2];	// pipeline off, on
+	int mode = 0;
+	bool started = false;
+	std::chrono::steady_clock::time_point frameStart;
+	JobHandle inFlight;
+	double lastSimMs = 0.0;	// written by the step, read once it is waited for
+	const std::function<void(float)>* step = nullptr;	// the step in flight and its time step
+	float stepDelta = 0.0f;
+	struct Command {
+		alignas(std::max_align_t) unsigned char storage[64];
+		void (*call)(void*);
+	};
+	std::vector<Command> commands, applying;
+
+	static double Ms(std::chrono::steady_clock::time_point a, std::chrono::steady_clock::time_point b) {
+		return std::chrono::duration<double, std::milli>(b - a).count();
+	}
+};
+
+#endif // !FRAMEPIPELINE_H
@@ -0,0 +1,153 @@
+#pragma once
+#ifndef FRAMESTATS_H
+#define FRAMESTATS_H
+
+#include "GLResource.h"
+#include "FrameArena.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cmath>
+
+// passes of the frame, for the draw counters
+enum RenderPass { PASS_SHADOW, PASS_SCENE, PASS_LIGHTING, PASS_EFFECTS, PASS_OVERLAY, PASS_COUNT };
+
+// What a frame cost and held: its time, with percentiles over the last WINDOW frames, the draw calls,
+// triangles and instances of each pass, the live particles, balls and fireballs, and memory (tracked GL
+// bytes, heap allocations, frame arena bytes). The draw sites (Mesh, ParticleBatch, DeferredRenderer)
+// report to the current pass; the loop brackets each frame, or each headless step, with BeginFrame and
+// EndFrame. EndFrame can append every frame as a CSV row. Nothing here allocates after Open.
+class FrameStats {
+public:
+	static const int WINDOW = 240;
+	struct Pass {
+		int draws = 0;
+		long long triangles = 0, instances = 0;
+	};
+
+	int pass = PASS_SCENE;	// where Draw counts, set by RenderPassScope
+	Pass current[PASS_COUNT], last[PASS_COUNT];	// this frame so far, and the last complete one
+	// set by the caller before EndFrame
+	int particles = 0, balls = 0, fireBalls = 0;
+	// sampled by EndFrame
+	long long glBytes = 0, heapAllocations = 0;
+	size_t arenaBytes = 0;
+
+	// counters
+	long long frames = 0;
+	float worstMs = 0.0f;
+
+	static FrameStats& Get() {
+		static FrameStats stats;
+		return stats;
+	}
+	static const char* Name(int pass) {
+		const char* names[PASS_COUNT] = { "shadow", "scene", "lighting", "effects", "overlay" };
+		return pass >= 0 && pass < PASS_COUNT ? names[pass] : "?";
+	}
+
+	// one draw call of the current pass
+	void Draw(long long triangles, long long instances = 1) {
+		Pass& p = current[pass];
+		p.draws++;
+		p.triangles += triangles * instances;
+		p.instances += instances;
+	}
+
+	void BeginFrame() {
+		for (Pass& p : current)p = Pass();
+		pass = PASS_SCENE;
+	}
+	void EndFrame(float ms) {
+		std::copy(current, current + PASS_COUNT, last);
+		times[frames % WINDOW] = ms;
+		frames++;
+		worstMs = std::max(worstMs, ms);
+		glBytes = GLResources::Get().Bytes();
+		long long heap = HeapCounter::Total().load(std::memory_order_relaxed);
+		heapAllocations = heap - lastHeap;
+		lastHeap = heap;
+		arenaBytes = FrameArena::Frame().Used();
+		if (csv)WriteRow();
+	}
+
+	// frame time at percentile p (0.5, 0.95, 0.99) of the window; the three at once cost one partial sort
+	float Percentile(float p) const {
+		int n = Count();
+		if (!n)return 0.0f;
+		std::copy(times, times + n, scratch);
+		int rank = std::min(std::max((int)std::ceil(p * n) - 1, 0), n - 1);
+		std::nth_element(scratch, scratch + rank, scratch + n);
+		return scratch[rank];
+	}
+	void Percentiles(float& p50, float& p95, float& p99) const {
+		int n = Count();
+		p50 = p95 = p99 = 0.0f;
+		if (!n)return;
+		std::copy(times, times + n, scratch);
+		const float at[3] = { 0.5f, 0.95f, 0.99f };
+		float* out[3] = { &p50, &p95, &p99 };
+		// each nth_element only has to look above the last one's element
+		int from = 0;
+		for (int i = 0; i < 3; i++) {
+			int rank = std::min(std::max((int)std::ceil(at[i] * n) - 1, from), n - 1);
+			std::nth_element(scratch + from, scratch + rank, scratch + n);
+			*out[i] = scratch[rank];
+			from = rank;
+		}
+	}
+	// frames in the window, and the one i back from the newest (0 is the newest)
+	int Count() const { return (int)std::min<long long>(frames, WINDOW); }
+	float Time(int i) const { return times[(frames - 1 - i) % WINDOW]; }
+
+	// every frame from here on as a row of path
+	bool Open(const char* path) {
+		csv = fopen(path, "w");
+		if (!csv) {
+			printf("frame stats: can't write %s\n", path);
+			return false;
+		}
+		fprintf(csv, "frame,ms,p50_ms,p95_ms,p99_ms");
+		for (int p = 0; p < PASS_COUNT; p++)fprintf(csv, ",%s_draws,%s_triangles,%s_instances", Name(p), Name(p), Name(p));
+		fprintf(csv, ",particles,balls,fireballs,gl_kb,heap_allocations,arena_kb\n");
+		return true;
+	}
+
+	void PrintStats() const {
+		if (!frames)return;
+		float p50, p95, p99;
+		Percentiles(p50, p95, p99);
+		printf("frame stats: %lld frames, the last %d at p50 %.2f ms, p95 %.2f ms, p99 %.2f ms, worst of the run %.2f ms\n", frames, Count(), p50, p95, p99, worstMs);
+		for (int p = 0; p < PASS_COUNT; p++)
+			if (last[p].draws)printf("  %-8s %5d draws %9lld triangles %7lld instances in the last frame\n", Name(p), last[p].draws, last[p].triangles, last[p].instances);
+	}
+
+	~FrameStats() {
+		if (csv)fclose(csv);
+	}
+
+private:
+	float times[WINDOW] = {};
+	mutable float scratch[WINDOW];
+	long long lastHeap = 0;
+	FILE* csv = nullptr;
+
+	void WriteRow() {
+		float p50, p95, p99;
+		Percentiles(p50, p95, p99);
+		fprintf(csv, "%lld,%.3f,%.3f,%.3f,%.3f", frames, Time(0), p50, p95, p99);
+		for (const Pass& p : last)fprintf(csv, ",%d,%lld,%lld", p.draws, p.triangles, p.instances);
+		fprintf(csv, ",%d,%d,%d,%.1f,%lld,%.1f\n", particles, balls, fireBalls, glBytes / 1024.0, heapAllocations, arenaBytes / 1024.0);
+	}
+};
+
+// draws in its scope count to pass
+struct RenderPassScope {
+	int previous;
+	explicit RenderPassScope(int pass) : previous(FrameStats::Get().pass) { FrameStats::Get().pass = pass; }
+	~RenderPassScope() { FrameStats::Get().pass = previous; }
+	RenderPassScope(const RenderPassScope&) = delete;
+	RenderPassScope& operator=(const RenderPassScope&) = delete;
+};
+
+#endif // !FRAMESTATS_H
@@ -0,0 +1,136 @@
+#pragma once
+#ifndef FRUSTUM_H
+#define FRUSTUM_H
+
+#include <glm/glm.hpp>
+
+#include <vector>
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__SSE__)
+#include <xmmintrin.h>
+#define FRUSTUM_SSE 1
+#endif
+
+// Axis-aligned box and enclosing sphere of a mesh or model, in its model space
+struct Bounds {
+	glm::vec3 min = glm::vec3(0.0f), max = glm::vec3(0.0f);
+	glm::vec3 center = glm::vec3(0.0f);
+	float radius = 0.0f;
+	bool empty = true;
+
+	void Add(const glm::vec3& p) {
+		if (empty)min = max = p, empty = false;
+		else min = glm::min(min, p), max = glm::max(max, p);
+	}
+	void Add(const Bounds& other) {
+		if (other.empty)return;
+		Add(other.min);
+		Add(other.max);
+	}
+	// sphere around the box; call after the last Add
+	void Finish() {
+		center = (min + max) * 0.5f;
+		radius = glm::length(max - center);
+	}
+	// sphere of the bounds placed by model, scaled by the matrix's largest axis
+	void WorldSphere(const glm::mat4& model, glm::vec3& worldCenter, float& worldRadius) const {
+		worldCenter = glm::vec3(model * glm::vec4(center, 1.0f));
+		float scale = std::max(glm::length(glm::vec3(model[0])), std::max(glm::length(glm::vec3(model[1])), glm::length(glm::vec3(model[2]))));
+		worldRadius = radius * scale;
+	}
+};
+
+// Spheres packed as separate x/y/z/r arrays, padded to a multiple of four so the frustum tests
+// four of them per instruction. ids maps each sphere back to the object it was added for.
+struct SphereBatch {
+	std::vector<float> x, y, z, r;
+	std::vector<int> ids;
+	std::vector<unsigned char> visible;	// filled by Frustum::Cull
+
+	void Clear() {
+		x.clear(), y.clear(), z.clear(), r.clear(), ids.clear();
+	}
+	void Add(int id, const glm::vec3& center, float radius) {
+		x.push_back(center.x), y.push_back(center.y), z.push_back(center.z), r.push_back(radius);
+		ids.push_back(id);
+	}
+	int Count() const { return (int)ids.size(); }
+};
+
+// The six planes of a view-projection matrix, normals pointing inwards
+class Frustum {
+public:
+	glm::vec4 planes[6];
+
+	// counters, reset by whoever reports them
+	int tested = 0, culled = 0;
+
+	Frustum() {}
+	explicit Frustum(const glm::mat4& viewProjection) { Extract(viewProjection); }
+
+	void Extract(const glm::mat4& m) {
+		// Gribb & Hartmann: rows of the matrix added to / subtracted from the w row
+		glm::vec4 row[4];
+		for (int i = 0; i < 4; i++)row[i] = glm::vec4(m[0][i], m[1][i], m[2][i], m[3][i]);
+		planes[0] = row[3] + row[0];
+		planes[1] = row[3] - row[0];
+		planes[2] = row[3] + row[1];
+		planes[3] = row[3] - row[1];
+		planes[4] = row[3] + row[2];
+		planes[5] = row[3] - row[2];
+		for (int i = 0; i < 6; i++)planes[i] /= glm::length(glm::vec3(planes[i]));
+	}
+
+	bool Sphere(const glm::vec3& center, float radius) {
+		tested++;
+		for (int i = 0; i < 6; i++)
+			if (glm::dot(glm::vec3(planes[i]), center) + planes[i].w < -radius) {
+				culled++;
+				return false;
+			}
+		return true;
+	}
+
+	void PrintStats(const char* pass) {
+		printf("%s culling: %d of %d bounds tested were outside (%.1f%%)\n", pass, culled, tested, tested ? 100.0 * culled / tested : 0.0);
+	}
+
+	// fills batch.visible for every sphere in the batch
+	void Cull(SphereBatch& batch) {
+		int n = batch.Count();
+		int padded = (n + 3) & ~3;
+		// padding spheres sit at the origin with radius -inf: always outside
+		batch.x.resize(padded, 0.0f), batch.y.resize(padded, 0.0f), batch.z.resize(padded, 0.0f);
+		batch.r.resize(padded, -INFINITY);
+		batch.visible.resize(padded);
+#ifdef FRUSTUM_SSE
+		for (int i = 0; i < padded; i += 4) {
+			__m128 x = _mm_loadu_ps(&batch.x[i]), y = _mm_loadu_ps(&batch.y[i]), z = _mm_loadu_ps(&batch.z[i]);
+			__m128 negR = _mm_sub_ps(_mm_setzero_ps(), _mm_loadu_ps(&batch.r[i]));
+			__m128 inside = _mm_cmpeq_ps(negR, negR);
+			for (int p = 0; p < 6; p++) {
+				__m128 d = _mm_add_ps(_mm_add_ps(_mm_mul_ps(x, _mm_set1_ps(planes[p].x)), _mm_mul_ps(y, _mm_set1_ps(planes[p].y))),
+					_mm_add_ps(_mm_mul_ps(z, _mm_set1_ps(planes[p].z)), _mm_set1_ps(planes[p].w)));
+				inside = _mm_and_ps(inside, _mm_cmpge_ps(d, negR));
+			}
+			int mask = _mm_movemask_ps(inside);
+			for (int k = 0; k < 4; k++)batch.visible[i + k] = (mask >> k) & 1;
+		}
+#else
+		for (int i = 0; i < padded; i++) {
+			bool inside = true;
+			for (int p = 0; p < 6 && inside; p++)
+				inside = planes[p].x * batch.x[i] + planes[p].y * batch.y[i] + planes[p].z * batch.z[i] + planes[p].w >= -batch.r[i];
+			batch.visible[i] = inside;
+		}
+#endif
+		batch.x.resize(n), batch.y.resize(n), batch.z.resize(n), batch.r.resize(n);
+		for (int i = 0; i < n; i++)culled += !batch.visible[i];
+		tested += n;
+	}
+};
+
+#endif // !FRUSTUM_H
@@ -0,0 +1,137 @@
+#pragma once
+#ifndef GLRESOURCE_H
+#define GLRESOURCE_H
+
+#include <glad/glad.h>
+
+#include <cstdio>
+
+// Live GL objects by kind, and the bytes known to be stored in them. Every GLObject reports here as it
+// is created, resized and deleted, so a run that keeps creating objects without deleting them shows.
+enum GLKind { GLRES_BUFFER, GLRES_VERTEX_ARRAY, GLRES_TEXTURE, GLRES_PROGRAM, GLRES_FRAMEBUFFER, GLRES_RENDERBUFFER, GLRES_KINDS };
+
+struct GLResources {
+	long long live[GLRES_KINDS] = {}, created[GLRES_KINDS] = {}, bytes[GLRES_KINDS] = {};
+	long long peakLive[GLRES_KINDS] = {}, peakBytes[GLRES_KINDS] = {};
+	bool context = true;	// cleared before the context goes, objects outliving it are only counted as deleted
+
+	static GLResources& Get() {
+		static GLResources tracker;
+		return tracker;
+	}
+	static const char* Name(int kind) {
+		const char* names[GLRES_KINDS] = { "buffers", "vertex arrays", "textures", "programs", "framebuffers", "renderbuffers" };
+		return names[kind];
+	}
+
+	long long Live() const {
+		long long total = 0;
+		for (int k = 0; k < GLRES_KINDS; k++)total += live[k];
+		return total;
+	}
+	long long Bytes() const {
+		long long total = 0;
+		for (int k = 0; k < GLRES_KINDS; k++)total += bytes[k];
+		return total;
+	}
+
+	void PrintStats() const {
+		for (int k = 0; k < GLRES_KINDS; k++) {
+			if (!created[k])continue;
+			printf("GL %s: %lld live (peak %lld), %lld created, %.1f KB (peak %.1f KB)\n",
+				Name(k), live[k], peakLive[k], created[k], bytes[k] / 1024.0, peakBytes[k] / 1024.0);
+		}
+	}
+
+private:
+	template <GLKind> friend class GLObject;
+	void Created(GLKind kind) {
+		live[kind]++, created[kind]++;
+		if (live[kind] > peakLive[kind])peakLive[kind] = live[kind];
+	}
+	void Resized(GLKind kind, long long delta) {
+		bytes[kind] += delta;
+		if (bytes[kind] > peakBytes[kind])peakBytes[kind] = bytes[kind];
+	}
+};
+
+// One GL object, deleted with its owner. Move-only: a copy would delete the same name twice, and a plain
+// copied name is what used to leak or dangle. Converts to the name, so GL calls take it as is.
+template <GLKind Kind>
+class GLObject {
+public:
+	GLObject() {}
+	~GLObject() { Reset(); }
+	GLObject(const GLObject&) = delete;
+	GLObject& operator=(const GLObject&) = delete;
+	GLObject(GLObject&& other) : id(other.id), size(other.size) { other.id = 0, other.size = 0; }
+	GLObject& operator=(GLObject&& other) {
+		if (this != &other) {
+			Reset();
+			id = other.id, size = other.size;
+			other.id = 0, other.size = 0;
+		}
+		return *this;
+	}
+
+	// takes over a name made elsewhere (a loader, glCreateProgram)
+	static GLObject Adopt(unsigned int name) {
+		GLObject object;
+		object.id = name;
+		if (name)GLResources::Get().Created(Kind);
+		return object;
+	}
+
+	// a new name, the old one is deleted first
+	void Create() {
+		Reset();
+		switch (Kind) {
+		case GLRES_BUFFER: glGenBuffers(1, &id); break;
+		case GLRES_VERTEX_ARRAY: glGenVertexArrays(1, &id); break;
+		case GLRES_TEXTURE: glGenTextures(1, &id); break;
+		case GLRES_PROGRAM: id = glCreateProgram(); break;
+		case GLRES_FRAMEBUFFER: glGenFramebuffers(1, &id); break;
+		case GLRES_RENDERBUFFER: glGenRenderbuffers(1, &id); break;
+		default: break;
+		}
+		if (id)GLResources::Get().Created(Kind);
+	}
+	void Reset() {
+		if (!id)return;
+		if (GLResources::Get().context)switch (Kind) {
+		case GLRES_BUFFER: glDeleteBuffers(1, &id); break;
+		case GLRES_VERTEX_ARRAY: glDeleteVertexArrays(1, &id); break;
+		case GLRES_TEXTURE: glDeleteTextures(1, &id); break;
+		case GLRES_PROGRAM: glDeleteProgram(id); break;
+		case GLRES_FRAMEBUFFER: glDeleteFramebuffers(1, &id); break;
+		case GLRES_RENDERBUFFER: glDeleteRenderbuffers(1, &id); break;
+		default: break;
+		}
+		Resize(0);
+		GLResources::Get().live[Kind]--;
+		id = 0;
+	}
+
+	// what the object stores now, for the byte count
+	void Resize(size_t bytes) {
+		GLResources::Get().Resized(Kind, (long long)bytes - (long long)size);
+		size = bytes;
+	}
+
+	unsigned int Name() const { return id; }
+	operator unsigned int() const { return id; }
+	size_t Size() const { return size; }
+
+private:
+	unsigned int id = 0;
+	size_t size = 0;
+};
+
+typedef GLObject<GLRES_BUFFER> GLBuffer;
+typedef GLObject<GLRES_VERTEX_ARRAY> GLVertexArray;
+typedef GLObject<GLRES_TEXTURE> GLTexture;
+typedef GLObject<GLRES_PROGRAM> GLProgram;
+typedef GLObject<GLRES_FRAMEBUFFER> GLFramebuffer;
+typedef GLObject<GLRES_RENDERBUFFER> GLRenderbuffer;
+
+#endif // !GLRESOURCE_H
@@ -0,0 +1,208 @@
+#pragma once
+#ifndef INPUTLOG_H
+#define INPUTLOG_H
+
+#include <glm/glm.hpp>
+
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+
+// one input that changes the simulation, applied between steps
+struct InputEvent {
+	enum Type : uint8_t { Activate, Launch, Capture, Drag, Release, TYPES };
+	uint8_t type = Activate;
+	glm::vec3 a = glm::vec3(0.0f), b = glm::vec3(0.0f);	// Launch: from, direction; Capture: ray origin, direction; Drag: x, y offset in a
+
+	static InputEvent Make(Type type, glm::vec3 a = glm::vec3(0.0f), glm::vec3 b = glm::vec3(0.0f)) {
+		InputEvent e;
+		e.type = type, e.a = a, e.b = b;
+		return e;
+	}
+	// payload floats written for each type
+	static int Floats(int type) {
+		const int floats[TYPES] = { 0, 6, 6, 2, 0 };
+		return type < TYPES ? floats[type] : 0;
+	}
+};
+
+// FNV-1a over the simulation state, for the log's checksums
+struct StateHash {
+	uint64_t value = 1469598103934665603ull;
+	void Add(const void* data, size_t bytes) {
+		const unsigned char* p = (const unsigned char*)data;
+		for (size_t i = 0; i < bytes; i++)value = (value ^ p[i]) * 1099511628211ull;
+	}
+	template <class T>
+	void Add(const T& v) { Add(&v, sizeof(T)); }
+};
+
+// Record and replay of everything the simulation is fed: per step the time step, the inputs applied
+// before it and, every CHECK_EVERY steps, a checksum of the state after it. With the random seed and the
+// arguments that shape the scene in the header, a replay runs the same steps again and any divergence
+// shows up at the first checksum after it; a replay with other scene arguments is refused.
+// File: "PNIL", version, seed, the scene arguments as a length and that many chars; then per step a count byte, a flags byte (1: checksum follows, 2: more
+// events of the same step follow), the time step as a float, each event as its type byte and payload
+// floats, the checksum.
+// BeginStep is called on the main thread as the step is started, EndStep where the step ran (a worker when
+// pipelined); the pipeline never runs them at the same time.
+class InputLog {
+public:
+	enum Mode { Off, Recording, Replaying };
+	static const int CHECK_EVERY = 30;
+	static const uint32_t VERSION = 2;
+
+	Mode mode = Off;
+	unsigned int seed = 0;
+	std::string scene;	// the arguments shaping the scene, as text
+
+	// counters
+	int steps = 0, checks = 0, mismatches = 0, firstMismatch = -1;
+	long long events = 0;
+
+	~InputLog() { Close(); }
+
+	bool Record(const char* path, unsigned int randomSeed, const std::string& sceneArgs) {
+		file = fopen(path, "wb");
+		if (!file) {
+			printf("input log: can't write %s\n", path);
+			return false;
+		}
+		seed = randomSeed;
+		scene = sceneArgs;
+		uint32_t version = VERSION, length = (uint32_t)scene.size();
+		fwrite("PNIL", 1, 4, file);
+		fwrite(&version, sizeof(version), 1, file);
+		fwrite(&seed, sizeof(seed), 1, file);
+		fwrite(&length, sizeof(length), 1, file);
+		fwrite(scene.data(), 1, length, file);
+		mode = Recording;
+		return true;
+	}
+	// sceneArgs has to match what the log was recorded with, or the steps would run on another scene
+	bool Replay(const char* path, const std::string& sceneArgs) {
+		file = fopen(path, "rb");
+		char magic[4] = {};
+		uint32_t version = 0, length = 0;
+		if (!file || fread(magic, 1, 4, file) != 4 || memcmp(magic, "PNIL", 4) || fread(&version, sizeof(version), 1, file) != 1 || version != VERSION
+			|| fread(&seed, sizeof(seed), 1, file) != 1 || fread(&length, sizeof(length), 1, file) != 1 || length > 1 << 20) {
+			printf("input log: %s isn't a readable log\n", path);
+			Close();
+			return false;
+		}
+		scene.resize(length);
+		if (length && fread(&scene[0], 1, length, file) != length) {
+			printf("input log: %s isn't a readable log\n", path);
+			Close();
+			return false;
+		}
+		if (scene != sceneArgs) {
+			printf("input log: %s was recorded with the scene \"%s\", not \"%s\"\n", path, scene.c_str(), sceneArgs.c_str());
+			Close();
+			return false;
+		}
+		mode = Replaying;
+		return true;
+	}
+	void Close() {
+		if (file)fclose(file);
+		file = nullptr;
+	}
+
+	// recording: an input for the next step
+	void Add(const InputEvent& e) {
+		if (mode == Recording)pending.push_back(e);
+	}
+
+	// recording: the step being started takes the inputs added since the last one
+	void BeginStep(float deltaTime) {
+		if (mode != Recording)return;
+		step.swap(pending);
+		pending.clear();
+		stepDelta = deltaTime;
+	}
+	// replaying: the next step's time step and inputs, false at the end of the log
+	bool ReadStep(float& deltaTime, std::vector<InputEvent>& out) {
+		out.clear();
+		uint8_t count, flags;
+		do {
+			if (mode != Replaying || fread(&count, 1, 1, file) != 1 || fread(&flags, 1, 1, file) != 1 || fread(&deltaTime, sizeof(float), 1, file) != 1)
+				return false;
+			for (int i = 0; i < count; i++) {
+				InputEvent e;
+				float payload[6] = {};
+				if (fread(&e.type, 1, 1, file) != 1 || e.type >= InputEvent::TYPES)return false;
+				int floats = InputEvent::Floats(e.type);
+				if (floats && fread(payload, sizeof(float), floats, file) != (size_t)floats)return false;
+				e.a = glm::vec3(payload[0], payload[1], payload[2]), e.b = glm::vec3(payload[3], payload[4], payload[5]);
+				out.push_back(e);
+			}
+			events += count;
+		} while (flags & 2);
+		expected = 0;
+		hasExpected = flags & 1;
+		if (hasExpected && fread(&expected, sizeof(expected), 1, file) != 1)return false;
+		return true;
+	}
+
+	// whether EndStep wants a checksum of the state after this step
+	bool WantsChecksum() const { return mode != Off && (steps + 1) % CHECK_EVERY == 0; }
+
+	// after the step: recording writes it out, replaying compares the checksum
+	void EndStep(uint64_t checksum = 0) {
+		if (mode == Off)return;
+		bool check = WantsChecksum();
+		steps++;
+		if (mode == Recording) {
+			// more inputs than a count byte holds (a long drag in one frame) go in several records
+			size_t done = 0;
+			do {
+				uint8_t count = (uint8_t)std::min<size_t>(step.size() - done, 255);
+				bool last = done + count == step.size();
+				uint8_t flags = last ? (check ? 1 : 0) : 2;
+				fwrite(&count, 1, 1, file);
+				fwrite(&flags, 1, 1, file);
+				fwrite(&stepDelta, sizeof(float), 1, file);
+				for (size_t i = done; i < done + count; i++) {
+					const InputEvent& e = step[i];
+					float payload[6] = { e.a.x, e.a.y, e.a.z, e.b.x, e.b.y, e.b.z };
+					fwrite(&e.type, 1, 1, file);
+					fwrite(payload, sizeof(float), InputEvent::Floats(e.type), file);
+				}
+				if (flags & 1)fwrite(&checksum, sizeof(checksum), 1, file);
+				done += count;
+				events += count;
+			} while (done < step.size());
+			if (check)checks++;
+			return;
+		}
+		if (!hasExpected)return;
+		checks++;
+		if (checksum != expected) {
+			mismatches++;
+			if (firstMismatch < 0)firstMismatch = steps;
+		}
+	}
+
+	void PrintStats() {
+		if (mode == Off)return;
+		printf("input log (%s, seed %u): %d steps, %lld inputs, %d checksums", mode == Recording ? "recorded" : "replayed", seed, steps, events, checks);
+		if (mode == Replaying) {
+			if (mismatches)printf(", %d mismatched, diverged by step %d\n", mismatches, firstMismatch);
+			else printf(", all matched\n");
+		}
+		else printf("\n");
+	}
+
+private:
+	FILE* file = nullptr;
+	std::vector<InputEvent> pending, step;
+	float stepDelta = 0.0f;
+	uint64_t expected = 0;
+	bool hasExpected = false;
+};
+
+#endif // !INPUTLOG_H
@@ -0,0 +1,250 @@
+#pragma once
+#ifndef JOBSYSTEM_H
+#define JOBSYSTEM_H
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <vector>
+#include <string>
+#include <chrono>
+#include <atomic>
+#include <algorithm>
+#include <cstdio>
+
+// A small job graph: jobs run once all their dependencies are done.
+// Worker jobs go to a thread pool, main jobs (anything touching GL) are queued
+// for the thread owning the context and executed in RunMainThread().
+// Finished jobs nobody holds a handle to any more are reused, and the queues only grow, so once warmed
+// up, submitting a job whose function fits std::function's inline storage doesn't touch the heap.
+struct Job {
+	std::string asset, stage;
+	std::function<void()> func;
+	bool onMain = false;
+	bool done = false;
+	int remainingDeps = 0;
+	std::vector<std::shared_ptr<Job>> dependents;
+
+	double startMs = 0.0, endMs = 0.0;
+	int thread = -1;
+};
+typedef std::shared_ptr<Job> JobHandle;
+
+struct JobRecord {
+	std::string asset, stage;
+	double startMs, endMs;
+	int thread;
+};
+
+class JobSystem {
+public:
+	bool recording = true;
+
+	JobSystem(unsigned int threadCount = 0) {
+		if (!threadCount) {
+			unsigned int hw = std::thread::hardware_concurrency();
+			threadCount = hw > 1 ? hw - 1 : 1;
+		}
+		origin = std::chrono::steady_clock::now();
+		for (unsigned int i = 0; i < threadCount; i++)
+			workers.emplace_back(&JobSystem::WorkerLoop, this, (int)i + 1);
+	}
+	~JobSystem() {
+		{
+			std::lock_guard<std::mutex> lock(mtx);
+			quit = true;
+		}
+		workerCv.notify_all();
+		for (auto& t : workers)t.join();
+	}
+
+	int ThreadCount() const { return (int)workers.size(); }
+
+	// run func on a worker thread once every handle in deps has finished
+	JobHandle Submit(const std::string& asset, const std::string& stage, std::function<void()> func, const std::vector<JobHandle>& deps = {}) {
+		return Add(asset, stage, std::move(func), deps, false);
+	}
+	// run func on the thread calling RunMainThread() once every handle in deps has finished
+	JobHandle SubmitMain(const std::string& asset, const std::string& stage, std::function<void()> func, const std::vector<JobHandle>& deps = {}) {
+		return Add(asset, stage, std::move(func), deps, true);
+	}
+
+	// executes main-thread jobs as they become ready, returns when no job is left
+	void RunMainThread() {
+		std::unique_lock<std::mutex> lock(mtx);
+		while (true) {
+			mainCv.wait(lock, [this] { return !mainQueue.empty() || pending == 0; });
+			if (mainQueue.empty())return;
+			JobHandle job = mainQueue.front();
+			mainQueue.pop_front();
+			lock.unlock();
+			Execute(job, 0);
+			lock.lock();
+		}
+	}
+	// blocks until job is finished, main-thread jobs are executed while waiting
+	void Wait(const JobHandle& job) {
+		std::unique_lock<std::mutex> lock(mtx);
+		while (!job->done) {
+			mainCv.wait(lock, [this, &job] { return !mainQueue.empty() || job->done; });
+			if (job->done)break;
+			JobHandle next = mainQueue.front();
+			mainQueue.pop_front();
+			lock.unlock();
+			Execute(next, 0);
+			lock.lock();
+		}
+	}
+
+	double NowMs() const {
+		return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - origin).count();
+	}
+
+	// per-asset timing of every recorded job since the system was created
+	void Report() {
+		std::vector<JobRecord> rec;
+		{
+			std::lock_guard<std::mutex> lock(mtx);
+			rec = records;
+		}
+		std::stable_sort(rec.begin(), rec.end(), [](const JobRecord& a, const JobRecord& b) { return a.asset < b.asset; });
+
+		printf("\n---------------------------- startup report ----------------------------\n");
+		printf("%-32s %-10s %-8s %10s %10s\n", "asset", "stage", "thread", "start(ms)", "time(ms)");
+		double wall = 0.0, mainMs = 0.0, workerMs = 0.0;
+		for (size_t i = 0; i < rec.size(); i++) {
+			const JobRecord& r = rec[i];
+			double t = r.endMs - r.startMs;
+			printf("%-32s %-10s %-8s %10.2f %10.2f\n", r.asset.c_str(), r.stage.c_str(), r.thread ? ("worker" + std::to_string(r.thread)).c_str() : "main", r.startMs, t);
+			wall = std::max(wall, r.endMs);
+			if (r.thread)workerMs += t;
+			else mainMs += t;
+		}
+		printf("------------------------------------------------------------------------\n");
+		printf("per asset (cpu = worker time, gpu = main-thread upload time):\n");
+		for (size_t i = 0; i < rec.size();) {
+			size_t j = i;
+			double cpu = 0.0, gpu = 0.0, ready = 0.0;
+			for (; j < rec.size() && rec[j].asset == rec[i].asset; j++) {
+				if (rec[j].thread)cpu += rec[j].endMs - rec[j].startMs;
+				else gpu += rec[j].endMs - rec[j].startMs;
+				ready = std::max(ready, rec[j].endMs);
+			}
+			printf("  %-30s cpu %8.2f ms  gpu %8.2f ms  ready at %8.2f ms\n", rec[i].asset.c_str(), cpu, gpu, ready);
+			i = j;
+		}
+		printf("wall %.2f ms, main thread %.2f ms, workers %.2f ms on %d threads\n", wall, mainMs, workerMs, ThreadCount());
+		printf("------------------------------------------------------------------------\n\n");
+	}
+
+private:
+	std::vector<std::thread> workers;
+	std::mutex mtx;
+	std::condition_variable workerCv, mainCv;
+	// first in, first out on a vector used as a ring; unlike a deque it allocates only to grow, not as it turns over
+	struct Queue {
+		std::vector<JobHandle> ring = std::vector<JobHandle>(64);
+		size_t head = 0, count = 0;
+
+		bool empty() const { return !count; }
+		const JobHandle& front() const { return ring[head]; }
+		void push_back(const JobHandle& job) {
+			if (count == ring.size()) {
+				std::vector<JobHandle> bigger(ring.size() * 2);
+				for (size_t i = 0; i < count; i++)bigger[i] = std::move(ring[(head + i) % ring.size()]);
+				ring.swap(bigger);
+				head = 0;
+			}
+			ring[(head + count++) % ring.size()] = job;
+		}
+		void pop_front() {
+			ring[head].reset();
+			head = (head + 1) % ring.size();
+			count--;
+		}
+	};
+	Queue workerQueue, mainQueue;
+	std::vector<JobHandle> jobs;	// every job made so far, for reuse
+	size_t nextJob = 0;
+	std::vector<JobRecord> records;
+	int pending = 0;
+	bool quit = false;
+	std::chrono::steady_clock::time_point origin;
+
+	JobHandle Add(const std::string& asset, const std::string& stage, std::function<void()> func, const std::vector<JobHandle>& deps, bool onMain) {
+		std::lock_guard<std::mutex> lock(mtx);
+		JobHandle job = Recycle();
+		job->asset = asset, job->stage = stage;
+		job->func = std::move(func);
+		job->onMain = onMain;
+		pending++;
+		for (const auto& dep : deps) {
+			if (!dep || dep->done)continue;
+			dep->dependents.push_back(job);
+			job->remainingDeps++;
+		}
+		if (!job->remainingDeps)Enqueue(job);
+		return job;
+	}
+
+	// a finished job only this system still holds, reset, or a new one. mtx must be held
+	JobHandle Recycle() {
+		for (size_t n = 0; n < jobs.size(); n++) {
+			JobHandle& job = jobs[nextJob = (nextJob + 1) % jobs.size()];
+			if (job.use_count() != 1 || !job->done)continue;
+			job->done = false;
+			job->remainingDeps = 0;
+			job->startMs = job->endMs = 0.0;
+			job->thread = -1;
+			return job;
+		}
+		jobs.push_back(std::make_shared<Job>());
+		return jobs.back();
+	}
+
+	// mtx must be held
+	void Enqueue(const JobHandle& job) {
+		if (job->onMain) {
+			mainQueue.push_back(job);
+			mainCv.notify_all();
+		}
+		else {
+			workerQueue.push_back(job);
+			workerCv.notify_one();
+		}
+	}
+
+	void Execute(const JobHandle& job, int thread) {
+		job->thread = thread;
+		job->startMs = NowMs();
+		job->func();
+		job->endMs = NowMs();
+		job->func = nullptr;
+
+		std::lock_guard<std::mutex> lock(mtx);
+		job->done = true;
+		if (recording)records.push_back({ job->asset, job->stage, job->startMs, job->endMs, thread });
+		for (const auto& next : job->dependents)
+			if (--next->remainingDeps == 0)Enqueue(next);
+		job->dependents.clear();
+		pending--;
+		mainCv.notify_all();
+	}
+
+	void WorkerLoop(int thread) {
+		std::unique_lock<std::mutex> lock(mtx);
+		while (true) {
+			workerCv.wait(lock, [this] { return quit || !workerQueue.empty(); });
+			if (quit)return;
+			JobHandle job = workerQueue.front();
+			workerQueue.pop_front();
+			lock.unlock();
+			Execute(job, thread);
+			lock.lock();
+		}
+	}
+};
+
+#endif // !JOBSYSTEM_H
@@ -0,0 +1,221 @@
+#pragma once
+#ifndef LIGHTCLUSTERS_H
+#define LIGHTCLUSTERS_H
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "Frustum.h"
+
+#include <vector>
+#include <random>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+
+struct PointLight {
+	glm::vec3 position = glm::vec3(0.0f);
+	glm::vec3 color = glm::vec3(1.0f);
+	float constant = 1.0f, linear = 0.14f, quadratic = 0.07f;
+	float ambient = 0.0f;	// share of color also added regardless of the surface's facing
+	bool shadowed = false;	// lit through the fireball's cube shadow
+	float radius = 0.0f;	// reach of the light; DeferredRenderer::AddLight works it out if 0
+};
+
+// Clustered light assignment on the CPU. The view frustum is cut into X * Y screen tiles and Z depth slices
+// (exponentially spaced, so clusters stay roughly cubic), and every light is binned into the clusters its
+// sphere touches. The result is a list of light indices per cluster, laid out as one array with an offset and
+// count per cluster, ready to be uploaded as is. Needs no GPU, so it can be tested and timed headless.
+class LightClusters {
+public:
+	static const int X = 16, Y = 9, Z = 24;
+	static const int COUNT = X * Y * Z;
+
+	std::vector<unsigned int> offsets, counts;	// per cluster, x fastest then y then z
+	std::vector<unsigned int> indices;	// light indices, counts[c] of them from offsets[c]
+
+	// counters
+	int frames = 0;
+	long long lightsAssigned = 0, pairs = 0;
+	double milliseconds = 0.0;
+
+	// the camera's projection; the cluster boxes are only rebuilt when it changes
+	void Setup(float fovy, float aspect, float nearPlane, float farPlane) {
+		if (fovy == setupFovy && aspect == setupAspect && nearPlane == zNear && farPlane == zFar)return;
+		setupFovy = fovy, setupAspect = aspect, zNear = nearPlane, zFar = farPlane;
+		float ty = std::tan(fovy * 0.5f), tx = ty * aspect;
+		logRatio = std::log(zFar / zNear);
+		for (int z = 0; z < Z; z++) {
+			float d0 = SliceDepth(z), d1 = SliceDepth(z + 1);
+			for (int y = 0; y < Y; y++)
+				for (int x = 0; x < X; x++) {
+					float nx0 = -1.0f + 2.0f * x / X, nx1 = -1.0f + 2.0f * (x + 1) / X;
+					float ny0 = -1.0f + 2.0f * y / Y, ny1 = -1.0f + 2.0f * (y + 1) / Y;
+					// the tile's x and y reach grow with depth, both ends of the slice bound it
+					int c = Index(x, y, z);
+					minX[c] = std::min(nx0 * tx * d0, nx0 * tx * d1), maxX[c] = std::max(nx1 * tx * d0, nx1 * tx * d1);
+					minY[c] = std::min(ny0 * ty * d0, ny0 * ty * d1), maxY[c] = std::max(ny1 * ty * d0, ny1 * ty * d1);
+					minZ[c] = -d1, maxZ[c] = -d0;
+				}
+		}
+	}
+
+	static int Index(int x, int y, int z) { return x + X * (y + Y * z); }
+
+	// bins every light by its sphere into the clusters of the current projection
+	void Assign(const std::vector<PointLight>& lights, const glm::mat4& view) {
+		auto start = std::chrono::high_resolution_clock::now();
+		counts.assign(COUNT, 0);
+		offsets.resize(COUNT);
+		foundCount = 0;
+		for (int i = 0; i < (int)lights.size(); i++) {
+			glm::vec3 p = glm::vec3(view * glm::vec4(lights[i].position, 1.0f));
+			float r = lights[i].radius, depth = -p.z;
+			if (depth + r < zNear || depth - r > zFar)continue;
+			int z0 = Slice(std::max(depth - r, zNear)), z1 = Slice(std::min(depth + r, zFar));
+			for (int z = z0; z <= z1; z++) {
+				// within a slice the tiles' x bounds only depend on x and their y bounds only on y,
+				// so the sphere's box narrows the tiles down before the exact tests
+				int slice = Index(0, 0, z);
+				int x0 = 0, x1 = X - 1, y0 = 0, y1 = Y - 1;
+				while (x0 < X && maxX[slice + x0] < p.x - r)x0++;
+				while (x1 >= x0 && minX[slice + x1] > p.x + r)x1--;
+				while (y0 < Y && maxY[slice + X * y0] < p.y - r)y0++;
+				while (y1 >= y0 && minY[slice + X * y1] > p.y + r)y1--;
+				for (int y = y0; y <= y1; y++)
+					TestRow(Index(0, y, z), x0, x1, p, r, i);
+			}
+		}
+		// counting sort of the (cluster, light) pairs into one index array
+		unsigned int total = 0;
+		for (int c = 0; c < COUNT; c++)offsets[c] = total, total += counts[c];
+		indices.resize(total);
+		cursor.assign(offsets.begin(), offsets.end());
+		for (size_t k = 0; k < foundCount; k++)indices[cursor[found[k].cluster]++] = found[k].light;
+
+		frames++;
+		lightsAssigned += lights.size();
+		pairs += foundCount;
+		milliseconds += std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+	}
+
+	// the same assignment testing every light against every cluster, for checking
+	void AssignBruteForce(const std::vector<PointLight>& lights, const glm::mat4& view) {
+		counts.assign(COUNT, 0);
+		offsets.resize(COUNT);
+		foundCount = 0;
+		for (int i = 0; i < (int)lights.size(); i++) {
+			glm::vec3 p = glm::vec3(view * glm::vec4(lights[i].position, 1.0f));
+			float r = lights[i].radius;
+			for (int c = 0; c < COUNT; c++) {
+				float dx = std::max(std::max(minX[c] - p.x, p.x - maxX[c]), 0.0f);
+				float dy = std::max(std::max(minY[c] - p.y, p.y - maxY[c]), 0.0f);
+				float dz = std::max(std::max(minZ[c] - p.z, p.z - maxZ[c]), 0.0f);
+				if (dx * dx + dy * dy + dz * dz <= r * r)Add(c, i);
+			}
+		}
+		unsigned int total = 0;
+		for (int c = 0; c < COUNT; c++)offsets[c] = total, total += counts[c];
+		indices.resize(total);
+		cursor.assign(offsets.begin(), offsets.end());
+		for (size_t k = 0; k < foundCount; k++)indices[cursor[found[k].cluster]++] = found[k].light;
+	}
+
+	float Near() const { return zNear; }
+	float Far() const { return zFar; }
+
+	void PrintStats() {
+		if (!frames)return;
+		printf("light clusters: %d frames, %.1f lights and %.1f cluster entries on average, %.3f ms per assignment\n",
+			frames, (double)lightsAssigned / frames, (double)pairs / frames, milliseconds / frames);
+	}
+
+private:
+	struct Pair { unsigned int cluster, light; };
+	// cluster boxes in view space, one array per bound so a row of four is one load
+	float minX[COUNT], maxX[COUNT], minY[COUNT], maxY[COUNT], minZ[COUNT], maxZ[COUNT];
+	std::vector<Pair> found;	// grown as needed and kept, only the first foundCount are this frame's
+	size_t foundCount = 0;
+	std::vector<unsigned int> cursor;
+	float setupFovy = 0.0f, setupAspect = 0.0f, zNear = 0.1f, zFar = 100.0f, logRatio = 1.0f;
+
+	float SliceDepth(int z) const { return zNear * std::exp(logRatio * z / Z); }
+	int Slice(float depth) const {
+		int z = (int)(std::log(depth / zNear) / logRatio * Z);
+		return std::min(std::max(z, 0), Z - 1);
+	}
+
+	void Add(int cluster, int light) {
+		if (found.size() <= foundCount)found.resize(found.size() * 2 + 64);
+		found[foundCount++] = Pair{ (unsigned int)cluster, (unsigned int)light };
+		counts[cluster]++;
+	}
+
+	// sphere against the boxes x0..x1 of a row, four at a time
+	void TestRow(int row, int x0, int x1, const glm::vec3& p, float r, int light) {
+#ifdef FRUSTUM_SSE
+		__m128 px = _mm_set1_ps(p.x), py = _mm_set1_ps(p.y), pz = _mm_set1_ps(p.z), r2 = _mm_set1_ps(r * r), zero = _mm_setzero_ps();
+		// whole groups of four, X is a multiple of four
+		for (int x = x0 & ~3; x <= x1; x += 4) {
+			int c = row + x;
+			__m128 dx = _mm_max_ps(_mm_max_ps(_mm_sub_ps(_mm_loadu_ps(minX + c), px), _mm_sub_ps(px, _mm_loadu_ps(maxX + c))), zero);
+			__m128 dy = _mm_max_ps(_mm_max_ps(_mm_sub_ps(_mm_loadu_ps(minY + c), py), _mm_sub_ps(py, _mm_loadu_ps(maxY + c))), zero);
+			__m128 dz = _mm_max_ps(_mm_max_ps(_mm_sub_ps(_mm_loadu_ps(minZ + c), pz), _mm_sub_ps(pz, _mm_loadu_ps(maxZ + c))), zero);
+			__m128 d2 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz));
+			int mask = _mm_movemask_ps(_mm_cmple_ps(d2, r2));
+			if (!mask)continue;
+			// written without branching on each bit, which are as good as random
+			if (found.size() < foundCount + 4)found.resize(found.size() * 2 + 64);
+			Pair* out = found.data() + foundCount;
+			unsigned int* count = counts.data() + c;
+			for (int k = 0; k < 4; k++) {
+				unsigned int bit = mask >> k & 1;
+				out[0] = Pair{ (unsigned int)(c + k), (unsigned int)light };
+				out += bit, count[k] += bit;
+			}
+			foundCount = out - found.data();
+		}
+#else
+		for (int x = x0; x <= x1; x++) {
+			int c = row + x;
+			float dx = std::max(std::max(minX[c] - p.x, p.x - maxX[c]), 0.0f);
+			float dy = std::max(std::max(minY[c] - p.y, p.y - maxY[c]), 0.0f);
+			float dz = std::max(std::max(minZ[c] - p.z, p.z - maxZ[c]), 0.0f);
+			if (dx * dx + dy * dy + dz * dz <= r * r)Add(c, light);
+		}
+#endif
+	}
+};
+
+// assignment time for growing numbers of lights scattered through the room, checked against the brute force
+inline void RunClusterBenchmark() {
+	printf("\n------------------------------ light clusters ------------------------------\n");
+	printf("%8s %12s %14s %10s\n", "lights", "entries", "ms/assign", "mismatch");
+	LightClusters clusters, reference;
+	clusters.Setup(glm::radians(45.0f), 1.0f, 0.1f, 100.0f);
+	reference.Setup(glm::radians(45.0f), 1.0f, 0.1f, 100.0f);
+	glm::mat4 view = glm::lookAt(glm::vec3(0.0f, 0.0f, 3.6f), glm::vec3(0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+	std::mt19937 rng(5);
+	std::uniform_real_distribution<float> unit(-1.0f, 1.0f), size(0.05f, 0.6f);
+	for (int n : { 10, 100, 1000, 4000 }) {
+		std::vector<PointLight> lights(n);
+		for (PointLight& l : lights)l.position = glm::vec3(unit(rng), unit(rng), unit(rng)), l.radius = size(rng);
+		const int RUNS = 50;
+		clusters.milliseconds = 0.0, clusters.frames = 0;
+		for (int run = 0; run < RUNS; run++)clusters.Assign(lights, view);
+		reference.AssignBruteForce(lights, view);
+		int mismatch = 0;
+		for (int c = 0; c < LightClusters::COUNT; c++) {
+			if (clusters.counts[c] != reference.counts[c]) {
+				mismatch++;
+				continue;
+			}
+			for (unsigned int k = 0; k < clusters.counts[c]; k++)
+				mismatch += clusters.indices[clusters.offsets[c] + k] != reference.indices[reference.offsets[c] + k];
+		}
+		printf("%8d %12d %14.4f %10d\n", n, (int)clusters.indices.size(), clusters.milliseconds / RUNS, mismatch);
+	}
+	printf("----------------------------------------------------------------------------\n\n");
+}
+
+#endif // !LIGHTCLUSTERS_H
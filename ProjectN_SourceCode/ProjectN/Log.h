@@ -0,0 +1,233 @@
+#pragma once
+#ifndef LOG_H
+#define LOG_H
+
+#include <atomic>
+#include <thread>
+#include <chrono>
+#include <memory>
+#include <cstdio>
+#include <cstdarg>
+#include <cstring>
+
+// levels; calls below LOG_LEVEL are compiled out, the rest are filtered at run time (Log::level)
+#define LOG_LEVEL_TRACE 0
+#define LOG_LEVEL_DEBUG 1
+#define LOG_LEVEL_INFO 2
+#define LOG_LEVEL_WARN 3
+#define LOG_LEVEL_ERROR 4
+#define LOG_LEVEL_OFF 5
+#ifndef LOG_LEVEL
+#define LOG_LEVEL LOG_LEVEL_DEBUG
+#endif
+
+// One call site's rate limit: at most perSecond lines a second, the rest are counted and the next line
+// that gets through says how many were left out
+struct LogSite {
+	const char* file;
+	int line;
+	int perSecond;
+	std::atomic<long long> window{ -1 };
+	std::atomic<int> written{ 0 };
+	std::atomic<int> suppressed{ 0 };
+	LogSite(const char* file, int line, int perSecond) :file(file), line(line), perSecond(perSecond) {}
+};
+
+// Logging that never waits on the terminal or the disk: the calling thread formats its line into a slot of
+// a fixed ring and goes on, a background thread writes the slots out in order. Any thread may log; the
+// ring is a bounded multi-producer queue (a sequence number per slot), and when it is full the line is
+// dropped and counted rather than blocking the caller. Nothing is allocated per line.
+class Log {
+public:
+	static const int SLOTS = 4096, TEXT = 240;
+
+	std::atomic<int> level{ LOG_LEVEL_INFO };
+
+	// counters
+	std::atomic<long long> written{ 0 }, dropped{ 0 }, suppressed{ 0 };
+
+	static Log& Get() {
+		static Log log;
+		return log;
+	}
+	static const char* Name(int level) {
+		const char* names[] = { "TRACE", "DEBUG", "INFO", "WARN", "ERROR" };
+		return level >= 0 && level < LOG_LEVEL_OFF ? names[level] : "?";
+	}
+	// "debug", "info", ... as given on the command line; -1 if unknown
+	static int Parse(const char* name) {
+		const char* names[] = { "trace", "debug", "info", "warn", "error", "off" };
+		for (int i = 0; i <= LOG_LEVEL_OFF; i++)
+			if (!strcmp(name, names[i]))return i;
+		return -1;
+	}
+
+	bool Enabled(int lineLevel) const { return lineLevel >= level.load(std::memory_order_relaxed); }
+
+	// lines go to path instead of the console; call before anything is logged
+	bool Open(const char* path) {
+		FILE* file = fopen(path, "w");
+		if (!file) {
+			printf("log: can't write %s\n", path);
+			return false;
+		}
+		out = file;
+		return true;
+	}
+
+	void Write(LogSite& site, int lineLevel, const char* format, ...) {
+		// rate limit per call site, over one-second windows
+		long long second = (long long)(NowMs() / 1000.0);
+		long long window = site.window.load(std::memory_order_relaxed);
+		int skipped = 0;
+		if (window != second && site.window.compare_exchange_strong(window, second)) {
+			site.written.store(0);
+			skipped = site.suppressed.exchange(0);
+		}
+		if (site.written.fetch_add(1) >= site.perSecond) {
+			site.suppressed.fetch_add(1);
+			suppressed.fetch_add(1, std::memory_order_relaxed);
+			return;
+		}
+
+		Slot* slot = Claim();
+		if (!slot) {
+			dropped.fetch_add(1, std::memory_order_relaxed);
+			return;
+		}
+		const char* file = strrchr(site.file, '/');
+		const char* backslash = strrchr(site.file, '\\');
+		file = backslash > file ? backslash : file;
+		int n = snprintf(slot->text, TEXT, "%10.3f %-5s %s:%d ", NowMs() / 1000.0, Name(lineLevel), file ? file + 1 : site.file, site.line);
+		if (skipped && n >= 0 && n < TEXT)
+			n += snprintf(slot->text + n, TEXT - n, "(%d like this left out) ", skipped);
+		if (n >= 0 && n < TEXT) {
+			va_list args;
+			va_start(args, format);
+			vsnprintf(slot->text + n, TEXT - n, format, args);
+			va_end(args);
+		}
+		Publish(slot);
+	}
+
+	// returns once everything logged so far is written out
+	void Flush() {
+		size_t end = head.load();
+		if (started)
+			while (tail.load(std::memory_order_acquire) < end)std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		else Drain();
+		fflush(out);
+	}
+
+	void PrintStats() {
+		if (!written && !dropped && !suppressed)return;
+		printf("log: %lld lines written, %lld dropped with the ring full, %lld over their call site's rate\n", written.load(), dropped.load(), suppressed.load());
+	}
+
+	~Log() {
+		quit = true;
+		if (writer.joinable())writer.join();
+		Drain();
+		fflush(out);
+		if (out != stdout)fclose(out);
+	}
+
+private:
+	struct Slot {
+		std::atomic<size_t> sequence;
+		char text[TEXT];
+	};
+	std::unique_ptr<Slot[]> ring;
+	std::atomic<size_t> head{ 0 };	// next slot to claim
+	std::atomic<size_t> tail{ 0 };	// next slot to write out, advanced by the writer thread only
+	FILE* out = stdout;
+	std::atomic<bool> quit{ false }, started{ false };
+	std::thread writer;
+	std::chrono::steady_clock::time_point origin = std::chrono::steady_clock::now();
+
+	Log() : ring(new Slot[SLOTS]) {
+		for (size_t i = 0; i < SLOTS; i++)ring[i].sequence.store(i);
+	}
+
+	double NowMs() const { return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - origin).count(); }
+
+	// a free slot for this line, nullptr if the writer is a whole ring behind
+	Slot* Claim() {
+		size_t position = head.load(std::memory_order_relaxed);
+		while (true) {
+			Slot& slot = ring[position % SLOTS];
+			size_t sequence = slot.sequence.load(std::memory_order_acquire);
+			if (sequence == position) {
+				if (head.compare_exchange_weak(position, position + 1, std::memory_order_relaxed))return &slot;
+			}
+			else if (sequence < position)return nullptr;
+			else position = head.load(std::memory_order_relaxed);
+		}
+	}
+	void Publish(Slot* slot) {
+		size_t position = slot->sequence.load(std::memory_order_relaxed);
+		slot->sequence.store(position + 1, std::memory_order_release);
+		// the writer starts with the first line, so a run that logs nothing has no extra thread
+		bool expected = false;
+		if (!started.load(std::memory_order_relaxed) && started.compare_exchange_strong(expected, true))
+			writer = std::thread([this] { Run(); });
+	}
+
+	// writes out the lines ready in order; false when there were none
+	bool Drain() {
+		bool any = false;
+		while (true) {
+			size_t position = tail.load(std::memory_order_relaxed);
+			Slot& slot = ring[position % SLOTS];
+			if (slot.sequence.load(std::memory_order_acquire) != position + 1)return any;
+			fputs(slot.text, out);
+			fputc('\n', out);
+			written.fetch_add(1, std::memory_order_relaxed);
+			slot.sequence.store(position + SLOTS, std::memory_order_release);
+			tail.store(position + 1, std::memory_order_release);
+			any = true;
+		}
+	}
+	void Run() {
+		while (!quit) {
+			if (Drain())fflush(out);
+			else std::this_thread::sleep_for(std::chrono::milliseconds(2));
+		}
+	}
+};
+
+#define LOG_AT(lineLevel, perSecond, ...) do { \
+	if (Log::Get().Enabled(lineLevel)) { \
+		static LogSite logSite(__FILE__, __LINE__, perSecond); \
+		Log::Get().Write(logSite, lineLevel, __VA_ARGS__); \
+	} \
+} while (0)
+
+// printf-style; every call site writes at most 20 lines a second (LOG_AT sets another rate)
+#if LOG_LEVEL <= LOG_LEVEL_TRACE
+#define LOG_TRACE(...) LOG_AT(LOG_LEVEL_TRACE, 20, __VA_ARGS__)
+#else
+#define LOG_TRACE(...) do {} while (0)
+#endif
+#if LOG_LEVEL <= LOG_LEVEL_DEBUG
+#define LOG_DEBUG(...) LOG_AT(LOG_LEVEL_DEBUG, 20, __VA_ARGS__)
+#else
+#define LOG_DEBUG(...) do {} while (0)
+#endif
+#if LOG_LEVEL <= LOG_LEVEL_INFO
+#define LOG_INFO(...) LOG_AT(LOG_LEVEL_INFO, 20, __VA_ARGS__)
+#else
+#define LOG_INFO(...) do {} while (0)
+#endif
+#if LOG_LEVEL <= LOG_LEVEL_WARN
+#define LOG_WARN(...) LOG_AT(LOG_LEVEL_WARN, 20, __VA_ARGS__)
+#else
+#define LOG_WARN(...) do {} while (0)
+#endif
+#if LOG_LEVEL <= LOG_LEVEL_ERROR
+#define LOG_ERROR(...) LOG_AT(LOG_LEVEL_ERROR, 20, __VA_ARGS__)
+#else
+#define LOG_ERROR(...) do {} while (0)
+#endif
+
+#endif // !LOG_H
@@ -7,9 +7,13 @@
 #include <glm/gtc/matrix_transform.hpp>
 
 #include "Shader.h"
+#include "Frustum.h"
+#include "GLResource.h"
+#include "FrameStats.h"
 
 #include <string>
 #include <vector>
+#include <cstdio>
 using namespace std;
 
 #define MAX_BONE_INFLUENCE 4
@@ -37,13 +41,19 @@ struct Texture {
     string path;
 };
 
+// set by the active TextureStreamer, Draw reports every texture it binds through it
+void (*TextureBindHook)(unsigned int id) = nullptr;
+
+// Owns its vertex array and buffers: they go with the mesh, and a mesh is moved, never copied.
 class Mesh {
 public:
     // mesh Data
     vector<Vertex>       vertices;
     vector<unsigned int> indices;
     vector<Texture>      textures;
-    unsigned int VAO;
+    GLVertexArray VAO;
+    // model-space box and sphere of the vertices, updated by every setup
+    Bounds bounds;
 
     // constructor
     Mesh(vector<Vertex> vertices, vector<unsigned int> indices, vector<Texture> textures)
@@ -79,31 +89,46 @@ public:
         {
             glActiveTexture(GL_TEXTURE0 + i); // active proper texture unit before binding
             // retrieve texture number (the N in diffuse_textureN)
-            string number;
-            string name = textures[i].type;
+            unsigned int number = 0;
+            const string& name = textures[i].type;
             if (name == "texture_diffuse")
-                number = std::to_string(diffuseNr++);
+                number = diffuseNr++;
             else if (name == "texture_specular")
-                number = std::to_string(specularNr++); // transfer unsigned int to string
+                number = specularNr++;
             else if (name == "texture_normal")
-                number = std::to_string(normalNr++); // transfer unsigned int to string
+                number = normalNr++;
             else if (name == "texture_height")
-                number = std::to_string(heightNr++); // transfer unsigned int to string
-
-            // now set the sampler to the correct texture unit
-            glUniform1i(glGetUniformLocation(shader.ID, (name + number).c_str()), i);
+                number = heightNr++;
+
+            // now set the sampler to the correct texture unit; the name is put together on the stack, this runs every draw
+            char uniform[64];
+            if (number)
+                snprintf(uniform, sizeof(uniform), "%s%u", name.c_str(), number);
+            else
+                snprintf(uniform, sizeof(uniform), "%s", name.c_str());
+            glUniform1i(glGetUniformLocation(shader.ID, uniform), i);
             // and finally bind the texture
             glBindTexture(GL_TEXTURE_2D, textures[i].id);
+            if (TextureBindHook)
+                TextureBindHook(textures[i].id);
         }
 
         // draw mesh
         glBindVertexArray(VAO);
         glDrawElements(GL_TRIANGLES, static_cast<unsigned int>(indices.size()), GL_UNSIGNED_INT, 0);
+        FrameStats::Get().Draw(indices.size() / 3);
         glBindVertexArray(0);
 
         // always good practice to set everything back to defaults once configured.
         glActiveTexture(GL_TEXTURE0);
     }
+    void computeBounds()
+    {
+        bounds = Bounds();
+        for (const Vertex& vertex : vertices)
+            bounds.Add(vertex.Position);
+        bounds.Finish();
+    }
     void Output()
     {
         printf("verdice size: %d\n", vertices.size());
@@ -118,15 +143,19 @@ public:
 
 private:
     // render data 
-    unsigned int VBO, EBO;
+    GLBuffer VBO, EBO;
 
     // initializes all the buffer objects/arrays
     void setupMesh()
     {
-        // create buffers/arrays
-        glGenVertexArrays(1, &VAO);
-        glGenBuffers(1, &VBO);
-        glGenBuffers(1, &EBO);
+        computeBounds();
+        // create buffers/arrays; a mesh that is set up again refills the ones it already has
+        if (!VAO)
+        {
+            VAO.Create();
+            VBO.Create();
+            EBO.Create();
+        }
 
         glBindVertexArray(VAO);
         // load data into vertex buffers
@@ -135,9 +164,11 @@ private:
         // The effect is that we can simply pass a pointer to the struct and it translates perfectly to a glm::vec3/2 array which
         // again translates to 3/2 floats which translates to a byte array.
         glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(Vertex), &vertices[0], GL_STATIC_DRAW);
+        VBO.Resize(vertices.size() * sizeof(Vertex));
 
         glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
         glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), &indices[0], GL_STATIC_DRAW);
+        EBO.Resize(indices.size() * sizeof(unsigned int));
 
         // set the vertex attribute pointers
         // vertex Positions
@@ -0,0 +1,171 @@
+#pragma once
+#ifndef MESHCOLLIDER_H
+#define MESHCOLLIDER_H
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "Model.h"
+#include "BVH.h"
+
+#include <vector>
+#include <string>
+#include <random>
+#include <chrono>
+#include <cstdio>
+
+struct Contact {
+	glm::vec3 point = glm::vec3(0.0f);	// on the surface, world space
+	glm::vec3 normal = glm::vec3(0.0f, 1.0f, 0.0f);	// from the surface towards the sphere
+	float depth = 0.0f;	// how far the sphere reaches into the surface
+	int triangle = -1;
+};
+
+// Triangle-accurate collision against a static mesh. The triangle BVH is built once in model space and
+// spheres are brought into it, so the transform has to be rigid with a uniform scale.
+class MeshCollider {
+public:
+	// counters
+	mutable long long queries = 0, contacts = 0;
+
+	void Build(const Model& model, const glm::mat4& transform) { Build(model.meshes, transform); }
+	void Build(const std::vector<Mesh>& meshes, const glm::mat4& transform) {
+		shape.Build(meshes);
+		model = transform;
+		inverse = glm::inverse(transform);
+		scale = glm::length(glm::vec3(transform[0]));
+		worldMin = glm::vec3(INFINITY), worldMax = glm::vec3(-INFINITY);
+		const Bounds& b = shape.bounds;
+		for (int c = 0; c < 8; c++) {
+			glm::vec3 corner((c & 1) ? b.max.x : b.min.x, (c & 2) ? b.max.y : b.min.y, (c & 4) ? b.max.z : b.min.z);
+			glm::vec3 w = glm::vec3(transform * glm::vec4(corner, 1.0f));
+			worldMin = glm::min(worldMin, w), worldMax = glm::max(worldMax, w);
+		}
+	}
+
+	// the sphere's contact with the surface, if it touches it
+	bool Collide(const glm::vec3& center, float radius, Contact& contact) const {
+		queries++;
+		if (center.x + radius < worldMin.x || center.y + radius < worldMin.y || center.z + radius < worldMin.z ||
+			center.x - radius > worldMax.x || center.y - radius > worldMax.y || center.z - radius > worldMax.z)return false;
+		glm::vec3 local = glm::vec3(inverse * glm::vec4(center, 1.0f));
+		float distance = radius / scale;
+		glm::vec3 closest;
+		int triangle = -1;
+		if (!shape.ClosestPoint(local, distance, closest, triangle))return false;
+		glm::vec3 normal;
+		contact.depth = Resolve(shape, local, closest, distance, triangle, radius, scale, normal);
+		contact.point = glm::vec3(model * glm::vec4(closest, 1.0f));
+		contact.normal = glm::normalize(glm::vec3(model * glm::vec4(normal, 0.0f)));
+		contact.triangle = triangle;
+		contacts++;
+		return true;
+	}
+
+	// the model-space normal pushing the sphere out and its depth in world units, from the closest point at
+	// distance (model units). A centre on the surface has no direction of its own and takes the face's; one
+	// behind the face, a fast sphere that has already crossed it, is pushed back out through the front
+	static float Resolve(const MeshBVH& shape, const glm::vec3& local, const glm::vec3& closest, float distance, int triangle, float radius, float scale, glm::vec3& normal) {
+		glm::vec3 face = shape.FaceNormal(triangle);
+		if (distance <= 1e-6f) {
+			normal = face;
+			return radius;
+		}
+		normal = (local - closest) / distance;
+		if (!(glm::dot(normal, face) < 0.0f))return radius - distance * scale;	// a degenerate face has no side
+		normal = -normal;
+		return radius + distance * scale;
+	}
+
+	const MeshBVH& Shape() const { return shape; }
+	const glm::mat4& Transform() const { return model; }
+
+private:
+	MeshBVH shape;
+	glm::mat4 model = glm::mat4(1.0f), inverse = glm::mat4(1.0f);
+	float scale = 1.0f;
+	glm::vec3 worldMin = glm::vec3(0.0f), worldMax = glm::vec3(0.0f);
+};
+
+// A static model furnishing the room, drawn in one colour and collided with triangle by triangle
+class Prop {
+public:
+	Model model;
+	glm::mat4 transform;
+	glm::vec3 color;
+	MeshCollider collider;
+
+	Prop(const std::string& path, const glm::mat4& modelMatrix, const glm::vec3& col) :model(path), transform(modelMatrix), color(col) {
+		collider.Build(model, transform);
+	}
+
+	bool InView(Frustum* frustum) const {
+		if (!frustum)return true;
+		glm::vec3 center;
+		float radius;
+		model.bounds.WorldSphere(transform, center, radius);
+		return frustum->Sphere(center, radius);
+	}
+	void Draw(Shader& shader) {
+		shader.setMat4("model", transform);
+		model.Draw(shader);
+		shader.setMat4("model", glm::mat4(1.0f));
+	}
+};
+
+// sphere-mesh queries per second through the BVH against testing every triangle, for spheres of the given
+// radius scattered around the collider. The two must agree on every contact depth (touching triangles
+// can tie, so the triangles themselves may differ). Then spheres centred just behind faces have to be
+// pushed out through the front, deeper than their radius
+inline void RunContactBenchmark(const char* name, const MeshCollider& collider, float radius) {
+	const MeshBVH& shape = collider.Shape();
+	glm::mat4 inverse = glm::inverse(collider.Transform());
+	float scale = glm::length(glm::vec3(collider.Transform()[0]));
+	std::mt19937 rng(11);
+	std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+	const Bounds& b = shape.bounds;
+	const int QUERIES = 20000;
+	std::vector<glm::vec3> centers(QUERIES);
+	for (int i = 0; i < QUERIES; i++) {
+		glm::vec3 t(unit(rng), unit(rng), unit(rng));
+		glm::vec3 local = b.min - (b.max - b.min) * 0.1f + (b.max - b.min) * 1.2f * t;
+		centers[i] = glm::vec3(collider.Transform() * glm::vec4(local, 1.0f));
+	}
+	std::vector<float> fast(QUERIES), slow(QUERIES);	// contact depth, -1 for none
+	auto start = std::chrono::high_resolution_clock::now();
+	for (int i = 0; i < QUERIES; i++) {
+		Contact contact;
+		fast[i] = collider.Collide(centers[i], radius, contact) ? contact.depth : -1.0f;
+	}
+	auto middle = std::chrono::high_resolution_clock::now();
+	for (int i = 0; i < QUERIES; i++) {
+		glm::vec3 local = glm::vec3(inverse * glm::vec4(centers[i], 1.0f)), closest;
+		float distance = radius / scale;
+		int triangle = -1;
+		glm::vec3 normal;
+		slow[i] = shape.ClosestPointLinear(local, distance, closest, triangle) ? MeshCollider::Resolve(shape, local, closest, distance, triangle, radius, scale, normal) : -1.0f;
+	}
+	auto end = std::chrono::high_resolution_clock::now();
+	int hits = 0, mismatch = 0;
+	for (int i = 0; i < QUERIES; i++)hits += fast[i] >= 0.0f, mismatch += std::fabs(fast[i] - slow[i]) > 1e-5f;
+	double bvhSeconds = std::chrono::duration<double>(middle - start).count();
+	double linearSeconds = std::chrono::duration<double>(end - middle).count();
+
+	// a fifth of the radius behind the middle of a face; a neighbouring face can be closer on a bent or
+	// thin surface, so only the cases where this face is the closest one count
+	int behind = 0, wrong = 0;
+	for (int t = 0; t < shape.TriangleCount(); t += std::max(1, shape.TriangleCount() / 500)) {
+		glm::vec3 face = shape.FaceNormal(t);
+		if (!std::isfinite(face.x))continue;
+		glm::vec3 middle = shape.Centroid(t) - face * (radius * 0.2f / scale);
+		Contact contact;
+		if (!collider.Collide(glm::vec3(collider.Transform() * glm::vec4(middle, 1.0f)), radius, contact) || contact.triangle != t)continue;
+		behind++;
+		glm::vec3 worldFace = glm::normalize(glm::vec3(collider.Transform() * glm::vec4(face, 0.0f)));
+		wrong += glm::dot(contact.normal, worldFace) <= 0.0f || contact.depth <= radius;
+	}
+	printf("%-24s %8d tris %6d contacts  BVH %7.2f us/query  linear %9.2f us/query  %7.1fx  %d mismatches, %d of %d behind a face pushed the wrong way\n", name, shape.TriangleCount(), hits,
+		bvhSeconds * 1e6 / QUERIES, linearSeconds * 1e6 / QUERIES, linearSeconds / bvhSeconds, mismatch, wrong, behind);
+}
+
+#endif // !MESHCOLLIDER_H
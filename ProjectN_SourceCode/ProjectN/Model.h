@@ -13,6 +13,8 @@
 
 #include "Mesh.h"
 #include "Shader.h"
+#include "JobSystem.h"
+#include "TextureStreamer.h"
 
 #include <string>
 #include <fstream>
@@ -22,7 +24,22 @@
 #include <vector>
 using namespace std;
 
+// decoded pixels waiting to be uploaded to a texture
+struct ImageData {
+    int width = 0, height = 0, nrComponents = 0;
+    unsigned char* data = nullptr;
+    NTexImage baked;    // filled instead of data when a .ntex sits next to the source image
+
+    ImageData() {}
+    ImageData(const ImageData&) = delete;
+    ImageData& operator=(const ImageData&) = delete;
+    ~ImageData() { if (data) stbi_image_free(data); }
+};
+
 unsigned int TextureFromFile(const char* path, const string& directory, bool gamma = false);
+void DecodeImage(const string& filename, ImageData& image);
+unsigned int UploadTexture(const ImageData& image, const string& filename);
+unsigned int UploadNTex(const NTexImage& image);
 
 class Model
 {
@@ -30,6 +47,8 @@ public:
     // model data 
     vector<Texture> textures_loaded;	// stores all the textures loaded so far, optimization to make sure textures aren't loaded more than once.
     vector<Mesh>    meshes;
+    vector<GLTexture> ownedTextures;    // the ones uploaded here rather than handed out by a streamer, deleted with the model
+    Bounds bounds;      // of all meshes, once they are set up
     string directory;
     bool gammaCorrection;
 
@@ -37,6 +56,30 @@ public:
     Model(string const& path, bool gamma = false) : gammaCorrection(gamma)
     {
         loadModel(path);
+        computeBounds();
+    }
+    Model(bool gamma = false) : gammaCorrection(gamma)
+    {
+    }
+
+    // parses the file and decodes its textures on worker threads, the buffer and texture uploads
+    // are queued as one main-thread job once everything it needs is ready.
+    // With a streamer the textures are requested from it instead and fill in over the next frames.
+    void LoadAsync(JobSystem& jobs, string const& path, string const& asset, TextureStreamer* streamer = nullptr)
+    {
+        deferUpload = true;
+        this->streamer = streamer;
+        jobs.Submit(asset, "parse", [this, &jobs, path, asset] {
+            loadModel(path);
+            vector<JobHandle> decodes;
+            for (unsigned int i = 0; i < pendingImages.size() && !this->streamer; i++)
+            {
+                std::shared_ptr<ImageData> image = pendingImages[i];
+                string filename = this->directory + '/' + textures_loaded[i].path;
+                decodes.push_back(jobs.Submit(asset, "decode", [image, filename] { DecodeImage(filename, *image); }));
+            }
+            jobs.SubmitMain(asset, "upload", [this] { upload(); }, decodes);
+        });
     }
 
     // draws the model, and thus all its meshes
@@ -54,6 +97,42 @@ public:
     }
 
 private:
+    bool deferUpload = false;
+    vector<std::shared_ptr<ImageData>> pendingImages; // decoded pixels of textures_loaded[i] while deferUpload is set
+    TextureStreamer* streamer = nullptr;
+
+    // uploads deferred textures and mesh buffers, needs the GL context
+    void upload()
+    {
+        for (unsigned int i = 0; i < textures_loaded.size(); i++)
+            if (streamer)
+                textures_loaded[i].id = streamer->Request(this->directory + '/' + textures_loaded[i].path);
+            else
+            {
+                textures_loaded[i].id = UploadTexture(*pendingImages[i], textures_loaded[i].path);
+                ownedTextures.push_back(GLTexture::Adopt(textures_loaded[i].id));
+            }
+        pendingImages.clear();
+        for (unsigned int i = 0; i < meshes.size(); i++)
+        {
+            for (unsigned int j = 0; j < meshes[i].textures.size(); j++)
+                for (unsigned int k = 0; k < textures_loaded.size(); k++)
+                    if (meshes[i].textures[j].path == textures_loaded[k].path)
+                        meshes[i].textures[j].id = textures_loaded[k].id;
+            meshes[i].setup();
+        }
+        computeBounds();
+        deferUpload = false;
+    }
+
+    void computeBounds()
+    {
+        bounds = Bounds();
+        for (unsigned int i = 0; i < meshes.size(); i++)
+            bounds.Add(meshes[i].bounds);
+        bounds.Finish();
+    }
+
     // loads a model with supported ASSIMP extensions from file and stores the resulting meshes in the meshes vector.
     void loadModel(string const& path)
     {
@@ -174,6 +253,14 @@ private:
         textures.insert(textures.end(), heightMaps.begin(), heightMaps.end());
 
         // return a mesh object created from the extracted mesh data
+        if (deferUpload)
+        {
+            Mesh result;
+            result.vertices = std::move(vertices);
+            result.indices = std::move(indices);
+            result.textures = std::move(textures);
+            return result;
+        }
         return Mesh(vertices, indices, textures);
     }
 
@@ -200,7 +287,16 @@ private:
             if (!skip)
             {   // if texture hasn't been loaded already, load it
                 Texture texture;
-                texture.id = TextureFromFile(str.C_Str(), this->directory);
+                if (deferUpload)
+                {
+                    texture.id = 0;
+                    pendingImages.push_back(std::make_shared<ImageData>());
+                }
+                else
+                {
+                    texture.id = TextureFromFile(str.C_Str(), this->directory);
+                    ownedTextures.push_back(GLTexture::Adopt(texture.id));
+                }
                 texture.type = typeName;
                 texture.path = str.C_Str();
                 textures.push_back(texture);
@@ -217,38 +313,78 @@ unsigned int TextureFromFile(const char* path, const string& directory, bool gam
     string filename = string(path);
     filename = directory + '/' + filename;
 
+    ImageData image;
+    DecodeImage(filename, image);
+    return UploadTexture(image, path);
+}
+
+void DecodeImage(const string& filename, ImageData& image)
+{
+    if (ReadNTex(filename + ".ntex", image.baked))
+        return;
+    image.data = stbi_load(filename.c_str(), &image.width, &image.height, &image.nrComponents, 0);
+}
+
+unsigned int UploadTexture(const ImageData& image, const string& filename)
+{
+    if (!image.baked.levels.empty())
+        return UploadNTex(image.baked);
+
     unsigned int textureID;
     glGenTextures(1, &textureID);
 
-    int width, height, nrComponents;
-    unsigned char* data = stbi_load(filename.c_str(), &width, &height, &nrComponents, 0);
-    if (data)
+    if (image.data)
     {
         GLenum format;
-        if (nrComponents == 1)
+        if (image.nrComponents == 1)
             format = GL_RED;
-        else if (nrComponents == 3)
+        else if (image.nrComponents == 3)
             format = GL_RGB;
-        else if (nrComponents == 4)
+        else if (image.nrComponents == 4)
             format = GL_RGBA;
 
         glBindTexture(GL_TEXTURE_2D, textureID);
-        glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, data);
+        glTexImage2D(GL_TEXTURE_2D, 0, format, image.width, image.height, 0, format, GL_UNSIGNED_BYTE, image.data);
         glGenerateMipmap(GL_TEXTURE_2D);
 
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-
-        stbi_image_free(data);
     }
     else
     {
-        std::cout << "Texture failed to load at path: " << path << std::endl;
-        stbi_image_free(data);
+        std::cout << "Texture failed to load at path: " << filename << std::endl;
+    }
+
+    return textureID;
+}
+
+// uploads a baked mip chain as is, block formats the driver can't sample are decoded to RGBA8 first
+unsigned int UploadNTex(const NTexImage& image)
+{
+    unsigned int textureID;
+    glGenTextures(1, &textureID);
+    glBindTexture(GL_TEXTURE_2D, textureID);
+
+    bool direct = NTexFormatSupported(image.format);
+    for (int level = 0; level < (int)image.levels.size(); level++)
+    {
+        int w = std::max(1, image.width >> level), h = std::max(1, image.height >> level);
+        const vector<unsigned char>& data = image.levels[level];
+        if (direct && image.format != NTEX_RGBA8)
+            glCompressedTexImage2D(GL_TEXTURE_2D, level, NTexGLFormat(image.format), w, h, 0, (GLsizei)data.size(), data.data());
+        else if (direct)
+            glTexImage2D(GL_TEXTURE_2D, level, GL_RGBA, w, h, 0, GL_RGBA, GL_UNSIGNED_BYTE, data.data());
+        else
+            glTexImage2D(GL_TEXTURE_2D, level, GL_RGBA, w, h, 0, GL_RGBA, GL_UNSIGNED_BYTE, DecompressLevel(data.data(), w, h, image.format).data());
     }
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, (int)image.levels.size() - 1);
 
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
     return textureID;
 }
 #endif
\ No newline at end of file
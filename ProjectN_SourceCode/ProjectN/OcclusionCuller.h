@@ -0,0 +1,249 @@
+#pragma once
+#ifndef OCCLUSIONCULLER_H
+#define OCCLUSIONCULLER_H
+
+#include <glm/glm.hpp>
+
+#include "Mesh.h"
+#include "Frustum.h"
+
+#include <vector>
+#include <unordered_map>
+#include <algorithm>
+#include <cstring>
+#include <cstdint>
+#include <cstdio>
+
+// Software occlusion culling. The large occluders are rasterised on the CPU into a small depth buffer,
+// a Hi-Z pyramid (farthest depth of every 2x2 block) is built from it, and object bounds are tested against
+// the level where their screen rectangle covers a couple of texels. Needs no GPU, so it can be run headless.
+//
+// Temporal reuse: only objects that were visible last frame are used as occluders, and when neither the
+// camera nor any occluder moved the pyramid is kept and unchanged objects keep last frame's answer.
+// Objects are identified by a key, usually their address, that stays the same across frames.
+class OcclusionCuller {
+public:
+	int width = 256, height = 144;
+	int triangleBudget = 60000;	// occluder triangles rasterised per frame, largest occluders first
+
+	// counters
+	int tested = 0, occluded = 0, reused = 0, framesRasterised = 0, framesReused = 0;
+	long long trianglesRasterised = 0;
+
+	OcclusionCuller(int w = 256, int h = 144) { Resize(w, h); }
+
+	void Resize(int w, int h) {
+		width = w, height = h;
+		levels.clear();
+		int lw = w, lh = h;
+		while (true) {
+			levels.push_back(Level{ lw, lh, std::vector<float>(lw * lh, 1.0f) });
+			if (lw == 1 && lh == 1)break;
+			lw = (lw + 1) / 2, lh = (lh + 1) / 2;
+		}
+		signature = 0;
+	}
+
+	// starts a frame: the occluders are queued after this, then Rasterise()
+	void Begin(const glm::mat4& viewProjection) {
+		viewProj = viewProjection;
+		occluders.clear();
+		frame++;
+	}
+
+	bool WasVisible(const void* key) const {
+		auto found = cache.find(key);
+		return found == cache.end() || found->second.visible;
+	}
+
+	void AddOccluder(const std::vector<Mesh>& meshes, const glm::mat4& modelMatrix) {
+		for (const Mesh& mesh : meshes)AddOccluder(mesh, modelMatrix);
+	}
+	void AddOccluder(const Mesh& mesh, const glm::mat4& modelMatrix) {
+		if (mesh.indices.empty())return;
+		Occluder o;
+		o.mesh = &mesh;
+		o.mvp = viewProj * modelMatrix;
+		o.area = ScreenArea(mesh.bounds, o.mvp);
+		occluders.push_back(o);
+	}
+
+	// depth pre-pass of the queued occluders and the Hi-Z pyramid, skipped if nothing changed since last frame
+	void Rasterise() {
+		uint64_t sig = Hash(&viewProj[0][0], sizeof(viewProj), 14695981039346656037ull);
+		for (const Occluder& o : occluders) {
+			sig = Hash(&o.mesh, sizeof(o.mesh), sig);
+			sig = Hash(&o.mvp[0][0], sizeof(o.mvp), sig);
+		}
+		pyramidReused = sig == signature;
+		if (pyramidReused) {
+			framesReused++;
+			return;
+		}
+		signature = sig;
+		framesRasterised++;
+
+		std::vector<float>& depth = levels[0].depth;
+		std::fill(depth.begin(), depth.end(), 1.0f);
+		std::sort(occluders.begin(), occluders.end(), [](const Occluder& a, const Occluder& b) { return a.area > b.area; });
+		long long budget = triangleBudget;
+		for (const Occluder& o : occluders) {
+			if (budget <= 0)break;
+			budget -= RasteriseMesh(*o.mesh, o.mvp, budget);
+		}
+		BuildPyramid();
+	}
+
+	// false if the bounds placed by modelMatrix are certainly hidden behind the occluders
+	bool Visible(const void* key, const Bounds& bounds, const glm::mat4& modelMatrix) {
+		tested++;
+		Entry& e = cache[key];
+		if (pyramidReused && e.frame == frame - 1 && e.model == modelMatrix) {
+			reused++;
+		}
+		else {
+			e.visible = TestBounds(bounds, viewProj * modelMatrix);
+			e.model = modelMatrix;
+		}
+		e.frame = frame;
+		if (!e.visible)occluded++;
+		return e.visible;
+	}
+
+	void PrintStats() {
+		printf("occlusion culling: %d of %d tests occluded (%.1f%%), %d answers reused; pyramid rebuilt %d frames, kept %d; %lld occluder triangles\n",
+			occluded, tested, tested ? 100.0 * occluded / tested : 0.0, reused, framesRasterised, framesReused, trianglesRasterised);
+	}
+
+private:
+	struct Level {
+		int w, h;
+		std::vector<float> depth;	// [0,1], 1 is the far plane; levels above 0 hold the farthest of their 2x2 block
+	};
+	struct Occluder {
+		const Mesh* mesh;
+		glm::mat4 mvp;
+		float area;
+	};
+	struct Entry {
+		glm::mat4 model = glm::mat4(0.0f);
+		int frame = -1;
+		bool visible = true;
+	};
+	std::vector<Level> levels;
+	std::vector<Occluder> occluders;
+	std::unordered_map<const void*, Entry> cache;
+	std::vector<glm::vec4> screen;	// x, y in pixels, z depth, w > 0 if in front of the camera
+	glm::mat4 viewProj = glm::mat4(1.0f);
+	uint64_t signature = 0;
+	bool pyramidReused = false;
+	int frame = 0;
+
+	static uint64_t Hash(const void* data, size_t size, uint64_t h) {
+		const unsigned char* p = (const unsigned char*)data;
+		for (size_t i = 0; i < size; i++)h = (h ^ p[i]) * 1099511628211ull;
+		return h;
+	}
+
+	glm::vec4 ToScreen(const glm::vec4& clip) const {
+		if (clip.w < 1e-4f)return glm::vec4(0.0f, 0.0f, 0.0f, -1.0f);
+		glm::vec3 ndc = glm::vec3(clip) / clip.w;
+		return glm::vec4((ndc.x * 0.5f + 0.5f) * width, (ndc.y * 0.5f + 0.5f) * height, ndc.z * 0.5f + 0.5f, 1.0f);
+	}
+
+	// pixel rectangle and nearest depth of the box; false if it reaches behind the camera
+	bool ScreenRect(const Bounds& bounds, const glm::mat4& mvp, glm::vec2& lo, glm::vec2& hi, float& nearest) const {
+		lo = glm::vec2(1e30f), hi = glm::vec2(-1e30f), nearest = 1.0f;
+		for (int c = 0; c < 8; c++) {
+			glm::vec3 corner((c & 1) ? bounds.max.x : bounds.min.x, (c & 2) ? bounds.max.y : bounds.min.y, (c & 4) ? bounds.max.z : bounds.min.z);
+			glm::vec4 s = ToScreen(mvp * glm::vec4(corner, 1.0f));
+			if (s.w < 0.0f)return false;
+			lo = glm::min(lo, glm::vec2(s)), hi = glm::max(hi, glm::vec2(s));
+			nearest = std::min(nearest, s.z);
+		}
+		return true;
+	}
+
+	float ScreenArea(const Bounds& bounds, const glm::mat4& mvp) const {
+		glm::vec2 lo, hi;
+		float nearest;
+		if (!ScreenRect(bounds, mvp, lo, hi, nearest))return (float)width * height;
+		lo = glm::clamp(lo, glm::vec2(0.0f), glm::vec2((float)width, (float)height));
+		hi = glm::clamp(hi, glm::vec2(0.0f), glm::vec2((float)width, (float)height));
+		return (hi.x - lo.x) * (hi.y - lo.y);
+	}
+
+	// returns the number of triangles submitted
+	long long RasteriseMesh(const Mesh& mesh, const glm::mat4& mvp, long long budget) {
+		screen.resize(mesh.vertices.size());
+		for (size_t i = 0; i < mesh.vertices.size(); i++)
+			screen[i] = ToScreen(mvp * glm::vec4(mesh.vertices[i].Position, 1.0f));
+		float* depth = levels[0].depth.data();
+		long long count = 0;
+		for (size_t t = 0; t + 2 < mesh.indices.size() && count < budget; t += 3) {
+			count++;
+			const glm::vec4& a = screen[mesh.indices[t]];
+			const glm::vec4& b = screen[mesh.indices[t + 1]];
+			const glm::vec4& c = screen[mesh.indices[t + 2]];
+			// triangles crossing the near plane are left out, which only makes the test more conservative
+			if (a.w < 0.0f || b.w < 0.0f || c.w < 0.0f)continue;
+			float area = (b.x - a.x) * (c.y - a.y) - (b.y - a.y) * (c.x - a.x);
+			if (area == 0.0f)continue;
+			int x0 = std::max(0, (int)std::floor(std::min(a.x, std::min(b.x, c.x))));
+			int x1 = std::min(width - 1, (int)std::ceil(std::max(a.x, std::max(b.x, c.x))));
+			int y0 = std::max(0, (int)std::floor(std::min(a.y, std::min(b.y, c.y))));
+			int y1 = std::min(height - 1, (int)std::ceil(std::max(a.y, std::max(b.y, c.y))));
+			float inv = 1.0f / area;
+			for (int y = y0; y <= y1; y++) {
+				float py = y + 0.5f;
+				for (int x = x0; x <= x1; x++) {
+					float px = x + 0.5f;
+					// barycentrics from the edge functions, sign-corrected by the winding
+					float w0 = ((c.x - b.x) * (py - b.y) - (c.y - b.y) * (px - b.x)) * inv;
+					float w1 = ((a.x - c.x) * (py - c.y) - (a.y - c.y) * (px - c.x)) * inv;
+					float w2 = 1.0f - w0 - w1;
+					if (w0 < 0.0f || w1 < 0.0f || w2 < 0.0f)continue;
+					float z = w0 * a.z + w1 * b.z + w2 * c.z;
+					float& d = depth[y * width + x];
+					if (z < d)d = z;
+				}
+			}
+		}
+		trianglesRasterised += count;
+		return count;
+	}
+
+	void BuildPyramid() {
+		for (size_t l = 1; l < levels.size(); l++) {
+			const Level& src = levels[l - 1];
+			Level& dst = levels[l];
+			for (int y = 0; y < dst.h; y++)
+				for (int x = 0; x < dst.w; x++) {
+					int sx = x * 2, sy = y * 2;
+					int sx1 = std::min(sx + 1, src.w - 1), sy1 = std::min(sy + 1, src.h - 1);
+					dst.depth[y * dst.w + x] = std::max(std::max(src.depth[sy * src.w + sx], src.depth[sy * src.w + sx1]),
+						std::max(src.depth[sy1 * src.w + sx], src.depth[sy1 * src.w + sx1]));
+				}
+		}
+	}
+
+	bool TestBounds(const Bounds& bounds, const glm::mat4& mvp) const {
+		if (bounds.empty)return true;
+		glm::vec2 lo, hi;
+		float nearest;
+		if (!ScreenRect(bounds, mvp, lo, hi, nearest))return true;
+		if (hi.x < 0.0f || hi.y < 0.0f || lo.x >= width || lo.y >= height)return true;	// off screen, left to frustum culling
+		int x0 = std::max(0, (int)std::floor(lo.x)), x1 = std::min(width - 1, (int)std::floor(hi.x));
+		int y0 = std::max(0, (int)std::floor(lo.y)), y1 = std::min(height - 1, (int)std::floor(hi.y));
+		// the level where the rectangle spans at most 2x2 texels
+		int l = 0;
+		while (l + 1 < (int)levels.size() && std::max(x1 - x0, y1 - y0) >> l > 1)l++;
+		const Level& level = levels[l];
+		for (int y = y0 >> l; y <= (y1 >> l); y++)
+			for (int x = x0 >> l; x <= (x1 >> l); x++)
+				if (nearest <= level.depth[y * level.w + x])return true;
+		return false;
+	}
+};
+
+#endif // !OCCLUSIONCULLER_H
@@ -0,0 +1,199 @@
+#pragma once
+#ifndef OFFSCREEN_H
+#define OFFSCREEN_H
+
+#include <glad/glad.h>
+
+#include "GLResource.h"
+
+#ifndef STBI_INCLUDE_STB_IMAGE_H
+#include <stb_image.h>
+#endif
+
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <cstdio>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+
+// A framebuffer the frame is drawn into instead of the window's, for runs nobody watches: the window stays
+// hidden (and may come from a context without a display, see main), what is drawn is read back from here.
+class OffscreenTarget {
+public:
+	GLFramebuffer framebuffer;
+	int width = 0, height = 0;
+
+	bool Init(int w, int h) {
+		width = w, height = h;
+		framebuffer.Create();
+		glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+		color.Create();
+		glBindTexture(GL_TEXTURE_2D, color);
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, w, h, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+		color.Resize((size_t)w * h * 4);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+		glBindTexture(GL_TEXTURE_2D, 0);
+		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, color, 0);
+		depth.Create();
+		glBindRenderbuffer(GL_RENDERBUFFER, depth);
+		glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, w, h);
+		depth.Resize((size_t)w * h * 4);
+		glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, depth);
+		bool complete = glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+		glBindFramebuffer(GL_FRAMEBUFFER, complete ? framebuffer : 0);
+		if (!complete)printf("offscreen: %dx%d framebuffer incomplete\n", w, h);
+		return complete;
+	}
+
+	// the frame as RGB rows from the top; waits for the GPU to finish it
+	void Read(std::vector<unsigned char>& rgb) {
+		size_t row = (size_t)width * 3;
+		rgb.resize(row * height);
+		upsideDown.resize(rgb.size());
+		glBindFramebuffer(GL_READ_FRAMEBUFFER, framebuffer);
+		glPixelStorei(GL_PACK_ALIGNMENT, 1);
+		glReadPixels(0, 0, width, height, GL_RGB, GL_UNSIGNED_BYTE, upsideDown.data());
+		glPixelStorei(GL_PACK_ALIGNMENT, 4);
+		for (int y = 0; y < height; y++)
+			memcpy(&rgb[y * row], &upsideDown[(height - 1 - y) * row], row);
+	}
+
+private:
+	GLTexture color;
+	GLRenderbuffer depth;
+	std::vector<unsigned char> upsideDown;
+};
+
+// An 8-bit RGB PNG. The image data is stored, not deflated: nothing to link against, and the files are
+// for comparing, not keeping small. scratch holds the file as it is put together
+inline bool WritePng(const char* path, int width, int height, const unsigned char* rgb, std::vector<unsigned char>& scratch) {
+	static uint32_t table[256];
+	if (!table[1])
+		for (uint32_t n = 0; n < 256; n++) {
+			uint32_t c = n;
+			for (int k = 0; k < 8; k++)c = c & 1 ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+			table[n] = c;
+		}
+	auto put32 = [&](uint32_t v) { unsigned char b[4] = { (unsigned char)(v >> 24), (unsigned char)(v >> 16), (unsigned char)(v >> 8), (unsigned char)v }; scratch.insert(scratch.end(), b, b + 4); };
+	// a chunk is its length, type and data, then the CRC of type and data
+	auto chunk = [&](const char* type, size_t start) {
+		size_t length = scratch.size() - start;
+		scratch.insert(scratch.begin() + start, 8, 0);
+		for (int i = 0; i < 4; i++)scratch[start + i] = (unsigned char)(length >> (24 - 8 * i)), scratch[start + 4 + i] = type[i];
+		uint32_t crc = 0xFFFFFFFFu;
+		for (size_t i = start + 4; i < scratch.size(); i++)crc = table[(crc ^ scratch[i]) & 0xFF] ^ (crc >> 8);
+		put32(crc ^ 0xFFFFFFFFu);
+	};
+
+	size_t row = (size_t)width * 3, raw = (row + 1) * height;
+	scratch.clear();
+	scratch.reserve(raw + raw / 65535 * 5 + 128);
+	const unsigned char signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+	scratch.insert(scratch.end(), signature, signature + 8);
+
+	size_t start = scratch.size();
+	put32(width), put32(height);
+	const unsigned char format[5] = { 8, 2, 0, 0, 0 };	// 8 bits, RGB, deflate, no filters, not interlaced
+	scratch.insert(scratch.end(), format, format + 5);
+	chunk("IHDR", start);
+
+	// zlib: header, the rows (each behind a filter byte of 0) in stored blocks of up to 65535 bytes, Adler-32
+	start = scratch.size();
+	scratch.push_back(0x78), scratch.push_back(0x01);
+	uint32_t a = 1, b = 0;
+	size_t done = 0, block = 0;
+	for (int y = 0; y < height; y++)
+		for (size_t x = 0; x <= row; x++) {
+			if (block == 0) {
+				size_t size = std::min<size_t>(raw - done, 65535);
+				scratch.push_back(done + size == raw ? 1 : 0);
+				scratch.push_back((unsigned char)size), scratch.push_back((unsigned char)(size >> 8));
+				scratch.push_back((unsigned char)~size), scratch.push_back((unsigned char)(~size >> 8));
+				block = size;
+			}
+			unsigned char byte = x ? rgb[y * row + x - 1] : 0;
+			scratch.push_back(byte);
+			a = (a + byte) % 65521, b = (b + a) % 65521;
+			done++, block--;
+		}
+	put32(b << 16 | a);
+	chunk("IDAT", start);
+	chunk("IEND", scratch.size());
+
+	FILE* file = fopen(path, "wb");
+	if (!file) {
+		printf("offscreen: can't write %s\n", path);
+		return false;
+	}
+	bool written = fwrite(scratch.data(), 1, scratch.size(), file) == scratch.size();
+	fclose(file);
+	return written;
+}
+
+// Frames written out as PNGs every few frames and, given golden images, checked against them: a pixel
+// differs when one of its channels is off by more than tolerance. For each frame that differs, a diff image
+// goes next to it, the differing pixels red over a dimmed copy of the frame.
+class FrameCapture {
+public:
+	std::string outDir = ".", goldenDir;
+	int every = 30, tolerance = 8;
+
+	// counters
+	int written = 0, compared = 0, failed = 0, missing = 0;
+
+	bool Wants(int frame, bool last) const { return last || (every > 0 && frame % every == 0); }
+
+	void Capture(int frame, OffscreenTarget& target) {
+		target.Read(pixels);
+		char name[32];
+		snprintf(name, sizeof(name), "frame_%05d.png", frame);
+		if (WritePng((outDir + "/" + name).c_str(), target.width, target.height, pixels.data(), scratch))written++;
+		if (goldenDir.empty())return;
+
+		int w = 0, h = 0, components = 0;
+		std::string golden = goldenDir + "/" + name;
+		// files are top row first, as written; the loader flips for textures on this thread otherwise
+		stbi_set_flip_vertically_on_load_thread(0);
+		unsigned char* expected = stbi_load(golden.c_str(), &w, &h, &components, 3);
+		stbi_set_flip_vertically_on_load_thread(1);
+		if (!expected || w != target.width || h != target.height) {
+			printf("offscreen: frame %d, no %dx%d golden image %s\n", frame, target.width, target.height, golden.c_str());
+			missing++;
+			if (expected)stbi_image_free(expected);
+			return;
+		}
+		compared++;
+		long long differing = 0;
+		int worst = 0;
+		diff.resize(pixels.size());
+		for (size_t p = 0; p < pixels.size(); p += 3) {
+			int delta = 0;
+			for (int c = 0; c < 3; c++)delta = std::max(delta, std::abs((int)pixels[p + c] - (int)expected[p + c]));
+			worst = std::max(worst, delta);
+			bool off = delta > tolerance;
+			differing += off;
+			for (int c = 0; c < 3; c++)diff[p + c] = off ? (c == 0 ? 255 : 0) : pixels[p + c] / 4;
+		}
+		stbi_image_free(expected);
+		if (!differing)return;
+		failed++;
+		printf("offscreen: frame %d, %lld pixels (%.3f%%) off by more than %d, at most %d\n", frame, differing, 100.0 * differing / (pixels.size() / 3), tolerance, worst);
+		snprintf(name, sizeof(name), "diff_%05d.png", frame);
+		WritePng((outDir + "/" + name).c_str(), target.width, target.height, diff.data(), scratch);
+	}
+
+	void PrintStats() const {
+		if (!written && !compared)return;
+		printf("offscreen: %d frames written to %s", written, outDir.c_str());
+		if (!goldenDir.empty())printf(", %d compared with %s: %d differ, %d without a golden image", compared, goldenDir.c_str(), failed, missing);
+		printf("\n");
+	}
+
+private:
+	std::vector<unsigned char> pixels, diff, scratch;
+};
+
+#endif // !OFFSCREEN_H
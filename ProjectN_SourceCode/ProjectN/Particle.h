@@ -7,11 +7,132 @@
 #include <glm/gtc/type_ptr.hpp>
 #include "Mesh.h"
 #include "Randomizer.h"
+#include "StreamBuffer.h"
 
-class Particle {
+// what drawing one particle takes; the simulation publishes these for the render pass
+struct ParticleInstance {
+	glm::vec3 position, rotation, color;
+	float size;
+};
+
+// Particles are all the same small shape, scaled, turned and coloured per particle. The shape is uploaded
+// on the first draw, so particles themselves never touch GL and can be simulated on any thread.
+// Given a stream buffer, the visible particles' transforms and colours are written into it and drawn in one
+// instanced call with the INSTANCED permutation of the particle shader; without, one draw per particle.
+class ParticleBatch {
 public:
-	Mesh mesh;
+	static Mesh& Shape() {
+		static Mesh shape;
+		if (shape.vertices.empty()) {
+			Vertex vertex;
+			vertex.Normal = glm::vec3(0.0f, 1.0f, 0.0f);
+			for (int i = 0; i < 8; i++) {
+				vertex.Position = glm::vec3(i & 2 ? 1.0f : -1.0f, i & 4 ? 1.0f : -1.0f, i & 1 ? 1.0f : -1.0f);
+				shape.vertices.push_back(vertex);
+			}
+			const unsigned int indices[] = { 0, 5, 6, 3, 6, 5, 3, 6, 0, 3, 5, 0 };
+			shape.indices.assign(indices, indices + 12);
+			shape.setup();
+		}
+		return shape;
+	}
+
+	// per particle in the stream: model matrix, colour
+	struct Instance {
+		glm::mat4 model;
+		glm::vec4 color;
+	};
+
+	// with a frustum, the particles are culled against it in one batch first
+	void Draw(Shader& shader, const std::vector<ParticleInstance>& instances, Frustum* frustum = nullptr, StreamBuffer* stream = nullptr) {
+		if (instances.empty())return;
+		shader.use();
+		Mesh& shape = Shape();
+		if (frustum) {
+			cullBatch.Clear();
+			for (int i = 0; i < (int)instances.size(); i++)
+				cullBatch.Add(i, instances[i].position, instances[i].size * shape.bounds.radius);
+			frustum->Cull(cullBatch);
+		}
+		if (stream) {
+			int visible = 0;
+			for (int i = 0; i < (int)instances.size(); i++)
+				visible += !frustum || cullBatch.visible[i];
+			size_t offset;
+			Instance* out = visible ? (Instance*)stream->Allocate(visible * sizeof(Instance), offset) : nullptr;
+			// the shader only reads the stream, so with the segment full these are left out (an overflow)
+			if (out) {
+				for (int i = 0; i < (int)instances.size(); i++) {
+					if (frustum && !cullBatch.visible[i])continue;
+					out->model = Model(instances[i]);
+					out->color = glm::vec4(instances[i].color, 1.0f);
+					out++;
+				}
+				stream->Commit();
+				glBindVertexArray(InstancedVAO());
+				glBindBuffer(GL_ARRAY_BUFFER, stream->buffer);
+				for (int k = 0; k < 5; k++)
+					glVertexAttribPointer(3 + k, 4, GL_FLOAT, GL_FALSE, sizeof(Instance), (void*)(offset + k * sizeof(glm::vec4)));
+				glDrawElementsInstanced(GL_TRIANGLES, (GLsizei)shape.indices.size(), GL_UNSIGNED_INT, 0, visible);
+				FrameStats::Get().Draw(shape.indices.size() / 3, visible);
+				glBindVertexArray(0);
+			}
+			return;
+		}
+		for (int i = 0; i < (int)instances.size(); i++) {
+			if (frustum && !cullBatch.visible[i])continue;
+			const ParticleInstance& p = instances[i];
+			shader.setMat4("model", Model(p));
+			shader.setVec3("particleColor", p.color);
+			shape.Draw(shader);
+		}
+	}
+
+private:
+	SphereBatch cullBatch;
+
+	static glm::mat4 Model(const ParticleInstance& p) {
+		glm::mat4 modelMatrix = glm::mat4(1.0f);
+		modelMatrix = glm::translate(modelMatrix, p.position);
+		modelMatrix = glm::rotate(modelMatrix, p.rotation.x, glm::vec3(1.0f, 0.0f, 0.0f));
+		modelMatrix = glm::rotate(modelMatrix, p.rotation.y, glm::vec3(0.0f, 1.0f, 0.0f));
+		modelMatrix = glm::rotate(modelMatrix, p.rotation.z, glm::vec3(0.0f, 0.0f, 1.0f));
+		modelMatrix = glm::scale(modelMatrix, glm::vec3(p.size));
+		return modelMatrix;
+	}
+
+	// the shape's vertices and indices again, with the per-instance attributes at 3-7; where they point
+	// into the stream buffer is set by every draw
+	static unsigned int InstancedVAO() {
+		static unsigned int vao = 0;
+		if (vao)return vao;
+		Mesh& shape = Shape();
+		unsigned int vbo, ebo;
+		glGenVertexArrays(1, &vao);
+		glGenBuffers(1, &vbo);
+		glGenBuffers(1, &ebo);
+		glBindVertexArray(vao);
+		glBindBuffer(GL_ARRAY_BUFFER, vbo);
+		glBufferData(GL_ARRAY_BUFFER, shape.vertices.size() * sizeof(Vertex), shape.vertices.data(), GL_STATIC_DRAW);
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ebo);
+		glBufferData(GL_ELEMENT_ARRAY_BUFFER, shape.indices.size() * sizeof(unsigned int), shape.indices.data(), GL_STATIC_DRAW);
+		glEnableVertexAttribArray(0);
+		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)0);
+		glEnableVertexAttribArray(1);
+		glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Normal));
+		glEnableVertexAttribArray(2);
+		glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, TexCoords));
+		for (int k = 0; k < 5; k++) {
+			glEnableVertexAttribArray(3 + k);
+			glVertexAttribDivisor(3 + k, 1);
+		}
+		glBindVertexArray(0);
+		return vao;
+	}
+};
 
+class Particle {
+public:
 	glm::vec3 position;
 	glm::vec3 rotation;
 	glm::vec3 startColor;
@@ -30,64 +151,11 @@ public:
 	Particle(glm::vec3 pos, glm::vec3 col1, glm::vec3 col2, glm::vec3 speed, glm::vec3 rspeed, float siz, float lifet, glm::vec3 GG=glm::vec3(0.0f,-0.98f,0.0f))
 		:position(pos),startColor(col1),endColor(col2),V(speed),rotateV(rspeed),size(siz),lifeTime(lifet),G(GG) {
 		sizeAttenuation = size / lifeTime;
-		generateMesh();
 		livedTime = 0.0f;
 		rotation = rspeed;
 	}
 	~Particle() {
 	}
-	void generateMesh() {
-		mesh.clear();
-
-		Vertex vertex;
-		vertex.Normal = glm::vec3(0.0f, 1.0f, 0.0f);
-		vertex.Position = glm::vec3(-size, -size, -size);
-		mesh.vertices.push_back(vertex);
-		vertex.Position = glm::vec3(-size, -size, size);
-		mesh.vertices.push_back(vertex);
-		vertex.Position = glm::vec3(size, -size, -size);
-		mesh.vertices.push_back(vertex);
-		vertex.Position = glm::vec3(size, -size, size);
-		mesh.vertices.push_back(vertex);
-		vertex.Position = glm::vec3(-size, size, -size);
-		mesh.vertices.push_back(vertex);
-		vertex.Position = glm::vec3(-size, size, size);
-		mesh.vertices.push_back(vertex);
-		vertex.Position = glm::vec3(size, size, -size);
-		mesh.vertices.push_back(vertex);
-		vertex.Position = glm::vec3(size, size, size);
-		mesh.vertices.push_back(vertex);
-		
-		//mesh.indices.push_back(0), mesh.indices.push_back(1), mesh.indices.push_back(3);
-		//mesh.indices.push_back(0), mesh.indices.push_back(2), mesh.indices.push_back(3);
-		//mesh.indices.push_back(4), mesh.indices.push_back(5), mesh.indices.push_back(7);
-		//mesh.indices.push_back(4), mesh.indices.push_back(6), mesh.indices.push_back(7);
-		//mesh.indices.push_back(0), mesh.indices.push_back(1), mesh.indices.push_back(5);
-		//mesh.indices.push_back(0), mesh.indices.push_back(4), mesh.indices.push_back(5);
-		//mesh.indices.push_back(1), mesh.indices.push_back(7), mesh.indices.push_back(3);
-		//mesh.indices.push_back(1), mesh.indices.push_back(7), mesh.indices.push_back(5);
-		//mesh.indices.push_back(2), mesh.indices.push_back(7), mesh.indices.push_back(6);
-		//mesh.indices.push_back(2), mesh.indices.push_back(7), mesh.indices.push_back(3);
-		//mesh.indices.push_back(0), mesh.indices.push_back(6), mesh.indices.push_back(2);
-		//mesh.indices.push_back(0), mesh.indices.push_back(6), mesh.indices.push_back(4);
-		mesh.indices.push_back(0), mesh.indices.push_back(5), mesh.indices.push_back(6);
-		mesh.indices.push_back(3), mesh.indices.push_back(6), mesh.indices.push_back(5);
-		mesh.indices.push_back(3), mesh.indices.push_back(6), mesh.indices.push_back(0);
-		mesh.indices.push_back(3), mesh.indices.push_back(5), mesh.indices.push_back(0);
-		mesh.setup();
-	}
-	void updateMesh() {
-		if (mesh.vertices.size() < 8)return;
-		mesh.vertices[0].Position = glm::vec3(-size, -size, -size);
-		mesh.vertices[1].Position = glm::vec3(-size, -size, size);
-		mesh.vertices[2].Position = glm::vec3(size, -size, -size);
-		mesh.vertices[3].Position = glm::vec3(size, -size, size);
-		mesh.vertices[4].Position = glm::vec3(-size, size, -size);
-		mesh.vertices[5].Position = glm::vec3(-size, size, size);
-		mesh.vertices[6].Position = glm::vec3(size, size, -size);
-		mesh.vertices[7].Position = glm::vec3(size, size, size);
-		mesh.setup();
-	}
 	
 	bool Calc(float deltaTime) {
 		position += V * deltaTime;
@@ -101,26 +169,19 @@ public:
 		V += (G + glm::length(V) * (-V) * f_k) * deltaTime;
 		size -= sizeAttenuation * deltaTime;
 		livedTime += deltaTime;
-		if (size > 0)updateMesh();
-		else return 0;
+		if (size <= 0)return 0;
 		return 1;
 	}
-	void Draw(Shader& shader)
-	{
-		glm::mat4 modelMatrix = glm::mat4(1.0f);
-		modelMatrix = glm::translate(modelMatrix, position);
-		modelMatrix = glm::rotate(modelMatrix, rotation.x, glm::vec3(1.0f, 0.0f, 0.0f));
-		modelMatrix = glm::rotate(modelMatrix, rotation.y, glm::vec3(0.0f, 1.0f, 0.0f));
-		modelMatrix = glm::rotate(modelMatrix, rotation.z, glm::vec3(0.0f, 0.0f, 1.0f));
-		shader.setMat4("model", modelMatrix);
+	ParticleInstance Instance() const {
 		glm::vec3 color = startColor * (lifeTime - livedTime) / lifeTime + endColor * (livedTime / lifeTime);
-		shader.setVec3("particleColor", color);
-		mesh.Draw(shader);
+		return ParticleInstance{ position, rotation, color, size };
 	}
 };
+// The particles are kept by value and the vector keeps its capacity, so once a system has grown, spawning
+// and dying don't allocate; pooled systems (StaticParticleManager) keep it across uses too
 class ParticleSystem {
 public:
-	std::vector<std::shared_ptr<Particle>>particles;
+	std::vector<Particle>particles;
 	
 	glm::vec3 centerPos;
 	float emitSpeed;
@@ -163,28 +224,39 @@ public:
 			glm::vec3 rspeed = glm::vec3(rdm.random(-1.0f, 1.0f), rdm.random(-1.0f, 1.0f), rdm.random(-1.0f, 1.0f)) * rotateSpeed;
 			glm::vec3 sysDir = systemV;
 			if (glm::length(sysDir))sysDir /= glm::length(sysDir);
-			particles.push_back(std::make_shared<Particle>(centerPos, sColor, eColor, speed, rspeed, particleSize, particleLife, -sysDir + glm::vec3(0.0f, particleG, 0.0f)));
+			particles.emplace_back(centerPos, sColor, eColor, speed, rspeed, particleSize, particleLife, -sysDir + glm::vec3(0.0f, particleG, 0.0f));
 		}
 	}
 
 	void Update(float deltaTime) {
 		if (!enabled)return;
 		centerPos += systemV * deltaTime;
-		int len = particles.size();
-		for (int i = 0; i < len; i++) {
-			if (!particles[i]->Calc(deltaTime))
-				particles.erase(particles.begin() + i), i--, len--;
-		}
+		// the survivors are moved up in order, the dead are dropped in one go
+		size_t kept = 0;
+		for (size_t i = 0; i < particles.size(); i++)
+			if (particles[i].Calc(deltaTime))particles[kept++] = particles[i];
+		particles.erase(particles.begin() + kept, particles.end());
 		if (consist)generateParticles((int)emitSpeed / deltaTime);
 	}
 
-	void Draw(Shader& shader)
-	{
+	// appends what drawing the living particles takes
+	void Publish(std::vector<ParticleInstance>& out) const {
 		if (!enabled)return;
-		shader.use();
-		for (const auto& particle : particles)
-			particle->Draw(shader);
+		for (const Particle& particle : particles)
+			out.push_back(particle.Instance());
 	}
+
+	// with a frustum, the particles are culled against it in one batch first
+	void Draw(Shader& shader, Frustum* frustum = nullptr, StreamBuffer* stream = nullptr)
+	{
+		instances.clear();
+		Publish(instances);
+		batch.Draw(shader, instances, frustum, stream);
+	}
+
+private:
+	std::vector<ParticleInstance> instances;
+	ParticleBatch batch;
 };
 
 
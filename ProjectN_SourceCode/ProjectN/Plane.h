@@ -2,12 +2,16 @@
 #define PLANE_H
 
 #include "Mesh.h"
+#include "MeshCollider.h"
 
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
 
 #include<random>
+#include <vector>
+#include <memory>
+#include <string>
 
 class Plane {
 public:
@@ -21,6 +25,10 @@ public:
 	{
 		mesh.Draw(shader);
 	}
+	// the planes are built in world space
+	bool InView(Frustum* frustum) {
+		return !frustum || frustum->Sphere(mesh.bounds.center, mesh.bounds.radius);
+	}
 
 private:
 
@@ -32,29 +40,51 @@ public:
 	Texture woodTexture;
 	float size;
 	Ball light = Ball(0.0f, 1.0f, 0.5f, 0.1f);
+	std::vector<std::unique_ptr<Prop>> props;	// furniture, collided with triangle by triangle
 	//Ball light = Ball(0.0f, -0.8f, 0.0f, 0.12f);
 
-	Room(float siz):size(siz) {
-		CreateTexture();
+	Room(float siz, const Texture& wood):woodTexture(wood), size(siz) {
 		CreateGround();
 		CreateWalls();
 	}
 
-	void Draw(Shader& pureShader, Shader& textureShader, Shader& lightShader, Shader& ceilingShader, Shader& groundShader, int depthMap) {
+	// needs the GL context; the collider is built here too
+	void AddProp(const std::string& path, const glm::mat4& transform, const glm::vec3& color) {
+		props.emplace_back(new Prop(path, transform, color));
+	}
+
+	// with a frustum, the walls and props outside it are skipped. The light ball can be left for DrawLight,
+	// to draw it after the opaque things
+	void Draw(Shader& pureShader, Shader& textureShader, Shader& lightShader, Shader& ceilingShader, Shader& groundShader, int depthMap, Frustum* frustum = nullptr, bool withLight = true) {
 		pureShader.use();
 		for (int i = 0; i < 3; i++) {
+			if (!walls[i].InView(frustum))continue;
 			pureShader.setVec3("objectColor", walls[i].color.x, walls[i].color.y, walls[i].color.z);
 			walls[i].Draw(pureShader);
 		}
-		ceilingShader.use();
-		ceilingShader.setVec3("objectColor", walls[3].color.x, walls[3].color.y, walls[3].color.z);
-		walls[3].Draw(ceilingShader);
-		groundShader.use();
-		glActiveTexture(GL_TEXTURE9);
-		glBindTexture(GL_TEXTURE_2D, depthMap);
-		ground.Draw(groundShader);
-		lightShader.use();
-		light.Draw(lightShader);
+		for (auto& prop : props) {
+			if (!prop->InView(frustum))continue;
+			pureShader.setVec3("objectColor", prop->color);
+			prop->Draw(pureShader);
+		}
+		if (walls[3].InView(frustum)) {
+			ceilingShader.use();
+			ceilingShader.setVec3("objectColor", walls[3].color.x, walls[3].color.y, walls[3].color.z);
+			walls[3].Draw(ceilingShader);
+		}
+		if (ground.InView(frustum)) {
+			groundShader.use();
+			glActiveTexture(GL_TEXTURE9);
+			glBindTexture(GL_TEXTURE_2D, depthMap);
+			ground.Draw(groundShader);
+		}
+		if (withLight)DrawLight(lightShader, frustum);
+	}
+	void DrawLight(Shader& lightShader, Frustum* frustum = nullptr) {
+		if (light.InView(frustum)) {
+			lightShader.use();
+			light.Draw(lightShader);
+		}
 	}
 	void renderShadow(Shader& simpleDepthShader) {
 		ground.Draw(simpleDepthShader);
@@ -178,35 +208,5 @@ public:
 		ground.mesh.textures.push_back(woodTexture);
 		ground.mesh.setup();
 	}
-
-	void CreateTexture() {
-
-		unsigned int textureID;
-		glGenTextures(1, &textureID);
-		int width, height, nrComponents;
-		unsigned char* data = stbi_load("texture\\wood.jpg", &width, &height, &nrComponents, 0);
-		if (data)
-		{
-
-			glBindTexture(GL_TEXTURE_2D, textureID);
-			glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, data);
-			glGenerateMipmap(GL_TEXTURE_2D);
-
-			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-
-			stbi_image_free(data);
-		}
-		else
-		{
-			std::cout << "Texture failed to load at path: ";
-			stbi_image_free(data);
-		}
-		woodTexture.id = textureID;
-		woodTexture.type = "texture_diffuse";
-		woodTexture.path = "texture\\wooden.jpg";
-	};
 };
 #endif
\ No newline at end of file
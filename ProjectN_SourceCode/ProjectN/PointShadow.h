@@ -0,0 +1,110 @@
+#pragma once
+#ifndef POINTSHADOW_H
+#define POINTSHADOW_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "Shader.h"
+
+#include <string>
+#include <cstdio>
+
+// Omnidirectional shadows for a moving point light (the fireball). The distance to the closest caster is
+// rendered into a depth cube map in one layered pass: the casters are submitted once and the geometry shader
+// sends each triangle only to the cube faces it touches. The resolution drops with the light's distance from
+// the camera, and the map is only redrawn once the light has moved further than moveThreshold, the
+// resolution changed or the casters changed.
+class PointShadow {
+public:
+	static const int LEVELS = 3;
+	int sizes[LEVELS] = { 512, 256, 128 };
+	float levelDistance[LEVELS - 1] = { 1.5f, 3.0f };	// camera to light, beyond which the next level is used
+	float nearPlane = 0.01f, farPlane = 3.5f;	// the room's diagonal
+	float moveThreshold = 0.02f;
+
+	// counters
+	int renders = 0, skipped = 0;
+
+	void Init() {
+		for (int l = 0; l < LEVELS; l++) {
+			glGenTextures(1, &cubes[l]);
+			glBindTexture(GL_TEXTURE_CUBE_MAP, cubes[l]);
+			for (int face = 0; face < 6; face++)
+				glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, 0, GL_DEPTH_COMPONENT, sizes[l], sizes[l], 0, GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
+			glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+			glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+			glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+			glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+			glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+
+			glGenFramebuffers(1, &fbos[l]);
+			glBindFramebuffer(GL_FRAMEBUFFER, fbos[l]);
+			// the whole cube is attached, gl_Layer picks the face
+			glFramebufferTexture(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, cubes[l], 0);
+			glDrawBuffer(GL_NONE);
+			glReadBuffer(GL_NONE);
+		}
+		glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	}
+
+	// the map is stale, e.g. the light went out or shadows were switched off
+	void Invalidate() {
+		valid = false;
+	}
+
+	// redraws the cube map if the light moved far enough or castersChanged; draw() renders the casters with depth bound
+	template<class DrawCasters>
+	void Render(Shader& depth, const glm::vec3& lightPos, const glm::vec3& cameraPos, bool castersChanged, DrawCasters draw) {
+		int wanted = 0;
+		float toCamera = glm::length(lightPos - cameraPos);
+		while (wanted < LEVELS - 1 && toCamera > levelDistance[wanted])wanted++;
+		if (valid && wanted == level && !castersChanged && glm::length(lightPos - renderedPos) <= moveThreshold) {
+			skipped++;
+			return;
+		}
+		level = wanted;
+		renderedPos = lightPos;
+
+		glm::mat4 projection = glm::perspective(glm::radians(90.0f), 1.0f, nearPlane, farPlane);
+		const glm::vec3 dirs[6] = { { 1, 0, 0 }, { -1, 0, 0 }, { 0, 1, 0 }, { 0, -1, 0 }, { 0, 0, 1 }, { 0, 0, -1 } };
+		const glm::vec3 ups[6] = { { 0, -1, 0 }, { 0, -1, 0 }, { 0, 0, 1 }, { 0, 0, -1 }, { 0, -1, 0 }, { 0, -1, 0 } };
+		depth.use();
+		for (int face = 0; face < 6; face++)
+			depth.setMat4("shadowMatrices[" + std::to_string(face) + "]", projection * glm::lookAt(lightPos, lightPos + dirs[face], ups[face]));
+		depth.setVec3("lightPos", lightPos);
+		depth.setFloat("far_plane", farPlane);
+
+		glViewport(0, 0, sizes[level], sizes[level]);
+		glBindFramebuffer(GL_FRAMEBUFFER, fbos[level]);
+		glClear(GL_DEPTH_BUFFER_BIT);
+		draw();
+		glBindFramebuffer(GL_FRAMEBUFFER, 0);
+		valid = true;
+		renders++;
+	}
+
+	unsigned int DepthMap() const { return cubes[level]; }
+
+	// the fireShadow* uniforms of a lit shader
+	void Apply(Shader& shader) const {
+		shader.use();
+		shader.setBool("fireShadows", valid);
+		shader.setFloat("fireFarPlane", farPlane);
+	}
+
+	void PrintStats() {
+		int total = renders + skipped;
+		printf("fireball shadow: %d frames, %d skipped (%.1f%%), %d single-pass cube renders, last at %dx%d\n",
+			total, skipped, total ? 100.0 * skipped / total : 0.0, renders, sizes[level], sizes[level]);
+	}
+
+private:
+	unsigned int cubes[LEVELS] = {}, fbos[LEVELS] = {};
+	int level = 0;
+	bool valid = false;
+	glm::vec3 renderedPos = glm::vec3(0.0f);
+};
+
+#endif // !POINTSHADOW_H
@@ -0,0 +1,351 @@
+#pragma once
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <glad/glad.h>
+
+#include <vector>
+#include <string>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <algorithm>
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+
+// PROFILING 0 compiles every zone out; 1 leaves them in, costing a branch each until the profiler is enabled
+#ifndef PROFILING
+#define PROFILING 1
+#endif
+
+// Timed zones of the frame, on every thread and on the GPU, kept for a Chrome trace (chrome://tracing or
+// Perfetto) and a per-zone summary. Each thread writes its zones to a buffer of its own, sized once when
+// the thread first records, and only publishes how many it has written: recording takes no lock and no
+// allocation. The buffer is a ring, so the trace keeps the newest zones of a long run, while the summary
+// comes from per-zone totals kept as the zones are recorded and covers all of it.
+// Zone names must outlive the profiler (string literals). The summary is read once the threads are idle.
+class Profiler {
+public:
+	static const int ZONES = 256;	// names with totals per thread
+
+	struct Event {
+		const char* name;
+		double startUs, durationUs;
+	};
+	struct ZoneTotal {
+		const char* name = nullptr;
+		long long calls = 0;
+		double us = 0.0;
+	};
+	struct Buffer {
+		std::string name;
+		int id = 0;
+		std::unique_ptr<Event[]> events;
+		std::atomic<size_t> count{ 0 };	// ever recorded; the newest eventsPerThread are kept
+		size_t rewound = 0;	// zones below this were overwritten by ones later rewound
+		ZoneTotal zones[ZONES];	// open addressing on the name's address
+		long long untracked = 0;	// zones past the ZONES names, in the trace but not the totals
+
+		ZoneTotal* Zone(const char* zone) {
+			size_t slot = (reinterpret_cast<uintptr_t>(zone) >> 3) % ZONES;
+			for (int i = 0; i < ZONES; i++, slot = (slot + 1) % ZONES) {
+				if (zones[slot].name == zone)return &zones[slot];
+				if (!zones[slot].name) {
+					zones[slot].name = zone;
+					return &zones[slot];
+				}
+			}
+			return nullptr;
+		}
+	};
+	// where a thread's zones were up to, for Totals and Rewind
+	struct Position {
+		size_t count = 0;
+		std::vector<ZoneTotal> zones;
+	};
+
+	bool enabled = false;
+	size_t eventsPerThread = 1 << 18;
+
+	static Profiler& Get() {
+		static Profiler profiler;
+		return profiler;
+	}
+
+	double NowUs() const {
+		return std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - origin).count();
+	}
+
+	// the calling thread's buffer, made on its first zone; name shows in the trace
+	Buffer& Thread(const char* name = nullptr) {
+		static thread_local Buffer* buffer = nullptr;
+		if (!buffer)buffer = &NewBuffer(name ? name : "worker");
+		if (name)buffer->name = name;
+		return *buffer;
+	}
+	// a track not tied to a thread (the GPU's), written to by one thread only
+	Buffer& NewBuffer(const std::string& name) {
+		std::lock_guard<std::mutex> lock(mtx);
+		buffers.emplace_back(new Buffer());
+		Buffer& buffer = *buffers.back();
+		buffer.name = name;
+		buffer.id = (int)buffers.size();
+		buffer.events.reset(new Event[eventsPerThread]);
+		return buffer;
+	}
+
+	void Record(Buffer& buffer, const char* name, double startUs, double durationUs) {
+		size_t n = buffer.count.load(std::memory_order_relaxed);
+		buffer.events[n % eventsPerThread] = Event{ name, startUs, durationUs };
+		buffer.count.store(n + 1, std::memory_order_release);
+		ZoneTotal* zone = buffer.Zone(name);
+		if (!zone) {
+			buffer.untracked++;
+			return;
+		}
+		zone->calls++;
+		zone->us += durationUs;
+	}
+	void Record(const char* name, double startUs, double endUs) { Record(Thread(), name, startUs, endUs - startUs); }
+
+	Position Mark() {
+		Buffer& buffer = Thread();
+		Position mark;
+		mark.count = buffer.count.load(std::memory_order_relaxed);
+		mark.zones.assign(buffer.zones, buffer.zones + ZONES);
+		return mark;
+	}
+	// the calling thread's zones since mark, total milliseconds by name, slowest first
+	std::vector<std::pair<std::string, double>> Totals(const Position& mark) {
+		Buffer& buffer = Thread();
+		std::map<std::string, double> totals;
+		for (int i = 0; i < ZONES; i++)
+			if (buffer.zones[i].calls > mark.zones[i].calls)totals[buffer.zones[i].name] += (buffer.zones[i].us - mark.zones[i].us) / 1000.0;
+		std::vector<std::pair<std::string, double>> sorted(totals.begin(), totals.end());
+		std::sort(sorted.begin(), sorted.end(), [](const std::pair<std::string, double>& a, const std::pair<std::string, double>& b) { return a.second > b.second; });
+		return sorted;
+	}
+	// drops the calling thread's zones since mark from the trace and the totals, for a run that only wants
+	// Totals. Zones the ring has overwritten since stay lost
+	void Rewind(const Position& mark) {
+		Buffer& buffer = Thread();
+		size_t count = buffer.count.load(std::memory_order_relaxed);
+		if (mark.count < count) {
+			buffer.rewound = std::max(buffer.rewound, Oldest(buffer, count));
+			buffer.count.store(mark.count, std::memory_order_release);
+		}
+		std::copy(mark.zones.begin(), mark.zones.end(), buffer.zones);
+	}
+
+	// every recorded zone as Chrome trace JSON
+	bool Export(const char* path) {
+		FILE* file = fopen(path, "w");
+		if (!file) {
+			printf("profiler: can't write %s\n", path);
+			return false;
+		}
+		std::lock_guard<std::mutex> lock(mtx);
+		fprintf(file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+		bool first = true;
+		long long events = 0;
+		for (const auto& buffer : buffers) {
+			fprintf(file, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"%s\"}}", first ? "" : ",\n", buffer->id, buffer->name.c_str());
+			first = false;
+			size_t count = buffer->count.load(std::memory_order_acquire);
+			for (size_t i = Oldest(*buffer, count); i < count; i++) {
+				const Event& e = buffer->events[i % eventsPerThread];
+				fprintf(file, ",\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f}", e.name, buffer->id, e.startUs, e.durationUs);
+			}
+			events += count - Oldest(*buffer, count);
+		}
+		fprintf(file, "\n]}\n");
+		fclose(file);
+		printf("profiler: %lld zones written to %s\n", events, path);
+		return true;
+	}
+
+	// per track and zone over the whole run: calls, average and total time, and time per frame (frames are
+	// the "frame" zones). A track whose ring wrapped says which span its trace still covers
+	void PrintStats() {
+		if (!enabled)return;
+		std::lock_guard<std::mutex> lock(mtx);
+		struct Total { long long calls = 0; double us = 0.0; };
+		long long frames = 0;
+		for (const auto& buffer : buffers)
+			for (const ZoneTotal& zone : buffer->zones)
+				if (zone.name && !strcmp(zone.name, "frame"))frames += zone.calls;
+		printf("profile (%lld frames):\n", frames);
+		for (const auto& buffer : buffers) {
+			std::map<std::string, Total> totals;
+			for (const ZoneTotal& zone : buffer->zones) {
+				if (!zone.name)continue;
+				Total& t = totals[zone.name];
+				t.calls += zone.calls;
+				t.us += zone.us;
+			}
+			std::vector<std::pair<std::string, Total>> sorted(totals.begin(), totals.end());
+			std::sort(sorted.begin(), sorted.end(), [](const std::pair<std::string, Total>& a, const std::pair<std::string, Total>& b) { return a.second.us > b.second.us; });
+			for (const auto& zone : sorted)
+				printf("  %-8s %-24s %8lld calls %9.3f ms avg %10.1f ms total %8.3f ms per frame\n", buffer->name.c_str(), zone.first.c_str(), zone.second.calls,
+					zone.second.us / 1000.0 / zone.second.calls, zone.second.us / 1000.0, frames ? zone.second.us / 1000.0 / frames : 0.0);
+			size_t count = buffer->count.load(std::memory_order_acquire);
+			if (Oldest(*buffer, count))
+				printf("  %-8s the trace keeps the last %llu of %llu zones, from %.1f ms on\n", buffer->name.c_str(),
+					(unsigned long long)(count - Oldest(*buffer, count)), (unsigned long long)count,
+					buffer->events[Oldest(*buffer, count) % eventsPerThread].startUs / 1000.0);
+			if (buffer->untracked)printf("  %-8s %lld zones past the first %d names aren't in the totals\n", buffer->name.c_str(), buffer->untracked, ZONES);
+		}
+	}
+
+private:
+	std::chrono::steady_clock::time_point origin = std::chrono::steady_clock::now();
+	std::mutex mtx;	// only for adding buffers and reading them out
+	std::vector<std::unique_ptr<Buffer>> buffers;
+
+	// the first of the buffer's count zones the ring still holds
+	size_t Oldest(const Buffer& buffer, size_t count) const {
+		return std::min(count, std::max(buffer.rewound, count > eventsPerThread ? count - eventsPerThread : 0));
+	}
+};
+
+// GPU time of the zones, from GL_TIMESTAMP queries read back a few frames later without waiting. Without
+// timer queries (no GL 3.3 or a counter of 0 bits) it stays off and the zones only time the CPU.
+// Nested zones are fine, zones are only recorded on the GL thread.
+class GpuProfiler {
+public:
+	static const int FRAMES = 4, ZONES = 48;
+	bool available = false;
+
+	// counters
+	long long frames = 0, skipped = 0, overflows = 0;
+
+	static GpuProfiler& Get() {
+		static GpuProfiler profiler;
+		return profiler;
+	}
+
+	void Init() {
+		GLint bits = 0;
+		if (GLVersion.major > 3 || (GLVersion.major == 3 && GLVersion.minor >= 3))
+			glGetQueryiv(GL_TIMESTAMP, GL_QUERY_COUNTER_BITS, &bits);
+		available = bits > 0;
+		if (!available) {
+			printf("profiler: no GPU timer queries, GPU zones are off\n");
+			return;
+		}
+		for (Frame& f : slots)glGenQueries(ZONES * 2, f.queries);
+		// GPU timestamps are moved onto the CPU timeline by the difference between the two clocks now
+		GLint64 gpuNow = 0;
+		glGetInteger64v(GL_TIMESTAMP, &gpuNow);
+		offsetUs = Profiler::Get().NowUs() - gpuNow / 1000.0;
+		track = &Profiler::Get().NewBuffer("GPU");
+	}
+
+	// at the start of every frame: collects the frames the GPU has finished, then starts this one's zones
+	// unless all slots still wait for the GPU, in which case this frame goes untimed
+	void BeginFrame() {
+		recording = false;
+		if (!available || !Profiler::Get().enabled)return;
+		while (pending) {
+			Frame& f = slots[oldest];
+			GLint done = 0;
+			glGetQueryObjectiv(f.queries[f.last], GL_QUERY_RESULT_AVAILABLE, &done);
+			if (!done)break;
+			for (int z = 0; z < f.zones; z++) {
+				GLuint64 start = 0, end = 0;
+				glGetQueryObjectui64v(f.queries[2 * z], GL_QUERY_RESULT, &start);
+				glGetQueryObjectui64v(f.queries[2 * z + 1], GL_QUERY_RESULT, &end);
+				Profiler::Get().Record(*track, f.names[z], start / 1000.0 + offsetUs, (end - start) / 1000.0);
+			}
+			oldest = (oldest + 1) % FRAMES;
+			pending--;
+		}
+		if (pending == FRAMES) {
+			skipped++;
+			return;
+		}
+		current = (oldest + pending) % FRAMES;
+		slots[current].zones = 0;
+		recording = true;
+	}
+	void EndFrame() {
+		if (!recording)return;
+		recording = false;
+		if (!slots[current].zones)return;
+		pending++;
+		frames++;
+	}
+
+	// -1 when not timing
+	int Begin(const char* name) {
+		if (!recording)return -1;
+		Frame& f = slots[current];
+		if (f.zones == ZONES) {
+			overflows++;
+			return -1;
+		}
+		int z = f.zones++;
+		f.names[z] = name;
+		glQueryCounter(f.queries[2 * z], GL_TIMESTAMP);
+		f.last = 2 * z;
+		return z;
+	}
+	void End(int z) {
+		if (z < 0 || !recording)return;
+		Frame& f = slots[current];
+		glQueryCounter(f.queries[2 * z + 1], GL_TIMESTAMP);
+		f.last = 2 * z + 1;
+	}
+
+	void PrintStats() {
+		if (!frames)return;
+		printf("GPU profiler: %lld frames timed, %lld skipped waiting for results, %lld zones over the %d per frame\n", frames, skipped, overflows, ZONES);
+	}
+
+private:
+	struct Frame {
+		GLuint queries[ZONES * 2];
+		const char* names[ZONES];
+		int zones = 0, last = 0;	// last: the query issued last, done means all are
+	};
+	Frame slots[FRAMES];
+	int oldest = 0, pending = 0, current = 0;
+	bool recording = false;
+	double offsetUs = 0.0;
+	Profiler::Buffer* track = nullptr;
+};
+
+// times its scope on the calling thread
+struct ProfileZone {
+	const char* name;
+	double start;
+	explicit ProfileZone(const char* zone) : name(Profiler::Get().enabled ? zone : nullptr), start(name ? Profiler::Get().NowUs() : 0.0) {}
+	~ProfileZone() {
+		if (name)Profiler::Get().Record(name, start, Profiler::Get().NowUs());
+	}
+	ProfileZone(const ProfileZone&) = delete;
+	ProfileZone& operator=(const ProfileZone&) = delete;
+};
+
+// times its scope on the CPU and, with timer queries, on the GPU
+struct ProfileGpuZone {
+	ProfileZone cpu;
+	int gpu;
+	explicit ProfileGpuZone(const char* zone) : cpu(zone), gpu(GpuProfiler::Get().Begin(zone)) {}
+	~ProfileGpuZone() { GpuProfiler::Get().End(gpu); }
+};
+
+#define PROFILE_JOIN2(a, b) a##b
+#define PROFILE_JOIN(a, b) PROFILE_JOIN2(a, b)
+#if PROFILING
+#define PROFILE_ZONE(name) ProfileZone PROFILE_JOIN(profileZone, __LINE__)(name)
+#define PROFILE_GPU_ZONE(name) ProfileGpuZone PROFILE_JOIN(profileZone, __LINE__)(name)
+#else
+#define PROFILE_ZONE(name)
+#define PROFILE_GPU_ZONE(name)
+#endif
+
+#endif // !PROFILER_H
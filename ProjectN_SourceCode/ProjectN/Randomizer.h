@@ -3,16 +3,45 @@
 #define RANDOMIZER_H
 
 #include<random>
+#include<atomic>
+
+// Seeds come from one sequence: Reseed restarts it, and every Randomizer takes the next seed the first
+// time it is used after that, keeping its engine from then on. So a run is repeatable from the seed as
+// long as the simulation uses its Randomizers in the same order (the input log relies on it). One given
+// a seed of its own, for things outside the simulation, stays out of the sequence.
 class Randomizer {
 public:
-	std::random_device rd;
-
 	Randomizer() {}
+	explicit Randomizer(unsigned int seed) :fixed(true) { gen.seed(seed); }
 
 	float random(float l = 0.0f, float r = 1.0f) {
-		std::mt19937 gen(rd());
+		Sequence& s = Seeds();
+		if (!fixed && epoch != s.epoch.load())
+			epoch = s.epoch.load(), gen.seed(s.base + 0x9E3779B9u * ++s.next);
 		std::uniform_real_distribution<> dis(l, r);
 		return dis(gen);
 	}
+
+	// restarts the sequence, every Randomizer reseeds on its next use
+	static void Reseed(unsigned int seed) {
+		Sequence& s = Seeds();
+		s.base = seed;
+		s.next = 0;
+		s.epoch++;
+	}
+	static unsigned int Seed() { return Seeds().base; }
+
+private:
+	struct Sequence {
+		unsigned int base = std::random_device()();	// a live session differs from run to run
+		std::atomic<unsigned int> next{ 0 }, epoch{ 1 };
+	};
+	static Sequence& Seeds() {
+		static Sequence sequence;
+		return sequence;
+	}
+	std::mt19937 gen;
+	unsigned int epoch = 0;
+	bool fixed = false;
 };
-#endif
\ No newline at end of file
+#endif
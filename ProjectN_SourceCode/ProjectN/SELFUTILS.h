@@ -3,6 +3,7 @@
 
 #include "Mesh.h"
 #include "FireAnimation.h"
+#include "FireBallPool.h"
 
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
@@ -10,6 +11,7 @@
 #include "Ball.h"
 #include "Plane.h"
 #include "tumbler.h"
+#include "BVH.h"
 
 const float fireBallMass = 3.0f;
 
@@ -154,6 +156,16 @@ bool Ball_TumblerCollide(Ball& ball, Tumbler& tumbler) {
 
 	return false;
 }
+bool Ball_PropCollide(Ball& ball, Room& room) {
+	Contact contact;
+	for (auto& prop : room.props)
+		if (prop->collider.Collide(ball.position, ball.radius, contact)) {
+			ball.position += contact.normal * contact.depth;
+			if (glm::dot(ball.V, contact.normal) < 0.0f)ball.Reflect(contact.normal);
+			return true;
+		}
+	return false;
+}
 void Balls_CollideCalculation(BallSystem &ballSys, Room &room, TumblerCluster &tumblers) {
 	if (!ballSys.isActivated)return;
 	for (int i = 0; i < ballSys.N; i++) {
@@ -165,6 +177,7 @@ void Balls_CollideCalculation(BallSystem &ballSys, Room &room, TumblerCluster &t
 				break;
 			}
 		if (tumblerFlag)continue;
+		if (Ball_PropCollide(ballSys.balls[i], room))continue;
 		if (Ball_WallCollide(ballSys.balls[i], room))continue;
 
 	}
@@ -194,6 +207,16 @@ bool Fireball_WallCollide(FireBall &fireBall, Room& room, StaticParticleManager&
 	}
 	return false;
 }
+bool Fireball_PropCollide(FireBall& fireBall, Room& room, StaticParticleManager& ptm) {
+	Contact contact;
+	for (auto& prop : room.props)
+		if (prop->collider.Collide(fireBall.position, fireBall.radius, contact)) {
+			fireBall.living = false;
+			ptm.SE_Sparkle(fireBall.position, contact.normal);
+			return true;
+		}
+	return false;
+}
 bool Fireball_TumblerCollide(FireBall& fireBall, Tumbler& tumbler, StaticParticleManager& ptm) {
 	glm::mat4 modelMatrix = glm::mat4(1.0f);
 	modelMatrix = glm::translate(modelMatrix, tumbler.position);
@@ -278,14 +301,27 @@ bool Fireball_BallCollide(FireBall& fireBall, Ball &ball, StaticParticleManager&
 
 	return true;
 }
-void Fireball_CollideCalculation(FireBall& fireball, BallSystem& ballSys, Room& room, TumblerCluster& tumblers, StaticParticleManager& ptm) {
+// With a scene BVH (tumblers as objects 0-4, balls from 5 on), only the objects whose boxes come near the
+// fireball are tested; the padding is the tumbler test's far threshold, which covers the ball test too
+void Fireball_CollideCalculation(FireBall& fireball, BallSystem& ballSys, Room& room, TumblerCluster& tumblers, StaticParticleManager& ptm, const SceneBVH* scene = nullptr) {
 	if (!fireball.living)return;
 
+	static std::vector<int> candidates;
+	if (scene) {
+		glm::vec3 pad(0.2f);
+		scene->Overlap(fireball.position - pad, fireball.position + pad, candidates);
+	}
+	else {
+		candidates.clear();
+		for (int i = 0; i < 5 + ballSys.N; i++)candidates.push_back(i);
+	}
+
 	bool flag = false;
 	if (ballSys.isActivated) {
-		for (int i = 0; i < ballSys.N; i++) {
-			if (!ballSys.balls[i].living)continue;
-			if (Fireball_BallCollide(fireball, ballSys.balls[i], ptm)) {
+		for (int id : candidates) {
+			if (id < 5)continue;
+			if (!ballSys.balls[id - 5].living)continue;
+			if (Fireball_BallCollide(fireball, ballSys.balls[id - 5], ptm)) {
 				flag = true;
 				break;
 			}
@@ -293,10 +329,16 @@ void Fireball_CollideCalculation(FireBall& fireball, BallSystem& ballSys, Room&
 	}
 	if (flag)return;
 
-	for (int i = 0; i < 5; i++)
-		if (Fireball_TumblerCollide(fireball, tumblers.tumblers[i], ptm))return;
+	for (int id : candidates)
+		if (id < 5 && Fireball_TumblerCollide(fireball, tumblers.tumblers[id], ptm))return;
+	if (Fireball_PropCollide(fireball, room, ptm))return;
 	if (Fireball_WallCollide(fireball, room, ptm))return;
 	return;
 }
+// every living fireball of the pool, they are handed back on its next Update
+void FireBalls_CollideCalculation(FireBallPool& pool, BallSystem& ballSys, Room& room, TumblerCluster& tumblers, StaticParticleManager& ptm, const SceneBVH* scene = nullptr) {
+	for (int slot : pool.Living())
+		Fireball_CollideCalculation(pool.balls[slot], ballSys, room, tumblers, ptm, scene);
+}
 
 #endif
@@ -0,0 +1,298 @@
+#pragma once
+#ifndef SCENARIOBENCH_H
+#define SCENARIOBENCH_H
+
+#include "Randomizer.h"
+#include "Profiler.h"
+#include "FrameArena.h"
+
+#include <vector>
+#include <string>
+#include <functional>
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+
+// One scripted run of the simulation: from the state the suite started in, with the random numbers
+// restarted from seed, setup and then input before every step feed it the same things every time
+struct Scenario {
+	const char* name;
+	const char* description;
+	unsigned int seed;
+	int steps;
+	std::function<void(Randomizer&)> setup;
+	std::function<void(int, Randomizer&)> input;	// step, the scenario's own random numbers
+};
+
+struct ScenarioResult {
+	std::string name;
+	int steps = 0;
+	double msPerStep = 0.0, p50Ms = 0.0, p95Ms = 0.0, maxMs = 0.0;
+	long long allocations = 0;
+	int allocatingSteps = 0;
+	std::string checksum;	// of the state at the end, the same for the same script
+	std::vector<std::pair<std::string, double>> zones;	// milliseconds per step, from the profile zones the step ran through
+	const double* Zone(const std::string& zone) const {
+		for (const auto& z : zones)
+			if (z.first == zone)return &z.second;
+		return nullptr;
+	}
+};
+
+// Runs scenarios headlessly at a fixed time step and writes their results as JSON: time per step (mean,
+// p50, p95, worst), per profile zone, heap allocations, and a checksum of the end state. Compare holds
+// two result files against each other and flags what got slower by more than a threshold.
+// The scene's state is reset between scenarios by reset; step is one simulation step, on this thread.
+class ScenarioBench {
+public:
+	float dt = 1.0f / 60.0f;
+	std::function<void()> reset;
+	std::function<void(float)> step;
+	std::function<uint64_t()> checksum;
+	std::vector<ScenarioResult> results;
+
+	void Run(const Scenario& scenario) {
+		reset();
+		Randomizer::Reseed(scenario.seed);
+		Randomizer random(scenario.seed);
+		if (scenario.setup)scenario.setup(random);
+
+		Profiler& profiler = Profiler::Get();
+		bool profiling = profiler.enabled;
+		profiler.enabled = true;
+		Profiler::Position mark = profiler.Mark();
+		std::vector<double> times(scenario.steps);
+		ScenarioResult result;
+		result.name = scenario.name;
+		result.steps = scenario.steps;
+		for (int i = 0; i < scenario.steps; i++) {
+			long long heap = HeapCounter::Thread();
+			auto start = std::chrono::steady_clock::now();
+			if (scenario.input)scenario.input(i, random);
+			step(dt);
+			times[i] = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+			long long allocations = HeapCounter::Thread() - heap;
+			result.allocations += allocations;
+			result.allocatingSteps += allocations > 0;
+		}
+		result.zones = profiler.Totals(mark);
+		for (auto& zone : result.zones)zone.second /= std::max(scenario.steps, 1);
+		// the suite's zones only make up the totals unless a trace was asked for
+		if (!profiling)profiler.Rewind(mark);
+		profiler.enabled = profiling;
+
+		for (double t : times)result.msPerStep += t;
+		result.msPerStep /= std::max(scenario.steps, 1);
+		if (!times.empty()) {
+			std::sort(times.begin(), times.end());
+			result.p50Ms = times[(times.size() - 1) / 2];
+			result.p95Ms = times[std::min(times.size() - 1, (size_t)std::ceil(times.size() * 0.95) - 1)];
+			result.maxMs = times.back();
+		}
+		char hash[17];
+		snprintf(hash, sizeof(hash), "%016llx", (unsigned long long)checksum());
+		result.checksum = hash;
+		printf("%-16s %6d steps %8.3f ms/step  p50 %7.3f  p95 %7.3f  max %7.3f  %7lld allocations in %5d steps  %s\n", result.name.c_str(), result.steps,
+			result.msPerStep, result.p50Ms, result.p95Ms, result.maxMs, result.allocations, result.allocatingSteps, result.checksum.c_str());
+		results.push_back(result);
+	}
+
+	bool Write(const char* path) const {
+		FILE* file = fopen(path, "w");
+		if (!file) {
+			printf("scenarios: can't write %s\n", path);
+			return false;
+		}
+		fprintf(file, "{\n\"dt\": %.6f,\n\"scenarios\": [", dt);
+		for (size_t i = 0; i < results.size(); i++) {
+			const ScenarioResult& r = results[i];
+			fprintf(file, "%s\n  {\"name\": \"%s\", \"steps\": %d, \"ms_per_step\": %.6f, \"p50_ms\": %.6f, \"p95_ms\": %.6f, \"max_ms\": %.6f, "
+				"\"allocations\": %lld, \"allocating_steps\": %d, \"checksum\": \"%s\",\n   \"zones\": {", i ? "," : "", r.name.c_str(), r.steps,
+				r.msPerStep, r.p50Ms, r.p95Ms, r.maxMs, r.allocations, r.allocatingSteps, r.checksum.c_str());
+			for (size_t z = 0; z < r.zones.size(); z++)
+				fprintf(file, "%s\"%s\": %.6f", z ? ", " : "", r.zones[z].first.c_str(), r.zones[z].second);
+			fprintf(file, "}}");
+		}
+		fprintf(file, "\n]\n}\n");
+		fclose(file);
+		printf("scenarios: %d results written to %s\n", (int)results.size(), path);
+		return true;
+	}
+
+	// a file Write wrote
+	static bool Read(const char* path, std::vector<ScenarioResult>& out) {
+		FILE* file = fopen(path, "rb");
+		if (!file) {
+			printf("scenarios: can't read %s\n", path);
+			return false;
+		}
+		std::string text;
+		char chunk[4096];
+		size_t n;
+		while ((n = fread(chunk, 1, sizeof(chunk), file)) > 0)text.append(chunk, n);
+		fclose(file);
+		Json json{ text.c_str() };
+		if (!json.Results(out)) {
+			printf("scenarios: %s isn't a results file (near byte %d)\n", path, (int)(json.p - text.c_str()));
+			return false;
+		}
+		return true;
+	}
+
+	// a zone under this many milliseconds a step is mostly timer noise, its changes are only shown
+	static constexpr double ZONE_FLOOR_MS = 0.05;
+
+	// every scenario in both, side by side; a regression is a time up by more than threshold (0.1 for 10%)
+	// and by more than a microsecond (a zone's by more than threshold of at least ZONE_FLOOR_MS), more
+	// allocations, a different end state, or a scenario of the baseline gone missing. Returns how many
+	static int Compare(const std::vector<ScenarioResult>& baseline, const std::vector<ScenarioResult>& current, double threshold) {
+		int regressions = 0;
+		auto check = [&](const char* scenario, const char* what, double before, double now, double floorMs) {
+			bool worse = now > before * (1.0 + threshold) && now - before > 0.001 && std::max(before, now) >= floorMs;
+			printf("  %-16s %-24s %10.4f -> %10.4f ms %+7.1f%%%s\n", scenario, what, before, now, before > 0.0 ? (now / before - 1.0) * 100.0 : 0.0,
+				worse ? "  REGRESSION" : now > before * (1.0 + threshold) && now - before > 0.001 ? "  (under the floor)" : "");
+			regressions += worse;
+		};
+		for (const ScenarioResult& now : current) {
+			const ScenarioResult* before = nullptr;
+			for (const ScenarioResult& r : baseline)
+				if (r.name == now.name)before = &r;
+			if (!before) {
+				printf("  %-16s not in the baseline\n", now.name.c_str());
+				continue;
+			}
+			const char* name = now.name.c_str();
+			check(name, "per step", before->msPerStep, now.msPerStep, 0.0);
+			check(name, "p95", before->p95Ms, now.p95Ms, 0.0);
+			for (const auto& zone : now.zones)
+				if (const double* was = before->Zone(zone.first))check(name, zone.first.c_str(), *was, zone.second, ZONE_FLOOR_MS);
+			if (now.allocations > before->allocations) {
+				printf("  %-16s %-24s %10lld -> %10lld  REGRESSION\n", name, "allocations", before->allocations, now.allocations);
+				regressions++;
+			}
+			if (now.steps != before->steps || now.checksum != before->checksum) {
+				printf("  %-16s end state %s -> %s after %d -> %d steps  DIVERGED\n", name, before->checksum.c_str(), now.checksum.c_str(), before->steps, now.steps);
+				regressions++;
+			}
+		}
+		for (const ScenarioResult& before : baseline) {
+			bool ran = false;
+			for (const ScenarioResult& r : current)
+				ran = ran || r.name == before.name;
+			if (ran)continue;
+			printf("  %-16s in the baseline, not in the results  MISSING\n", before.name.c_str());
+			regressions++;
+		}
+		printf("scenarios: %d regressions beyond %.0f%%\n", regressions, threshold * 100.0);
+		return regressions;
+	}
+
+private:
+	// just enough JSON for the results files: objects, arrays, strings without escapes, numbers
+	struct Json {
+		const char* p;
+
+		void Space() { while (*p == ' ' || *p == '\n' || *p == '\r' || *p == '\t')p++; }
+		bool Take(char c) {
+			Space();
+			if (*p != c)return false;
+			p++;
+			return true;
+		}
+		bool String(std::string& out) {
+			if (!Take('"'))return false;
+			const char* end = strchr(p, '"');
+			if (!end)return false;
+			out.assign(p, end);
+			p = end + 1;
+			return true;
+		}
+		bool Number(double& out) {
+			Space();
+			char* end;
+			out = strtod(p, &end);
+			if (end == p)return false;
+			p = end;
+			return true;
+		}
+		// a value of a key nothing reads
+		bool Skip() {
+			Space();
+			std::string s;
+			double d;
+			if (*p == '"')return String(s);
+			if (*p == '{' || *p == '[') {
+				char close = *p == '{' ? '}' : ']';
+				p++;
+				if (Take(close))return true;
+				do {
+					if (close == '}' && (!String(s) || !Take(':')))return false;
+					if (!Skip())return false;
+				} while (Take(','));
+				return Take(close);
+			}
+			for (const char* word : { "true", "false", "null" })
+				if (!strncmp(p, word, strlen(word)))return p += strlen(word), true;
+			return Number(d);
+		}
+		// a scenario's object
+		bool Result(ScenarioResult& r) {
+			if (!Take('{'))return false;
+			std::string key;
+			do {
+				double number = 0.0;
+				if (!String(key) || !Take(':'))return false;
+				bool ok = true;
+				if (key == "name")ok = String(r.name);
+				else if (key == "checksum")ok = String(r.checksum);
+				else if (key == "zones") {
+					if (!Take('{'))return false;
+					if (!Take('}')) {
+						do {
+							std::string zone;
+							if (!String(zone) || !Take(':') || !Number(number))return false;
+							r.zones.push_back({ zone, number });
+						} while (Take(','));
+						ok = Take('}');
+					}
+				}
+				else if (key == "steps")ok = Number(number), r.steps = (int)number;
+				else if (key == "ms_per_step")ok = Number(r.msPerStep);
+				else if (key == "p50_ms")ok = Number(r.p50Ms);
+				else if (key == "p95_ms")ok = Number(r.p95Ms);
+				else if (key == "max_ms")ok = Number(r.maxMs);
+				else if (key == "allocations")ok = Number(number), r.allocations = (long long)number;
+				else if (key == "allocating_steps")ok = Number(number), r.allocatingSteps = (int)number;
+				else ok = Skip();
+				if (!ok)return false;
+			} while (Take(','));
+			return Take('}');
+		}
+		bool Results(std::vector<ScenarioResult>& out) {
+			if (!Take('{'))return false;
+			std::string key;
+			do {
+				if (!String(key) || !Take(':'))return false;
+				if (key != "scenarios") {
+					if (!Skip())return false;
+					continue;
+				}
+				if (!Take('['))return false;
+				if (Take(']'))continue;
+				do {
+					ScenarioResult r;
+					if (!Result(r))return false;
+					out.push_back(r);
+				} while (Take(','));
+				if (!Take(']'))return false;
+			} while (Take(','));
+			return Take('}');
+		}
+	};
+};
+
+#endif // !SCENARIOBENCH_H
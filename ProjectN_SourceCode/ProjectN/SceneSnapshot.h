@@ -0,0 +1,196 @@
+#pragma once
+#ifndef SCENESNAPSHOT_H
+#define SCENESNAPSHOT_H
+
+#include <vector>
+#include <algorithm>
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+
+// The simulation's state at one moment, as named columns: every block holds one field of every object of a
+// kind (all particle positions, then all particle velocities, ...), so saving and restoring are plain
+// copies and two snapshots compare field by field. The objects write and read their own blocks (Save and
+// Restore on TumblerCluster, BallSystem, FireBallPool, StaticParticleManager).
+// File: "PNSS", version, block count, then per block its tag, element size, count and offset, then the
+// blocks, each 16-byte aligned from the start of the file. Nothing needs unpacking, so a file mapped into
+// memory can be handed to View and read in place.
+class SceneSnapshot {
+public:
+	static const uint32_t VERSION = 1;
+
+	// a new block of count elements for the caller to fill, valid until the next Add
+	template <class T>
+	T* Add(const char* tag, size_t count) {
+		Block block;
+		memcpy(block.tag, tag, 4);
+		block.elementSize = sizeof(T);
+		block.count = count;
+		block.offset = (data.size() + 15) / 16 * 16;
+		data.resize(block.offset + sizeof(T) * count);
+		blocks.push_back(block);
+		base = data.data();
+		return reinterpret_cast<T*>(data.data() + block.offset);
+	}
+	// the block with this tag, nullptr unless it holds count elements of T
+	template <class T>
+	const T* Get(const char* tag, size_t count) const {
+		const Block* block = Find(tag);
+		if (!block || block->elementSize != sizeof(T) || block->count != count)return nullptr;
+		return reinterpret_cast<const T*>(base + block->offset);
+	}
+	// a block's element count, for sizing what it is restored into; 0 if missing
+	size_t Count(const char* tag) const {
+		const Block* block = Find(tag);
+		return block ? (size_t)block->count : 0;
+	}
+
+	// one field of every object as a block, from objects in an array or behind pointers
+	template <class T, class Object>
+	void AddField(const char* tag, const Object* objects, size_t count, T Object::* field) {
+		T* out = Add<T>(tag, count);
+		for (size_t i = 0; i < count; i++)out[i] = objects[i].*field;
+	}
+	template <class T, class Object>
+	void AddField(const char* tag, const Object* const* objects, size_t count, T Object::* field) {
+		T* out = Add<T>(tag, count);
+		for (size_t i = 0; i < count; i++)out[i] = objects[i]->*field;
+	}
+	// and back; false, leaving the objects as they were, if the block is missing or of another size
+	template <class T, class Object>
+	bool GetField(const char* tag, Object* objects, size_t count, T Object::* field) const {
+		const T* in = Get<T>(tag, count);
+		if (!in)return false;
+		for (size_t i = 0; i < count; i++)objects[i].*field = in[i];
+		return true;
+	}
+	template <class T, class Object>
+	bool GetField(const char* tag, Object* const* objects, size_t count, T Object::* field) const {
+		const T* in = Get<T>(tag, count);
+		if (!in)return false;
+		for (size_t i = 0; i < count; i++)objects[i]->*field = in[i];
+		return true;
+	}
+
+	// a whole vector as a block, restored at the size it was saved with
+	template <class T>
+	void AddArray(const char* tag, const std::vector<T>& values) {
+		T* out = Add<T>(tag, values.size());
+		std::copy(values.begin(), values.end(), out);
+	}
+	template <class T>
+	bool GetArray(const char* tag, std::vector<T>& values) const {
+		size_t count = Count(tag);
+		const T* in = Get<T>(tag, count);
+		if (!in)return false;
+		values.assign(in, in + count);
+		return true;
+	}
+
+	bool Save(const char* path) const {
+		FILE* file = fopen(path, "wb");
+		if (!file) {
+			printf("snapshot: can't write %s\n", path);
+			return false;
+		}
+		uint32_t header[4] = { 0, VERSION, (uint32_t)blocks.size(), 0 };
+		memcpy(header, "PNSS", 4);
+		bool written = fwrite(header, sizeof(header), 1, file) == 1;
+		uint64_t table = sizeof(header) + sizeof(Block) * blocks.size(), start = (table + 15) / 16 * 16;
+		for (Block block : blocks) {
+			block.offset += start;
+			written = written && fwrite(&block, sizeof(block), 1, file) == 1;
+		}
+		const unsigned char padding[16] = {};
+		written = written && fwrite(padding, 1, start - table, file) == start - table;
+		written = written && fwrite(data.data(), 1, data.size(), file) == data.size();
+		// a full disk may only show when the buffer is flushed
+		written = fclose(file) == 0 && written;
+		if (!written)printf("snapshot: couldn't write all of %s\n", path);
+		return written;
+	}
+	// reads the whole file and views it
+	bool Load(const char* path) {
+		FILE* file = fopen(path, "rb");
+		if (!file) {
+			printf("snapshot: can't read %s\n", path);
+			return false;
+		}
+		fseek(file, 0, SEEK_END);
+		long size = ftell(file);
+		fseek(file, 0, SEEK_SET);
+		data.resize(size > 0 ? size : 0);
+		bool read = fread(data.data(), 1, data.size(), file) == data.size();
+		fclose(file);
+		if (!read || !View(data.data(), data.size())) {
+			printf("snapshot: %s isn't a readable snapshot\n", path);
+			return false;
+		}
+		return true;
+	}
+	// a snapshot file already in memory (mapped, or read by Load), 16-byte aligned; bytes must outlive it
+	bool View(const unsigned char* bytes, size_t size) {
+		blocks.clear();
+		uint32_t header[4];
+		if (size < sizeof(header))return false;
+		memcpy(header, bytes, sizeof(header));
+		if (memcmp(header, "PNSS", 4) || header[1] != VERSION || header[2] > (size - sizeof(header)) / sizeof(Block))return false;
+		blocks.resize(header[2]);
+		memcpy(blocks.data(), bytes + sizeof(header), sizeof(Block) * blocks.size());
+		// divided rather than multiplied, so a corrupt count can't wrap around
+		for (const Block& block : blocks)
+			if (block.offset % 16 || block.offset > size || !block.elementSize || block.count > (size - block.offset) / block.elementSize)return false;
+		base = bytes;
+		return true;
+	}
+
+	// prints the blocks that differ from other's, with how many elements and the first; returns how many
+	int Diff(const SceneSnapshot& other) const {
+		int differing = 0;
+		for (const Block& block : blocks) {
+			const Block* theirs = other.Find(block.tag);
+			if (!theirs || theirs->elementSize != block.elementSize || theirs->count != block.count) {
+				printf("  %.4s: %llu elements here, %llu there\n", block.tag, (unsigned long long)block.count, theirs ? (unsigned long long)theirs->count : 0ull);
+				differing++;
+				continue;
+			}
+			const unsigned char* a = base + block.offset, * b = other.base + theirs->offset;
+			uint64_t changed = 0, first = 0;
+			for (uint64_t i = 0; i < block.count; i++)
+				if (memcmp(a + i * block.elementSize, b + i * block.elementSize, block.elementSize)) {
+					if (!changed)first = i;
+					changed++;
+				}
+			if (!changed)continue;
+			printf("  %.4s: %llu of %llu elements differ, the first at %llu\n", block.tag, (unsigned long long)changed, (unsigned long long)block.count, (unsigned long long)first);
+			differing++;
+		}
+		for (const Block& block : other.blocks)
+			if (!Find(block.tag)) {
+				printf("  %.4s: missing here, %llu elements there\n", block.tag, (unsigned long long)block.count);
+				differing++;
+			}
+		return differing;
+	}
+
+	size_t Bytes() const { return data.size(); }
+	int Blocks() const { return (int)blocks.size(); }
+
+private:
+	struct Block {
+		char tag[4];
+		uint32_t elementSize;
+		uint64_t count, offset;
+	};
+	std::vector<Block> blocks;
+	std::vector<unsigned char> data;
+	const unsigned char* base = nullptr;
+
+	const Block* Find(const char* tag) const {
+		for (const Block& block : blocks)
+			if (!memcmp(block.tag, tag, 4))return &block;
+		return nullptr;
+	}
+};
+
+#endif // !SCENESNAPSHOT_H
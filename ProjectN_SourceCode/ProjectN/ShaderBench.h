@@ -0,0 +1,74 @@
+#pragma once
+#ifndef SHADERBENCH_H
+#define SHADERBENCH_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include "Mesh.h"
+#include "ShaderManager.h"
+
+#include <string>
+#include <vector>
+#include <functional>
+#include <cstdio>
+
+// Fragment cost of shader permutations: every case shades a full-screen quad a number of times inside a
+// GL_TIME_ELAPSED query. Cases sharing a group are compared with the first case of that group.
+// Run with LIBGL_ALWAYS_SOFTWARE=1 (Mesa llvmpipe) to measure on a software rasteriser, where the time
+// follows the per-fragment instructions and texture taps directly.
+struct ShaderBenchCase {
+	std::string group, label;
+	ShaderVariants* variants;
+	std::string defines;
+	std::function<void(Shader&)> uniforms;	// called with the program bound
+};
+
+inline void RunShaderBenchmark(const std::vector<ShaderBenchCase>& cases, const Texture& texture, int passes = 20) {
+	vector<Vertex> vertices(4);
+	const float corners[4][2] = { { -1.0f, -1.0f }, { 1.0f, -1.0f }, { 1.0f, 1.0f }, { -1.0f, 1.0f } };
+	for (int i = 0; i < 4; i++) {
+		vertices[i].Position = glm::vec3(corners[i][0], corners[i][1], 0.0f);
+		vertices[i].Normal = glm::vec3(0.0f, 0.0f, 1.0f);
+		vertices[i].TexCoords = glm::vec2(corners[i][0] * 0.5f + 0.5f, corners[i][1] * 0.5f + 0.5f);
+	}
+	Mesh quad(vertices, { 0, 1, 2, 0, 2, 3 }, { texture });
+
+	GLint viewport[4];
+	glGetIntegerv(GL_VIEWPORT, viewport);
+	double fragments = (double)viewport[2] * viewport[3] * passes;
+	unsigned int query;
+	glGenQueries(1, &query);
+	glDisable(GL_DEPTH_TEST);
+
+	printf("\n---------------------------- shader permutation cost ----------------------------\n");
+	printf("renderer: %s, %dx%d, %d passes per case\n", (const char*)glGetString(GL_RENDERER), viewport[2], viewport[3], passes);
+	printf("%-8s %-44s %10s %10s %8s\n", "group", "case", "ms/pass", "ns/frag", "vs base");
+	double base = 0.0;
+	std::string group;
+	for (const ShaderBenchCase& c : cases) {
+		Shader& shader = c.variants->Get(c.defines);
+		shader.use();
+		c.uniforms(shader);
+		shader.setMat4("projection", glm::mat4(1.0f));
+		shader.setMat4("view", glm::mat4(1.0f));
+		shader.setMat4("model", glm::mat4(1.0f));
+		quad.Draw(shader);
+		glFinish();
+
+		glBeginQuery(GL_TIME_ELAPSED, query);
+		for (int i = 0; i < passes; i++)quad.Draw(shader);
+		glEndQuery(GL_TIME_ELAPSED);
+		GLuint64 ns = 0;
+		glGetQueryObjectui64v(query, GL_QUERY_RESULT, &ns);
+
+		if (c.group != group)group = c.group, base = (double)ns;
+		printf("%-8s %-44s %10.3f %10.3f %7.0f%%\n", c.group.c_str(), c.label.c_str(), ns / 1e6 / passes, ns / fragments, base > 0.0 ? 100.0 * ns / base : 100.0);
+	}
+	printf("---------------------------------------------------------------------------------\n\n");
+
+	glDeleteQueries(1, &query);
+	glEnable(GL_DEPTH_TEST);
+}
+
+#endif // !SHADERBENCH_H
@@ -0,0 +1,380 @@
+#pragma once
+#ifndef SHADERMANAGER_H
+#define SHADERMANAGER_H
+
+#include <glad/glad.h>
+
+#include "Shader.h"
+#include "JobSystem.h"
+#include "GLResource.h"
+
+#include <string>
+#include <vector>
+#include <map>
+#include <memory>
+#include <fstream>
+#include <iterator>
+#include <thread>
+#include <functional>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#ifdef _WIN32
+#include <direct.h>
+#else
+#include <sys/stat.h>
+#endif
+
+#ifndef GL_COMPLETION_STATUS_KHR
+#define GL_COMPLETION_STATUS_KHR 0x91B1
+#endif
+
+// Builds every shader program once. Programs with identical sources are shared, linked programs are
+// cached as driver binaries keyed by source hash and driver, and compiles are only issued by the load
+// jobs: their status is collected in Finish(), so with KHR_parallel_shader_compile they build in the
+// driver's threads while the rest of the startup goes on.
+class ShaderManager {
+public:
+	ShaderManager(JobSystem& jobSystem, GLADloadproc load, const std::string& cacheDirectory = "shader/cache")
+		:jobs(jobSystem), cacheDir(cacheDirectory) {
+		driver = std::string((const char*)glGetString(GL_VENDOR)) + "|" + (const char*)glGetString(GL_RENDERER) + "|" + (const char*)glGetString(GL_VERSION);
+
+		// GLX and EGL hand out a pointer for any name, so only the extension list says the driver has it
+		typedef void (*MaxThreadsProc)(GLuint);
+		MaxThreadsProc maxThreads = nullptr;
+		if (HasExtension("GL_KHR_parallel_shader_compile"))maxThreads = (MaxThreadsProc)load("glMaxShaderCompilerThreadsKHR");
+		else if (HasExtension("GL_ARB_parallel_shader_compile"))maxThreads = (MaxThreadsProc)load("glMaxShaderCompilerThreadsARB");
+		if (maxThreads) {
+			maxThreads(0xFFFFFFFFu);
+			parallel = true;
+		}
+#ifdef GL_NUM_PROGRAM_BINARY_FORMATS
+		GLint formats = 0;
+		if (GLVersion.major > 4 || (GLVersion.major == 4 && GLVersion.minor >= 1))
+			glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+		binaryCache = formats > 0;
+#endif
+		if (binaryCache) {
+#ifdef _WIN32
+			_mkdir(cacheDir.c_str());
+#else
+			mkdir(cacheDir.c_str(), 0755);
+#endif
+		}
+		startMs = jobs.NowMs();
+	}
+
+	// shader gets its ID in Finish(), the returned job is done once the program is issued to the driver.
+	// defines is a ';' separated list of "NAME value" pairs, inserted as #define lines after #version
+	JobHandle Load(Shader& shader, const char* vertexPath, const char* fragmentPath, const std::string& defines = "", const char* geometryPath = nullptr) {
+		std::string pathKey = std::string(vertexPath) + '|' + fragmentPath + '|' + defines + '|' + (geometryPath ? geometryPath : "");
+		auto found = byPath.find(pathKey);
+		if (found != byPath.end()) {
+			found->second->users.push_back(&shader);
+			if (found->second->assigned)shader.ID = (found->second->alias ? found->second->alias : found->second)->id;
+			return found->second->issued;
+		}
+		std::unique_ptr<Program> program(new Program());
+		Program* p = program.get();
+		p->vertexPath = vertexPath, p->fragmentPath = fragmentPath, p->defines = defines;
+		if (geometryPath)p->geometryPath = geometryPath;
+		p->users.push_back(&shader);
+		byPath[pathKey] = p;
+		programs.push_back(std::move(program));
+
+		JobHandle read = jobs.Submit(p->fragmentPath, "read", [this, p] {
+			Shader::ReadSources(p->vertexPath.c_str(), p->fragmentPath.c_str(), p->vertexCode, p->fragmentCode);
+			ApplyDefines(p->vertexCode, p->defines);
+			ApplyDefines(p->fragmentCode, p->defines);
+			if (!p->geometryPath.empty()) {
+				ReadFile(p->geometryPath, p->geometryCode);
+				ApplyDefines(p->geometryCode, p->defines);
+			}
+			p->key = Hash(p->vertexCode + '\0' + p->geometryCode + '\0' + p->fragmentCode + '\0' + driver);
+		});
+		p->issued = jobs.SubmitMain(p->fragmentPath, "compile", [this, p] { Issue(p); }, { read });
+		return p->issued;
+	}
+
+	// waits for every loaded program to be issued and linked, hands out the IDs and stores new binaries.
+	// Can be called again for programs loaded later on. Main thread only, it runs the pending compile jobs
+	void Finish() {
+		for (auto& program : programs)
+			if (!program->done)jobs.Wait(program->issued);
+		double pollStart = jobs.NowMs();
+		bool pending = true;
+		while (pending) {
+			pending = false;
+			for (auto& program : programs) {
+				Program* p = program.get();
+				if (p->done || p->alias)continue;
+				if (parallel) {
+					GLint complete = 0;
+					glGetProgramiv(p->id, GL_COMPLETION_STATUS_KHR, &complete);
+					// a driver that rejects the query, or never reports completion, is waited on through the link status
+					if (!complete && glGetError() == GL_INVALID_ENUM)parallel = false;
+					else if (!complete && jobs.NowMs() - pollStart < POLL_MS) {
+						pending = true;
+						continue;
+					}
+				}
+				Collect(p);
+			}
+			if (pending)std::this_thread::yield();
+		}
+		for (auto& program : programs) {
+			Program* p = program.get();
+			if (p->assigned)continue;
+			Program* source = p->alias ? p->alias : p;
+			// a program that never got a GL object stays unassigned rather than binding program 0
+			if (!source->done || !source->id)continue;
+			for (Shader* shader : p->users)shader->ID = source->id;
+			p->assigned = true;
+			printf("%d  <--- %s%s%s\n", source->id.Name(), p->vertexPath.c_str(), p->defines.empty() ? "" : (" [" + p->defines + "]").c_str(), source->fromCache ? " (cached)" : "");
+		}
+		if (!finishMs)finishMs = jobs.NowMs();
+	}
+
+	void Report() {
+		int cached = 0, compiled = 0, shaders = 0;
+		double slowest = 0.0;
+		for (auto& program : programs) {
+			shaders += (int)program->users.size();
+			if (program->alias)continue;
+			if (program->fromCache)cached++;
+			else compiled++;
+			slowest = std::max(slowest, program->readyMs - program->issuedMs);
+		}
+		const char* kind = !compiled ? "warm" : !cached ? "cold" : "partly cached";
+		printf("shaders (%s start): %d programs for %d shaders, %d from the binary cache, %d compiled\n",
+			kind, cached + compiled, shaders, cached, compiled);
+		printf("  ready %.2f ms after the manager was created, slowest program %.2f ms, parallel compile %s, binary cache %s\n",
+			finishMs - startMs, slowest, parallel ? "yes" : "no", binaryCache ? "yes" : "no");
+	}
+
+private:
+	struct Program {
+		std::string vertexPath, fragmentPath, geometryPath, defines, vertexCode, fragmentCode, geometryCode;
+		uint64_t key = 0;
+		std::vector<Shader*> users;
+		JobHandle issued;
+		Program* alias = nullptr;	// another program built from the same sources
+		GLProgram id;	// deleted with the manager
+		unsigned int vertex = 0, fragment = 0, geometry = 0;
+		bool fromCache = false, done = false, assigned = false;
+		double issuedMs = 0.0, readyMs = 0.0;
+	};
+
+	static constexpr double POLL_MS = 10000.0;	// how long Finish polls for completion before it blocks
+
+	JobSystem& jobs;
+	std::string cacheDir, driver;
+	bool parallel = false, binaryCache = false;
+	std::vector<std::unique_ptr<Program>> programs;
+	std::map<std::string, Program*> byPath;
+	std::map<uint64_t, Program*> byKey;
+	double startMs = 0.0, finishMs = 0.0;
+
+	static bool HasExtension(const char* name) {
+		GLint count = 0;
+		glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+		for (GLint i = 0; i < count; i++) {
+			const char* extension = (const char*)glGetStringi(GL_EXTENSIONS, i);
+			if (extension && !strcmp(extension, name))return true;
+		}
+		return false;
+	}
+
+	// FNV-1a
+	static uint64_t Hash(const std::string& s) {
+		uint64_t h = 14695981039346656037ull;
+		for (unsigned char c : s)h = (h ^ c) * 1099511628211ull;
+		return h;
+	}
+
+	static void ReadFile(const std::string& path, std::string& code) {
+		std::ifstream file(path, std::ios::binary);
+		if (!file) {
+			printf("ERROR::SHADER::FILE_NOT_SUCCESSFULLY_READ: %s\n", path.c_str());
+			return;
+		}
+		code.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+	}
+
+	static void ApplyDefines(std::string& code, const std::string& defines) {
+		if (defines.empty())return;
+		std::string lines;
+		size_t begin = 0;
+		while (begin < defines.size()) {
+			size_t end = defines.find(';', begin);
+			if (end == std::string::npos)end = defines.size();
+			if (end > begin)lines += "#define " + defines.substr(begin, end - begin) + "\n";
+			begin = end + 1;
+		}
+		// right after the #version line, which has to stay first
+		size_t version = code.find("#version");
+		size_t at = version == std::string::npos ? 0 : code.find('\n', version);
+		at = at == std::string::npos ? code.size() : at + 1;
+		code.insert(at, lines);
+	}
+
+	std::string CachePath(uint64_t key) const {
+		char name[32];
+		snprintf(name, sizeof(name), "/%016llx.bin", (unsigned long long)key);
+		return cacheDir + name;
+	}
+
+	// main thread: starts the link from the cached binary or from source, without waiting for it
+	void Issue(Program* p) {
+		p->issuedMs = jobs.NowMs();
+		auto found = byKey.find(p->key);
+		if (found != byKey.end()) {
+			p->alias = found->second;
+			return;
+		}
+		byKey[p->key] = p;
+		if (LoadBinary(p))return;
+
+		const char* vShaderCode = p->vertexCode.c_str();
+		const char* fShaderCode = p->fragmentCode.c_str();
+		p->vertex = glCreateShader(GL_VERTEX_SHADER);
+		glShaderSource(p->vertex, 1, &vShaderCode, NULL);
+		glCompileShader(p->vertex);
+		p->fragment = glCreateShader(GL_FRAGMENT_SHADER);
+		glShaderSource(p->fragment, 1, &fShaderCode, NULL);
+		glCompileShader(p->fragment);
+		p->id.Create();
+		glAttachShader(p->id, p->vertex);
+		glAttachShader(p->id, p->fragment);
+		if (!p->geometryCode.empty()) {
+			const char* gShaderCode = p->geometryCode.c_str();
+			p->geometry = glCreateShader(GL_GEOMETRY_SHADER);
+			glShaderSource(p->geometry, 1, &gShaderCode, NULL);
+			glCompileShader(p->geometry);
+			glAttachShader(p->id, p->geometry);
+		}
+#ifdef GL_PROGRAM_BINARY_RETRIEVABLE_HINT
+		if (binaryCache)glProgramParameteri(p->id, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+#endif
+		glLinkProgram(p->id);
+	}
+
+	// main thread, once the link has completed
+	void Collect(Program* p) {
+		p->done = true;
+		p->readyMs = jobs.NowMs();
+		if (p->fromCache)return;
+		Shader::checkCompileErrors(p->vertex, "VERTEX");
+		Shader::checkCompileErrors(p->fragment, "FRAGMENT");
+		if (p->geometry)Shader::checkCompileErrors(p->geometry, "GEOMETRY");
+		Shader::checkCompileErrors(p->id, "PROGRAM");
+		glDeleteShader(p->vertex);
+		glDeleteShader(p->fragment);
+		if (p->geometry)glDeleteShader(p->geometry);
+		GLint linked = 0;
+		glGetProgramiv(p->id, GL_LINK_STATUS, &linked);
+		if (linked)SaveBinary(p);
+	}
+
+	bool LoadBinary(Program* p) {
+#ifdef GL_NUM_PROGRAM_BINARY_FORMATS
+		if (!binaryCache)return false;
+		std::ifstream file(CachePath(p->key), std::ios::binary);
+		uint64_t key = 0;
+		uint32_t format = 0, length = 0;
+		if (!file.read((char*)&key, sizeof(key)) || !file.read((char*)&format, sizeof(format)) || !file.read((char*)&length, sizeof(length)) || key != p->key)
+			return false;
+		std::vector<char> blob(length);
+		if (!file.read(blob.data(), length))return false;
+
+		p->id.Create();
+		glProgramBinary(p->id, format, blob.data(), (GLsizei)length);
+		GLint linked = 0;
+		glGetProgramiv(p->id, GL_LINK_STATUS, &linked);
+		if (!linked) {
+			// driver update or a different GPU, rebuild from source
+			p->id.Reset();
+			return false;
+		}
+		p->fromCache = true;
+		p->done = true;
+		p->readyMs = jobs.NowMs();
+		return true;
+#else
+		return false;
+#endif
+	}
+
+	void SaveBinary(Program* p) {
+#ifdef GL_NUM_PROGRAM_BINARY_FORMATS
+		if (!binaryCache)return;
+		GLint length = 0;
+		glGetProgramiv(p->id, GL_PROGRAM_BINARY_LENGTH, &length);
+		if (length <= 0)return;
+		std::vector<char> blob(length);
+		GLenum format = 0;
+		glGetProgramBinary(p->id, length, &length, &format, blob.data());
+		std::ofstream file(CachePath(p->key), std::ios::binary);
+		uint32_t format32 = format, length32 = (uint32_t)length;
+		file.write((const char*)&p->key, sizeof(p->key));
+		file.write((const char*)&format32, sizeof(format32));
+		file.write((const char*)&length32, sizeof(length32));
+		file.write(blob.data(), length);
+#endif
+	}
+};
+
+// The #define permutations of one vs/fs pair, each built on first use (or ahead of time with Warm)
+// and kept. Every variant is its own program with its own uniform state.
+class ShaderVariants {
+public:
+	std::function<void(Shader&)> setup;	// runs once on each variant before it is first handed out
+
+	ShaderVariants(ShaderManager& shaderManager, JobSystem& jobSystem, const char* vertexPath, const char* fragmentPath)
+		:manager(shaderManager), jobs(jobSystem), vPath(vertexPath), fPath(fragmentPath) {}
+
+	// queues the compile, the program is ready after the manager's next Finish()
+	void Warm(const std::string& defines) {
+		std::unique_ptr<Variant>& v = variants[defines];
+		if (v)return;
+		v.reset(new Variant());
+		v->issued = manager.Load(v->shader, vPath.c_str(), fPath.c_str(), defines);
+	}
+
+	// defines as in ShaderManager::Load, the same set has to be spelled the same way to be shared.
+	// Looked up without a std::string, so the per-frame calls don't allocate once the variant exists
+	Shader& Get(const char* defines) {
+		auto found = variants.find(defines);
+		if (found == variants.end()) {
+			Warm(defines);
+			found = variants.find(defines);
+		}
+		Variant* v = found->second.get();
+		if (!v->shader.ID) {
+			// not built yet: compile now, the binary cache makes this cheap from the second run on
+			jobs.Wait(v->issued);
+			manager.Finish();
+		}
+		if (!v->prepared) {
+			v->prepared = true;
+			if (setup)setup(v->shader);
+		}
+		return v->shader;
+	}
+	Shader& Get(const std::string& defines) { return Get(defines.c_str()); }
+
+	int Count() const { return (int)variants.size(); }
+
+private:
+	struct Variant {
+		Shader shader;
+		JobHandle issued;
+		bool prepared = false;
+	};
+	ShaderManager& manager;
+	JobSystem& jobs;
+	std::string vPath, fPath;
+	std::map<std::string, std::unique_ptr<Variant>, std::less<>> variants;	// stable addresses, the manager writes the IDs through them
+};
+
+#endif // !SHADERMANAGER_H
@@ -0,0 +1,143 @@
+#pragma once
+#ifndef SHADOWCACHE_H
+#define SHADOWCACHE_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include "Frustum.h"
+
+#include <vector>
+#include <cstdio>
+
+// Shadow map kept across frames for a fixed light. Casters that haven't moved for settleFrames frames live in a
+// static layer, redrawn only when a caster enters or leaves it; the moving ones are drawn over a copy of that
+// layer, and only on frames where one of them moved. A settled scene skips the shadow pass altogether.
+class ShadowCache {
+public:
+	unsigned int depthMap = 0;	// the composed map the lit shaders sample
+	int width = 0, height = 0;
+	int settleFrames = 3;
+
+	// counters
+	int framesSkipped = 0, staticRenders = 0, dynamicRenders = 0;
+
+	void Init(int w, int h, int casterCount) {
+		width = w, height = h;
+		casters.assign(casterCount, Caster());
+		CreateTarget(staticFBO, staticDepth);
+		CreateTarget(fbo, depthMap);
+		Invalidate();
+	}
+
+	// everything is redrawn next time, e.g. after the light moved
+	void Invalidate() {
+		staticDirty = dynamicDirty = true;
+	}
+
+	// once per frame for every caster slot, before Render. With bounds the caster can be culled
+	// against the light's frustum
+	void Update(int slot, const glm::mat4& transform, bool visible, const Bounds* bounds = nullptr) {
+		Caster& c = casters[slot];
+		c.bounds = bounds;
+		bool changed = visible != c.visible || (visible && transform != c.transform);
+		c.transform = transform;
+		c.visible = visible;
+		c.restFrames = changed ? 0 : c.restFrames + 1;
+		bool isStatic = visible && c.restFrames >= settleFrames;
+		if (isStatic != c.isStatic) {
+			c.isStatic = isStatic;
+			staticDirty = true;
+		}
+		else if (changed && !isStatic)dynamicDirty = true;
+	}
+
+	// whether any caster in [first, first + count) moved, appeared or vanished in this frame's Update
+	bool Changed(int first, int count) const {
+		for (int i = first; i < first + count; i++)
+			if (casters[i].restFrames == 0)return true;
+		return false;
+	}
+
+	// redraws the dirty layers; draw(slot) renders one caster with the depth shader bound.
+	// Casters outside frustum are skipped
+	template<class DrawCaster>
+	void Render(DrawCaster draw, Frustum* frustum = nullptr) {
+		if (!staticDirty && !dynamicDirty) {
+			framesSkipped++;
+			return;
+		}
+		glViewport(0, 0, width, height);
+		if (staticDirty) {
+			glBindFramebuffer(GL_FRAMEBUFFER, staticFBO);
+			glClear(GL_DEPTH_BUFFER_BIT);
+			DrawLayer(true, draw, frustum);
+			staticRenders++;
+		}
+		glBindFramebuffer(GL_READ_FRAMEBUFFER, staticFBO);
+		glBindFramebuffer(GL_DRAW_FRAMEBUFFER, fbo);
+		glBlitFramebuffer(0, 0, width, height, 0, 0, width, height, GL_DEPTH_BUFFER_BIT, GL_NEAREST);
+		glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+		DrawLayer(false, draw, frustum);
+		dynamicRenders++;
+		glBindFramebuffer(GL_FRAMEBUFFER, 0);
+		staticDirty = dynamicDirty = false;
+	}
+
+	void PrintStats() {
+		int total = framesSkipped + dynamicRenders;
+		printf("shadow map: %d frames, %d skipped (%.1f%%), %d redrawn, static layer rebuilt %d times\n",
+			total, framesSkipped, total ? 100.0 * framesSkipped / total : 0.0, dynamicRenders, staticRenders);
+	}
+
+private:
+	struct Caster {
+		glm::mat4 transform = glm::mat4(1.0f);
+		const Bounds* bounds = nullptr;
+		bool visible = false, isStatic = false;
+		int restFrames = 0;
+	};
+	std::vector<Caster> casters;
+	unsigned int staticFBO = 0, staticDepth = 0, fbo = 0;
+	bool staticDirty = true, dynamicDirty = true;
+	SphereBatch cullBatch;
+
+	template<class DrawCaster>
+	void DrawLayer(bool statics, DrawCaster& draw, Frustum* frustum) {
+		cullBatch.Clear();
+		for (int i = 0; i < (int)casters.size(); i++) {
+			const Caster& c = casters[i];
+			if (!c.visible || c.isStatic != statics)continue;
+			if (!frustum || !c.bounds) {
+				draw(i);
+				continue;
+			}
+			glm::vec3 center;
+			float radius;
+			c.bounds->WorldSphere(c.transform, center, radius);
+			cullBatch.Add(i, center, radius);
+		}
+		if (!cullBatch.Count())return;
+		frustum->Cull(cullBatch);
+		for (int k = 0; k < cullBatch.Count(); k++)
+			if (cullBatch.visible[k])draw(cullBatch.ids[k]);
+	}
+
+	void CreateTarget(unsigned int& framebuffer, unsigned int& texture) {
+		glGenFramebuffers(1, &framebuffer);
+		glGenTextures(1, &texture);
+		glBindTexture(GL_TEXTURE_2D, texture);
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT, width, height, 0, GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+		glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, texture, 0);
+		glDrawBuffer(GL_NONE);
+		glReadBuffer(GL_NONE);
+		glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	}
+};
+
+#endif // !SHADOWCACHE_H
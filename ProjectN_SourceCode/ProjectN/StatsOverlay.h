@@ -0,0 +1,182 @@
+#pragma once
+#ifndef STATSOVERLAY_H
+#define STATSOVERLAY_H
+
+#include <glad/glad.h>
+
+#include "Shader.h"
+#include "FrameStats.h"
+#include "StreamBuffer.h"
+#include "GLResource.h"
+
+#include <vector>
+#include <algorithm>
+#include <cstdio>
+#include <cstdarg>
+#include <cstddef>
+#include <cstring>
+#include <cstdint>
+
+// The frame stats on screen: a panel of text (frame time and its percentiles, each pass's draws, the live
+// counts and memory) over a bar graph of the last FrameStats::WINDOW frame times, green under 16.7 ms,
+// yellow under 33.3 ms, red above. Everything is coloured quads in pixels, text included (a 3x5 font, one
+// quad per run of lit pixels in a glyph row), written into one vertex array and drawn with one call.
+class StatsOverlay {
+public:
+	static const int MAX_VERTICES = 24576;
+	bool visible = false;
+	int scale = 3;	// screen pixels per font pixel
+
+	void Init() {
+		vertices.reserve(MAX_VERTICES);
+		vao.Create();
+		buffer.Create();
+		glBindVertexArray(vao);
+		glBindBuffer(GL_ARRAY_BUFFER, buffer);
+		glEnableVertexAttribArray(0);
+		glEnableVertexAttribArray(1);
+		glBindVertexArray(0);
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+	}
+
+	// over whatever is in the framebuffer; with a stream buffer the vertices go into this frame's segment
+	void Draw(Shader& shader, const FrameStats& stats, int width, int height, StreamBuffer* stream = nullptr) {
+		if (!visible || !vao)return;
+		Build(stats);
+		if (vertices.empty())return;
+		size_t bytes = vertices.size() * sizeof(HudVertex), offset = 0;
+		unsigned char* out = stream ? stream->Allocate(bytes, offset) : nullptr;
+		if (out) {
+			memcpy(out, vertices.data(), bytes);
+			stream->Commit();
+			glBindBuffer(GL_ARRAY_BUFFER, stream->buffer);
+		}
+		else {
+			// orphaned every frame, the driver hands out fresh storage while the GPU still draws the last
+			glBindBuffer(GL_ARRAY_BUFFER, buffer);
+			glBufferData(GL_ARRAY_BUFFER, MAX_VERTICES * sizeof(HudVertex), NULL, GL_STREAM_DRAW);
+			glBufferSubData(GL_ARRAY_BUFFER, 0, bytes, vertices.data());
+			buffer.Resize(MAX_VERTICES * sizeof(HudVertex));
+			offset = 0;
+		}
+		glBindVertexArray(vao);
+		glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, sizeof(HudVertex), (void*)offset);
+		glVertexAttribPointer(1, 4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(HudVertex), (void*)(offset + offsetof(HudVertex, color)));
+
+		shader.use();
+		shader.setVec2("screenSize", (float)width, (float)height);
+		GLboolean depth = glIsEnabled(GL_DEPTH_TEST), blend = glIsEnabled(GL_BLEND);
+		glDisable(GL_DEPTH_TEST);
+		glEnable(GL_BLEND);
+		glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+		glDrawArrays(GL_TRIANGLES, 0, (GLsizei)vertices.size());
+		{
+			RenderPassScope pass(PASS_OVERLAY);
+			FrameStats::Get().Draw(vertices.size() / 3);
+		}
+		if (!blend)glDisable(GL_BLEND);
+		if (depth)glEnable(GL_DEPTH_TEST);
+		glBindVertexArray(0);
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+	}
+
+private:
+	struct HudVertex {
+		float x, y;
+		uint32_t color;	// RGBA, a byte each
+	};
+	std::vector<HudVertex> vertices;
+	GLVertexArray vao;
+	GLBuffer buffer;
+
+	static uint32_t Color(int r, int g, int b, int a = 255) {
+		unsigned char bytes[4] = { (unsigned char)r, (unsigned char)g, (unsigned char)b, (unsigned char)a };
+		uint32_t color;
+		memcpy(&color, bytes, 4);
+		return color;
+	}
+
+	// a glyph's 5 rows of 3 pixels, an octal digit a row from the top, the high bit left; lower case is drawn
+	// as upper case, characters without a glyph as blanks
+	static unsigned Glyph(char c) {
+		static const char chars[] = "!%()+,-./0123456789:=ABCDEFGHIJKLMNOPQRSTUVWXYZ";
+		static const unsigned short glyphs[] = {
+			022202, 051245, 012221, 042224, 002720, 000024, 000700, 000002, 011244,
+			075557, 026227, 071747, 071717, 055711, 074717, 074757, 071111, 075757, 075717,
+			002020, 007070,
+			025755, 065656, 034443, 065556, 074647, 074644, 034553, 055755, 072227, 011152, 055655, 044447, 057755,
+			065555, 025552, 065644, 025563, 065655, 034716, 072222, 055557, 055552, 055775, 055255, 055222, 071247,
+		};
+		if (c >= 'a' && c <= 'z')c = c - 'a' + 'A';
+		const char* found = c ? strchr(chars, c) : nullptr;
+		return found ? glyphs[found - chars] : 0;
+	}
+
+	void Rect(float x, float y, float w, float h, uint32_t color) {
+		if (vertices.size() + 6 > MAX_VERTICES)return;
+		HudVertex a = { x, y, color }, b = { x + w, y, color }, c = { x + w, y + h, color }, d = { x, y + h, color };
+		HudVertex quad[6] = { a, b, c, a, c, d };
+		vertices.insert(vertices.end(), quad, quad + 6);
+	}
+	// returns the x after the text
+	float Text(float x, float y, const char* text, uint32_t color) {
+		for (; *text; text++, x += 4 * scale) {
+			unsigned glyph = Glyph(*text);
+			for (int row = 0; row < 5; row++) {
+				unsigned bits = (glyph >> (3 * (4 - row))) & 7;
+				for (int col = 0; col < 3; col++) {
+					if (!(bits & (4 >> col)))continue;
+					int run = col;
+					while (run + 1 < 3 && (bits & (4 >> (run + 1))))run++;
+					Rect(x + col * scale, y + row * scale, (float)((run - col + 1) * scale), (float)scale, color);
+					col = run;
+				}
+			}
+		}
+		return x;
+	}
+	void Line(float x, float& y, uint32_t color, const char* format, ...) {
+		char text[96];
+		va_list args;
+		va_start(args, format);
+		vsnprintf(text, sizeof(text), format, args);
+		va_end(args);
+		Text(x, y, text, color);
+		y += 7 * scale;
+	}
+
+	void Build(const FrameStats& stats) {
+		vertices.clear();
+		const float left = 10.0f, top = 10.0f, pad = 2.0f * scale;
+		const float graphWidth = 2.0f * FrameStats::WINDOW, graphHeight = 100.0f, msHeight = graphHeight / 50.0f;
+		int passes = 0;
+		for (int p = 0; p < PASS_COUNT; p++)passes += stats.last[p].draws > 0;
+		float width = std::max(graphWidth, 50.0f * 4 * scale) + 2 * pad;
+		float height = (4 + passes) * 7.0f * scale + graphHeight + 3 * pad;
+		Rect(left, top, width, height, Color(0, 0, 0, 160));
+
+		float p50, p95, p99;
+		stats.Percentiles(p50, p95, p99);
+		uint32_t white = Color(235, 235, 235), grey = Color(160, 160, 160);
+		float x = left + pad, y = top + pad;
+		Line(x, y, white, "frame %5.2f ms  p50 %5.2f  p95 %5.2f  p99 %5.2f", stats.Count() ? stats.Time(0) : 0.0f, p50, p95, p99);
+		for (int p = 0; p < PASS_COUNT; p++) {
+			const FrameStats::Pass& pass = stats.last[p];
+			if (pass.draws)Line(x, y, grey, "%-8s %4d draws %8lld tris %6lld inst", FrameStats::Name(p), pass.draws, pass.triangles, pass.instances);
+		}
+		Line(x, y, white, "particles %d  balls %d  fireballs %d", stats.particles, stats.balls, stats.fireBalls);
+		Line(x, y, white, "gl %.1f mb  heap %lld/frame  arena %.1f kb", stats.glBytes / 1048576.0, stats.heapAllocations, stats.arenaBytes / 1024.0);
+
+		// newest frame on the right, with lines at 60 and 30 fps
+		float bottom = y + pad + graphHeight;
+		for (int i = 0; i < stats.Count(); i++) {
+			float ms = std::min(stats.Time(i), 50.0f);
+			uint32_t color = ms <= 16.7f ? Color(80, 220, 80) : ms <= 33.3f ? Color(230, 200, 60) : Color(230, 70, 60);
+			Rect(x + graphWidth - 2.0f * (i + 1), bottom - ms * msHeight, 2.0f, ms * msHeight, color);
+		}
+		Rect(x, bottom - 16.7f * msHeight, graphWidth, 1.0f, Color(255, 255, 255, 120));
+		Rect(x, bottom - 33.3f * msHeight, graphWidth, 1.0f, Color(255, 255, 255, 120));
+	}
+};
+
+#endif // !STATSOVERLAY_H
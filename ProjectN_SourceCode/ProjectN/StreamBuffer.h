@@ -0,0 +1,127 @@
+#pragma once
+#ifndef STREAMBUFFER_H
+#define STREAMBUFFER_H
+
+#include <glad/glad.h>
+#include "GLResource.h"
+
+#include <vector>
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+
+// Per-frame vertex and instance data: one buffer used as a ring of frame-sized segments. With GL 4.4 it is
+// mapped once, persistently, and every segment is guarded by a fence, so writing never waits on the GPU
+// unless it is three frames behind. On GL 3.3 the buffer is orphaned whenever the ring wraps instead and
+// ranges are mapped unsynchronized; the driver hands out fresh storage while the GPU still reads the old.
+// Either way nothing is allocated per frame and no buffer is recreated.
+class StreamBuffer {
+public:
+	GLBuffer buffer;
+	bool persistent = false;
+
+	// counters
+	int frames = 0;
+	long long bytesWritten = 0, fenceWaits = 0, orphans = 0, overflows = 0;
+	size_t peakFrameBytes = 0;
+	double waitMilliseconds = 0.0;
+
+	void Init(size_t bytesPerFrame, int framesInFlight = 3) {
+		segmentSize = bytesPerFrame;
+		segments = framesInFlight;
+		fences.assign(segments, (GLsync)0);
+		buffer.Create();
+		glBindBuffer(GL_ARRAY_BUFFER, buffer);
+#ifdef GL_MAP_PERSISTENT_BIT
+		persistent = GLVersion.major > 4 || (GLVersion.major == 4 && GLVersion.minor >= 4);
+		if (persistent) {
+			GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+			glBufferStorage(GL_ARRAY_BUFFER, segmentSize * segments, NULL, flags);
+			mapped = (unsigned char*)glMapBufferRange(GL_ARRAY_BUFFER, 0, segmentSize * segments, flags);
+		}
+#endif
+		if (!persistent)
+			glBufferData(GL_ARRAY_BUFFER, segmentSize * segments, NULL, GL_STREAM_DRAW);
+		buffer.Resize(segmentSize * segments);
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+	}
+
+	// persistent: waits until the GPU is done with what this frame's segment held last time round
+	void BeginFrame() {
+		frameBytes = 0;
+		if (!persistent) {
+			if (cursor + segmentSize > segmentSize * segments) {
+				glBindBuffer(GL_ARRAY_BUFFER, buffer);
+				glBufferData(GL_ARRAY_BUFFER, segmentSize * segments, NULL, GL_STREAM_DRAW);
+				glBindBuffer(GL_ARRAY_BUFFER, 0);
+				cursor = 0;
+				orphans++;
+			}
+			frameStart = cursor;
+			return;
+		}
+		GLsync& fence = fences[current];
+		if (fence) {
+			if (glClientWaitSync(fence, 0, 0) == GL_TIMEOUT_EXPIRED) {
+				auto start = std::chrono::steady_clock::now();
+				while (glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000) == GL_TIMEOUT_EXPIRED);
+				waitMilliseconds += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+				fenceWaits++;
+			}
+			glDeleteSync(fence);
+			fence = 0;
+		}
+		frameStart = cursor = current * segmentSize;
+	}
+
+	// room for bytes in this frame's segment; offset is from the start of the buffer, for attribute pointers.
+	// NULL when the segment is used up, the caller then skips or falls back
+	unsigned char* Allocate(size_t bytes, size_t& offset, size_t align = 16) {
+		size_t start = (cursor + align - 1) / align * align;
+		if (start + bytes > frameStart + segmentSize) {
+			overflows++;
+			return NULL;
+		}
+		offset = start;
+		cursor = start + bytes;
+		frameBytes = cursor - frameStart;
+		bytesWritten += bytes;
+		if (persistent)return mapped + offset;
+		glBindBuffer(GL_ARRAY_BUFFER, buffer);
+		return (unsigned char*)glMapBufferRange(GL_ARRAY_BUFFER, offset, bytes, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+	}
+	// must follow every Allocate before the data is drawn from
+	void Commit() {
+		if (persistent)return;
+		glBindBuffer(GL_ARRAY_BUFFER, buffer);
+		glUnmapBuffer(GL_ARRAY_BUFFER);
+	}
+
+	// after the frame's last draw from the buffer
+	void EndFrame() {
+		frames++;
+		peakFrameBytes = std::max(peakFrameBytes, frameBytes);
+		if (!persistent) {
+			// the next frame starts on a fresh segment boundary, so BeginFrame's wrap test stays exact
+			cursor = frameStart + segmentSize;
+			return;
+		}
+		if (frameBytes)fences[current] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+		current = (current + 1) % segments;
+	}
+
+	void PrintStats() {
+		if (!frames)return;
+		printf("stream buffer (%s): %d frames, %.1f KB per frame, peak %.1f of %.1f KB, %lld overflows, %lld fence waits (%.3f ms), %lld orphans\n",
+			persistent ? "persistent" : "orphaning", frames, bytesWritten / 1024.0 / frames, peakFrameBytes / 1024.0, segmentSize / 1024.0,
+			overflows, fenceWaits, waitMilliseconds, orphans);
+	}
+
+private:
+	size_t segmentSize = 0, cursor = 0, frameStart = 0, frameBytes = 0;
+	int segments = 0, current = 0;
+	unsigned char* mapped = NULL;
+	std::vector<GLsync> fences;
+};
+
+#endif // !STREAMBUFFER_H
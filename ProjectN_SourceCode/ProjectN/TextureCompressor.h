@@ -0,0 +1,504 @@
+#pragma once
+#ifndef TEXTURECOMPRESSOR_H
+#define TEXTURECOMPRESSOR_H
+
+// Block compression (BC1/BC3/BC7) and the .ntex container holding a precomputed mip chain.
+// CPU only, shared by the TextureBaker tool and the runtime loaders.
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <cmath>
+#include <string>
+#include <vector>
+#include <algorithm>
+
+enum NTexFormat { NTEX_RGBA8 = 0, NTEX_BC1 = 1, NTEX_BC3 = 2, NTEX_BC7 = 3 };
+const uint32_t NTEX_VERSION = 1;
+
+struct NTexHeader {
+	char magic[4];			// "NTEX"
+	uint32_t version;
+	uint32_t format;		// NTexFormat
+	uint32_t width, height;
+	uint32_t levelCount;
+	// followed by levelCount { uint32_t offset, size } pairs (offsets from the start of the file), then the level data
+};
+
+struct NTexImage {
+	NTexFormat format = NTEX_RGBA8;
+	int width = 0, height = 0;
+	std::vector<std::vector<unsigned char>> levels;
+};
+
+inline int NTexBlockBytes(NTexFormat format) {
+	return format == NTEX_BC1 ? 8 : format == NTEX_RGBA8 ? 0 : 16;
+}
+inline size_t NTexLevelBytes(NTexFormat format, int width, int height) {
+	if (format == NTEX_RGBA8)return (size_t)width * height * 4;
+	return (size_t)((width + 3) / 4) * ((height + 3) / 4) * NTexBlockBytes(format);
+}
+inline const char* NTexFormatName(NTexFormat format) {
+	const char* names[] = { "RGBA8", "BC1", "BC3", "BC7" };
+	return names[format];
+}
+
+// ------------------------------------------------------------------------
+// mip chain
+// ------------------------------------------------------------------------
+
+// 2x2 box filter, the odd row/column is clamped
+inline void DownsampleBox(const std::vector<unsigned char>& src, int w, int h, int c, std::vector<unsigned char>& dst) {
+	int dw = std::max(1, w >> 1), dh = std::max(1, h >> 1);
+	dst.resize((size_t)dw * dh * c);
+	for (int y = 0; y < dh; y++) {
+		int y0 = std::min(2 * y, h - 1), y1 = std::min(2 * y + 1, h - 1);
+		for (int x = 0; x < dw; x++) {
+			int x0 = std::min(2 * x, w - 1), x1 = std::min(2 * x + 1, w - 1);
+			for (int k = 0; k < c; k++) {
+				int sum = src[((size_t)y0 * w + x0) * c + k] + src[((size_t)y0 * w + x1) * c + k]
+					+ src[((size_t)y1 * w + x0) * c + k] + src[((size_t)y1 * w + x1) * c + k];
+				dst[((size_t)y * dw + x) * c + k] = (unsigned char)((sum + 2) >> 2);
+			}
+		}
+	}
+}
+
+inline int MipLevelCount(int w, int h) {
+	int levels = 1;
+	while ((w >> levels) || (h >> levels))levels++;
+	return levels;
+}
+
+// expands 1..4 channel pixels to RGBA8
+inline std::vector<unsigned char> ToRGBA8(const unsigned char* data, int w, int h, int c) {
+	std::vector<unsigned char> rgba((size_t)w * h * 4);
+	for (size_t i = 0; i < (size_t)w * h; i++) {
+		const unsigned char* p = data + i * c;
+		rgba[i * 4 + 0] = p[0];
+		rgba[i * 4 + 1] = c >= 3 ? p[1] : p[0];
+		rgba[i * 4 + 2] = c >= 3 ? p[2] : p[0];
+		rgba[i * 4 + 3] = c == 4 ? p[3] : c == 2 ? p[1] : 255;
+	}
+	return rgba;
+}
+
+// ------------------------------------------------------------------------
+// block helpers
+// ------------------------------------------------------------------------
+
+// gathers the 4x4 RGBA block at (bx,by), pixels outside the image repeat the edge
+inline void FetchBlock(const unsigned char* rgba, int w, int h, int bx, int by, unsigned char block[16][4]) {
+	for (int y = 0; y < 4; y++)
+		for (int x = 0; x < 4; x++) {
+			int sx = std::min(bx * 4 + x, w - 1), sy = std::min(by * 4 + y, h - 1);
+			memcpy(block[y * 4 + x], rgba + ((size_t)sy * w + sx) * 4, 4);
+		}
+}
+
+// principal axis of the block's colours (channels 0..n-1), by power iteration on the covariance
+inline void PrincipalAxis(const unsigned char block[16][4], int n, float mean[4], float axis[4]) {
+	for (int k = 0; k < 4; k++)mean[k] = 0.0f, axis[k] = 0.0f;
+	for (int i = 0; i < 16; i++)
+		for (int k = 0; k < n; k++)mean[k] += block[i][k] / 16.0f;
+	float cov[4][4] = {};
+	for (int i = 0; i < 16; i++)
+		for (int a = 0; a < n; a++)
+			for (int b = 0; b < n; b++)
+				cov[a][b] += (block[i][a] - mean[a]) * (block[i][b] - mean[b]);
+	float v[4] = { 1.0f, 1.0f, 1.0f, 1.0f };
+	for (int iter = 0; iter < 8; iter++) {
+		float r[4] = {}, len = 0.0f;
+		for (int a = 0; a < n; a++) {
+			for (int b = 0; b < n; b++)r[a] += cov[a][b] * v[b];
+			len += r[a] * r[a];
+		}
+		len = std::sqrt(len);
+		if (len < 1e-6f)break;
+		for (int a = 0; a < n; a++)v[a] = r[a] / len;
+	}
+	for (int k = 0; k < n; k++)axis[k] = v[k];
+}
+
+// endpoints at the extreme projections of the block onto its principal axis
+inline void AxisEndpoints(const unsigned char block[16][4], int n, float lo[4], float hi[4]) {
+	float mean[4], axis[4];
+	PrincipalAxis(block, n, mean, axis);
+	float tmin = 1e9f, tmax = -1e9f;
+	for (int i = 0; i < 16; i++) {
+		float t = 0.0f;
+		for (int k = 0; k < n; k++)t += (block[i][k] - mean[k]) * axis[k];
+		tmin = std::min(tmin, t), tmax = std::max(tmax, t);
+	}
+	for (int k = 0; k < 4; k++) {
+		lo[k] = k < n ? std::min(255.0f, std::max(0.0f, mean[k] + axis[k] * tmin)) : 255.0f;
+		hi[k] = k < n ? std::min(255.0f, std::max(0.0f, mean[k] + axis[k] * tmax)) : 255.0f;
+	}
+}
+
+inline int ColorDistance(const unsigned char* a, const unsigned char* b, int n) {
+	int d = 0;
+	for (int k = 0; k < n; k++)d += (a[k] - b[k]) * (a[k] - b[k]);
+	return d;
+}
+
+// ------------------------------------------------------------------------
+// BC1 (also the colour half of BC3)
+// ------------------------------------------------------------------------
+
+inline uint16_t Pack565(float r, float g, float b) {
+	int R = (int)std::lround(r * 31.0f / 255.0f), G = (int)std::lround(g * 63.0f / 255.0f), B = (int)std::lround(b * 31.0f / 255.0f);
+	return (uint16_t)((std::min(31, std::max(0, R)) << 11) | (std::min(63, std::max(0, G)) << 5) | std::min(31, std::max(0, B)));
+}
+inline void Unpack565(uint16_t c, unsigned char out[4]) {
+	int r = (c >> 11) & 31, g = (c >> 5) & 63, b = c & 31;
+	out[0] = (unsigned char)((r << 3) | (r >> 2));
+	out[1] = (unsigned char)((g << 2) | (g >> 4));
+	out[2] = (unsigned char)((b << 3) | (b >> 2));
+	out[3] = 255;
+}
+inline void BC1Palette(uint16_t c0, uint16_t c1, bool fourColor, unsigned char pal[4][4]) {
+	Unpack565(c0, pal[0]);
+	Unpack565(c1, pal[1]);
+	for (int k = 0; k < 3; k++) {
+		if (fourColor) {
+			pal[2][k] = (unsigned char)((2 * pal[0][k] + pal[1][k] + 1) / 3);
+			pal[3][k] = (unsigned char)((pal[0][k] + 2 * pal[1][k] + 1) / 3);
+		}
+		else {
+			pal[2][k] = (unsigned char)((pal[0][k] + pal[1][k]) / 2);
+			pal[3][k] = 0;
+		}
+	}
+	pal[2][3] = 255;
+	pal[3][3] = fourColor ? 255 : 0;
+}
+
+// picks the closest palette entry for every pixel, returns the summed squared error
+inline int BC1Indices(const unsigned char block[16][4], uint16_t c0, uint16_t c1, uint32_t& indices) {
+	unsigned char pal[4][4];
+	BC1Palette(c0, c1, true, pal);
+	int error = 0;
+	indices = 0;
+	for (int i = 0; i < 16; i++) {
+		int best = 0, bestD = ColorDistance(block[i], pal[0], 3);
+		for (int p = 1; p < 4; p++) {
+			int d = ColorDistance(block[i], pal[p], 3);
+			if (d < bestD)best = p, bestD = d;
+		}
+		indices |= (uint32_t)best << (2 * i);
+		error += bestD;
+	}
+	return error;
+}
+
+// always produces a four-colour block (c0 > c1), as BC3 requires
+inline void EncodeColorBlock(const unsigned char block[16][4], unsigned char out[8]) {
+	float lo[4], hi[4];
+	AxisEndpoints(block, 3, lo, hi);
+	uint16_t c0 = Pack565(hi[0], hi[1], hi[2]), c1 = Pack565(lo[0], lo[1], lo[2]);
+	uint32_t indices;
+	int error = BC1Indices(block, c0, c1, indices);
+
+	// one least-squares refinement of the endpoints for the chosen indices
+	const float weights[4] = { 0.0f, 1.0f, 1.0f / 3, 2.0f / 3 };
+	float aa = 0, ab = 0, bb = 0, ax[3] = {}, bx[3] = {};
+	for (int i = 0; i < 16; i++) {
+		float b = weights[(indices >> (2 * i)) & 3], a = 1.0f - b;
+		aa += a * a, ab += a * b, bb += b * b;
+		for (int k = 0; k < 3; k++)ax[k] += a * block[i][k], bx[k] += b * block[i][k];
+	}
+	float det = aa * bb - ab * ab;
+	if (std::fabs(det) > 1e-6f) {
+		float e0[3], e1[3];
+		for (int k = 0; k < 3; k++) {
+			e0[k] = std::min(255.0f, std::max(0.0f, (ax[k] * bb - bx[k] * ab) / det));
+			e1[k] = std::min(255.0f, std::max(0.0f, (bx[k] * aa - ax[k] * ab) / det));
+		}
+		uint16_t r0 = Pack565(e0[0], e0[1], e0[2]), r1 = Pack565(e1[0], e1[1], e1[2]);
+		if (r0 < r1)std::swap(r0, r1);
+		uint32_t rIndices;
+		int rError = r0 != r1 ? BC1Indices(block, r0, r1, rIndices) : error;
+		if (r0 != r1 && rError < error)c0 = r0, c1 = r1, indices = rIndices, error = rError;
+	}
+
+	if (c0 < c1) {
+		// swapping the endpoints maps index 0<->1 and 2<->3
+		std::swap(c0, c1);
+		indices ^= 0x55555555;
+	}
+	else if (c0 == c1)indices = 0;
+	out[0] = c0 & 0xff, out[1] = c0 >> 8;
+	out[2] = c1 & 0xff, out[3] = c1 >> 8;
+	for (int k = 0; k < 4; k++)out[4 + k] = (indices >> (8 * k)) & 0xff;
+}
+
+inline void DecodeColorBlock(const unsigned char in[8], bool forceFourColor, unsigned char out[16][4]) {
+	uint16_t c0 = in[0] | (in[1] << 8), c1 = in[2] | (in[3] << 8);
+	uint32_t indices = in[4] | (in[5] << 8) | (in[6] << 16) | ((uint32_t)in[7] << 24);
+	unsigned char pal[4][4];
+	BC1Palette(c0, c1, forceFourColor || c0 > c1, pal);
+	for (int i = 0; i < 16; i++)memcpy(out[i], pal[(indices >> (2 * i)) & 3], 4);
+}
+
+// ------------------------------------------------------------------------
+// BC3 alpha
+// ------------------------------------------------------------------------
+
+inline void AlphaPalette(int a0, int a1, int pal[8]) {
+	pal[0] = a0, pal[1] = a1;
+	if (a0 > a1)
+		for (int i = 1; i < 7; i++)pal[i + 1] = ((7 - i) * a0 + i * a1 + 3) / 7;
+	else {
+		for (int i = 1; i < 5; i++)pal[i + 1] = ((5 - i) * a0 + i * a1 + 2) / 5;
+		pal[6] = 0, pal[7] = 255;
+	}
+}
+
+inline void EncodeAlphaBlock(const unsigned char block[16][4], unsigned char out[8]) {
+	int a0 = 0, a1 = 255;
+	for (int i = 0; i < 16; i++)a0 = std::max(a0, (int)block[i][3]), a1 = std::min(a1, (int)block[i][3]);
+	out[0] = (unsigned char)a0, out[1] = (unsigned char)a1;
+	uint64_t bits = 0;
+	if (a0 != a1) {
+		int pal[8];
+		AlphaPalette(a0, a1, pal);
+		for (int i = 0; i < 16; i++) {
+			int best = 0;
+			for (int p = 1; p < 8; p++)
+				if (std::abs(pal[p] - block[i][3]) < std::abs(pal[best] - block[i][3]))best = p;
+			bits |= (uint64_t)best << (3 * i);
+		}
+	}
+	for (int k = 0; k < 6; k++)out[2 + k] = (bits >> (8 * k)) & 0xff;
+}
+
+inline void DecodeAlphaBlock(const unsigned char in[8], unsigned char out[16][4]) {
+	int pal[8];
+	AlphaPalette(in[0], in[1], pal);
+	uint64_t bits = 0;
+	for (int k = 0; k < 6; k++)bits |= (uint64_t)in[2 + k] << (8 * k);
+	for (int i = 0; i < 16; i++)out[i][3] = (unsigned char)pal[(bits >> (3 * i)) & 7];
+}
+
+// ------------------------------------------------------------------------
+// BC7, mode 6 only: one subset, 7.7.7.7 endpoints with a p-bit each, 4-bit indices
+// ------------------------------------------------------------------------
+
+const int BC7Weights4[16] = { 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+
+struct BitWriter {
+	unsigned char* out;
+	int pos = 0;
+	BitWriter(unsigned char* o) :out(o) { memset(out, 0, 16); }
+	void Put(uint32_t value, int bits) {
+		for (int i = 0; i < bits; i++, pos++)
+			if ((value >> i) & 1)out[pos >> 3] |= 1 << (pos & 7);
+	}
+};
+struct BitReader {
+	const unsigned char* in;
+	int pos = 0;
+	BitReader(const unsigned char* i) :in(i) {}
+	uint32_t Get(int bits) {
+		uint32_t value = 0;
+		for (int i = 0; i < bits; i++, pos++)value |= (uint32_t)((in[pos >> 3] >> (pos & 7)) & 1) << i;
+		return value;
+	}
+};
+
+// quantised endpoints + indices for one p-bit choice, returns the squared error
+inline int BC7Mode6Fit(const unsigned char block[16][4], const float lo[4], const float hi[4], int p0, int p1, int q[2][4], int indices[16]) {
+	unsigned char e[2][4];
+	for (int k = 0; k < 4; k++) {
+		q[0][k] = std::min(127, std::max(0, (int)std::lround((lo[k] - p0) / 2.0f)));
+		q[1][k] = std::min(127, std::max(0, (int)std::lround((hi[k] - p1) / 2.0f)));
+		e[0][k] = (unsigned char)((q[0][k] << 1) | p0);
+		e[1][k] = (unsigned char)((q[1][k] << 1) | p1);
+	}
+	unsigned char pal[16][4];
+	for (int i = 0; i < 16; i++)
+		for (int k = 0; k < 4; k++)
+			pal[i][k] = (unsigned char)(((64 - BC7Weights4[i]) * e[0][k] + BC7Weights4[i] * e[1][k] + 32) >> 6);
+	int error = 0;
+	for (int i = 0; i < 16; i++) {
+		int best = 0, bestD = ColorDistance(block[i], pal[0], 4);
+		for (int p = 1; p < 16; p++) {
+			int d = ColorDistance(block[i], pal[p], 4);
+			if (d < bestD)best = p, bestD = d;
+		}
+		indices[i] = best;
+		error += bestD;
+	}
+	return error;
+}
+
+inline void EncodeBC7Block(const unsigned char block[16][4], unsigned char out[16]) {
+	float lo[4], hi[4];
+	AxisEndpoints(block, 4, lo, hi);
+	int q[2][4], indices[16], bestQ[2][4], bestIndices[16], bestP[2] = { 0, 0 }, bestError = -1;
+	for (int p = 0; p < 4; p++) {
+		int error = BC7Mode6Fit(block, lo, hi, p & 1, p >> 1, q, indices);
+		if (bestError < 0 || error < bestError) {
+			bestError = error;
+			bestP[0] = p & 1, bestP[1] = p >> 1;
+			memcpy(bestQ, q, sizeof(q));
+			memcpy(bestIndices, indices, sizeof(indices));
+		}
+	}
+	// the anchor (pixel 0) index has an implicit zero MSB
+	if (bestIndices[0] & 8) {
+		for (int k = 0; k < 4; k++)std::swap(bestQ[0][k], bestQ[1][k]);
+		std::swap(bestP[0], bestP[1]);
+		for (int i = 0; i < 16; i++)bestIndices[i] = 15 - bestIndices[i];
+	}
+	BitWriter bw(out);
+	bw.Put(1 << 6, 7);
+	for (int k = 0; k < 4; k++)bw.Put(bestQ[0][k], 7), bw.Put(bestQ[1][k], 7);
+	bw.Put(bestP[0], 1), bw.Put(bestP[1], 1);
+	bw.Put(bestIndices[0], 3);
+	for (int i = 1; i < 16; i++)bw.Put(bestIndices[i], 4);
+}
+
+// decodes mode 6 blocks; blocks in any other mode (never written by EncodeBC7Block) come out magenta
+inline void DecodeBC7Block(const unsigned char in[16], unsigned char out[16][4]) {
+	if ((in[0] & 0x7f) != 0x40) {
+		for (int i = 0; i < 16; i++)out[i][0] = 255, out[i][1] = 0, out[i][2] = 255, out[i][3] = 255;
+		return;
+	}
+	BitReader br(in);
+	br.Get(7);
+	int q[2][4];
+	for (int k = 0; k < 4; k++)q[0][k] = br.Get(7), q[1][k] = br.Get(7);
+	int p0 = br.Get(1), p1 = br.Get(1);
+	int e[2][4];
+	for (int k = 0; k < 4; k++)e[0][k] = (q[0][k] << 1) | p0, e[1][k] = (q[1][k] << 1) | p1;
+	for (int i = 0; i < 16; i++) {
+		int index = br.Get(i ? 4 : 3);
+		for (int k = 0; k < 4; k++)
+			out[i][k] = (unsigned char)(((64 - BC7Weights4[index]) * e[0][k] + BC7Weights4[index] * e[1][k] + 32) >> 6);
+	}
+}
+
+// ------------------------------------------------------------------------
+// whole images
+// ------------------------------------------------------------------------
+
+inline std::vector<unsigned char> CompressLevel(const std::vector<unsigned char>& rgba, int w, int h, NTexFormat format) {
+	if (format == NTEX_RGBA8)return rgba;
+	int bw = (w + 3) / 4, bh = (h + 3) / 4, blockBytes = NTexBlockBytes(format);
+	std::vector<unsigned char> out((size_t)bw * bh * blockBytes);
+	unsigned char block[16][4];
+	for (int by = 0; by < bh; by++)
+		for (int bx = 0; bx < bw; bx++) {
+			FetchBlock(rgba.data(), w, h, bx, by, block);
+			unsigned char* dst = &out[((size_t)by * bw + bx) * blockBytes];
+			if (format == NTEX_BC1)EncodeColorBlock(block, dst);
+			else if (format == NTEX_BC3)EncodeAlphaBlock(block, dst), EncodeColorBlock(block, dst + 8);
+			else EncodeBC7Block(block, dst);
+		}
+	return out;
+}
+
+inline std::vector<unsigned char> DecompressLevel(const unsigned char* data, int w, int h, NTexFormat format) {
+	if (format == NTEX_RGBA8)return std::vector<unsigned char>(data, data + (size_t)w * h * 4);
+	int bw = (w + 3) / 4, bh = (h + 3) / 4, blockBytes = NTexBlockBytes(format);
+	std::vector<unsigned char> rgba((size_t)w * h * 4);
+	unsigned char block[16][4];
+	for (int by = 0; by < bh; by++)
+		for (int bx = 0; bx < bw; bx++) {
+			const unsigned char* src = data + ((size_t)by * bw + bx) * blockBytes;
+			if (format == NTEX_BC1)DecodeColorBlock(src, false, block);
+			else if (format == NTEX_BC3)DecodeColorBlock(src + 8, true, block), DecodeAlphaBlock(src, block);
+			else DecodeBC7Block(src, block);
+			for (int y = 0; y < 4; y++)
+				for (int x = 0; x < 4; x++) {
+					int px = bx * 4 + x, py = by * 4 + y;
+					if (px < w && py < h)memcpy(&rgba[((size_t)py * w + px) * 4], block[y * 4 + x], 4);
+				}
+		}
+	return rgba;
+}
+
+// builds the full mip chain from RGBA8 pixels and compresses every level
+inline NTexImage BuildNTex(const std::vector<unsigned char>& rgba, int w, int h, NTexFormat format) {
+	NTexImage image;
+	image.format = format, image.width = w, image.height = h;
+	int levelCount = MipLevelCount(w, h);
+	std::vector<unsigned char> level = rgba, next;
+	for (int l = 0; l < levelCount; l++) {
+		int lw = std::max(1, w >> l), lh = std::max(1, h >> l);
+		image.levels.push_back(CompressLevel(level, lw, lh, format));
+		if (l + 1 < levelCount)DownsampleBox(level, lw, lh, 4, next), level.swap(next);
+	}
+	return image;
+}
+
+inline double PSNR(const std::vector<unsigned char>& a, const std::vector<unsigned char>& b, bool withAlpha) {
+	double sum = 0.0;
+	size_t count = 0;
+	for (size_t i = 0; i < a.size(); i++) {
+		if (!withAlpha && i % 4 == 3)continue;
+		double d = (double)a[i] - b[i];
+		sum += d * d;
+		count++;
+	}
+	if (!count || sum == 0.0)return 99.0;
+	return 10.0 * std::log10(255.0 * 255.0 / (sum / count));
+}
+
+// ------------------------------------------------------------------------
+// .ntex files
+// ------------------------------------------------------------------------
+
+inline bool WriteNTex(const std::string& path, const NTexImage& image) {
+	std::ofstream file(path, std::ios::binary);
+	if (!file)return false;
+	NTexHeader header;
+	memcpy(header.magic, "NTEX", 4);
+	header.version = NTEX_VERSION;
+	header.format = image.format;
+	header.width = image.width, header.height = image.height;
+	header.levelCount = (uint32_t)image.levels.size();
+	file.write((const char*)&header, sizeof(header));
+	uint32_t offset = (uint32_t)(sizeof(header) + image.levels.size() * 2 * sizeof(uint32_t));
+	for (const auto& level : image.levels) {
+		uint32_t entry[2] = { offset, (uint32_t)level.size() };
+		file.write((const char*)entry, sizeof(entry));
+		offset += entry[1];
+	}
+	for (const auto& level : image.levels)file.write((const char*)level.data(), level.size());
+	return (bool)file;
+}
+
+inline bool ReadNTex(const std::string& path, NTexImage& image) {
+	std::ifstream file(path, std::ios::binary);
+	if (!file)return false;
+	NTexHeader header;
+	bool ok = file.read((char*)&header, sizeof(header)) && !memcmp(header.magic, "NTEX", 4)
+		&& header.version == NTEX_VERSION && header.format <= NTEX_BC7 && header.levelCount && header.levelCount <= 32;
+	std::vector<uint32_t> entries;
+	if (ok) {
+		entries.resize(header.levelCount * 2);
+		ok = (bool)file.read((char*)entries.data(), entries.size() * sizeof(uint32_t));
+	}
+	if (ok) {
+		image.format = (NTexFormat)header.format;
+		image.width = header.width, image.height = header.height;
+		image.levels.resize(header.levelCount);
+		for (uint32_t l = 0; l < header.levelCount && ok; l++) {
+			int lw = std::max(1, image.width >> l), lh = std::max(1, image.height >> l);
+			if (entries[l * 2 + 1] != NTexLevelBytes(image.format, lw, lh)) {
+				ok = false;
+				break;
+			}
+			image.levels[l].resize(entries[l * 2 + 1]);
+			ok = file.seekg(entries[l * 2]) && file.read((char*)image.levels[l].data(), image.levels[l].size());
+		}
+	}
+	if (!ok)printf("ERROR::NTEX:: malformed file %s\n", path.c_str());
+	return ok;
+}
+
+#endif // !TEXTURECOMPRESSOR_H
@@ -0,0 +1,382 @@
+#pragma once
+#ifndef TEXTURESTREAMER_H
+#define TEXTURESTREAMER_H
+
+#include <glad/glad.h>
+
+#include "JobSystem.h"
+#include "Mesh.h"
+#include "TextureCompressor.h"
+
+#ifndef STBI_INCLUDE_STB_IMAGE_H
+#include <stb_image.h>
+#endif
+
+#include <string>
+#include <vector>
+#include <map>
+#include <unordered_map>
+#include <memory>
+#include <atomic>
+#include <cstring>
+#include <cstdio>
+
+#ifndef GL_COMPRESSED_RGB_S3TC_DXT1_EXT
+#define GL_COMPRESSED_RGB_S3TC_DXT1_EXT 0x83F0
+#endif
+#ifndef GL_COMPRESSED_RGBA_S3TC_DXT5_EXT
+#define GL_COMPRESSED_RGBA_S3TC_DXT5_EXT 0x83F3
+#endif
+#ifndef GL_COMPRESSED_RGBA_BPTC_UNORM
+#define GL_COMPRESSED_RGBA_BPTC_UNORM 0x8E8C
+#endif
+
+inline GLenum NTexGLFormat(NTexFormat format) {
+	const GLenum formats[] = { GL_RGBA, GL_COMPRESSED_RGB_S3TC_DXT1_EXT, GL_COMPRESSED_RGBA_S3TC_DXT5_EXT, GL_COMPRESSED_RGBA_BPTC_UNORM };
+	return formats[format];
+}
+
+// whether the driver samples this block format directly, needs the GL context
+inline bool NTexFormatSupported(NTexFormat format) {
+	if (format == NTEX_RGBA8)return true;
+	GLint count = 0;
+	glGetIntegerv(GL_NUM_COMPRESSED_TEXTURE_FORMATS, &count);
+	std::vector<GLint> formats(std::max(count, 1));
+	if (count)glGetIntegerv(GL_COMPRESSED_TEXTURE_FORMATS, formats.data());
+	for (int i = 0; i < count; i++)
+		if ((GLenum)formats[i] == NTexGLFormat(format))return true;
+	// BPTC is core since 4.2 but not every driver lists it
+	return format == NTEX_BC7 && (GLVersion.major > 4 || (GLVersion.major == 4 && GLVersion.minor >= 2));
+}
+
+// Staging memory for texture uploads: a buffer split into one segment per frame in flight,
+// each guarded by a fence. Persistently mapped when the driver has GL 4.4, otherwise each
+// allocation maps its range unsynchronized (the fence already guarantees the GPU is done with it).
+class PixelUploadRing {
+public:
+	GLBuffer buffer;
+	bool persistent = false;
+
+	void Init(size_t bytesPerFrame, int framesInFlight = 3) {
+		segmentSize = bytesPerFrame;
+		segments = framesInFlight;
+		fences.assign(segments, (GLsync)0);
+		buffer.Create();
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, buffer);
+#ifdef GL_MAP_PERSISTENT_BIT
+		persistent = GLVersion.major > 4 || (GLVersion.major == 4 && GLVersion.minor >= 4);
+		if (persistent) {
+			GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+			glBufferStorage(GL_PIXEL_UNPACK_BUFFER, segmentSize * segments, NULL, flags);
+			mapped = (unsigned char*)glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, segmentSize * segments, flags);
+		}
+#endif
+		if (!persistent)
+			glBufferData(GL_PIXEL_UNPACK_BUFFER, segmentSize * segments, NULL, GL_STREAM_DRAW);
+		buffer.Resize(segmentSize * segments);
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+	}
+
+	// waits until the GPU has consumed what was written into this frame's segment last time round
+	void BeginFrame() {
+		GLsync& fence = fences[current];
+		if (fence) {
+			while (glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000) == GL_TIMEOUT_EXPIRED);
+			glDeleteSync(fence);
+			fence = 0;
+		}
+		cursor = 0;
+	}
+	// returns a pointer to copy bytes into, offset is relative to the bound unpack buffer; NULL when the segment is full
+	unsigned char* Allocate(size_t bytes, size_t& offset) {
+		if (cursor + bytes > segmentSize)return NULL;
+		offset = current * segmentSize + cursor;
+		cursor += (bytes + 15) & ~(size_t)15;
+		if (persistent)return mapped + offset;
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, buffer);
+		return (unsigned char*)glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, offset, bytes, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+	}
+	// must follow every Allocate before the data is used as an unpack source
+	void Commit() {
+		if (persistent)return;
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, buffer);
+		glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+	}
+	void EndFrame() {
+		if (cursor)fences[current] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+		current = (current + 1) % segments;
+	}
+
+private:
+	size_t segmentSize = 0, cursor = 0;
+	int segments = 0, current = 0;
+	unsigned char* mapped = NULL;
+	std::vector<GLsync> fences;
+};
+
+struct StreamedTexture {
+	GLTexture id;
+	std::string filename;
+	int width = 0, height = 0, components = 0, levelCount = 0;
+	GLenum format = GL_RGB;
+	GLenum compressedFormat = 0;	// block format of a baked .ntex, 0 for plain pixels
+	int blockBytes = 0;
+
+	// CPU side mip chain written by the decode job, valid while state == Ready
+	enum State { Empty, Decoding, Ready, Failed };
+	std::atomic<int> state{ Empty };
+	std::vector<std::vector<unsigned char>> levels;
+
+	int residentLevel = -1;		// finest level that can be sampled, levelCount while only the placeholder is there, -1 before the first decode
+	int targetLevel = 0;		// finest level we want resident
+	int uploadingLevel = -1, uploadedRows = 0;
+	size_t residentBytes = 0;
+	unsigned long long lastUsedFrame = 0;
+};
+
+class TextureStreamer {
+public:
+	size_t budgetBytes;
+	size_t uploadBytesPerFrame;
+
+	// counters
+	size_t residentBytes = 0;
+	int evictions = 0, uploadsThisFrame = 0;
+
+	TextureStreamer(JobSystem& jobSystem, size_t budget = 256u << 20, size_t perFrame = 4u << 20)
+		:budgetBytes(budget), uploadBytesPerFrame(perFrame), jobs(jobSystem) {
+		ring.Init(uploadBytesPerFrame);
+		for (int f = NTEX_RGBA8; f <= NTEX_BC7; f++)gpuFormats[f] = NTexFormatSupported((NTexFormat)f);
+		active = this;
+		TextureBindHook = [](unsigned int id) { if (active)active->Touch(id); };
+	}
+	~TextureStreamer() {
+		if (active == this)active = nullptr, TextureBindHook = nullptr;
+		while (inFlight.load())std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	}
+
+	// returns a texture name right away, it samples as a grey placeholder until the first mips arrive
+	unsigned int Request(const std::string& filename) {
+		auto found = byName.find(filename);
+		if (found != byName.end())return found->second->id;
+
+		std::unique_ptr<StreamedTexture> st(new StreamedTexture());
+		st->filename = filename;
+		st->id.Create();
+		glBindTexture(GL_TEXTURE_2D, st->id);
+		const unsigned char grey[4] = { 128, 128, 128, 255 };
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, grey);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, 0);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 0);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		glBindTexture(GL_TEXTURE_2D, 0);
+
+		StreamedTexture* raw = st.get();
+		byName[filename] = raw;
+		byId[raw->id] = raw;
+		textures.push_back(std::move(st));
+		StartDecode(raw);
+		return raw->id;
+	}
+
+	void Touch(unsigned int id) {
+		auto found = byId.find(id);
+		if (found == byId.end())return;
+		StreamedTexture* st = found->second;
+		st->lastUsedFrame = frame;
+		st->targetLevel = 0;
+	}
+
+	// once per frame on the GL thread: spend the upload budget, then evict down to the memory budget
+	void Update() {
+		frame++;
+		uploadsThisFrame = 0;
+		ring.BeginFrame();
+		size_t budget = uploadBytesPerFrame;
+		glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+		for (auto& tex : textures) {
+			StreamedTexture* st = tex.get();
+			if (st->residentLevel >= 0 && st->residentLevel <= st->targetLevel)continue;
+			int state = st->state.load(std::memory_order_acquire);
+			if (state == StreamedTexture::Empty)StartDecode(st);
+			if (state != StreamedTexture::Ready)continue;
+			if (st->residentLevel < 0) {
+				st->format = st->compressedFormat ? st->compressedFormat : st->components == 1 ? GL_RED : st->components == 3 ? GL_RGB : GL_RGBA;
+				st->residentLevel = st->levelCount;
+			}
+			while (budget && st->residentLevel > st->targetLevel)
+				if (!UploadStep(st, budget))break;
+			if (st->residentLevel == 0)
+				st->levels.clear(), st->levels.shrink_to_fit(), st->state = StreamedTexture::Empty;
+			if (!budget)break;
+		}
+		glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+		ring.EndFrame();
+		EnforceBudget();
+	}
+
+	// textures still short of the level they should have resident
+	int Streaming() const {
+		int streaming = 0;
+		for (auto& tex : textures)
+			if (tex->state.load() != StreamedTexture::Failed && (tex->residentLevel < 0 || tex->residentLevel > tex->targetLevel))streaming++;
+		return streaming;
+	}
+
+	void PrintStats() {
+		printf("textures: %d, streaming %d, resident %.1f / %.1f MB, evictions %d, persistent PBO %s\n",
+			(int)textures.size(), Streaming(), residentBytes / 1048576.0, budgetBytes / 1048576.0, evictions, ring.persistent ? "yes" : "no");
+	}
+
+private:
+	JobSystem& jobs;
+	PixelUploadRing ring;
+	std::vector<std::unique_ptr<StreamedTexture>> textures;
+	std::map<std::string, StreamedTexture*> byName;
+	std::unordered_map<unsigned int, StreamedTexture*> byId;
+	std::atomic<int> inFlight{ 0 };
+	unsigned long long frame = 0;
+	bool gpuFormats[NTEX_BC7 + 1];
+	static TextureStreamer* active;
+
+	static size_t LevelBytes(const StreamedTexture* st, int level) {
+		int w = std::max(1, st->width >> level), h = std::max(1, st->height >> level);
+		if (st->blockBytes)return (size_t)((w + 3) / 4) * ((h + 3) / 4) * st->blockBytes;
+		return (size_t)w * h * st->components;
+	}
+
+	void StartDecode(StreamedTexture* st) {
+		st->state = StreamedTexture::Decoding;
+		inFlight++;
+		jobs.Submit(st->filename, "decode", [this, st] {
+			int w, h, c;
+			GLenum compressedFormat = 0;
+			int blockBytes = 0;
+			NTexImage ntex;
+			if (ReadNTex(st->filename + ".ntex", ntex)) {
+				// baked offline, the mip chain is already there
+				w = ntex.width, h = ntex.height, c = 4;
+				if (gpuFormats[ntex.format]) {
+					st->levels = std::move(ntex.levels);
+					if (ntex.format != NTEX_RGBA8)
+						compressedFormat = NTexGLFormat(ntex.format), blockBytes = NTexBlockBytes(ntex.format);
+				}
+				else {
+					st->levels.resize(ntex.levels.size());
+					for (int l = 0; l < (int)ntex.levels.size(); l++)
+						st->levels[l] = DecompressLevel(ntex.levels[l].data(), std::max(1, w >> l), std::max(1, h >> l), ntex.format);
+				}
+			}
+			else {
+				unsigned char* data = stbi_load(st->filename.c_str(), &w, &h, &c, 0);
+				if (!data) {
+					printf("Texture failed to load at path: %s\n", st->filename.c_str());
+					st->state = StreamedTexture::Failed;
+					inFlight--;
+					return;
+				}
+				int levelCount = MipLevelCount(w, h);
+				st->levels.resize(levelCount);
+				st->levels[0].assign(data, data + (size_t)w * h * c);
+				stbi_image_free(data);
+				for (int l = 1; l < levelCount; l++)
+					DownsampleBox(st->levels[l - 1], std::max(1, w >> (l - 1)), std::max(1, h >> (l - 1)), c, st->levels[l]);
+			}
+
+			if (!st->levelCount) {
+				st->width = w, st->height = h, st->components = c, st->levelCount = (int)st->levels.size();
+				st->compressedFormat = compressedFormat, st->blockBytes = blockBytes;
+			}
+			st->state.store(StreamedTexture::Ready, std::memory_order_release);
+			inFlight--;
+		});
+	}
+
+	// uploads as many rows of the next finer level as the budget allows, returns false when out of budget.
+	// Compressed levels go in whole rows of 4x4 blocks.
+	bool UploadStep(StreamedTexture* st, size_t& budget) {
+		int level = st->residentLevel - 1;
+		int w = std::max(1, st->width >> level), h = std::max(1, st->height >> level);
+		int rowCount = st->blockBytes ? (h + 3) / 4 : h;
+		size_t rowBytes = st->blockBytes ? (size_t)((w + 3) / 4) * st->blockBytes : (size_t)w * st->components;
+
+		glBindTexture(GL_TEXTURE_2D, st->id);
+		if (st->uploadingLevel != level) {
+			// the last step left the ring bound, and NULL would then be an offset into it rather than no data
+			glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+			if (st->blockBytes)
+				glCompressedTexImage2D(GL_TEXTURE_2D, level, st->format, w, h, 0, (GLsizei)LevelBytes(st, level), NULL);
+			else
+				glTexImage2D(GL_TEXTURE_2D, level, st->format, w, h, 0, st->format, GL_UNSIGNED_BYTE, NULL);
+			st->uploadingLevel = level;
+			st->uploadedRows = 0;
+		}
+		int rows = (int)std::min((size_t)(rowCount - st->uploadedRows), budget / rowBytes);
+		if (rows <= 0) {
+			budget = 0;
+			return false;
+		}
+		size_t bytes = rows * rowBytes, offset;
+		unsigned char* dst = ring.Allocate(bytes, offset);
+		if (!dst) {
+			budget = 0;
+			return false;
+		}
+		memcpy(dst, &st->levels[level][st->uploadedRows * rowBytes], bytes);
+		ring.Commit();
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, ring.buffer);
+		if (st->blockBytes) {
+			int y = st->uploadedRows * 4;
+			glCompressedTexSubImage2D(GL_TEXTURE_2D, level, 0, y, w, std::min(rows * 4, h - y), st->format, (GLsizei)bytes, (void*)offset);
+		}
+		else
+			glTexSubImage2D(GL_TEXTURE_2D, level, 0, st->uploadedRows, w, rows, st->format, GL_UNSIGNED_BYTE, (void*)offset);
+		st->uploadedRows += rows;
+		budget -= bytes;
+		uploadsThisFrame++;
+
+		if (st->uploadedRows == rowCount) {
+			// the whole level is in, let the sampler see it
+			st->residentLevel = level;
+			st->uploadingLevel = -1;
+			st->residentBytes += LevelBytes(st, level);
+			st->id.Resize(st->residentBytes);
+			residentBytes += LevelBytes(st, level);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, level);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, st->levelCount - 1);
+		}
+		return true;
+	}
+
+	// drops the finest level of the least recently used textures until we are back under budget
+	void EnforceBudget() {
+		while (residentBytes > budgetBytes) {
+			StreamedTexture* victim = nullptr;
+			for (auto& tex : textures) {
+				StreamedTexture* st = tex.get();
+				if (st->lastUsedFrame + 1 >= frame || st->residentLevel >= st->levelCount - 1)continue;
+				if (!victim || st->lastUsedFrame < victim->lastUsedFrame)victim = st;
+			}
+			if (!victim)return;
+
+			int level = victim->residentLevel;
+			glBindTexture(GL_TEXTURE_2D, victim->id);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, level + 1);
+			// the level is below BASE_LEVEL now, a 0x0 image releases it whatever format it had
+			glTexImage2D(GL_TEXTURE_2D, level, GL_RGBA, 0, 0, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+			victim->residentLevel = level + 1;
+			victim->targetLevel = level + 1;
+			victim->residentBytes -= LevelBytes(victim, level);
+			victim->id.Resize(victim->residentBytes);
+			residentBytes -= LevelBytes(victim, level);
+			evictions++;
+		}
+	}
+};
+TextureStreamer* TextureStreamer::active = nullptr;
+
+#endif // !TEXTURESTREAMER_H
@@ -6,14 +6,35 @@
 #include <glm/gtc/type_ptr.hpp>
 
 #include "Shader.h"
+#include "ShaderManager.h"
+#include "ShaderBench.h"
 #include "Camera.h"
 #include "Model.h"
 #include "tumbler.h"
 #include "SELFUTILS.h"
 #include "Plane.h"
 #include "FireAnimation.h"
+#include "ShadowCache.h"
+#include "PointShadow.h"
+#include "OcclusionCuller.h"
+#include "BVH.h"
+#include "DeferredRenderer.h"
+#include "FramePipeline.h"
+#include "InputLog.h"
+#include "SceneSnapshot.h"
+#include "Profiler.h"
+#include "Log.h"
+#include "StatsOverlay.h"
+#include "ScenarioBench.h"
+#include "Offscreen.h"
 
 #include <iostream>
+#include <memory>
+#include <string>
+#include <cstring>
+#include <thread>
+#include <chrono>
+#include <functional>
 
 void framebuffer_size_callback(GLFWwindow* window, int width, int height);
 void mouse_callback(GLFWwindow* window, double xpos, double ypos);
@@ -21,6 +42,18 @@ void scroll_callback(GLFWwindow* window, double xoffset, double yoffset);
 void mouse_button_callback(GLFWwindow* window, int button, int action, int mods);
 void processInput(GLFWwindow* window);
 void renderQuad();
+glm::vec3 MouseRay(GLFWwindow* window);
+void UpdateScene();
+const char* GroundDefines(const char* fire);
+void Input(const InputEvent& e, GLFWwindow* window = nullptr);
+void ApplyInput(const InputEvent& e, GLFWwindow* window = nullptr);
+uint64_t SimulationChecksum();
+void CountLive();
+bool SaveSnapshot(const char* path);
+bool LoadSnapshot(const char* path);
+struct PickingScene;
+std::vector<Scenario> Scenarios(PickingScene& picking);
+int Shutdown(int code, const char* profilePath = nullptr);
 
 // settings
 const unsigned int SCR_WIDTH = 1500;
@@ -41,17 +74,179 @@ bool ballMoving = false;
 bool hasMousePressed = false;
 int MouseControllingIdx = -1;
 
+// shadows: 0 off, 1 single tap, 2 3x3 PCF, 3 5x5 PCF (K cycles)
+int shadowQuality = 2;
+// point lights through the G-buffer instead of forward permutations (G toggles)
+bool deferredShading = false;
+// simulate the next frame on a worker while this one renders (--pipeline, L toggles); input that
+// changes the simulation goes through pipeline.Defer
+FramePipeline pipeline;
+bool isKeyLPressed = false;
+
 // Objects
 TumblerCluster tumblers;
 BallSystem ballSys;
-FireBall fireBall;
+FireBallPool fireBalls;
+ShadowCache shadowCache;
+PointShadow pointShadow;
 StaticParticleManager ptm;
 
-int main()
+// ray picking and the fireball's broad phase: tumblers are objects 0-4, balls 5 on
+const unsigned int TUMBLER_LAYER = 1, BALL_LAYER = 2;
+MeshBVH tumblerShape, ballShape;
+SceneBVH scene;
+
+// everything that changes the simulation goes through Input, so --record <file> can log it and
+// --replay <file> can feed it back headlessly, checking the state along the way
+InputLog inputLog;
+
+// frame time percentiles, draws per pass, live counts and memory on screen (--hud, H toggles)
+StatsOverlay statsOverlay;
+bool isKeyHPressed = false;
+
+// picking's five dragons along the back of the room, loaded only if the scenario runs
+struct PickingScene {
+    std::unique_ptr<Model> dragon;
+    MeshBVH shape;
+    SceneBVH dragons;
+    long long hits = 0;
+};
+
+int main(int argc, char** argv)
 {
+    bool runShaderBench = false, runPickBench = false, clusteredShading = false;
+    int stressLights = 0;   // --lights <n> adds n small lights circling the room, for the deferred path
+    float rapidFire = 0.0f; // --rapid-fire <n> launches n fireballs a second from the camera, spread around the view
+    int fireBallSlots = 256;    // --fireballs <n> sizes the pool
+    int soakMinutes = 0;    // --soak [minutes] steps the scene for that long (an hour by default) as fast as it goes and checks GL usage stays flat
+    const char* recordPath = nullptr, * replayPath = nullptr;  // --record <file>, --replay <file>
+    // --load-snapshot <file> starts the simulation from a saved state, --save-snapshot <file> saves it on the way out
+    const char* loadSnapshotPath = nullptr, * saveSnapshotPath = nullptr;
+    const char* profilePath = nullptr;  // --profile <file> times the frame's stages and writes a Chrome trace on the way out
+    // --scenarios <results.json> runs the scripted scenarios headlessly (--scenario <name> picks some) and writes their results
+    const char* scenariosPath = nullptr;
+    std::vector<std::string> scenarioNames;
+    const char* statsPath = nullptr;    // --stats-csv <file> writes every frame's (or headless step's) stats as a CSV row
+    // --offscreen <frames> <dir> renders that many frames of a scripted scene into a framebuffer, without showing the
+    // window, and writes every --capture-every <k>th (30th) and the last as PNGs to dir; --golden <dir> checks them
+    // against the images there, off by at most --tolerance <n> (8) per channel. --offscreen-api egl|osmesa runs GLFW
+    // without a window system (its null platform, GLFW 3.4) on a surfaceless EGL or an OSMesa context. The glfw3.dll
+    // bundled with the project is 3.3.8, which has no null platform: built against it --offscreen-api always errors
+    // out, and --offscreen alone still needs a display for its hidden window
+    int offscreenFrames = 0;
+    const char* offscreenApi = nullptr;
+    FrameCapture capture;
+    bool streamed = true;   // --no-stream draws particles one by one and uploads light instances with glBufferData, for comparison
+    // --prop <model> <x> <y> <z> <scale> <yaw degrees> furnishes the room, repeatable
+    struct PropArg { std::string path; glm::vec3 position; float scale, yaw; };
+    std::vector<PropArg> propArgs;
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "--shader-bench"))runShaderBench = true;
+        if (!strcmp(argv[i], "--pick-bench"))runPickBench = true;
+        if (!strcmp(argv[i], "--deferred"))deferredShading = true;
+        if (!strcmp(argv[i], "--pipeline"))pipeline.enabled = true;
+        if (!strcmp(argv[i], "--lights") && i + 1 < argc)stressLights = atoi(argv[++i]);
+        if (!strcmp(argv[i], "--rapid-fire") && i + 1 < argc)rapidFire = (float)atof(argv[++i]);
+        if (!strcmp(argv[i], "--fireballs") && i + 1 < argc)fireBallSlots = std::max(atoi(argv[++i]), 1);
+        if (!strcmp(argv[i], "--no-stream"))streamed = false;
+        if (!strcmp(argv[i], "--record") && i + 1 < argc)recordPath = argv[++i];
+        if (!strcmp(argv[i], "--replay") && i + 1 < argc)replayPath = argv[++i];
+        if (!strcmp(argv[i], "--load-snapshot") && i + 1 < argc)loadSnapshotPath = argv[++i];
+        if (!strcmp(argv[i], "--save-snapshot") && i + 1 < argc)saveSnapshotPath = argv[++i];
+        if (!strcmp(argv[i], "--profile") && i + 1 < argc)profilePath = argv[++i];
+        if (!strcmp(argv[i], "--stats-csv") && i + 1 < argc)statsPath = argv[++i];
+        if (!strcmp(argv[i], "--hud"))statsOverlay.visible = true;
+        if (!strcmp(argv[i], "--offscreen") && i + 2 < argc)offscreenFrames = std::max(atoi(argv[i + 1]), 1), capture.outDir = argv[i + 2], i += 2;
+        if (!strcmp(argv[i], "--offscreen-api") && i + 1 < argc)offscreenApi = argv[++i];
+        if (!strcmp(argv[i], "--golden") && i + 1 < argc)capture.goldenDir = argv[++i];
+        if (!strcmp(argv[i], "--tolerance") && i + 1 < argc)capture.tolerance = std::max(atoi(argv[++i]), 0);
+        if (!strcmp(argv[i], "--capture-every") && i + 1 < argc)capture.every = std::max(atoi(argv[++i]), 0);
+        // --log <file> writes the log there instead of the console, --log-level <trace|debug|info|warn|error|off>
+        // shows more or less of it (debug has the physics diagnostics)
+        if (!strcmp(argv[i], "--log") && i + 1 < argc && !Log::Get().Open(argv[++i]))
+            return -1;
+        if (!strcmp(argv[i], "--log-level") && i + 1 < argc && Log::Parse(argv[i + 1]) >= 0)
+            Log::Get().level = Log::Parse(argv[++i]);
+        // --snapshot-diff <a> <b> lists the blocks in which two saved states differ
+        if (!strcmp(argv[i], "--snapshot-diff") && i + 2 < argc) {
+            SceneSnapshot a, b;
+            if (!a.Load(argv[i + 1]) || !b.Load(argv[i + 2]))
+                return -1;
+            int differing = a.Diff(b);
+            printf("snapshot diff: %d blocks differ\n", differing);
+            return differing ? 1 : 0;
+        }
+        if (!strcmp(argv[i], "--scenarios") && i + 1 < argc)scenariosPath = argv[++i];
+        if (!strcmp(argv[i], "--scenario") && i + 1 < argc)scenarioNames.push_back(argv[++i]);
+        // --scenario-compare <baseline.json> <results.json> [percent] flags what got slower by more than percent (10 by default)
+        if (!strcmp(argv[i], "--scenario-compare") && i + 2 < argc) {
+            std::vector<ScenarioResult> baseline, current;
+            if (!ScenarioBench::Read(argv[i + 1], baseline) || !ScenarioBench::Read(argv[i + 2], current))
+                return -1;
+            double threshold = i + 3 < argc && atof(argv[i + 3]) > 0.0 ? atof(argv[i + 3]) / 100.0 : 0.1;
+            return ScenarioBench::Compare(baseline, current, threshold) ? 1 : 0;
+        }
+        if (!strcmp(argv[i], "--soak"))soakMinutes = i + 1 < argc && atoi(argv[i + 1]) > 0 ? atoi(argv[++i]) : 60;
+        // deferred, lit through per-cluster light lists binned on the CPU instead of light volumes
+        if (!strcmp(argv[i], "--clustered"))deferredShading = clusteredShading = true;
+        if (!strcmp(argv[i], "--cluster-bench")) {
+            RunClusterBenchmark();
+            return 0;
+        }
+        if (!strcmp(argv[i], "--prop") && i + 6 < argc) {
+            propArgs.push_back({ argv[i + 1], glm::vec3(atof(argv[i + 2]), atof(argv[i + 3]), atof(argv[i + 4])), (float)atof(argv[i + 5]), (float)atof(argv[i + 6]) });
+            i += 6;
+        }
+    }
+    // what the log's steps ran on: a replay needs the same pool and props
+    std::string sceneArgs = "--fireballs " + std::to_string(fireBallSlots);
+    for (const PropArg& prop : propArgs)
+    {
+        char numbers[160];
+        snprintf(numbers, sizeof(numbers), " %g %g %g %g %g", prop.position.x, prop.position.y, prop.position.z, prop.scale, prop.yaw);
+        sceneArgs += " --prop " + prop.path + numbers;
+    }
+    // the simulation's random numbers restart from the log's seed, before loading draws any
+    if (replayPath && !inputLog.Replay(replayPath, sceneArgs))
+        return -1;
+    if (!replayPath && recordPath && !inputLog.Record(recordPath, Randomizer::Seed(), sceneArgs))
+        return -1;
+    if (inputLog.mode != InputLog::Off)
+        Randomizer::Reseed(inputLog.seed);
+    // offscreen frames are compared with earlier runs', so they start from the same random numbers too
+    else if (offscreenFrames)
+        Randomizer::Reseed(4);
+    if (profilePath)
+    {
+        Profiler::Get().enabled = true;
+        Profiler::Get().Thread("main");
+    }
+    if (statsPath && !FrameStats::Get().Open(statsPath))
+        return -1;
+    if (offscreenApi && ((strcmp(offscreenApi, "egl") && strcmp(offscreenApi, "osmesa")) || !offscreenFrames))
+    {
+        printf("offscreen: --offscreen-api takes egl or osmesa, with --offscreen\n");
+        return -1;
+    }
+
     // glfw: initialize and configure
     // ------------------------------
-    glfwInit();
+    // with --offscreen-api there is no X11 or Wayland display to connect to: the null platform creates no
+    // windows, and its EGL context goes through EGL_PLATFORM_SURFACELESS_MESA, or OSMesa renders in memory
+    if (offscreenApi)
+    {
+#if defined(GLFW_PLATFORM_NULL) && defined(GLFW_EGL_CONTEXT_API) && defined(GLFW_OSMESA_CONTEXT_API)
+        glfwInitHint(GLFW_PLATFORM, GLFW_PLATFORM_NULL);
+#else
+        printf("offscreen: --offscreen-api %s needs GLFW 3.4 or later, built with the null platform\n", offscreenApi);
+        return -1;
+#endif
+    }
+    if (!glfwInit())
+    {
+        std::cout << "Failed to initialize GLFW" << std::endl;
+        return -1;
+    }
     glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
     glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
     glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
@@ -59,6 +254,13 @@ int main()
 #ifdef __APPLE__
     glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
 #endif
+    // offscreen the window is only there for its context, and is never shown
+    if (offscreenFrames)
+        glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+#if defined(GLFW_PLATFORM_NULL) && defined(GLFW_EGL_CONTEXT_API) && defined(GLFW_OSMESA_CONTEXT_API)
+    if (offscreenApi)
+        glfwWindowHint(GLFW_CONTEXT_CREATION_API, strcmp(offscreenApi, "egl") ? GLFW_OSMESA_CONTEXT_API : GLFW_EGL_CONTEXT_API);
+#endif
 
     // glfw window creation
     // --------------------
@@ -66,8 +268,7 @@ int main()
     if (window == NULL)
     {
         std::cout << "Failed to create GLFW window" << std::endl;
-        glfwTerminate();
-        return -1;
+        return Shutdown(-1);
     }
     glfwMakeContextCurrent(window);
     glfwSetFramebufferSizeCallback(window, framebuffer_size_callback);
@@ -86,6 +287,8 @@ int main()
         std::cout << "Failed to initialize GLAD" << std::endl;
         return -1;
     }
+    if (profilePath)
+        GpuProfiler::Get().Init();
 
     // tell stb_image.h to flip loaded texture's on the y-axis (before loading model).
     stbi_set_flip_vertically_on_load(true);
@@ -98,109 +301,446 @@ int main()
     // Prebuilding Configurations
     // -----------------------------------------------------------------------------------------------------------------------------------------------------------
 
+    // Loading jobs: file reads, parsing, decoding and mesh generation run on workers,
+    // everything touching GL is queued back to this thread by jobs.RunMainThread()
+    JobSystem jobs;
+
     // Shaders Configurations
-    Shader pureShader("shader\\pure.vs", "shader\\pure.fs");
-    Shader ceilingShader("shader\\ceiling.vs", "shader\\ceiling.fs");
-    Shader textureShader("shader\\texture.vs", "shader\\texture.fs");
-    Shader lightShader("shader\\light.vs", "shader\\light.fs");
-    Shader tumblerShader("shader\\texture.vs", "shader\\texture.fs");
-    Shader groundShader("shader\\ground.vs", "shader\\ground.fs");
-    Shader ballShader("shader\\ball.vs", "shader\\ball.fs");
-    Shader particleShader("shader\\particle.vs", "shader\\particle.fs");
+    // identical programs are built once and linked programs come from the binary cache after the first run;
+    // the IDs are handed out by shaders.Finish()
+    ShaderManager shaders(jobs, (GLADloadproc)glfwGetProcAddress);
+    Shader lightShader, particleShader, particleInstancedShader;
+    Shader debugDepthQuad, simpleDepthShader, pointShadowShader, deferredLightShader, clusteredLightShader, hudShader;
+    shaders.Load(lightShader, "shader\\light.vs", "shader\\light.fs");
+    shaders.Load(particleShader, "shader\\particle.vs", "shader\\particle.fs");
+    shaders.Load(particleInstancedShader, "shader\\particle.vs", "shader\\particle.fs", "INSTANCED 1");
+    shaders.Load(debugDepthQuad, "shader\\debug_quad_depth.vs", "shader\\debug_quad_depth.fs");
+    shaders.Load(simpleDepthShader, "shader\\shadow_mapping_depth.vs", "shader\\shadow_mapping_depth.fs");
+    shaders.Load(pointShadowShader, "shader\\point_shadow_depth.vs", "shader\\point_shadow_depth.fs", "", "shader\\point_shadow_depth.gs");
+    shaders.Load(deferredLightShader, "shader\\deferred_light.vs", "shader\\deferred_light.fs");
+    shaders.Load(clusteredLightShader, "shader\\deferred_clustered.vs", "shader\\deferred_clustered.fs");
+    shaders.Load(hudShader, "shader\\hud.vs", "shader\\hud.fs");
+    // lit shaders come in #define permutations (FIREBALL_LIGHT, SHADOWS/PCF_RADIUS and BALL_TYPE in the .fs files),
+    // the render loop picks the one without the branches it doesn't need; the likely ones are built up front
+    ShaderVariants pureShaders(shaders, jobs, "shader\\pure.vs", "shader\\pure.fs");
+    ShaderVariants ceilingShaders(shaders, jobs, "shader\\ceiling.vs", "shader\\ceiling.fs");
+    ShaderVariants textureShaders(shaders, jobs, "shader\\texture.vs", "shader\\texture.fs");
+    ShaderVariants groundShaders(shaders, jobs, "shader\\ground.vs", "shader\\ground.fs");
+    ShaderVariants ballShaders(shaders, jobs, "shader\\ball.vs", "shader\\ball.fs");
+    // the fireball's shadow cube map sits on unit 10
+    auto fireShadowUnit = [](Shader& shader) { shader.use(); shader.setInt("fireShadowMap", 10); };
+    pureShaders.setup = ceilingShaders.setup = textureShaders.setup = ballShaders.setup = fireShadowUnit;
+    groundShaders.setup = [=](Shader& shader) { fireShadowUnit(shader); shader.setInt("shadowMap", 9); };
+    for (const char* fire : { "FIREBALL_LIGHT 0", "FIREBALL_LIGHT 1" })
+    {
+        pureShaders.Warm(fire);
+        ceilingShaders.Warm(fire);
+        textureShaders.Warm(fire);
+        groundShaders.Warm(GroundDefines(fire));
+        for (int type = Default; type <= Tumblers; type++)
+            ballShaders.Warm(std::string(fire) + ";BALL_TYPE " + std::to_string(type));
+    }
+    if (deferredShading)
+    {
+        const char* fire = "FIREBALL_LIGHT 0;DEFERRED 1";
+        pureShaders.Warm(fire);
+        ceilingShaders.Warm(fire);
+        textureShaders.Warm(fire);
+        groundShaders.Warm(GroundDefines(fire));
+        for (int type = Default; type <= Tumblers; type++)
+            ballShaders.Warm(std::string(fire) + ";BALL_TYPE " + std::to_string(type));
+    }
 
-    glm::mat4 projection = glm::perspective(glm::radians(camera.Zoom), (float)SCR_WIDTH / (float)SCR_HEIGHT, 0.1f, 100.0f);
-    glm::mat4 view = camera.GetViewMatrix();
+    // Textures are decoded on workers and streamed in over the first frames, lowest mips first,
+    // so nothing below waits for them
+    TextureStreamer streamer(jobs);
 
-    InitShader(pureShader, projection, view, camera.Position);
+    // Room and tumblers
+    Texture woodTexture;
+    woodTexture.id = streamer.Request("texture/wood.jpg");
+    woodTexture.type = "texture_diffuse";
+    woodTexture.path = "texture/wood.jpg";
+    tumblers.Init(jobs, &streamer);
+    ballSys.InitBalls(jobs, woodTexture, nullptr);
+    std::unique_ptr<Room> roomPtr;
+    jobs.SubmitMain("room", "upload", [&] { roomPtr.reset(new Room(1.0f, woodTexture)); });
+
+    jobs.RunMainThread();
+    shaders.Finish();
+    jobs.Report();
+    shaders.Report();
+    // from here on jobs are per frame, they aren't kept for the report
+    jobs.recording = false;
+    Room& room = *roomPtr;
+    const glm::vec3 propColors[] = { glm::vec3(0.72f, 0.53f, 0.35f), glm::vec3(0.85f, 0.85f, 0.8f), glm::vec3(0.95f, 0.6f, 0.2f) };
+    for (size_t i = 0; i < propArgs.size(); i++) {
+        glm::mat4 transform = glm::translate(glm::mat4(1.0f), propArgs[i].position);
+        transform = glm::rotate(transform, glm::radians(propArgs[i].yaw), glm::vec3(0.0f, 1.0f, 0.0f));
+        transform = glm::scale(transform, glm::vec3(propArgs[i].scale));
+        room.AddProp(propArgs[i].path, transform, propColors[i % 3]);
+    }
 
-    InitShader(ceilingShader, projection, view, camera.Position);
-    ceilingShader.setVec3("light.ambient", 0.7f, 0.7f, 0.7f);
+    tumblerShape.Build(tumblers.tumblers[0].model->meshes);
+    ballShape.Build(ballSys.balls[0].mesh);
+    for (int i = 0; i < 5; i++)
+        scene.Add(&tumblerShape, tumblers.tumblers[i].ModelMatrix(), true, TUMBLER_LAYER);
+    for (int i = 0; i < ballSys.N; i++)
+        scene.Add(&ballShape, glm::translate(glm::mat4(1.0f), ballSys.balls[i].position), ballSys.balls[i].living, BALL_LAYER);
+    scene.Build();
 
-    InitShader(textureShader, projection, view, camera.Position);
-    textureShader.setVec3("light.specular", 0.9f, 0.9f, 0.9f);
+    if (runPickBench)
+    {
+        RunPickBenchmark({ &tumblerShape, &ballShape });
+        printf("-------------------------------- sphere contacts --------------------------------\n");
+        MeshCollider tumblerCollider;
+        tumblerCollider.Build(tumblers.tumblers[0].model->meshes, tumblers.tumblers[0].ModelMatrix());
+        RunContactBenchmark("tumbler", tumblerCollider, ballSys.balls[0].radius);
+        for (size_t i = 0; i < room.props.size(); i++)
+            RunContactBenchmark(propArgs[i].path.c_str(), room.props[i]->collider, ballSys.balls[0].radius);
+        return Shutdown(0);
+    }
 
-    InitShader(ballShader, projection, view, camera.Position);
+    glm::mat4 projection = glm::perspective(glm::radians(camera.Zoom), (float)SCR_WIDTH / (float)SCR_HEIGHT, 0.1f, 100.0f);
+    glm::mat4 view = camera.GetViewMatrix();
 
     InitShader(lightShader, projection, view, camera.Position);
 
-    InitShader(tumblerShader, projection, view, camera.Position);
-
-    InitShader(groundShader, projection, view, camera.Position);
-
     InitShader(particleShader, projection, view, camera.Position);
 
     // Shadow texture
-    Shader debugDepthQuad("shader\\debug_quad_depth.vs", "shader\\debug_quad_depth.fs");
-    Shader simpleDepthShader("shader\\shadow_mapping_depth.vs", "shader\\shadow_mapping_depth.fs");
-    // configure depth map FBO
+    // cached across frames, slots: tumblers 0-4, balls 5-34, fireball 35, props after it
     const unsigned int SHADOW_WIDTH = 1024, SHADOW_HEIGHT = 1024;
-    unsigned int depthMapFBO;
-    glGenFramebuffers(1, &depthMapFBO);
-    // create depth texture
-    unsigned int depthMap;
-    glGenTextures(1, &depthMap);
-    glBindTexture(GL_TEXTURE_2D, depthMap);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT, SHADOW_WIDTH, SHADOW_HEIGHT, 0, GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-    // attach depth texture as FBO's depth buffer
-    glBindFramebuffer(GL_FRAMEBUFFER, depthMapFBO);
-    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, depthMap, 0);
-    glDrawBuffer(GL_NONE);
-    glReadBuffer(GL_NONE);
-    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    const int FIREBALL_SLOT = 5 + ballSys.N;
+    const int PROP_SLOT = FIREBALL_SLOT + 1;
+    shadowCache.Init(SHADOW_WIDTH, SHADOW_HEIGHT, PROP_SLOT + (int)room.props.size());
+    unsigned int depthMap = shadowCache.depthMap;
+    pointShadow.Init();
+    fireBalls.Init(fireBallSlots);
+    float rapidFireCarry = 0.0f;
+    Randomizer rapidFireRandom(1);
+    DeferredRenderer deferred;
+    if (!deferred.Init(SCR_WIDTH, SCR_HEIGHT))deferredShading = false;
+    deferred.clustered = clusteredShading;
+    // per-frame vertex and instance data (particles, light volumes) goes through one ring buffer,
+    // three frames deep, persistently mapped where GL 4.4 allows
+    StreamBuffer streamBuffer;
+    if (streamed)
+    {
+        streamBuffer.Init(4 << 20);
+        deferred.stream = &streamBuffer;
+    }
+    Shader& particles = streamed ? particleInstancedShader : particleShader;
+    statsOverlay.Init();
+    LightClusters clusters;
+    // the stress lights' orbits: radius, height, angular speed, phase, and their colours
+    std::vector<glm::vec4> orbits;
+    std::vector<glm::vec3> orbitColors;
+    Randomizer orbitRandom(2);
+    for (int i = 0; i < stressLights; i++) {
+        orbits.push_back(glm::vec4(orbitRandom.random(0.1f, 0.95f), orbitRandom.random(-0.95f, 0.9f), orbitRandom.random(-1.5f, 1.5f), orbitRandom.random(0.0f, 6.2831853f)));
+        orbitColors.push_back(glm::vec3(orbitRandom.random(0.2f, 1.0f), orbitRandom.random(0.2f, 1.0f), orbitRandom.random(0.2f, 1.0f)) * 0.5f);
+    }
 
     // shader configuration
-    groundShader.use();
-    groundShader.setInt("shadowMap", 9);
     debugDepthQuad.use();
     debugDepthQuad.setInt("depthMap", 9);
 
+    if (runShaderBench)
+    {
+        // wait for the full-resolution wood texture, then time the permutations against the runtime-branch shaders
+        while (streamer.Streaming())
+            streamer.Update(), std::this_thread::yield();
+        auto lit = [&](bool fire, int type) {
+            return [&, fire, type](Shader& shader) {
+                InitShader(shader, glm::mat4(1.0f), glm::mat4(1.0f), glm::vec3(0.0f, 0.0f, 1.0f));
+                shader.setBool("isFireballActive", fire);
+                shader.setInt("type", type);
+                shader.setInt("shadowMap", 9);
+                shader.setMat4("lightSpaceMatrix", glm::mat4(1.0f));
+                glActiveTexture(GL_TEXTURE9);
+                glBindTexture(GL_TEXTURE_2D, depthMap);
+            };
+        };
+        RunShaderBenchmark({
+            { "ground", "branches, fireball off, 3x3 PCF", &groundShaders, "", lit(false, 0) },
+            { "ground", "FIREBALL_LIGHT 0, PCF_RADIUS 1", &groundShaders, "FIREBALL_LIGHT 0;PCF_RADIUS 1", lit(false, 0) },
+            { "ground", "FIREBALL_LIGHT 0, PCF_RADIUS 0", &groundShaders, "FIREBALL_LIGHT 0;PCF_RADIUS 0", lit(false, 0) },
+            { "ground", "FIREBALL_LIGHT 0, PCF_RADIUS 2", &groundShaders, "FIREBALL_LIGHT 0;PCF_RADIUS 2", lit(false, 0) },
+            { "ground", "FIREBALL_LIGHT 0, SHADOWS 0", &groundShaders, "FIREBALL_LIGHT 0;SHADOWS 0", lit(false, 0) },
+            { "groundF", "branches, fireball on, 3x3 PCF", &groundShaders, "", lit(true, 0) },
+            { "groundF", "FIREBALL_LIGHT 1, PCF_RADIUS 1", &groundShaders, "FIREBALL_LIGHT 1;PCF_RADIUS 1", lit(true, 0) },
+            { "ball", "branches, type 0", &ballShaders, "", lit(false, Default) },
+            { "ball", "FIREBALL_LIGHT 0, BALL_TYPE 0", &ballShaders, "FIREBALL_LIGHT 0;BALL_TYPE 0", lit(false, Default) },
+            { "ballG", "branches, type 5 (textured)", &ballShaders, "", lit(false, Ground) },
+            { "ballG", "FIREBALL_LIGHT 0, BALL_TYPE 5", &ballShaders, "FIREBALL_LIGHT 0;BALL_TYPE 5", lit(false, Ground) },
+            { "pure", "branches, fireball off", &pureShaders, "", lit(false, 0) },
+            { "pure", "FIREBALL_LIGHT 0", &pureShaders, "FIREBALL_LIGHT 0", lit(false, 0) },
+        }, woodTexture);
+        return Shutdown(0);
+    }
 
 
 
-    // -----------------------------------------------------------------------------------------------------------------------------------------------------------
-    // Prebuilding Objects
-    // -----------------------------------------------------------------------------------------------------------------------------------------------------------
 
-    // Room and tumblers
-    Room room(1.0f);
-    tumblers.Init();
-    ballSys.InitBalls();
+    // draw in wireframe
+    //glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
 
+    // view-frustum culling for the camera and the light pass, the counters add up over the run
+    Frustum cameraFrustum, lightFrustum;
+    // occlusion culling of tumblers and balls behind the tumblers, on a CPU depth buffer
+    OcclusionCuller occlusion;
+
+    // one simulation step; pipelined, it runs on a worker while the last step's published state is drawn
+    std::function<void(float)> simulate = [&](float dt) {
+        PROFILE_ZONE("simulate");
+        { PROFILE_ZONE("tumbler kinetics"); tumblers.KineticCalculation(dt); }
+        { PROFILE_ZONE("ball kinetics"); ballSys.Animate(dt); }
+        { PROFILE_ZONE("fireballs"); fireBalls.Update(dt); }
+        { PROFILE_ZONE("particles"); ptm.Update(dt); }
+        { PROFILE_ZONE("ball collisions"); Balls_CollideCalculation(ballSys, room, tumblers); }
+        { PROFILE_ZONE("scene refit"); UpdateScene(); }
+        { PROFILE_ZONE("fireball collisions"); FireBalls_CollideCalculation(fireBalls, ballSys, room, tumblers, ptm, &scene); }
+        if (inputLog.mode != InputLog::Off)
+            inputLog.EndStep(inputLog.WantsChecksum() ? SimulationChecksum() : 0);
+    };
+    // everything the render pass reads from the simulation, copied between steps
+    std::function<void()> publish = [&] {
+        PROFILE_ZONE("publish");
+        tumblers.Publish();
+        ballSys.Publish();
+        fireBalls.Publish();
+        ptm.Publish();
+    };
+
+    if (loadSnapshotPath)
+    {
+        if (!LoadSnapshot(loadSnapshotPath))
+            return Shutdown(-1);
+        publish();
+    }
 
+    if (scenariosPath)
+    {
+        // every scenario starts from the scene as loaded, at 60 Hz, and is fed the same inputs every run, so
+        // the end state's checksum only changes when the simulation does
+        SceneSnapshot start;
+        tumblers.Save(start);
+        ballSys.Save(start);
+        fireBalls.Save(start);
+        ptm.Save(start);
+        ScenarioBench bench;
+        bench.reset = [&] {
+            tumblers.Restore(start);
+            ballSys.Restore(start);
+            fireBalls.Restore(start);
+            ptm.Restore(start);
+            tumblers.ReleaseMouse();
+            UpdateScene();
+            publish();
+        };
+        bench.step = [&](float dt) { simulate(dt); publish(); };
+        bench.checksum = SimulationChecksum;
+
+        PickingScene picking;
+        std::vector<Scenario> scenarios = Scenarios(picking);
+        int ran = 0;
+        for (const Scenario& scenario : scenarios)
+        {
+            if (!scenarioNames.empty() && std::find(scenarioNames.begin(), scenarioNames.end(), scenario.name) == scenarioNames.end())
+                continue;
+            bench.Run(scenario);
+            ran++;
+        }
+        if (!ran)
+        {
+            printf("scenarios: none of those; there are");
+            for (const Scenario& scenario : scenarios)
+                printf(" \"%s\"", scenario.name);
+            printf("\n");
+        }
+        if (picking.hits)
+            printf("scenarios: %lld picking rays hit\n", picking.hits);
+        return Shutdown(ran && bench.Write(scenariosPath) ? 0 : 1, profilePath);
+    }
 
-    // draw in wireframe
-    //glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
+    if (soakMinutes)
+    {
+        // fixed 60 Hz steps with a fireball launched every 0.2 s and the balls reset every 20 s; the particles
+        // are drawn through the stream buffer every step. After the first minute's warm-up, live GL objects and
+        // bytes and the textures the balls bind have to stay where they are, and no step, resets included, may
+        // allocate on the heap at all
+        const float step = 1.0f / 60.0f;
+        GLResources& gl = GLResources::Get();
+        Randomizer soakRandom(3);
+        long long baseLive = 0, baseBytes = 0, worstLive = 0, worstBytes = 0;
+        int baseTextures = 0, worstTextures = 0;
+        FrameAllocations soakAllocations;
+        soakAllocations.warmup = 3600;
+        InitShader(particles, projection, view, camera.Position);
+        for (int i = 0; i <= soakMinutes * 3600; i++)
+        {
+            PROFILE_ZONE("frame");
+            auto start = std::chrono::steady_clock::now();
+            FrameStats::Get().BeginFrame();
+            if (i % 12 == 0)
+                fireBalls.Launch(glm::vec3(0.0f, 0.0f, 0.8f), glm::vec3(soakRandom.random(-0.5f, 0.5f), soakRandom.random(-0.5f, 0.5f), -1.0f));
+            FrameArena::Frame().Reset();
+            soakAllocations.Begin();
+            if (i % 1200 == 0)
+                ballSys.Activate();
+            simulate(step);
+            publish();
+            streamer.Update();
+            if (streamed)
+                streamBuffer.BeginFrame();
+            fireBalls.Draw(lightShader, particles, nullptr, streamed ? &streamBuffer : nullptr);
+            ptm.Draw(particles, nullptr, streamed ? &streamBuffer : nullptr);
+            if (streamed)
+                streamBuffer.EndFrame();
+            CountLive();
+            FrameStats::Get().EndFrame(std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count());
+            soakAllocations.End();
+            if (i % 3600)continue;
+            int minute = i / 3600;
+            printf("soak %3d min: %lld GL objects, %.1f KB, %d fireballs, %d particle systems, %d ball textures\n", minute, gl.Live(), gl.Bytes() / 1024.0, fireBalls.Count(), (int)ptm.ps.size(), ballSys.TextureCount());
+            if (minute == 1)
+                baseLive = worstLive = gl.Live(), baseBytes = worstBytes = gl.Bytes(), baseTextures = worstTextures = ballSys.TextureCount();
+            worstLive = std::max(worstLive, gl.Live()), worstBytes = std::max(worstBytes, gl.Bytes()), worstTextures = std::max(worstTextures, ballSys.TextureCount());
+        }
+        bool flat = soakMinutes < 1 || (worstLive == baseLive && worstBytes == baseBytes && worstTextures == baseTextures);
+        soakAllocations.PrintStats("soak steps");
+        printf("soak: %s, %lld GL objects, %.1f KB and %d ball textures after warm-up, at most %lld, %.1f KB and %d since\n",
+            flat ? "flat" : "GREW", baseLive, baseBytes / 1024.0, baseTextures, worstLive, worstBytes / 1024.0, worstTextures);
+        gl.PrintStats();
+        streamBuffer.PrintStats();
+        fireBalls.PrintStats();
+        FrameStats::Get().PrintStats();
+        if (saveSnapshotPath)
+            SaveSnapshot(saveSnapshotPath);
+        return Shutdown(flat && soakAllocations.Clean() ? 0 : 1, profilePath);
+    }
+
+    if (inputLog.mode == InputLog::Replaying)
+    {
+        // the logged steps with their inputs, nothing drawn; a checksum that differs from the recorded one
+        // means the simulation went elsewhere, the step times show where it got slower
+        float dt;
+        std::vector<InputEvent> events;
+        double totalMs = 0.0, worstMs = 0.0;
+        int worstStep = 0;
+        while (inputLog.ReadStep(dt, events))
+        {
+            PROFILE_ZONE("frame");
+            auto start = std::chrono::steady_clock::now();
+            FrameStats::Get().BeginFrame();
+            for (const InputEvent& e : events)
+                ApplyInput(e);
+            simulate(dt);
+            publish();
+            double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+            CountLive();
+            FrameStats::Get().EndFrame((float)ms);
+            if (ms > worstMs)
+                worstMs = ms, worstStep = inputLog.steps;
+            totalMs += ms;
+        }
+        inputLog.PrintStats();
+        if (inputLog.steps)
+            printf("replay: %.3f ms per step, slowest %.3f ms at step %d\n", totalMs / inputLog.steps, worstMs, worstStep);
+        FrameStats::Get().PrintStats();
+        if (saveSnapshotPath)
+            SaveSnapshot(saveSnapshotPath);
+        return Shutdown(inputLog.mismatches ? 1 : 0, profilePath);
+    }
+
+    // heap allocations on this thread per frame, reported at exit. Past the warm-up a frame allocates nothing:
+    // jobs and deferred input are pooled, and the headless run (--offscreen) fails if any frame did
+    FrameAllocations frameAllocations;
+
+    // offscreen the frame goes to the target instead of the window, with every texture at full resolution,
+    // at a fixed time step, and with the same inputs every run: the balls at once, a fireball every 20 frames
+    OffscreenTarget offscreen;
+    Randomizer offscreenRandom(5);
+    if (offscreenFrames)
+    {
+        if (!offscreen.Init(SCR_WIDTH, SCR_HEIGHT))
+            return Shutdown(-1);
+        deferred.screen = offscreen.framebuffer;
+        auto waitStart = std::chrono::steady_clock::now();
+        while (streamer.Streaming() && std::chrono::steady_clock::now() - waitStart < std::chrono::seconds(30))
+            streamer.Update(), std::this_thread::yield();
+        if (streamer.Streaming())
+            printf("offscreen: %d textures still streaming, the frames may not match\n", streamer.Streaming());
+    }
+    int frame = 0;
 
     // render loop
     // -----------
-    while (!glfwWindowShouldClose(window))
+    while (!glfwWindowShouldClose(window) && (!offscreenFrames || frame < offscreenFrames))
     {
+        PROFILE_ZONE("frame");
+        GpuProfiler::Get().BeginFrame();
         // per-frame time logic
         // --------------------
-        float currentFrame = static_cast<float>(glfwGetTime());
-        deltaTime = currentFrame - lastFrame;
+        // what the last frame left in the arena goes, this frame's allocations are counted from here
+        FrameArena::Frame().Reset();
+        frameAllocations.Begin();
+        FrameStats::Get().BeginFrame();
+        float frameStart = static_cast<float>(glfwGetTime());
+        float currentFrame = offscreenFrames ? frame / 60.0f : frameStart;
+        deltaTime = offscreenFrames ? 1.0f / 60.0f : currentFrame - lastFrame;
         lastFrame = currentFrame;
 
-        tumblers.KineticCalculation(deltaTime);
-        ballSys.Animate(deltaTime);
-        fireBall.Update(deltaTime);
-        ptm.Update(deltaTime);
-        Balls_CollideCalculation(ballSys, room, tumblers);
-        Fireball_CollideCalculation(fireBall, ballSys, room, tumblers, ptm);
+        {
+            PROFILE_ZONE("texture streaming");
+            streamer.Update();
+        }
 
         // input
         // -----
-        processInput(window);
+        // read before the step, so what it defers is applied this frame
+        if (!offscreenFrames)
+            processInput(window);
+        else if (frame == 0)
+            Input(InputEvent::Make(InputEvent::Activate));
+        else if (frame % 20 == 0)
+            Input(InputEvent::Make(InputEvent::Launch, camera.Position, camera.Front + camera.Right * offscreenRandom.random(-0.3f, 0.3f) + camera.Up * offscreenRandom.random(-0.2f, 0.2f)));
+        // --rapid-fire: a steady stream of fireballs in a cone around the view direction
+        rapidFireCarry += rapidFire * deltaTime;
+        for (; rapidFireCarry >= 1.0f; rapidFireCarry -= 1.0f)
+        {
+            glm::vec3 from = camera.Position;
+            glm::vec3 direction = camera.Front + camera.Right * rapidFireRandom.random(-0.3f, 0.3f) + camera.Up * rapidFireRandom.random(-0.2f, 0.2f);
+            Input(InputEvent::Make(InputEvent::Launch, from, direction));
+        }
+        // the inputs so far are the next step's, with its time step
+        if (inputLog.mode == InputLog::Recording)
+            pipeline.Defer([dt = deltaTime] { inputLog.BeginStep(dt); });
+
+        // simulation
+        // ----------
+        {
+            PROFILE_ZONE("pipeline step");
+            pipeline.Step(jobs, deltaTime, simulate, publish);
+        }
+        // the newest fireball lights and shadows the forward shaders
+        FireBall& fireBall = fireBalls.Lead();
 
         // render
         // ------
         glClearColor(0.05f, 0.05f, 0.05f, 1.0f);
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
+        // permutations for this frame: the fireball light is compiled in or out instead of branching per fragment
+        // deferred, the fireball is one of the point lights instead
+        bool useDeferred = deferredShading && deferred.Ready();
+        const char* fire = useDeferred ? "FIREBALL_LIGHT 0;DEFERRED 1" : fireBall.living ? "FIREBALL_LIGHT 1" : "FIREBALL_LIGHT 0";
+        Shader& pureShader = pureShaders.Get(fire);
+        Shader& ceilingShader = ceilingShaders.Get(fire);
+        Shader& textureShader = textureShaders.Get(fire);
+        Shader& tumblerShader = textureShader;
+        Shader& groundShader = groundShaders.Get(GroundDefines(fire));
+
         // don't forget to enable shader before setting uniforms
        
 
@@ -221,20 +761,48 @@ int main()
         simpleDepthShader.use();
         simpleDepthShader.setMat4("lightSpaceMatrix", lightSpaceMatrix);
 
-        glViewport(0, 0, SHADOW_WIDTH, SHADOW_HEIGHT);
-        glBindFramebuffer(GL_FRAMEBUFFER, depthMapFBO);
-        glClear(GL_DEPTH_BUFFER_BIT);
-        //glActiveTexture(GL_TEXTURE0);
-        //glBindTexture(GL_TEXTURE_2D, woodTexture);
-        tumblers.renderShadow(simpleDepthShader);
-        ballSys.renderShadow(simpleDepthShader);
-        fireBall.renderShadow(simpleDepthShader);
-
-        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        if (shadowQuality)
+        {
+            PROFILE_GPU_ZONE("shadow pass");
+            RenderPassScope pass(PASS_SHADOW);
+            // only redrawn when a caster moved, the light is fixed
+            for (int i = 0; i < 5; i++)
+                shadowCache.Update(i, tumblers.tumblers[i].pose, true, &tumblers.tumblers[i].model->bounds);
+            for (int i = 0; i < ballSys.N; i++)
+                shadowCache.Update(5 + i, glm::translate(glm::mat4(1.0f), ballSys.balls[i].pose.position), ballSys.balls[i].pose.living, &ballSys.balls[i].mesh.bounds);
+            shadowCache.Update(FIREBALL_SLOT, fireBalls.GroupTransform(), fireBalls.Count() > 0, &fireBalls.GroupBounds());
+            for (size_t i = 0; i < room.props.size(); i++)
+                shadowCache.Update(PROP_SLOT + (int)i, room.props[i]->transform, true, &room.props[i]->model.bounds);
+            lightFrustum.Extract(lightSpaceMatrix);
+            shadowCache.Render([&](int slot) {
+                if (slot < 5)tumblers.tumblers[slot].Draw(simpleDepthShader);
+                else if (slot < FIREBALL_SLOT)ballSys.balls[slot - 5].Draw(simpleDepthShader);
+                else if (slot == FIREBALL_SLOT)fireBalls.renderShadow(simpleDepthShader);
+                else room.props[slot - PROP_SLOT]->Draw(simpleDepthShader);
+            }, &lightFrustum);
+            // the fireball doesn't shadow itself, so only the other casters count
+            if (fireBall.living)
+                pointShadow.Render(pointShadowShader, fireBall.position, camera.Position, shadowCache.Changed(0, FIREBALL_SLOT), [&] {
+                    tumblers.renderShadow(pointShadowShader);
+                    ballSys.renderShadow(pointShadowShader);
+                    for (auto& prop : room.props)
+                        prop->Draw(pointShadowShader);
+                });
+            else pointShadow.Invalidate();
+        }
+        else pointShadow.Invalidate();
+        glActiveTexture(GL_TEXTURE10);
+        glBindTexture(GL_TEXTURE_CUBE_MAP, pointShadow.DepthMap());
+        glActiveTexture(GL_TEXTURE0);
 
         // reset viewport
+        glBindFramebuffer(GL_FRAMEBUFFER, offscreen.framebuffer);
         glViewport(0, 0, SCR_WIDTH, SCR_HEIGHT);
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+        if (useDeferred)
+            deferred.BeginGeometry();
+        if (streamed)
+            streamBuffer.BeginFrame();
 
         // -----------------------------------------------------------------------------------------------------------------------------------------------------------
         // Drawing Objects
@@ -243,16 +811,63 @@ int main()
         // Update if moving is allowed
         glm::mat4 projection = glm::perspective(glm::radians(camera.Zoom), (float)SCR_WIDTH / (float)SCR_HEIGHT, 0.1f, 100.0f);
         glm::mat4 view = camera.GetViewMatrix();
+        cameraFrustum.Extract(projection * view);
+        {
+            PROFILE_ZONE("occlusion");
+            occlusion.Begin(projection * view);
+            tumblers.AddOccluders(occlusion);
+            occlusion.Rasterise();
+        }
+
+        // this frame's point lights; clustered, a worker bins them while the scene is drawn
+        JobHandle clusterJob;
+        if (useDeferred)
+        {
+            deferred.lights.clear();
+            for (size_t i = 0; i < fireBalls.Shown().size(); i++)
+            {
+                // the lead (the newest, last) reaches as far as its cube shadow, the others are short-range flares
+                PointLight fireLight;
+                fireLight.position = fireBalls.Shown()[i];
+                fireLight.color = glm::vec3(248.0f / 256 * 0.3f, 54.0f / 256 * 0.3f, 0.0f);
+                if (i + 1 == fireBalls.Shown().size())
+                    fireLight.shadowed = true, fireLight.radius = pointShadow.farPlane;
+                else
+                    fireLight.linear = 4.5f, fireLight.quadratic = 75.0f;
+                deferred.AddLight(fireLight);
+            }
+            for (int i = 0; i < stressLights; i++)
+            {
+                PointLight light;
+                float angle = orbits[i].w + orbits[i].z * currentFrame;
+                light.position = glm::vec3(orbits[i].x * std::cos(angle), orbits[i].y, orbits[i].x * std::sin(angle));
+                light.color = orbitColors[i];
+                light.linear = 4.5f, light.quadratic = 75.0f;
+                deferred.AddLight(light);
+            }
+            // the sparkles' flashes fade out over their short life
+            for (const auto& flash : ptm.shownFlashes)
+            {
+                PointLight light;
+                light.position = flash.position;
+                light.color = glm::vec3(249.0f / 256, 212.0f / 256, 35.0f / 256) * (1.0f - flash.age / ptm.flashTime);
+                light.linear = 4.5f, light.quadratic = 75.0f;
+                deferred.AddLight(light);
+            }
+            if (deferred.clustered)
+            {
+                clusters.Setup(glm::radians(camera.Zoom), (float)SCR_WIDTH / (float)SCR_HEIGHT, 0.1f, 100.0f);
+                clusterJob = jobs.Submit("clusters", "assign", [&] { clusters.Assign(deferred.lights, view); });
+            }
+        }
         InitShader(pureShader, projection, view, camera.Position);
         InitShader(ceilingShader, projection, view, camera.Position);
         ceilingShader.setVec3("light.ambient", 0.7f, 0.7f, 0.7f);
         InitShader(textureShader, projection, view, camera.Position);
-        textureShader.setVec3("light.specular", 0.9f, 0.9f, 0.9f);
         InitShader(lightShader, projection, view, camera.Position);
         InitShader(tumblerShader, projection, view, camera.Position);
         InitShader(groundShader, projection, view, camera.Position);
-        InitShader(ballShader, projection, view, camera.Position);
-        InitShader(particleShader, projection, view, camera.Position);
+        InitShader(particles, projection, view, camera.Position);
 
         // Update fireBall position to shaders;
         UpdateFireballToShader(pureShader, fireBall);
@@ -260,19 +875,79 @@ int main()
         UpdateFireballToShader(textureShader, fireBall);
         UpdateFireballToShader(tumblerShader, fireBall);
         UpdateFireballToShader(groundShader, fireBall);
-        UpdateFireballToShader(ballShader, fireBall);
+        for (Shader* shader : { &pureShader, &ceilingShader, &textureShader, &groundShader })
+            pointShadow.Apply(*shader);
         // Draw room and tumblers
-        room.Draw(pureShader, textureShader, lightShader, ceilingShader, groundShader, depthMap);
-        tumblers.Draw(tumblerShader);
+        // textureShader and tumblerShader are the same program, so the room's stronger specular is set around its draw
+        {
+            PROFILE_GPU_ZONE("room");
+            textureShader.use();
+            textureShader.setVec3("light.specular", 0.9f, 0.9f, 0.9f);
+            room.Draw(pureShader, textureShader, lightShader, ceilingShader, groundShader, depthMap, &cameraFrustum, !useDeferred);
+        }
+        {
+            PROFILE_GPU_ZONE("tumblers");
+            tumblerShader.use();
+            tumblerShader.setVec3("light.specular", 0.3f, 0.3f, 0.3f);
+            tumblers.Draw(tumblerShader, &cameraFrustum, &occlusion);
+        }
 
         // Draw Balls
-        ballSys.Draw(ballShader);
+        {
+            PROFILE_GPU_ZONE("balls");
+            ballSys.Draw(ballShaders, fire, [&](Shader& shader) {
+                InitShader(shader, projection, view, camera.Position);
+                UpdateFireballToShader(shader, fireBall);
+                pointShadow.Apply(shader);
+            }, &cameraFrustum, &occlusion);
+        }
+
+        // Light the G-buffer, what follows is drawn forward on top
+        if (useDeferred)
+        {
+            PROFILE_GPU_ZONE("deferred lighting");
+            RenderPassScope pass(PASS_LIGHTING);
+            if (clusterJob)
+            {
+                jobs.Wait(clusterJob);
+                pointShadow.Apply(clusteredLightShader);
+                deferred.LightClustered(clusteredLightShader, clusters, view, projection, camera.Position);
+            }
+            else
+            {
+                pointShadow.Apply(deferredLightShader);
+                deferred.Light(deferredLightShader, view, projection, camera.Position);
+            }
+            room.DrawLight(lightShader, &cameraFrustum);
+        }
 
         // Draw Fire Animations
-        fireBall.Draw(lightShader, particleShader);
+        {
+            PROFILE_GPU_ZONE("fireballs");
+            RenderPassScope pass(PASS_EFFECTS);
+            fireBalls.Draw(lightShader, particles, &cameraFrustum, streamed ? &streamBuffer : nullptr);
+        }
 
         // Draw animation particles
-        ptm.Draw(particleShader);
+        {
+            PROFILE_GPU_ZONE("particles");
+            RenderPassScope pass(PASS_EFFECTS);
+            ptm.Draw(particles, &cameraFrustum, streamed ? &streamBuffer : nullptr);
+        }
+
+        if (useDeferred)
+        {
+            PROFILE_GPU_ZONE("present");
+            deferred.Present();
+        }
+        // the stats overlay goes on top of the presented frame, showing the last complete one
+        {
+            PROFILE_GPU_ZONE("stats overlay");
+            statsOverlay.Draw(hudShader, FrameStats::Get(), SCR_WIDTH, SCR_HEIGHT, streamed ? &streamBuffer : nullptr);
+        }
+        if (streamed)
+            streamBuffer.EndFrame();
+        GpuProfiler::Get().EndFrame();
 
 
         // render Depth map to quad for visual debugging
@@ -290,14 +965,54 @@ int main()
         
         // glfw: swap buffers and poll IO events (keys pressed/released, mouse moved etc.)
         // -------------------------------------------------------------------------------
-        glfwSwapBuffers(window);
+        if (offscreenFrames && capture.Wants(frame, frame + 1 == offscreenFrames))
+        {
+            PROFILE_ZONE("capture");
+            capture.Capture(frame, offscreen);
+        }
+        auto swapStart = std::chrono::steady_clock::now();
+        if (!offscreenFrames)
+        {
+            PROFILE_ZONE("swap");
+            glfwSwapBuffers(window);
+        }
+        pipeline.Idle(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - swapStart).count());
         glfwPollEvents();
+        CountLive();
+        FrameStats::Get().EndFrame((static_cast<float>(glfwGetTime()) - frameStart) * 1000.0f);
+        frameAllocations.End();
+        frame++;
     }
+    pipeline.Finish(jobs);
+    if (saveSnapshotPath)
+        SaveSnapshot(saveSnapshotPath);
 
     // glfw: terminate, clearing all previously allocated GLFW resources.
     // ------------------------------------------------------------------
-    glfwTerminate();
-    return 0;
+    shadowCache.PrintStats();
+    cameraFrustum.PrintStats("camera pass");
+    lightFrustum.PrintStats("light pass");
+    occlusion.PrintStats();
+    pointShadow.PrintStats();
+    deferred.PrintStats();
+    fireBalls.PrintStats();
+    pipeline.PrintStats();
+    inputLog.PrintStats();
+    frameAllocations.PrintStats("render loop");
+    FrameArena::Frame().PrintStats("frame");
+    ptm.PrintStats();
+    clusters.PrintStats();
+    streamBuffer.PrintStats();
+    GpuProfiler::Get().PrintStats();
+    Log::Get().PrintStats();
+    FrameStats::Get().PrintStats();
+    capture.PrintStats();
+
+    bool allocated = offscreenFrames && !frameAllocations.Clean();
+    if (allocated)
+        printf("offscreen: %d frames allocated on the heap after the warm-up\n", frameAllocations.allocating);
+
+    return Shutdown(capture.failed || capture.missing || allocated ? 1 : 0, profilePath);
 }
 
 // renderQuad() renders a 1x1 XY quad in NDC
@@ -337,13 +1052,15 @@ void renderQuad()
 bool isKeyXPressed = false;
 bool isKeyFPressed = false;
 bool isKeyPPressed = false;
+bool isKeyKPressed = false;
+bool isKeyGPressed = false;
 void processInput(GLFWwindow* window)
 {
     if (glfwGetKey(window, GLFW_KEY_ESCAPE) == GLFW_PRESS)
         glfwSetWindowShouldClose(window, true);
 
     if (glfwGetKey(window, GLFW_KEY_X) == GLFW_PRESS) {
-        if (!isKeyXPressed)ballSys.Activate();
+        if (!isKeyXPressed)Input(InputEvent::Make(InputEvent::Activate));
         isKeyXPressed = true;
     }
     else if(glfwGetKey(window, GLFW_KEY_X) == GLFW_RELEASE)
@@ -376,54 +1093,268 @@ void processInput(GLFWwindow* window)
 
     if (glfwGetKey(window, GLFW_KEY_F) == GLFW_PRESS && !isKeyFPressed) {
         isKeyFPressed = true;
-        double xpos, ypos;
-        glfwGetCursorPos(window, &xpos, &ypos);
+        glm::vec3 rayDirection = MouseRay(window);
+        glm::vec3 from = camera.Position;
 
-        float ndcX = (2.0f * xpos) / SCR_WIDTH - 1.0f;
-        float ndcY = 1.0f - (2.0f * ypos) / SCR_HEIGHT;
+        Input(InputEvent::Make(InputEvent::Launch, from, rayDirection));
+        //fireBalls.Launch(glm::vec3(0.0f), glm::vec3(1.0f,0.0f,0.0f));
+    }
+    else if (glfwGetKey(window, GLFW_KEY_F) == GLFW_RELEASE)isKeyFPressed = false;
 
-        glm::mat4 projection = glm::perspective(glm::radians(camera.Zoom), (float)SCR_WIDTH / (float)SCR_HEIGHT, 0.1f, 100.0f);
-        glm::mat4 view = camera.GetViewMatrix();
+    if (glfwGetKey(window, GLFW_KEY_P) == GLFW_PRESS && !isKeyPPressed) {
+        isKeyPPressed = true;
+        glm::vec3 rayDirection = MouseRay(window);
+
+        //ballSys.Debug(camera.Position, rayDirection);
+        //ptm.SE_Ash(glm::vec3(0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+        //ptm.SE_Sparkle(glm::vec3(0.0f), glm::vec3(1.0f, 0.0f, 0.0f));
 
-        glm::vec4 rayClip = glm::vec4(ndcX, ndcY, -1.0, 1.0);
-        glm::vec4 rayEye = glm::inverse(projection) * rayClip;
-        rayEye = glm::vec4(rayEye.x, rayEye.y, -1.0, 0.0);
 
-        glm::vec4 rayWorld = glm::inverse(view) * rayEye;
-        glm::vec3 rayDirection = glm::normalize(glm::vec3(rayWorld));
+        Input(InputEvent::Make(InputEvent::Launch, glm::vec3(0.0f,0.0f,5.0f), glm::vec3(0.0f,0.0f,-1.0f)));
 
-        fireBall.Launch(camera.Position, rayDirection);
-        //fireBall.Launch(glm::vec3(0.0f), glm::vec3(1.0f,0.0f,0.0f));
     }
-    else if (glfwGetKey(window, GLFW_KEY_F) == GLFW_RELEASE)isKeyFPressed = false;
+    else if(glfwGetKey(window, GLFW_KEY_P) == GLFW_RELEASE)isKeyPPressed = false;
 
-    if (glfwGetKey(window, GLFW_KEY_P) == GLFW_PRESS && !isKeyPPressed) {
-        isKeyPPressed = true;
-        double xpos, ypos;
-        glfwGetCursorPos(window, &xpos, &ypos);
+    if (glfwGetKey(window, GLFW_KEY_K) == GLFW_PRESS && !isKeyKPressed) {
+        isKeyKPressed = true;
+        shadowQuality = (shadowQuality + 1) % 4;
+        const char* names[] = { "off", "single tap", "3x3 PCF", "5x5 PCF" };
+        printf("shadows: %s\n", names[shadowQuality]);
+    }
+    else if (glfwGetKey(window, GLFW_KEY_K) == GLFW_RELEASE)isKeyKPressed = false;
 
-        float ndcX = (2.0f * xpos) / SCR_WIDTH - 1.0f;
-        float ndcY = 1.0f - (2.0f * ypos) / SCR_HEIGHT;
+    if (glfwGetKey(window, GLFW_KEY_G) == GLFW_PRESS && !isKeyGPressed) {
+        isKeyGPressed = true;
+        deferredShading = !deferredShading;
+        printf("lighting: %s\n", deferredShading ? "deferred" : "forward");
+    }
+    else if (glfwGetKey(window, GLFW_KEY_G) == GLFW_RELEASE)isKeyGPressed = false;
 
-        glm::mat4 projection = glm::perspective(glm::radians(camera.Zoom), (float)SCR_WIDTH / (float)SCR_HEIGHT, 0.1f, 100.0f);
-        glm::mat4 view = camera.GetViewMatrix();
+    if (glfwGetKey(window, GLFW_KEY_L) == GLFW_PRESS && !isKeyLPressed) {
+        isKeyLPressed = true;
+        pipeline.enabled = !pipeline.enabled;
+        printf("frame pipeline: %s\n", pipeline.enabled ? "on" : "off");
+    }
+    else if (glfwGetKey(window, GLFW_KEY_L) == GLFW_RELEASE)isKeyLPressed = false;
 
-        glm::vec4 rayClip = glm::vec4(ndcX, ndcY, -1.0, 1.0);
-        glm::vec4 rayEye = glm::inverse(projection) * rayClip;
-        rayEye = glm::vec4(rayEye.x, rayEye.y, -1.0, 0.0);
+    if (glfwGetKey(window, GLFW_KEY_H) == GLFW_PRESS && !isKeyHPressed) {
+        isKeyHPressed = true;
+        statsOverlay.visible = !statsOverlay.visible;
+    }
+    else if (glfwGetKey(window, GLFW_KEY_H) == GLFW_RELEASE)isKeyHPressed = false;
+}
 
-        glm::vec4 rayWorld = glm::inverse(view) * rayEye;
-        glm::vec3 rayDirection = glm::normalize(glm::vec3(rayWorld));
+// world-space direction of the ray from the camera through the cursor
+// ---------------------------------------------------------------------
+glm::vec3 MouseRay(GLFWwindow* window)
+{
+    double xpos, ypos;
+    glfwGetCursorPos(window, &xpos, &ypos);
 
-        //ballSys.Debug(camera.Position, rayDirection);
-        //ptm.SE_Ash(glm::vec3(0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
-        //ptm.SE_Sparkle(glm::vec3(0.0f), glm::vec3(1.0f, 0.0f, 0.0f));
+    float ndcX = (2.0f * xpos) / SCR_WIDTH - 1.0f;
+    float ndcY = 1.0f - (2.0f * ypos) / SCR_HEIGHT;
+
+    glm::mat4 projection = glm::perspective(glm::radians(camera.Zoom), (float)SCR_WIDTH / (float)SCR_HEIGHT, 0.1f, 100.0f);
+    glm::mat4 view = camera.GetViewMatrix();
+
+    glm::vec4 rayClip = glm::vec4(ndcX, ndcY, -1.0, 1.0);
+    glm::vec4 rayEye = glm::inverse(projection) * rayClip;
+    rayEye = glm::vec4(rayEye.x, rayEye.y, -1.0, 0.0);
+
+    glm::vec4 rayWorld = glm::inverse(view) * rayEye;
+    return glm::normalize(glm::vec3(rayWorld));
+}
+
+// an input for the simulation: logged when recording, applied between steps
+// --------------------------------------------------------------------------
+void Input(const InputEvent& e, GLFWwindow* window)
+{
+    inputLog.Add(e);
+    pipeline.Defer([=] { ApplyInput(e, window); });
+}
+
+// what an input does to the simulation; replayed there is no window
+// ------------------------------------------------------------------
+void ApplyInput(const InputEvent& e, GLFWwindow* window)
+{
+    switch (e.type)
+    {
+    case InputEvent::Activate:
+        ballSys.Activate();
+        break;
+    case InputEvent::Launch:
+        fireBalls.Launch(e.a, e.b);
+        break;
+    case InputEvent::Capture:
+    {
+        // the nearest tumbler triangle under the cursor; hits on the upper part tilt it, the rest drag it.
+        // Picked between simulation steps, against the scene as the simulation has it
+        RayHit hit;
+        MouseControllingIdx = -1;
+        if (scene.Intersect(e.a, e.b, hit, TUMBLER_LAYER))
+            MouseControllingIdx = tumblers.Capture(hit.object, hit.localPoint.y > 0.025f);
+        LOG_INFO("touched %d", MouseControllingIdx);
+        if (MouseControllingIdx == -1 && window) {
+            glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_NORMAL);
+        }
+        break;
+    }
+    case InputEvent::Drag:
+        // the capture itself may still be deferred, processOffsets ignores the drag until it has happened
+        tumblers.processOffsets(e.a.x, e.a.y);
+        break;
+    case InputEvent::Release:
+        tumblers.ReleaseMouse();
+        break;
+    }
+}
 
+// hash of the simulated state: tumblers, balls, fireballs and particles
+// ----------------------------------------------------------------------
+uint64_t SimulationChecksum()
+{
+    StateHash hash;
+    for (const Tumbler& t : tumblers.tumblers)
+    {
+        hash.Add(t.position);
+        hash.Add(t.normAngle), hash.Add(t.axisAngle), hash.Add(t.selfAngle);
+        hash.Add(t.selfRotate_v), hash.Add(t.normRotate_v), hash.Add(t.axisRotate_v), hash.Add(t.axisRotate_a);
+    }
+    for (int i = 0; i < ballSys.N; i++)
+    {
+        const Ball& b = ballSys.balls[i];
+        hash.Add(b.position), hash.Add(b.V), hash.Add(b.living);
+    }
+    for (int slot : fireBalls.Living())
+        hash.Add(fireBalls.balls[slot].position), hash.Add(fireBalls.balls[slot].V);
+    for (const ParticleSystem* ps : ptm.ps)
+    {
+        hash.Add(ps->particles.size());
+        for (const Particle& p : ps->particles)
+            hash.Add(p.position);
+    }
+    return hash.value;
+}
 
-        fireBall.Launch(glm::vec3(0.0f,0.0f,5.0f), glm::vec3(0.0f,0.0f,-1.0f));
+// what is alive as of the last publish, for the frame stats
+// ---------------------------------------------------------
+void CountLive()
+{
+    FrameStats& stats = FrameStats::Get();
+    stats.particles = ptm.Particles() + fireBalls.Particles();
+    stats.balls = ballSys.Living();
+    stats.fireBalls = fireBalls.Count();
+}
 
+// the scripted scenarios of --scenarios, each fed the same inputs every run
+// -------------------------------------------------------------------------
+std::vector<Scenario> Scenarios(PickingScene& picking)
+{
+    const glm::vec3 launcher(0.0f, 0.0f, 0.8f);
+    auto activate = [](Randomizer&) { ApplyInput(InputEvent::Make(InputEvent::Activate)); };
+    return {
+        { "balls", "30 balls bouncing off the room, the tumblers and the props", 1, 600, activate, nullptr },
+        { "balls under fire", "the balls shot at every 6 steps, ash and sparkles where fireballs hit them", 2, 600, activate, [launcher](int i, Randomizer& random) {
+            if (i % 6)return;
+            int first = (int)random.random(0.0f, (float)ballSys.N);
+            for (int k = 0; k < ballSys.N; k++) {
+                const Ball& ball = ballSys.balls[(first + k) % ballSys.N];
+                if (!ball.living)continue;
+                ApplyInput(InputEvent::Make(InputEvent::Launch, launcher, ball.position - launcher));
+                break;
+            }
+        } },
+        { "wall impacts", "100 fireballs into the walls and the floor, sparkles at each", 3, 600, nullptr, [launcher](int i, Randomizer& random) {
+            if (i % 4 || i >= 400)return;
+            ApplyInput(InputEvent::Make(InputEvent::Launch, launcher, glm::vec3(random.random(-1.0f, 1.0f), random.random(-0.8f, 0.3f), random.random(-1.0f, -0.2f))));
+        } },
+        { "tumbler storm", "a fireball at one of the tumblers every other step, knocking them about", 4, 600, nullptr, [launcher](int i, Randomizer& random) {
+            if (i % 2)return;
+            glm::vec3 target = tumblers.tumblers[i / 2 % 5].position + glm::vec3(random.random(-0.05f, 0.05f), random.random(0.0f, 0.2f), 0.0f);
+            ApplyInput(InputEvent::Make(InputEvent::Launch, launcher, target - launcher));
+        } },
+        { "dragon picking", "500 rays a step against five Stanford dragons and the scene, the balls moving", 5, 300, [&picking, activate](Randomizer& random) {
+            activate(random);
+            if (picking.dragon)return;
+            picking.dragon.reset(new Model("models/stanford_dragon.obj"));
+            picking.shape.Build(picking.dragon->meshes);
+            float scale = 0.3f / std::max(glm::length(picking.dragon->bounds.max - picking.dragon->bounds.min), 1e-6f);
+            for (int k = 0; k < 5; k++)
+                picking.dragons.Add(&picking.shape, glm::translate(glm::mat4(1.0f), glm::vec3(-0.6f + 0.3f * k, -0.9f, -0.7f)) * glm::scale(glm::mat4(1.0f), glm::vec3(scale)));
+            picking.dragons.Build();
+        }, [&picking](int, Randomizer& random) {
+            PROFILE_ZONE("picking");
+            for (int k = 0; k < 500; k++) {
+                glm::vec3 from = camera.Position + glm::vec3(random.random(-0.2f, 0.2f), random.random(-0.2f, 0.2f), 0.0f);
+                glm::vec3 to(random.random(-1.0f, 1.0f), random.random(-1.0f, 0.0f), random.random(-1.0f, 0.0f));
+                RayHit hit;
+                picking.hits += picking.dragons.Intersect(from, to - from, hit);
+                picking.hits += scene.Intersect(from, to - from, hit);
+            }
+        } },
+    };
+}
+
+// leaving main, early or at the end: the profile if one was asked for, then GLFW. The GL objects still in
+// scope go after the context, so they are told not to delete their names
+// -------------------------------------------------------------------------------------------------------
+int Shutdown(int code, const char* profilePath)
+{
+    if (profilePath)
+        Profiler::Get().PrintStats(), Profiler::Get().Export(profilePath);
+    GLResources::Get().context = false;
+    glfwTerminate();
+    return code;
+}
+
+// the simulation's state to a file and back
+// ------------------------------------------
+bool SaveSnapshot(const char* path)
+{
+    SceneSnapshot snapshot;
+    tumblers.Save(snapshot);
+    ballSys.Save(snapshot);
+    fireBalls.Save(snapshot);
+    ptm.Save(snapshot);
+    if (!snapshot.Save(path))
+        return false;
+    printf("snapshot: saved %d blocks, %.1f KB to %s\n", snapshot.Blocks(), snapshot.Bytes() / 1024.0, path);
+    return true;
+}
+bool LoadSnapshot(const char* path)
+{
+    SceneSnapshot snapshot;
+    if (!snapshot.Load(path))
+        return false;
+    if (!tumblers.Restore(snapshot) || !ballSys.Restore(snapshot) || !fireBalls.Restore(snapshot) || !ptm.Restore(snapshot))
+    {
+        printf("snapshot: %s doesn't fit this scene\n", path);
+        return false;
     }
-    else if(glfwGetKey(window, GLFW_KEY_P) == GLFW_RELEASE)isKeyPPressed = false;
+    // the picking tree follows the restored tumblers and balls
+    UpdateScene();
+    printf("snapshot: restored %s, %d fireballs, %d particle systems\n", path, (int)fireBalls.Living().size(), (int)ptm.ps.size());
+    return true;
+}
+
+// moves the scene BVH's objects to where the simulation left them; the tree is refitted, not rebuilt
+// ---------------------------------------------------------------------------------------------------
+void UpdateScene()
+{
+    for (int i = 0; i < 5; i++)
+        scene.SetTransform(i, tumblers.tumblers[i].ModelMatrix(), true);
+    for (int i = 0; i < ballSys.N; i++)
+        scene.SetTransform(5 + i, glm::translate(glm::mat4(1.0f), ballSys.balls[i].position), ballSys.balls[i].living);
+    scene.Refit();
+}
+
+// ground.fs permutation for the current shadow setting, in the frame arena as it is asked for every frame
+// --------------------------------------------------------------------------------------------------------
+const char* GroundDefines(const char* fire)
+{
+    if (!shadowQuality)
+        return FrameArena::Frame().Format("%s;SHADOWS 0", fire);
+    return FrameArena::Frame().Format("%s;PCF_RADIUS %d", fire, shadowQuality - 1);
 }
 
 // glfw: whenever the window size changed (by OS or user resize) this callback function executes
@@ -461,8 +1392,8 @@ void mouse_callback(GLFWwindow* window, double xposIn, double yposIn)
     // tumbler controll
     //---------------------------------------------------------------------------------------------------
 
-    if (hasMousePressed && MouseControllingIdx != -1) {
-        tumblers.processOffsets(xoffset, yoffset);
+    if (hasMousePressed) {
+        Input(InputEvent::Make(InputEvent::Drag, glm::vec3(xoffset, yoffset, 0.0f)));
     }
 
 }
@@ -477,32 +1408,15 @@ void mouse_button_callback(GLFWwindow* window, int button, int action, int mods)
         // check ray
         //---------------------------------------------------------------------------------------------------
 
-        double xpos, ypos;
-        glfwGetCursorPos(window, &xpos, &ypos);
-
-        float ndcX = (2.0f * xpos) / SCR_WIDTH - 1.0f;
-        float ndcY = 1.0f - (2.0f * ypos) / SCR_HEIGHT;
-
-        glm::mat4 projection = glm::perspective(glm::radians(camera.Zoom), (float)SCR_WIDTH / (float)SCR_HEIGHT, 0.1f, 100.0f);
-        glm::mat4 view = camera.GetViewMatrix();
+        glm::vec3 rayDirection = MouseRay(window);
+        glm::vec3 origin = camera.Position;
 
-        glm::vec4 rayClip = glm::vec4(ndcX, ndcY, -1.0, 1.0);
-        glm::vec4 rayEye = glm::inverse(projection) * rayClip;
-        rayEye = glm::vec4(rayEye.x, rayEye.y, -1.0, 0.0);
-
-        glm::vec4 rayWorld = glm::inverse(view) * rayEye;
-        glm::vec3 rayDirection = glm::normalize(glm::vec3(rayWorld));
-
-        MouseControllingIdx = tumblers.checkRay(camera.Position, rayDirection);
-        printf("touched %d.\n", MouseControllingIdx);
-        if(MouseControllingIdx == -1){
-            glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_NORMAL);
-        }
+        Input(InputEvent::Make(InputEvent::Capture, origin, rayDirection), window);
     }
     if (button == GLFW_MOUSE_BUTTON_LEFT && action == GLFW_RELEASE) {
         hasMousePressed = false;
         glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_NORMAL);
-        tumblers.ReleaseMouse();
+        Input(InputEvent::Make(InputEvent::Release));
     }
 }
 
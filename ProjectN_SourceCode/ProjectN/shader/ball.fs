@@ -1,5 +1,18 @@
 #version 330 core
+// permutation switch: 1 also writes the G-buffer for the deferred light pass
+#ifndef DEFERRED
+#define DEFERRED 0
+#endif
+#if DEFERRED
+layout (location = 0) out vec4 FragColor;
+layout (location = 1) out vec4 gPosition;
+layout (location = 2) out vec4 gNormal;
+layout (location = 3) out vec4 gAlbedo;
+in vec3 WorldPos;
+in vec3 WorldNormal;
+#else
 out vec4 FragColor;
+#endif
 
 struct Light {
     vec3 position;  
@@ -21,9 +34,31 @@ uniform vec3 viewPos;
 uniform sampler2D texture_diffuse1;
 uniform Light light;
 uniform int type;
+// permutation switch: the colour type baked in, -1 (default) reads the type uniform
+#ifndef BALL_TYPE
+#define BALL_TYPE -1
+#endif
 
 uniform bool isFireballActive;
 uniform Light fireballLight;
+// permutation switch: 0 off, 1 on, -1 (default) decided at runtime by isFireballActive
+#ifndef FIREBALL_LIGHT
+#define FIREBALL_LIGHT -1
+#endif
+// fireball shadows: distance to the closest caster around the fireball, stored over fireFarPlane
+uniform samplerCube fireShadowMap;
+uniform float fireFarPlane;
+uniform bool fireShadows;
+
+float FireShadowCalculation()
+{
+    if(!fireShadows)return 0.0;
+    vec3 fragToLight = FragPos - fireballLight.position;
+    float closestDepth = texture(fireShadowMap, fragToLight).r * fireFarPlane;
+    float currentDepth = length(fragToLight);
+    float bias = 0.005;
+    return currentDepth - bias > closestDepth ? 1.0 : 0.0;
+}
 
 vec3 color_wall0 = vec3(0.05859375f, 0.734375f, 0.97265625f);
 vec3 color_wall1 = vec3(0.04296875f, 0.90625f, 0.50390625f);
@@ -33,7 +68,12 @@ vec3 color_tumbler = vec3(0.9f, 0.05f, 0.05f);
 vec3 color_default = vec3(1.0f, 1.0f, 1.0f);
 
 vec3 calcFire(){
+#if FIREBALL_LIGHT == 0
+    return vec3(0.0f, 0.0f, 0.0f);
+#else
+#if FIREBALL_LIGHT < 0
     if(!isFireballActive)return vec3(0.0f, 0.0f, 0.0f);
+#endif
     // ambient
     vec3 ambient = fireballLight.ambient * texture(texture_diffuse1, TexCoords).rgb;
   	
@@ -57,11 +97,27 @@ vec3 calcFire(){
     diffuse   *= attenuation;
     specular *= attenuation;   
         
-    vec3 result = ambient + diffuse;
+    vec3 result = ambient + (1.0 - FireShadowCalculation()) * diffuse;
     return result;
+#endif
 }
 void main()
 {
+#if BALL_TYPE == 0
+    vec3 color = color_default;
+#elif BALL_TYPE == 1
+    vec3 color = color_wall0;
+#elif BALL_TYPE == 2
+    vec3 color = color_wall1;
+#elif BALL_TYPE == 3
+    vec3 color = color_wall2;
+#elif BALL_TYPE == 4
+    vec3 color = color_wall3;
+#elif BALL_TYPE == 5
+    vec3 color = texture(texture_diffuse1, TexCoords).rgb;
+#elif BALL_TYPE == 6
+    vec3 color = color_tumbler;
+#else
     vec3 color_ground = texture(texture_diffuse1, TexCoords).rgb;
 
     vec3 color;
@@ -72,6 +128,7 @@ void main()
     if(type == 4) color = color_wall3;
     if(type == 5) color = color_ground;
     if(type == 6) color = color_tumbler;
+#endif
 
     // ambient
     vec3 ambient = light.ambient * color;
@@ -99,4 +156,9 @@ void main()
     vec3 result = ambient + diffuse + specular;
     vec3 fireResult = calcFire();
     FragColor = vec4(result + fireResult, 1.0);
+#if DEFERRED
+    gPosition = vec4(WorldPos, 1.0);
+    gNormal = vec4(normalize(WorldNormal), 1.0);
+    gAlbedo = vec4(color, 1.0);
+#endif
 } 
\ No newline at end of file
@@ -0,0 +1,83 @@
+#version 330 core
+out vec4 FragColor;
+
+uniform sampler2D gPosition;
+uniform sampler2D gNormal;
+uniform sampler2D gAlbedo;
+uniform vec2 screenSize;
+uniform vec3 viewPos;
+uniform mat4 view;
+
+// per light three texels: position and radius, colour and shadow flag, attenuation and ambient share
+uniform samplerBuffer lightData;
+// per cluster the offset and count of its light indices, which follow in the same buffer
+uniform usamplerBuffer clusterData;
+uniform vec3 clusterGrid;   // tiles across, tiles up, depth slices
+uniform float clusterNear;
+uniform float clusterFar;
+
+// fireball shadows: distance to the closest caster around the fireball, stored over fireFarPlane
+uniform samplerCube fireShadowMap;
+uniform float fireFarPlane;
+uniform bool fireShadows;
+
+float FireShadowCalculation(vec3 fragPos, vec3 lightPos)
+{
+    if(!fireShadows)return 0.0;
+    vec3 fragToLight = fragPos - lightPos;
+    float closestDepth = texture(fireShadowMap, fragToLight).r * fireFarPlane;
+    float currentDepth = length(fragToLight);
+    float bias = 0.005;
+    return currentDepth - bias > closestDepth ? 1.0 : 0.0;
+}
+
+void main()
+{
+    vec2 uv = gl_FragCoord.xy / screenSize;
+    vec4 albedo = texture(gAlbedo, uv);
+    // nothing opaque here
+    if(albedo.a == 0.0)discard;
+    vec3 fragPos = texture(gPosition, uv).xyz;
+    vec4 normal = texture(gNormal, uv);
+    vec3 norm = normal.xyz;
+    vec3 viewDir = normalize(viewPos - fragPos);
+
+    // the same clusters as LightClusters: screen tiles, depth slices spaced exponentially
+    float depth = -(view * vec4(fragPos, 1.0)).z;
+    int slice = int(log(max(depth, clusterNear) / clusterNear) / log(clusterFar / clusterNear) * clusterGrid.z);
+    ivec3 grid = ivec3(clusterGrid);
+    ivec3 cell = clamp(ivec3(ivec2(uv * clusterGrid.xy), slice), ivec3(0), grid - 1);
+    int cluster = cell.x + grid.x * (cell.y + grid.y * cell.z);
+    int first = int(texelFetch(clusterData, 2 * cluster).r);
+    int count = int(texelFetch(clusterData, 2 * cluster + 1).r);
+
+    vec3 result = vec3(0.0);
+    for(int i = 0; i < count; i++)
+    {
+        int light = int(texelFetch(clusterData, first + i).r);
+        vec4 position = texelFetch(lightData, 3 * light);
+        vec4 color = texelFetch(lightData, 3 * light + 1);
+        vec4 attenuationTerms = texelFetch(lightData, 3 * light + 2);
+        float distance = length(position.xyz - fragPos);
+        if(distance > position.w)continue;
+
+        // diffuse
+        vec3 lightDir = (position.xyz - fragPos) / max(distance, 1e-4);
+        float diff = max(dot(norm, lightDir), 0.0);
+
+        // specular, normal.w is the surface's specular strength
+        vec3 reflectDir = reflect(-lightDir, norm);
+        float spec = pow(max(dot(viewDir, reflectDir), 0.0), 32) * normal.w;
+
+        // attenuation, faded out towards the radius like the light volumes
+        float attenuation = 1.0 / (attenuationTerms.x + attenuationTerms.y * distance + attenuationTerms.z * (distance * distance));
+        float edge = distance / position.w;
+        attenuation *= clamp(1.0 - edge * edge * edge * edge, 0.0, 1.0);
+
+        float shadow = color.w > 0.5 ? FireShadowCalculation(fragPos, position.xyz) : 0.0;
+        vec3 ambient = attenuationTerms.w * albedo.rgb;
+        vec3 lit = (1.0 - shadow) * (diff + spec) * albedo.rgb;
+        result += (ambient + lit) * color.rgb * attenuation;
+    }
+    FragColor = vec4(result, 1.0);
+}
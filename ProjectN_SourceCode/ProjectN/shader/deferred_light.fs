@@ -0,0 +1,58 @@
+#version 330 core
+out vec4 FragColor;
+
+flat in vec4 Light;
+flat in vec4 Color;
+flat in vec4 Attenuation;
+
+uniform sampler2D gPosition;
+uniform sampler2D gNormal;
+uniform sampler2D gAlbedo;
+uniform vec2 screenSize;
+uniform vec3 viewPos;
+
+// fireball shadows: distance to the closest caster around the fireball, stored over fireFarPlane
+uniform samplerCube fireShadowMap;
+uniform float fireFarPlane;
+uniform bool fireShadows;
+
+float FireShadowCalculation(vec3 fragPos)
+{
+    if(!fireShadows || Color.w < 0.5)return 0.0;
+    vec3 fragToLight = fragPos - Light.xyz;
+    float closestDepth = texture(fireShadowMap, fragToLight).r * fireFarPlane;
+    float currentDepth = length(fragToLight);
+    float bias = 0.005;
+    return currentDepth - bias > closestDepth ? 1.0 : 0.0;
+}
+
+void main()
+{
+    vec2 uv = gl_FragCoord.xy / screenSize;
+    vec4 albedo = texture(gAlbedo, uv);
+    // nothing opaque here
+    if(albedo.a == 0.0)discard;
+    vec3 fragPos = texture(gPosition, uv).xyz;
+    float distance = length(Light.xyz - fragPos);
+    if(distance > Light.w)discard;
+    vec4 normal = texture(gNormal, uv);
+
+    // diffuse
+    vec3 norm = normal.xyz;
+    vec3 lightDir = (Light.xyz - fragPos) / max(distance, 1e-4);
+    float diff = max(dot(norm, lightDir), 0.0);
+
+    // specular, normal.w is the surface's specular strength
+    vec3 viewDir = normalize(viewPos - fragPos);
+    vec3 reflectDir = reflect(-lightDir, norm);
+    float spec = pow(max(dot(viewDir, reflectDir), 0.0), 32) * normal.w;
+
+    // attenuation, faded out towards the radius so the sphere's edge doesn't show
+    float attenuation = 1.0 / (Attenuation.x + Attenuation.y * distance + Attenuation.z * (distance * distance));
+    float edge = distance / Light.w;
+    attenuation *= clamp(1.0 - edge * edge * edge * edge, 0.0, 1.0);
+
+    vec3 ambient = Attenuation.w * albedo.rgb;
+    vec3 lit = (1.0 - FireShadowCalculation(fragPos)) * (diff + spec) * albedo.rgb;
+    FragColor = vec4((ambient + lit) * Color.rgb * attenuation, 1.0);
+}
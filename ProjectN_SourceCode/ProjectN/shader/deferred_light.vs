@@ -0,0 +1,21 @@
+#version 330 core
+layout (location = 0) in vec3 aPos;
+// per light
+layout (location = 3) in vec4 aLight;       // position, radius
+layout (location = 4) in vec4 aColor;       // colour, 1 if lit through the fireball's cube shadow
+layout (location = 5) in vec4 aAttenuation; // constant, linear, quadratic, ambient share
+
+flat out vec4 Light;
+flat out vec4 Color;
+flat out vec4 Attenuation;
+
+uniform mat4 view;
+uniform mat4 projection;
+
+void main()
+{
+    Light = aLight;
+    Color = aColor;
+    Attenuation = aAttenuation;
+    gl_Position = projection * view * vec4(aLight.xyz + aPos * aLight.w, 1.0);
+}
@@ -1,5 +1,18 @@
 #version 330 core
+// permutation switch: 1 also writes the G-buffer for the deferred light pass
+#ifndef DEFERRED
+#define DEFERRED 0
+#endif
+#if DEFERRED
+layout (location = 0) out vec4 FragColor;
+layout (location = 1) out vec4 gPosition;
+layout (location = 2) out vec4 gNormal;
+layout (location = 3) out vec4 gAlbedo;
+in vec3 WorldPos;
+in vec3 WorldNormal;
+#else
 out vec4 FragColor;
+#endif
 
 struct Light {
     vec3 position;  
@@ -25,10 +38,33 @@ uniform Light light;
 
 uniform bool isFireballActive;
 uniform Light fireballLight;
+// permutation switch: 0 off, 1 on, -1 (default) decided at runtime by isFireballActive
+#ifndef FIREBALL_LIGHT
+#define FIREBALL_LIGHT -1
+#endif
+// fireball shadows: distance to the closest caster around the fireball, stored over fireFarPlane
+uniform samplerCube fireShadowMap;
+uniform float fireFarPlane;
+uniform bool fireShadows;
+
+float FireShadowCalculation()
+{
+    if(!fireShadows)return 0.0;
+    vec3 fragToLight = FragPos - fireballLight.position;
+    float closestDepth = texture(fireShadowMap, fragToLight).r * fireFarPlane;
+    float currentDepth = length(fragToLight);
+    float bias = 0.005;
+    return currentDepth - bias > closestDepth ? 1.0 : 0.0;
+}
 
 
 vec3 calcFire(){
+#if FIREBALL_LIGHT == 0
+    return vec3(0.0f, 0.0f, 0.0f);
+#else
+#if FIREBALL_LIGHT < 0
     if(!isFireballActive)return vec3(0.0f, 0.0f, 0.0f);
+#endif
     // ambient
     vec3 ambient = fireballLight.ambient * texture(texture_diffuse1, TexCoords).rgb;
   	
@@ -52,11 +88,22 @@ vec3 calcFire(){
     diffuse   *= attenuation;
     specular *= attenuation;   
         
-    vec3 result = ambient + diffuse;
+    vec3 result = ambient + (1.0 - FireShadowCalculation()) * diffuse;
     return result;
+#endif
 }
+// permutation switches: shadow lookups on/off and the PCF kernel radius (0 is a single tap)
+#ifndef SHADOWS
+#define SHADOWS 1
+#endif
+#ifndef PCF_RADIUS
+#define PCF_RADIUS 1
+#endif
 float ShadowCalculation(vec4 fragPosLightSpace)
 {
+#if SHADOWS == 0
+    return 0.0;
+#else
     // perform perspective divide
     vec3 projCoords = fragPosLightSpace.xyz / fragPosLightSpace.w;
     // transform to [0,1] range
@@ -68,20 +115,21 @@ float ShadowCalculation(vec4 fragPosLightSpace)
     // check whether current frag pos is in shadow
     float shadow = 0.0;
     vec2 texelSize = 1.0 / textureSize(shadowMap, 0);
-    for(int x = -1; x <= 1; ++x)
+    for(int x = -PCF_RADIUS; x <= PCF_RADIUS; ++x)
     {
-        for(int y = -1; y <= 1; ++y)
+        for(int y = -PCF_RADIUS; y <= PCF_RADIUS; ++y)
         {
             float pcfDepth = texture(shadowMap, projCoords.xy + vec2(x, y) * texelSize).r; 
             shadow += currentDepth > pcfDepth  ? 1.0 : 0.0;        
         }    
     }
-    shadow /= 9.0;
+    shadow /= float((2 * PCF_RADIUS + 1) * (2 * PCF_RADIUS + 1));
     
     if(projCoords.z > 1.0)
         shadow = 0.0;
 
     return shadow;
+#endif
 }
 void main()
 {
@@ -115,4 +163,9 @@ void main()
     vec3 result = ambient + (1.0 - shadow) * (diffuse + specular);
     vec3 fireResult = calcFire();
     FragColor = vec4(result + fireResult, 1.0);
+#if DEFERRED
+    gPosition = vec4(WorldPos, 1.0);
+    gNormal = vec4(normalize(WorldNormal), 1.0);
+    gAlbedo = vec4(color, 1.0);
+#endif
 } 
\ No newline at end of file
@@ -1,4 +1,7 @@
 #version 330 core
+#ifndef INSTANCED
+#define INSTANCED 0
+#endif
 out vec4 FragColor;
 struct Light {
     vec3 position;  
@@ -15,6 +18,9 @@ struct Light {
 in vec3 FragPos;  
 in vec3 Normal;  
 in vec2 TexCoords;
+#if INSTANCED
+flat in vec3 InstanceColor;
+#endif
   
 uniform vec3 viewPos;
 uniform sampler2D texture_diffuse1;
@@ -25,5 +31,9 @@ uniform bool isFireballActive;
 uniform Light fireballLight;
 void main()
 {   
+#if INSTANCED
+    FragColor = vec4(InstanceColor, 1.0f);
+#else
     FragColor = vec4(particleColor.x, particleColor.y, particleColor.z, 1.0f);
+#endif
 }
\ No newline at end of file
@@ -1,7 +1,16 @@
 #version 330 core
+// permutation switch: 1 takes model and colour per instance from the stream buffer instead of uniforms
+#ifndef INSTANCED
+#define INSTANCED 0
+#endif
 layout (location = 0) in vec3 aPos;
 layout (location = 1) in vec3 aNormal;
 layout (location = 2) in vec2 aTexCoords;
+#if INSTANCED
+layout (location = 3) in mat4 aModel;
+layout (location = 7) in vec4 aColor;
+flat out vec3 InstanceColor;
+#endif
 
 out vec2 TexCoords;
 out vec3 FragPos;
@@ -16,5 +25,10 @@ void main()
     TexCoords = aTexCoords;    
     FragPos = aPos;
     Normal = aNormal;
+#if INSTANCED
+    InstanceColor = aColor.rgb;
+    gl_Position = projection * view * aModel * vec4(aPos, 1.0);
+#else
     gl_Position = projection * view * model * vec4(aPos, 1.0);
-}
\ No newline at end of file
+#endif
+}
@@ -0,0 +1,33 @@
+#version 330 core
+layout (triangles) in;
+layout (triangle_strip, max_vertices = 18) out;
+
+uniform mat4 shadowMatrices[6];
+
+out vec4 FragPos; // world position, per emitted vertex
+
+void main()
+{
+    for(int face = 0; face < 6; ++face)
+    {
+        vec4 clip[3];
+        for(int i = 0; i < 3; ++i)
+            clip[i] = shadowMatrices[face] * gl_in[i].gl_Position;
+        // skip the faces the triangle lies completely outside of
+        bvec3 left   = bvec3(clip[0].x < -clip[0].w, clip[1].x < -clip[1].w, clip[2].x < -clip[2].w);
+        bvec3 right  = bvec3(clip[0].x >  clip[0].w, clip[1].x >  clip[1].w, clip[2].x >  clip[2].w);
+        bvec3 bottom = bvec3(clip[0].y < -clip[0].w, clip[1].y < -clip[1].w, clip[2].y < -clip[2].w);
+        bvec3 top    = bvec3(clip[0].y >  clip[0].w, clip[1].y >  clip[1].w, clip[2].y >  clip[2].w);
+        bvec3 behind = bvec3(clip[0].z < -clip[0].w, clip[1].z < -clip[1].w, clip[2].z < -clip[2].w);
+        if(all(left) || all(right) || all(bottom) || all(top) || all(behind))
+            continue;
+        gl_Layer = face; // built-in variable that specifies to which face we render.
+        for(int i = 0; i < 3; ++i) // for each triangle vertex
+        {
+            FragPos = gl_in[i].gl_Position;
+            gl_Position = clip[i];
+            EmitVertex();
+        }
+        EndPrimitive();
+    }
+}
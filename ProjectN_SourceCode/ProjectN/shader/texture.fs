@@ -1,5 +1,18 @@
 #version 330 core
+// permutation switch: 1 also writes the G-buffer for the deferred light pass
+#ifndef DEFERRED
+#define DEFERRED 0
+#endif
+#if DEFERRED
+layout (location = 0) out vec4 FragColor;
+layout (location = 1) out vec4 gPosition;
+layout (location = 2) out vec4 gNormal;
+layout (location = 3) out vec4 gAlbedo;
+in vec3 WorldPos;
+in vec3 WorldNormal;
+#else
 out vec4 FragColor;
+#endif
 
 struct Light {
     vec3 position;  
@@ -23,9 +36,32 @@ uniform Light light;
 
 uniform bool isFireballActive;
 uniform Light fireballLight;
+// permutation switch: 0 off, 1 on, -1 (default) decided at runtime by isFireballActive
+#ifndef FIREBALL_LIGHT
+#define FIREBALL_LIGHT -1
+#endif
+// fireball shadows: distance to the closest caster around the fireball, stored over fireFarPlane
+uniform samplerCube fireShadowMap;
+uniform float fireFarPlane;
+uniform bool fireShadows;
+
+float FireShadowCalculation()
+{
+    if(!fireShadows)return 0.0;
+    vec3 fragToLight = FragPos - fireballLight.position;
+    float closestDepth = texture(fireShadowMap, fragToLight).r * fireFarPlane;
+    float currentDepth = length(fragToLight);
+    float bias = 0.005;
+    return currentDepth - bias > closestDepth ? 1.0 : 0.0;
+}
 
 vec3 calcFire(){
+#if FIREBALL_LIGHT == 0
+    return vec3(0.0f, 0.0f, 0.0f);
+#else
+#if FIREBALL_LIGHT < 0
     if(!isFireballActive)return vec3(0.0f, 0.0f, 0.0f);
+#endif
     // ambient
     vec3 ambient = fireballLight.ambient * texture(texture_diffuse1, TexCoords).rgb;
   	
@@ -49,8 +85,9 @@ vec3 calcFire(){
     diffuse   *= attenuation;
     specular *= attenuation;   
         
-    vec3 result = ambient + diffuse;
+    vec3 result = ambient + (1.0 - FireShadowCalculation()) * diffuse;
     return result;
+#endif
 }
 void main()
 {
@@ -80,4 +117,9 @@ void main()
     vec3 result = ambient + diffuse + specular;
     vec3 fireResult = calcFire();
     FragColor = vec4(result + fireResult, 1.0);
+#if DEFERRED
+    gPosition = vec4(WorldPos, 1.0);
+    gNormal = vec4(normalize(WorldNormal), 1.0);
+    gAlbedo = vec4(texture(texture_diffuse1, TexCoords).rgb, 1.0);
+#endif
 } 
\ No newline at end of file
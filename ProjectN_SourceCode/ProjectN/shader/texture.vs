@@ -6,6 +6,10 @@ layout (location = 2) in vec2 aTexCoords;
 out vec2 TexCoords;
 out vec3 FragPos;
 out vec3 Normal;
+#if defined(DEFERRED) && DEFERRED
+out vec3 WorldPos;
+out vec3 WorldNormal;
+#endif
 
 uniform mat4 model;
 uniform mat4 view;
@@ -16,5 +20,9 @@ void main()
     TexCoords = aTexCoords;    
     FragPos = aPos;
     Normal = aNormal;
+#if defined(DEFERRED) && DEFERRED
+    WorldPos = vec3(model * vec4(aPos, 1.0));
+    WorldNormal = mat3(model) * aNormal;
+#endif
     gl_Position = projection * view * model * vec4(aPos, 1.0);
 }
\ No newline at end of file
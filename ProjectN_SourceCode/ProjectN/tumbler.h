@@ -3,6 +3,9 @@
 
 #include "Mesh.h"
 #include "Model.h"
+#include "OcclusionCuller.h"
+#include "SceneSnapshot.h"
+#include "Log.h"
 
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
@@ -34,6 +37,9 @@ public:
 	float total_x_offset, total_y_offset;
 	bool beingCaptured = false;
 
+	// ModelMatrix() as of the last Publish; drawing only uses this, so the simulation may run meanwhile
+	glm::mat4 pose = glm::mat4(1.0f);
+
 	Tumbler(){
 	}
 	~Tumbler() {
@@ -47,7 +53,14 @@ public:
 		ClearStatus();
 		scale = glm::vec3(2.0f);
 	}
-	void Draw(Shader& shader) {
+	void Init(JobSystem& jobs, const std::string& asset, TextureStreamer* streamer = nullptr) {
+		model = new Model();
+		model->LoadAsync(jobs, "./models/tumbler.obj", asset, streamer);
+		position = glm::vec3(0.0f);
+		ClearStatus();
+		scale = glm::vec3(2.0f);
+	}
+	glm::mat4 ModelMatrix() const {
 		glm::mat4 modelMatrix = glm::mat4(1.0f);
 		modelMatrix = glm::translate(modelMatrix, position); // translate it down so it's at the center of the scene
 		glm::vec3 axis = glm::vec3(cos(normAngle), 0, -sin(normAngle));
@@ -55,9 +68,16 @@ public:
 		modelMatrix = glm::rotate(modelMatrix, selfAngle, glm::vec3(0.0f, 1.0f, 0.0f));
 
 		modelMatrix = glm::scale(modelMatrix, scale);	// it's a bit too big for our scene, so scale it down
-		shader.setMat4("model", modelMatrix);
+		return modelMatrix;
+	}
+	void Publish() { pose = ModelMatrix(); }
+	void Draw(Shader& shader) {
+		shader.setMat4("model", pose);
 		model->Draw(shader);
 	}
+	void WorldSphere(glm::vec3& center, float& radius) const {
+		model->bounds.WorldSphere(pose, center, radius);
+	}
 
 	int isRayDetect(glm::vec3 raySource, glm::vec3 rayDirection) {
 		//printf("POS(%lf,%lf,%lf)\n", position.x, position.y, position.z);
@@ -121,17 +141,13 @@ public:
 
 	void CollideCalculation(glm::vec3 pos, glm::vec3 ballV, glm::vec3 normal) {
 		pos -= position;
-		printf("\n-----------------------\nCollide\n");
-		printf("pos (%lf,%lf,%lf)\n", pos.x, pos.y, pos.z);
-		printf("ballV is (%lf,%lf,%lf)\n", ballV.x, ballV.y, ballV.z);
-		printf("normal is (%lf,%lf,%lf)\n", normal.x, normal.y, normal.z);
+		LOG_DEBUG("collide: pos (%f,%f,%f) ballV (%f,%f,%f) normal (%f,%f,%f)", pos.x, pos.y, pos.z, ballV.x, ballV.y, ballV.z, normal.x, normal.y, normal.z);
 		glm::vec3 F = 2 * glm::dot(ballV, normal) * normal;
 		glm::mat4 modelMatrix = glm::mat4(1.0f);
 		glm::vec3 axis = glm::vec3(cos(normAngle), 0, -sin(normAngle));
 		modelMatrix = glm::rotate(modelMatrix, axisAngle, axis);
 		glm::vec3 SymmAxis = glm::vec3(modelMatrix * glm::vec4(0.0f, 1.0f, 0.0f, 1.0f));
 		glm::vec3 normAxis = glm::vec3(cos(normAngle), 0, -sin(normAngle));
-		printf("SymmAxis (%lf,%lf,%lf)\n", SymmAxis.x, SymmAxis.y, SymmAxis.z);
 
 		glm::vec3 trueF = F - glm::dot(F, SymmAxis) * SymmAxis;
 	
@@ -155,16 +171,14 @@ public:
 		const float axisJ = J + mass * 0.1;
 		float origin_A = 1.0f / 2 * axisJ * axisRotate_v * axisRotate_v + 1.0f / 2 * axisRotate_KM * mass * axisAngle * axisAngle;
 		glm::vec3 TransF = glm::vec3(glm::inverse(modelMatrix) * glm::vec4(F, 1.0f));
-		printf("originF is (%lf,%lf,%lf)\n", F.x, F.y, F.z);
-		printf("TransF is (%lf,%lf,%lf)\n", TransF.x, TransF.y, TransF.z);
+		LOG_DEBUG("collide: SymmAxis (%f,%f,%f) originF (%f,%f,%f) TransF (%f,%f,%f)", SymmAxis.x, SymmAxis.y, SymmAxis.z, F.x, F.y, F.z, TransF.x, TransF.y, TransF.z);
 		float Trend_angle = glm::atan((-TransF.z) / TransF.x);
 		if (TransF.x < 0)Trend_angle += glm::pi<float>();
 		float Trend_A = axis_param * glm::length(glm::vec3(TransF.x, 0.0f, TransF.z));
 		glm::vec2 newA = glm::vec2(origin_A * glm::cos(origin_angle) + Trend_A * glm::cos(Trend_angle), origin_A * glm::sin(origin_angle) + Trend_A * glm::sin(Trend_angle));
 
-		printf("origin_angle is %lf\norigin_A is %lf\n", origin_angle / glm::pi<float>() * 180, origin_A);
-		printf("trend_angle is %lf\ntrend_A is %lf\n", Trend_angle / glm::pi<float>() * 180, Trend_A);
-		printf("newA is (%lf,%lf)\n", newA.x, newA.y);
+		LOG_DEBUG("collide: origin_angle %f origin_A %f trend_angle %f trend_A %f newA (%f,%f)",
+			origin_angle / glm::pi<float>() * 180, origin_A, Trend_angle / glm::pi<float>() * 180, Trend_A, newA.x, newA.y);
 
 		float newEnergy = min(glm::length(newA), 1.0f / 2 * axisRotate_KM * mass * glm::pi<float>() * 75 / 180 * glm::pi<float>() * 75 / 180);
 		float newV2 = (newEnergy - 1.0f / 2 * axisRotate_KM * mass * axisAngle * axisAngle) * (2.0f / axisJ);
@@ -179,8 +193,8 @@ public:
 		float newNormAngle = tmpAngle + glm::pi<float>() / 2;
 		normRotate_v += (newNormAngle - normAngle) / 1.5f;
 
-		printf("normAngle is %lf, new norm angle should be %lf\naxisRotate_v is %lf\n", normAngle/glm::pi<float>()*180, newNormAngle/glm::pi<float>()*180,axisRotate_v);
-		printf("normRotate_v = %lf\n", normRotate_v);
+		LOG_DEBUG("collide: normAngle %f, new norm angle should be %f, axisRotate_v %f, normRotate_v %f",
+			normAngle / glm::pi<float>() * 180, newNormAngle / glm::pi<float>() * 180, axisRotate_v, normRotate_v);
 	}
 
 	void ClearStatus() {
@@ -225,22 +239,53 @@ public:
 	int capturedIdx = -1;
 	bool isTiltMode = false;
 
+	SphereBatch cullBatch;
+
 	TumblerCluster() {
 	}
 	void Init() {
 		for (int i = 0; i < 5; i++)tumblers[i].Init();
+		PlaceTumblers();
+	}
+	void Init(JobSystem& jobs, TextureStreamer* streamer = nullptr) {
+		for (int i = 0; i < 5; i++)tumblers[i].Init(jobs, "tumbler.obj#" + std::to_string(i), streamer);
+		PlaceTumblers();
+	}
+	void PlaceTumblers() {
 		tumblers[0].position = glm::vec3(0.0f, groundY, 0.0f);
 		tumblers[1].position = glm::vec3(0.5f, groundY, 0.5f);
 		tumblers[2].position = glm::vec3(0.5f, groundY, -0.5f);
 		tumblers[3].position = glm::vec3(-0.5f, groundY, 0.5f);
 		tumblers[4].position = glm::vec3(-0.5f, groundY, -0.5f);
+		Publish();
 	}
-	void Draw(Shader& shader) {
+	void Publish() {
+		for (int i = 0; i < 5; i++)tumblers[i].Publish();
+	}
+	// with a frustum, the tumblers outside it are skipped, with an occlusion culler the hidden ones too
+	void Draw(Shader& shader, Frustum* frustum = nullptr, OcclusionCuller* occlusion = nullptr) {
 		shader.use();
+		if (frustum) {
+			cullBatch.Clear();
+			for (int i = 0; i < 5; i++) {
+				glm::vec3 center;
+				float radius;
+				tumblers[i].WorldSphere(center, radius);
+				cullBatch.Add(i, center, radius);
+			}
+			frustum->Cull(cullBatch);
+		}
 		for (int i = 0; i < 5; i++) {
+			if (frustum && !cullBatch.visible[i])continue;
+			if (occlusion && !occlusion->Visible(&tumblers[i], tumblers[i].model->bounds, tumblers[i].pose))continue;
 			tumblers[i].Draw(shader);
 		}
 	}
+	// the tumblers that weren't hidden last frame are the occluders
+	void AddOccluders(OcclusionCuller& occlusion) {
+		for (int i = 0; i < 5; i++)
+			if (occlusion.WasVisible(&tumblers[i]))occlusion.AddOccluder(tumblers[i].model->meshes, tumblers[i].pose);
+	}
 	void renderShadow(Shader& simpleDepthShader) {
 		for (int i = 0; i < 5; i++) {
 			tumblers[i].Draw(simpleDepthShader);
@@ -250,19 +295,21 @@ public:
 	int checkRay(glm::vec3 raySource, glm::vec3 rayDirection) {
 		for (int i = 0; i < 5; i++) {
 			int retval = tumblers[i].isRayDetect(raySource, rayDirection);
-			if (retval) {
-				capturedIdx = i;
-				isTiltMode = (retval == 1);
-				tumblers[i].ClearStatus();
-				tumblers[i].beingCaptured = true;
-
-				//tumblers[i].normRotate_v = 10.0f;
-				//tumblers[i].selfRotate_v = 10.0f;
-				return i;
-			}
+			if (retval)return Capture(i, retval == 1);
 		}
 		return -1;
 	}
+	// hands tumbler i to the mouse, tilting it or dragging it around
+	int Capture(int i, bool tilt) {
+		capturedIdx = i;
+		isTiltMode = tilt;
+		tumblers[i].ClearStatus();
+		tumblers[i].beingCaptured = true;
+
+		//tumblers[i].normRotate_v = 10.0f;
+		//tumblers[i].selfRotate_v = 10.0f;
+		return i;
+	}
 	void KineticCalculation(float deltaTime) {
 		for (int i = 0; i < 5; i++)
 			tumblers[i].KineticCalculation(deltaTime);
@@ -295,9 +342,43 @@ public:
 		}
 	}
 	void ReleaseMouse() {
+		if (capturedIdx == -1)return;
 		tumblers[capturedIdx].beingCaptured = false;
 		capturedIdx = -1;
 
 	}
+
+	// placement and motion of the tumblers, and which one the mouse holds
+	void Save(SceneSnapshot& snapshot) const {
+		snapshot.AddField("TPOS", tumblers, 5, &Tumbler::position);
+		snapshot.AddField("TNAN", tumblers, 5, &Tumbler::normAngle);
+		snapshot.AddField("TAAN", tumblers, 5, &Tumbler::axisAngle);
+		snapshot.AddField("TSAN", tumblers, 5, &Tumbler::selfAngle);
+		snapshot.AddField("TSV ", tumblers, 5, &Tumbler::selfRotate_v);
+		snapshot.AddField("TNV ", tumblers, 5, &Tumbler::normRotate_v);
+		snapshot.AddField("TAV ", tumblers, 5, &Tumbler::axisRotate_v);
+		snapshot.AddField("TAA ", tumblers, 5, &Tumbler::axisRotate_a);
+		snapshot.AddField("TOFX", tumblers, 5, &Tumbler::total_x_offset);
+		snapshot.AddField("TOFY", tumblers, 5, &Tumbler::total_y_offset);
+		snapshot.AddField("TCAP", tumblers, 5, &Tumbler::beingCaptured);
+		int* mouse = snapshot.Add<int>("TMOU", 2);
+		mouse[0] = capturedIdx, mouse[1] = isTiltMode;
+	}
+	bool Restore(const SceneSnapshot& snapshot) {
+		const int* mouse = snapshot.Get<int>("TMOU", 2);
+		if (!mouse)return false;
+		capturedIdx = mouse[0], isTiltMode = mouse[1] != 0;
+		return snapshot.GetField("TPOS", tumblers, 5, &Tumbler::position)
+			&& snapshot.GetField("TNAN", tumblers, 5, &Tumbler::normAngle)
+			&& snapshot.GetField("TAAN", tumblers, 5, &Tumbler::axisAngle)
+			&& snapshot.GetField("TSAN", tumblers, 5, &Tumbler::selfAngle)
+			&& snapshot.GetField("TSV ", tumblers, 5, &Tumbler::selfRotate_v)
+			&& snapshot.GetField("TNV ", tumblers, 5, &Tumbler::normRotate_v)
+			&& snapshot.GetField("TAV ", tumblers, 5, &Tumbler::axisRotate_v)
+			&& snapshot.GetField("TAA ", tumblers, 5, &Tumbler::axisRotate_a)
+			&& snapshot.GetField("TOFX", tumblers, 5, &Tumbler::total_x_offset)
+			&& snapshot.GetField("TOFY", tumblers, 5, &Tumbler::total_y_offset)
+			&& snapshot.GetField("TCAP", tumblers, 5, &Tumbler::beingCaptured);
+	}
 };
 #endif
\ No newline at end of file
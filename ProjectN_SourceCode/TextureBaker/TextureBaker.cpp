@@ -0,0 +1,102 @@
+// Offline texture baker: decodes source images, builds the mip chain, block compresses every level
+// and writes <image>.ntex next to the source, which the runtime loaders pick up instead of the image.
+// Each bake is decoded again and compared to the source; a bake below the PSNR threshold is not written
+// and makes the run exit with 1, so a build step can stop on it.
+//
+// usage: TextureBaker [--format auto|bc1|bc3|bc7|rgba8] [--min-psnr dB] [--no-flip] image...
+
+#define STB_IMAGE_IMPLEMENTATION
+#include "../ProjectN/stb_image.h"
+#include "../ProjectN/TextureCompressor.h"
+
+#include <chrono>
+#include <cstdlib>
+
+static bool HasAlpha(const std::vector<unsigned char>& rgba) {
+	for (size_t i = 3; i < rgba.size(); i += 4)
+		if (rgba[i] != 255)return true;
+	return false;
+}
+
+// squared error between the decoded bake and the source mip chain, over every level
+static double ChainPSNR(const NTexImage& image, const std::vector<unsigned char>& rgba, bool withAlpha, double& level0) {
+	std::vector<unsigned char> source = rgba, next;
+	double sum = 0.0, count = 0.0;
+	for (int l = 0; l < (int)image.levels.size(); l++) {
+		int w = std::max(1, image.width >> l), h = std::max(1, image.height >> l);
+		std::vector<unsigned char> decoded = DecompressLevel(image.levels[l].data(), w, h, image.format);
+		double psnr = PSNR(source, decoded, withAlpha);
+		if (!l)level0 = psnr;
+		double n = (double)w * h * (withAlpha ? 4 : 3);
+		sum += n * 255.0 * 255.0 / std::pow(10.0, psnr / 10.0);
+		count += n;
+		if (l + 1 < (int)image.levels.size())DownsampleBox(source, w, h, 4, next), source.swap(next);
+	}
+	if (sum <= 0.0)return 99.0;
+	return 10.0 * std::log10(255.0 * 255.0 / (sum / count));
+}
+
+int main(int argc, char** argv) {
+	std::string formatName = "auto";
+	double minPSNR = 30.0;
+	bool flip = true;
+	std::vector<std::string> inputs;
+	for (int i = 1; i < argc; i++) {
+		std::string arg = argv[i];
+		if (arg == "--format" && i + 1 < argc)formatName = argv[++i];
+		else if (arg == "--min-psnr" && i + 1 < argc)minPSNR = atof(argv[++i]);
+		else if (arg == "--no-flip")flip = false;
+		else inputs.push_back(arg);
+	}
+	if (inputs.empty()) {
+		printf("usage: TextureBaker [--format auto|bc1|bc3|bc7|rgba8] [--min-psnr dB] [--no-flip] image...\n");
+		return 1;
+	}
+	// the game loads images flipped (stbi_set_flip_vertically_on_load in main.cpp), bake them the same way
+	stbi_set_flip_vertically_on_load(flip);
+
+	int failed = 0;
+	for (const std::string& input : inputs) {
+		auto start = std::chrono::steady_clock::now();
+		int w, h, c;
+		unsigned char* data = stbi_load(input.c_str(), &w, &h, &c, 0);
+		if (!data) {
+			printf("%s: failed to load (%s)\n", input.c_str(), stbi_failure_reason());
+			failed++;
+			continue;
+		}
+		std::vector<unsigned char> rgba = ToRGBA8(data, w, h, c);
+		stbi_image_free(data);
+
+		bool alpha = HasAlpha(rgba);
+		NTexFormat format;
+		if (formatName == "bc1")format = NTEX_BC1;
+		else if (formatName == "bc3")format = NTEX_BC3;
+		else if (formatName == "bc7")format = NTEX_BC7;
+		else if (formatName == "rgba8")format = NTEX_RGBA8;
+		else format = alpha ? NTEX_BC3 : NTEX_BC1;
+
+		NTexImage image = BuildNTex(rgba, w, h, format);
+		double level0 = 0.0;
+		double chain = ChainPSNR(image, rgba, alpha && format != NTEX_BC1, level0);
+
+		size_t baked = 0, raw = 0;
+		for (int l = 0; l < (int)image.levels.size(); l++)
+			baked += image.levels[l].size(), raw += (size_t)std::max(1, w >> l) * std::max(1, h >> l) * c;
+		double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+		bool pass = chain >= minPSNR;
+		printf("%s: %dx%d %d ch -> %s, %d levels, %.2f MB -> %.2f MB (%.1fx), psnr %.2f dB (level 0 %.2f dB), %.0f ms%s\n",
+			input.c_str(), w, h, c, NTexFormatName(format), (int)image.levels.size(), raw / 1048576.0, baked / 1048576.0,
+			(double)raw / baked, chain, level0, ms, pass ? "" : "  BELOW THRESHOLD, not written");
+		if (!pass) {
+			failed++;
+			continue;
+		}
+		if (!WriteNTex(input + ".ntex", image)) {
+			printf("%s: could not write %s.ntex\n", input.c_str(), input.c_str());
+			failed++;
+		}
+	}
+	return failed ? 1 : 0;
+}